@@ -0,0 +1,89 @@
+/*******************************************************************************************
+ * Archivo: include/AirtimeBudget.h
+ * Descripción: Cálculo del tiempo en aire de cada uplink y presupuesto de tiempo en aire
+ *              del nodo, para no saturar el canal en sitios con muchos nodos por gateway.
+ *
+ * Tiempo en aire LoRa (Semtech AN1200.13), preámbulo de 8 símbolos, cabecera explícita y
+ * CRC, CR 4/5; optimización de data rate baja con símbolos de 16 ms o más. El data rate
+ * se traduce a SF/BW con la tabla del plan de canales LORA_REGION_PLAN.
+ *
+ * Presupuesto: cubeta de AIRTIME_BUDGET_MS que se rellena de forma continua en
+ * AIRTIME_BUDGET_WINDOW_S (ventana deslizante aproximada), guardada en memoria RTC. En
+ * EU868 no debe superar el 1 % de la ventana (ciclo de trabajo legal).
+ *******************************************************************************************/
+
+#ifndef AIRTIME_BUDGET_H
+#define AIRTIME_BUDGET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LORAWAN_JOIN_REQUEST_LENGTH  23     // PHYPayload de un Join-request
+
+class AirtimeBudget {
+public:
+    /**
+     * @brief Tiempo en aire de un frame LoRa.
+     * @param sf Spreading factor (7-12)
+     * @param bandwidthKHz Ancho de banda (125, 250 o 500)
+     * @param phyLength Bytes de PHYPayload
+     * @return Microsegundos
+     */
+    static uint32_t loraTimeOnAirUs(uint8_t sf, uint16_t bandwidthKHz, size_t phyLength);
+
+    /**
+     * @brief Tiempo en aire de un PHYPayload en un data rate del plan de canales.
+     * @return Microsegundos, o 0 si el data rate no existe en el plan
+     */
+    static uint32_t timeOnAirUs(size_t phyLength, uint8_t datarate);
+
+    /**
+     * @brief Tiempo en aire de un uplink de datos: payload + cabeceras LoRaWAN + FOpts.
+     */
+    static uint32_t uplinkTimeOnAirUs(size_t payloadLength, uint8_t datarate, size_t foptsLength = 0);
+
+    /**
+     * @brief Payload de aplicación máximo de un data rate del plan de canales, sin FOpts.
+     * @return Bytes, o 0 si el data rate no existe en el plan
+     */
+    static uint8_t maxPayloadLen(uint8_t datarate);
+
+    /**
+     * @brief Indica si el presupuesto alcanza para un uplink.
+     */
+    static bool canSend(uint32_t airtimeUs);
+
+    /**
+     * @brief Descuenta del presupuesto un uplink transmitido.
+     */
+    static void consume(uint32_t airtimeUs);
+
+    /**
+     * @brief Cuenta un uplink que no se transmitió por falta de presupuesto.
+     */
+    static void deny();
+
+    /**
+     * @brief Tiempo en aire disponible ahora, en milisegundos.
+     */
+    static uint32_t availableMs();
+
+    /**
+     * @brief Indica si el disponible está por debajo de AIRTIME_BUDGET_LOW_PCT: se
+     *        evitan los envíos opcionales (keyframes periódicos, frames adicionales).
+     */
+    static bool low();
+
+    /**
+     * @brief Uplinks rechazados por falta de presupuesto desde el arranque en frío.
+     */
+    static uint16_t denied();
+
+private:
+    /**
+     * @brief Rellena la cubeta con el tiempo transcurrido desde la última vez.
+     */
+    static void refill();
+};
+
+#endif // AIRTIME_BUDGET_H
@@ -20,6 +20,9 @@ public:
     static const unsigned long connectionTimeout = CONFIG_BLE_MAX_CONN_TIME; // Usar constante de config.h
     static BLEServer* pBLEServer; // Referencia global al servidor BLE
     static bool shouldExitOnDisconnect; // Indica si debemos salir del modo configuración al desconectar
+    static volatile bool modbusScanRequested; // Búsqueda Modbus pendiente (se ejecuta en runConfigLoop)
+    static uint8_t modbusScanFirst;     // Rango de direcciones de la búsqueda pendiente
+    static uint8_t modbusScanLast;
     
     /**
      * @brief Verifica si se mantuvo presionado el botón de configuración y activa el modo BLE.
@@ -95,6 +98,18 @@ private:
         void onWrite(BLECharacteristic *pCharacteristic) override;
         void onRead(BLECharacteristic *pCharacteristic) override;
     };
+
+    // Callback para búsqueda de esclavos Modbus e inventario
+    class ModbusScanCallback: public BLECharacteristicCallbacks {
+        void onWrite(BLECharacteristic *pCharacteristic) override;
+        void onRead(BLECharacteristic *pCharacteristic) override;
+    };
+
+    // Callback para mapas de registros Modbus
+    class ModbusMapsConfigCallback: public BLECharacteristicCallbacks {
+        void onWrite(BLECharacteristic *pCharacteristic) override;
+        void onRead(BLECharacteristic *pCharacteristic) override;
+    };
 };
 
 #endif // BLE_H 
\ No newline at end of file
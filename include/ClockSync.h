@@ -0,0 +1,87 @@
+/*******************************************************************************************
+ * Archivo: include/ClockSync.h
+ * Descripción: Corrección de la deriva del RTC interno con la hora del servidor LoRaWAN.
+ *
+ * Cada respuesta DeviceTime compara la hora local (ya corregida) al final del uplink con
+ * la del servidor: el error acumulado dividido por el tiempo desde que se empezó a medir
+ * (al menos CLOCK_DRIFT_MIN_INTERVAL_S) es la deriva que queda sin corregir, y se suma a
+ * la estimación. Con la estimación:
+ *   - En cada despertar se adelanta o atrasa el RTC lo que derivó desde la última
+ *     corrección, así todos los timestamps salen corregidos.
+ *   - El tiempo de deep sleep se ajusta (el temporizador usa el mismo reloj).
+ *   - DeviceTimeReq solo viaja en un uplink normal cuando el error previsto (tiempo
+ *     desde la sincronización por la incertidumbre de la deriva) supera
+ *     CLOCK_SYNC_THRESHOLD_S.
+ *
+ * Deriva en ppm: positiva si el RTC adelanta.
+ *******************************************************************************************/
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+class ClockSync {
+public:
+    /**
+     * @brief Aplica al RTC la deriva estimada desde la última corrección. Llamar una
+     *        vez por despertar, antes de tomar timestamps.
+     */
+    static void correct();
+
+    /**
+     * @brief Registra la hora local en que termina el uplink que se va a transmitir.
+     *        Llamar justo antes de sendReceive.
+     * @param airtimeUs Tiempo en aire del uplink
+     */
+    static void uplinkStarting(uint32_t airtimeUs);
+
+    /**
+     * @brief Fija el RTC con la hora del servidor y actualiza la estimación de deriva.
+     *        La hora del servidor corresponde al final del uplink (uplinkStarting): se
+     *        le suma lo que pasó desde entonces hasta la ventana RX que respondió.
+     * @param unixEpoch Segundos (respuesta DeviceTime)
+     * @param fraction Fracción de segundo en 1/256 s
+     */
+    static void applyServerTime(uint32_t unixEpoch, uint8_t fraction);
+
+    /**
+     * @brief Da la hora por perdida (p. ej. tras un corte de energía): se pide en el
+     *        próximo uplink y no se usa para estimar la deriva.
+     */
+    static void invalidate();
+
+    /**
+     * @brief Indica si hay que pedir la hora al servidor en este despertar.
+     */
+    static bool syncDue();
+
+    /**
+     * @brief Marca que DeviceTimeReq viaja en los próximos uplinks.
+     */
+    static void syncRequested();
+
+    /**
+     * @brief Indica si se espera una respuesta DeviceTime en los downlinks.
+     */
+    static bool awaitingAnswer();
+
+    /**
+     * @brief Microsegundos a programar en el temporizador para dormir un tiempo real.
+     * @param seconds Segundos reales de sleep
+     */
+    static uint64_t sleepMicros(uint32_t seconds);
+
+    /**
+     * @brief Deriva estimada en ppm.
+     */
+    static float driftPpm();
+
+private:
+    /**
+     * @brief Hora local con milisegundos.
+     */
+    static double localTime();
+};
+
+#endif // CLOCK_SYNC_H
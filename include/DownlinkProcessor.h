@@ -0,0 +1,126 @@
+/*******************************************************************************************
+ * Archivo: include/DownlinkProcessor.h
+ * Descripción: Comandos binarios recibidos por downlink para reconfigurar el dispositivo
+ *              a distancia. Los cambios se aplican con ConfigManager y se confirman en un
+ *              frame de control (UPLINK_FPORT_CONTROL) en el siguiente envío.
+ *
+ * Un downlink en el puerto DOWNLINK_FPORT_COMMAND es una secuencia de comandos:
+ * [código][argumentos], enteros y floats en LE.
+ *   0x01  pedir esquema          -                       (= PAYLOAD_DOWNLINK_SCHEMA_REQUEST)
+ *   0x02  pedir diagnóstico      -
+ *   0x03  forzar rejoin          -                       (nuevo join en el próximo despertar)
+ *   0x10  tiempo de sleep        u32 segundos            (DOWNLINK_SLEEP_MIN..DOWNLINK_SLEEP_MAX)
+ *   0x11  habilitar sensor       ref, 0/1
+ *   0x12  periodo de sensor      ref, ciclos             (0 o 1 = en todos los ciclos)
+ *   0x20  calibración            destino, punto, x f32, y f32
+ *
+ * ref: bit 7 = sensor Modbus, bits 0-6 = posición en la lista de configuraciones.
+ * Calibración, destino: 1 NTC100K, 2 NTC10K, 3 conductividad, 4 pH. Puntos 0-2 son los
+ * pares (temperatura, resistencia) o (voltaje, valor); el punto 3 es (calTemp, coefComp)
+ * en conductividad y (defaultTemp, -) en pH.
+ *
+ * Un código desconocido detiene el análisis: sin su longitud no se puede seguir.
+ *
+ * Frame de control, registros [tipo][longitud][datos]:
+ *   0x01  confirmación   fCnt del downlink (u16), y por comando: código, estado
+ *   0x02  diagnóstico    arranques (u16), batería mV (u16), sleep s (u32),
+ *                        cola pendiente (u16), cola descartada (u16), joins fallidos (u16),
+ *                        tiempo en aire disponible ms (u32), uplinks sin presupuesto (u16)
+ *   0x03  enlace         junto al diagnóstico: data rate, margen dB, gateways, SNR dB (i8),
+ *                        RSSI dBm (i16), entrega %, cambios de data rate, motivo (LinkAdapter)
+ *******************************************************************************************/
+
+#ifndef DOWNLINK_PROCESSOR_H
+#define DOWNLINK_PROCESSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Códigos de comando
+#define DOWNLINK_CMD_SCHEMA_REQUEST     0x01
+#define DOWNLINK_CMD_DIAGNOSTICS        0x02
+#define DOWNLINK_CMD_REJOIN             0x03
+#define DOWNLINK_CMD_SLEEP_TIME         0x10
+#define DOWNLINK_CMD_SENSOR_ENABLE      0x11
+#define DOWNLINK_CMD_SENSOR_PERIOD      0x12
+#define DOWNLINK_CMD_CALIBRATION        0x20
+
+// Estado de cada comando en la confirmación
+#define DOWNLINK_STATUS_OK              0
+#define DOWNLINK_STATUS_UNKNOWN         1   // Código desconocido (se descarta el resto)
+#define DOWNLINK_STATUS_BAD_LENGTH      2   // Faltan bytes de argumentos
+#define DOWNLINK_STATUS_BAD_ARGUMENT    3   // Sensor, destino o valor fuera de rango
+
+// Acciones que debe ejecutar quien envía (resultado de process)
+#define DOWNLINK_ACTION_SEND_SCHEMA     0x01
+#define DOWNLINK_ACTION_CONFIG_CHANGED  0x02
+
+// Registros del frame de control
+#define CONTROL_RECORD_ACK              0x01
+#define CONTROL_RECORD_DIAGNOSTICS      0x02
+#define CONTROL_DIAGNOSTICS_LENGTH      20
+#define CONTROL_RECORD_LINK             0x03
+
+#define DOWNLINK_SENSOR_MODBUS          0x80    // Bit de ref que selecciona la lista Modbus
+
+class DownlinkProcessor {
+public:
+    /**
+     * @brief Ejecuta los comandos de un downlink y guarda su confirmación.
+     * @param data Payload del downlink
+     * @param length Cantidad de bytes
+     * @param fCnt Contador del downlink (se devuelve en la confirmación)
+     * @return Acciones DOWNLINK_ACTION_* a cargo del llamador
+     */
+    static uint8_t process(const uint8_t* data, size_t length, uint32_t fCnt);
+
+    /**
+     * @brief Indica si algún comando de este despertar cambió la configuración guardada.
+     */
+    static bool configChanged();
+
+    /**
+     * @brief Indica si el servidor pidió un nuevo join; se mantiene hasta clearRejoin.
+     */
+    static bool rejoinRequested();
+
+    /**
+     * @brief Olvida el pedido de rejoin (tras un join exitoso).
+     */
+    static void clearRejoin();
+
+    /**
+     * @brief Indica si hay una confirmación o un diagnóstico pendiente de enviar.
+     */
+    static bool hasControlFrame();
+
+    /**
+     * @brief Escribe el frame de control pendiente.
+     * @return Tamaño del frame, o 0 si no hay nada pendiente o no cabe
+     */
+    static size_t buildControlFrame(uint8_t* buffer, size_t bufferSize);
+
+    /**
+     * @brief Descarta lo pendiente tras transmitir el frame de control, salvo que el
+     *        downlink de ese envío haya traído nuevos comandos.
+     */
+    static void controlFrameSent();
+
+private:
+    /**
+     * @brief Ejecuta un comando.
+     * @param args Argumentos (tras el código)
+     * @param available Bytes disponibles desde args
+     * @param used Bytes de argumentos consumidos
+     * @return DOWNLINK_STATUS_*
+     */
+    static uint8_t execute(uint8_t command, const uint8_t* args, size_t available, size_t& used,
+                           uint8_t& actions);
+
+    static uint8_t setSleepTime(uint32_t seconds);
+    static uint8_t setSensorEnabled(uint8_t ref, uint8_t enabled);
+    static uint8_t setSensorPeriod(uint8_t ref, uint8_t period);
+    static uint8_t setCalibration(uint8_t target, uint8_t point, float x, float y);
+};
+
+#endif // DOWNLINK_PROCESSOR_H
@@ -0,0 +1,89 @@
+/*******************************************************************************************
+ * Archivo: include/LinkAdapter.h
+ * Descripción: Elección local del data rate de los uplinks según la calidad del enlace,
+ *              en lugar del ADR de la red (LINK_ADAPTATION en config.h).
+ *
+ * Cada LINK_CHECK_INTERVAL uplinks viaja un LinkCheckReq en un uplink normal. La respuesta
+ * da el margen de demodulación en el gateway (dB sobre el mínimo del SF actual) y la
+ * cantidad de gateways; si no llega, el uplink (o su respuesta) se perdió. Con eso:
+ *   - Cada data rate guarda su tasa de entrega (media móvil de los LinkCheck).
+ *   - Con margen de sobra se sube un paso por cada LINK_DB_PER_STEP dB por encima de
+ *     LINK_MARGIN_DB, sin pasar a un data rate con entrega bajo LINK_TARGET_DELIVERY.
+ *   - Con margen negativo o con la entrega del data rate actual bajo el objetivo se baja.
+ * El RSSI y SNR de los downlinks se registran para el diagnóstico.
+ *******************************************************************************************/
+
+#ifndef LINK_ADAPTER_H
+#define LINK_ADAPTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Motivo del último cambio de data rate (diagnóstico)
+#define LINK_REASON_NONE            0
+#define LINK_REASON_MARGIN_UP       1   // Margen de sobra: data rate más rápido
+#define LINK_REASON_MARGIN_DOWN     2   // Margen insuficiente: data rate más robusto
+#define LINK_REASON_DELIVERY        3   // Entrega bajo el objetivo: data rate más robusto
+
+#define CONTROL_LINK_LENGTH         9   // Bytes del registro de enlace en el frame de control
+
+class LinkAdapter {
+public:
+    /**
+     * @brief Data rate a usar en los uplinks.
+     */
+    static uint8_t datarate();
+
+    /**
+     * @brief Indica si toca pedir un LinkCheck en este despertar.
+     */
+    static bool linkCheckDue();
+
+    /**
+     * @brief Marca que LinkCheckReq viaja en el próximo uplink.
+     */
+    static void linkCheckRequested();
+
+    /**
+     * @brief Indica si el próximo uplink transmitido lleva un LinkCheckReq sin resolver.
+     */
+    static bool awaitingLinkCheck();
+
+    /**
+     * @brief Registra la respuesta a un LinkCheckReq y decide el data rate.
+     * @param datarate Data rate del uplink que lo llevó
+     * @param margin Margen de demodulación en dB
+     * @param gatewayCount Gateways que recibieron el uplink
+     */
+    static void linkCheckAnswered(uint8_t datarate, uint8_t margin, uint8_t gatewayCount);
+
+    /**
+     * @brief Registra un LinkCheckReq sin respuesta y decide el data rate.
+     */
+    static void linkCheckLost(uint8_t datarate);
+
+    /**
+     * @brief Cuenta un uplink transmitido (para espaciar los LinkCheck).
+     */
+    static void uplinkSent();
+
+    /**
+     * @brief Registra la calidad de un downlink recibido.
+     */
+    static void downlinkReceived(float rssi, float snr);
+
+    /**
+     * @brief Escribe el registro de enlace: data rate, margen, gateways, SNR (dB), RSSI
+     *        (dBm, i16), entrega del data rate actual (%), cambios (con tope 255) y motivo.
+     * @return CONTROL_LINK_LENGTH, o 0 si no cabe
+     */
+    static size_t writeDiagnostics(uint8_t* buffer, size_t bufferSize);
+
+private:
+    /**
+     * @brief Cambia el data rate y registra el motivo.
+     */
+    static void select(uint8_t datarate, uint8_t reason);
+};
+
+#endif // LINK_ADAPTER_H
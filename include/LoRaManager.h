@@ -10,33 +10,30 @@
 #include <Arduino.h>
 #include <RadioLib.h>
 #include <vector>
-#include <ArduinoJson.h>
 #include "config_manager.h"
 #include "utilities.h"
 #include "sensor_types.h"
 #include <ESP32Time.h>
-#include "SensorManager.h"
+#include "PayloadCodec.h"
+#include "LoRaNode.h"
 
 // Código de error personalizado para fallo en sincronización RTC
 #define RADIOLIB_ERR_RTC_SYNC_FAILED -5000
+// Código de error personalizado: el próximo join aún no toca (espera tras fallos)
+#define RADIOLIB_ERR_JOIN_DEFERRED -5001
+// Código de error personalizado: uplink no transmitido por falta de presupuesto de tiempo en aire
+#define RADIOLIB_ERR_AIRTIME_BUDGET -5002
 
 class LoRaManager {
 public:
     /**
-     * @brief Inicializa el módulo LoRa con la configuración especificada
-     * @param radio Puntero al módulo de radio SX1262
-     * @param region Región LoRaWAN a utilizar
-     * @param subBand Sub-banda para la región (relevante para US915)
-     * @return Estado de la inicialización
-     */
-    static int16_t begin(SX1262* radio, const LoRaWANBand_t* region, uint8_t subBand);
-
-    /**
-     * @brief Activa el nodo LoRaWAN restaurando la sesión o realizando un nuevo join
+     * @brief Activa el nodo LoRaWAN restaurando la sesión o realizando un nuevo join.
+     *        Tras un join fallido el siguiente se pospone (espera exponencial con jitter)
+     *        y cada intento usa el siguiente data rate de JOIN_DATARATES.
      * @param node Referencia al nodo LoRaWAN
-     * @return Estado de la activación
+     * @return Estado de la activación (RADIOLIB_ERR_JOIN_DEFERRED si el join no toca)
      */
-    static int16_t lwActivate(LoRaWANNode& node);
+    static int16_t lwActivate(LoRaNode& node);
 
     /**
      * @brief Crea un payload optimizado con formato delimitado por | y , en lugar de JSON.
@@ -93,7 +90,7 @@ public:
      * @param rtc Referencia al RTC para obtener timestamp
      */
     static void sendDelimitedPayload(const std::vector<SensorReading>& readings, 
-                                   LoRaWANNode& node,
+                                   LoRaNode& node,
                                    const String& deviceId, 
                                    const String& stationId, 
                                    ESP32Time& rtc);
@@ -110,12 +107,70 @@ public:
      */
     static void sendDelimitedPayload(const std::vector<SensorReading>& normalReadings, 
                                    const std::vector<ModbusSensorReading>& modbusReadings,
-                                   LoRaWANNode& node,
+                                   LoRaNode& node,
                                    const String& deviceId, 
                                    const String& stationId, 
                                    ESP32Time& rtc);
 #endif
 
+    /**
+     * @brief Envía las lecturas con el formato binario compacto de PayloadCodec
+     *        por el puerto UPLINK_FPORT_BINARY. Los sensores se empaquetan por prioridad
+     *        hasta el payload máximo del data rate actual; el resto va en frames
+     *        adicionales (hasta UPLINK_MAX_FRAGMENTS). Lo que no sale en este ciclo se
+     *        guarda como keyframe en la cola persistente o, si no se puede, encabeza el
+     *        próximo ciclo.
+     *        Antes, si el esquema cambió o el servidor lo pidió, se envía el esquema
+     *        por UPLINK_FPORT_SCHEMA. Con UPLINK_HISTORY_SAMPLES > 1 las lecturas se
+     *        acumulan y salen juntas en un bloque de SeriesCodec (UPLINK_FPORT_HISTORY).
+     * @param normalReadings Vector con lecturas de sensores estándar
+     * @param modbusReadings Vector con lecturas de sensores Modbus (vacío si no hay)
+     * @param priorities Prioridad de cada sensor en el orden del esquema (menor = antes)
+     * @param node Referencia al nodo LoRaWAN
+     * @param deviceId ID del dispositivo (solo viaja en el esquema)
+     * @param stationId ID de la estación (solo viaja en el esquema)
+     * @param rtc Referencia al RTC para obtener timestamp
+     */
+    static void sendBinaryPayload(const std::vector<SensorReading>& normalReadings,
+                                  const std::vector<ModbusSensorReading>& modbusReadings,
+                                  const std::vector<uint8_t>& priorities,
+                                  LoRaNode& node,
+                                  const String& deviceId,
+                                  const String& stationId,
+                                  ESP32Time& rtc);
+
+    /**
+     * @brief Guarda las lecturas de un ciclo sin red en la cola persistente (UplinkQueue),
+     *        en el formato de uplink configurado, para enviarlas en ciclos siguientes.
+     * @param normalReadings Vector con lecturas de sensores estándar
+     * @param modbusReadings Vector con lecturas de sensores Modbus
+     * @param deviceId ID del dispositivo
+     * @param stationId ID de la estación
+     * @param rtc Referencia al RTC para obtener timestamp
+     */
+    static void queueReadings(const std::vector<SensorReading>& normalReadings,
+                              const std::vector<ModbusSensorReading>& modbusReadings,
+                              const String& deviceId,
+                              const String& stationId,
+                              ESP32Time& rtc);
+
+    /**
+     * @brief Reenvía los uplinks más antiguos de la cola persistente como uplinks
+     *        confirmados, hasta UPLINK_QUEUE_DRAIN_MAX y UPLINK_QUEUE_AIRTIME_MS de tiempo
+     *        en aire por despertar, mientras el presupuesto de tiempo en aire no esté bajo.
+     *        Un uplink que no cabe en el data rate actual pasa detrás de los demás.
+     *        Los envíos normales lo llaman antes de transmitir.
+     * @param node Referencia al nodo LoRaWAN
+     * @return Uplinks entregados
+     */
+    static uint16_t drainUplinkQueue(LoRaNode& node);
+
+    /**
+     * @brief Guarda un punto de control de la sesión activa en flash (SessionStore) si
+     *        toca. Debe llamarse antes de dormir.
+     */
+    static void persistSession(LoRaNode& node);
+
     /**
      * @brief Prepara el módulo LoRa para entrar en modo sleep
      * @param radio Puntero al módulo de radio SX1262
@@ -127,11 +182,98 @@ public:
      * @param node Referencia al nodo LoRaWAN
      * @param datarate Valor del datarate a configurar
      */
-    static void setDatarate(LoRaWANNode& node, uint8_t datarate);
+    static void setDatarate(LoRaNode& node, uint8_t datarate);
 
 private:
-    static LoRaWANNode* node;
-    static SX1262* radioModule;
+    static bool sessionActive;      // Hay una sesión activa en este despertar
+    static uint8_t currentDatarate; // Data rate fijado con setDatarate (tiempo en aire)
+
+    /**
+     * @brief Agrega comandos MAC al próximo uplink: DeviceTimeReq si el error previsto
+     *        del RTC supera CLOCK_SYNC_THRESHOLD_S (ClockSync) y LinkCheckReq si toca
+     *        evaluar el enlace (LinkAdapter).
+     */
+    static void queueMacRequests(LoRaNode& node);
+
+    /**
+     * @brief Fija el data rate de los uplinks según LinkAdapter (con LINK_ADAPTATION) o
+     *        el data rate fijo indicado.
+     */
+    static void applyUplinkDatarate(LoRaNode& node, uint8_t fixedDatarate);
+
+    /**
+     * @brief Espera hasta el próximo join tras una cantidad de fallos consecutivos:
+     *        JOIN_BACKOFF_BASE_S duplicado por fallo, con tope y jitter.
+     * @return Segundos de espera
+     */
+    static uint32_t joinBackoffSeconds(uint16_t failures);
+
+    /**
+     * @brief Envía el esquema de sensores en tantas partes como pida el payload máximo
+     *        del data rate actual.
+     * @return true si se transmitieron todas las partes
+     */
+    static bool sendSchema(LoRaNode& node, const UplinkSchema& schema, uint16_t schemaHash);
+
+    /**
+     * @brief Envía, si hay, las confirmaciones de comandos y el diagnóstico pedidos por
+     *        downlink (UPLINK_FPORT_CONTROL).
+     */
+    static void sendControlFrame(LoRaNode& node);
+
+    /**
+     * @brief Transmite un uplink esperando las ventanas de recepción y pasa el downlink
+     *        que llegue a DownlinkProcessor.
+     * @param confirmed true para pedir confirmación al servidor
+     * @return RADIOLIB_ERR_NONE si se transmitió (y, si se pidió, fue confirmado)
+     */
+    static int16_t sendAndProcessDownlink(LoRaNode& node, uint8_t* payload, size_t size, uint8_t fPort,
+                                          bool confirmed = false);
+
+#if UPLINK_HISTORY_SAMPLES > 1
+    /**
+     * @brief Agrega la muestra del ciclo (batería y valores en el orden del esquema) al
+     *        historial en memoria RTC.
+     * @return false si tiene más de UPLINK_HISTORY_MAX_SERIES series
+     */
+    static bool appendHistory(const std::vector<SensorReading>& normalReadings,
+                              const std::vector<ModbusSensorReading>& modbusReadings,
+                              float battery, uint32_t timestamp, uint16_t schemaHash);
+
+    /**
+     * @brief Quita las muestras más antiguas del historial.
+     */
+    static void dropHistorySamples(uint8_t count);
+
+    /**
+     * @brief Envía el historial comprimido (SeriesCodec) por UPLINK_FPORT_HISTORY.
+     */
+    static void flushHistory(LoRaNode& node);
+#endif
+
+    /**
+     * @brief Guarda en la cola persistente un uplink que no se pudo entregar.
+     * @return true si quedó guardado
+     */
+    static bool queueUplink(uint8_t fPort, uint32_t timestamp, const uint8_t* payload, size_t size);
+
+    /**
+     * @brief Guarda en la cola persistente las lecturas de los sensores indicados como
+     *        keyframes binarios, repartidos en frames de hasta queuedPayloadLimit() bytes.
+     * @param sensors Sensores a guardar, por posición en el esquema
+     * @return Sensores que no se pudieron guardar (no caben solos o la cola no los admitió)
+     */
+    static std::vector<size_t> queueKeyframes(const std::vector<SensorReading>& normalReadings,
+                                              const std::vector<ModbusSensorReading>& modbusReadings,
+                                              float battery, uint32_t timestamp, uint16_t schemaHash,
+                                              const std::vector<size_t>& sensors);
+
+    /**
+     * @brief Payload máximo de un uplink que se guarda en la cola: el de LINK_MIN_DATARATE
+     *        menos UPLINK_QUEUE_FOPTS_RESERVE, para que se pueda reenviar a cualquier
+     *        data rate que elija el nodo.
+     */
+    static size_t queuedPayloadLimit();
 
 };
 
@@ -0,0 +1,103 @@
+/*******************************************************************************************
+ * Archivo: include/LoRaNode.h
+ * Descripción: Operaciones del nodo LoRaWAN que usa LoRaManager, detrás de una interfaz.
+ *
+ * LoRaManager y SleepManager trabajan con LoRaNode en lugar de LoRaWANNode: en el equipo
+ * se usa RadioLibNode (LoRaWANNode + SX1262), y otra implementación puede hacer de nodo y
+ * servidor de red (joins, DeviceTime, downlinks, pérdidas) sin radio. Los métodos tienen
+ * la misma firma y los mismos códigos de error que LoRaWANNode.
+ *******************************************************************************************/
+
+#ifndef LORA_NODE_H
+#define LORA_NODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <RadioLib.h>
+
+class LoRaNode {
+public:
+    virtual ~LoRaNode() {}
+
+    /**
+     * @brief Fija las credenciales OTAA.
+     */
+    virtual void beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey, uint8_t* appKey) = 0;
+
+    /**
+     * @brief Join OTAA, o reanuda la sesión cargada con setBufferSession.
+     * @param datarate Data rate del Join-request
+     */
+    virtual int16_t activateOTAA(uint8_t datarate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED) = 0;
+
+    /**
+     * @brief Buffers de nonces y de sesión (RADIOLIB_LORAWAN_*_BUF_SIZE bytes).
+     */
+    virtual uint8_t* getBufferNonces() = 0;
+    virtual int16_t setBufferNonces(uint8_t* buffer) = 0;
+    virtual uint8_t* getBufferSession() = 0;
+    virtual int16_t setBufferSession(uint8_t* buffer) = 0;
+
+    /**
+     * @brief Uplink y espera de las ventanas de recepción.
+     * @return RADIOLIB_ERR_NONE con downlink, RADIOLIB_ERR_RX_TIMEOUT sin downlink, o error
+     */
+    virtual int16_t sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown,
+                                size_t* lenDown, bool confirmed = false,
+                                LoRaWANEvent_t* eventUp = nullptr, LoRaWANEvent_t* eventDown = nullptr) = 0;
+
+    /**
+     * @brief Agrega un comando MAC (RADIOLIB_LORAWAN_MAC_*) al próximo uplink.
+     */
+    virtual bool sendMacCommandReq(uint8_t cid) = 0;
+
+    /**
+     * @brief Respuestas a DeviceTimeReq y LinkCheckReq del último downlink.
+     */
+    virtual int16_t getMacDeviceTimeAns(uint32_t* epoch, uint8_t* fraction, bool returnUnix) = 0;
+    virtual int16_t getMacLinkCheckAns(uint8_t* margin, uint8_t* gatewayCount) = 0;
+
+    virtual uint8_t getMaxPayloadLen() = 0;
+    virtual uint32_t getFCntUp() = 0;
+    virtual int16_t setDatarate(uint8_t datarate) = 0;
+    virtual void setADR(bool enable) = 0;
+
+    /**
+     * @brief RSSI (dBm) y SNR (dB) del último paquete recibido.
+     */
+    virtual float getRSSI() = 0;
+    virtual float getSNR() = 0;
+};
+
+/**
+ * @brief LoRaNode sobre RadioLib: delega en LoRaWANNode y lee RSSI/SNR del SX1262.
+ */
+class RadioLibNode : public LoRaNode {
+public:
+    RadioLibNode(LoRaWANNode& node, SX1262& radio);
+
+    void beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey, uint8_t* appKey) override;
+    int16_t activateOTAA(uint8_t datarate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED) override;
+    uint8_t* getBufferNonces() override;
+    int16_t setBufferNonces(uint8_t* buffer) override;
+    uint8_t* getBufferSession() override;
+    int16_t setBufferSession(uint8_t* buffer) override;
+    int16_t sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown,
+                        size_t* lenDown, bool confirmed = false,
+                        LoRaWANEvent_t* eventUp = nullptr, LoRaWANEvent_t* eventDown = nullptr) override;
+    bool sendMacCommandReq(uint8_t cid) override;
+    int16_t getMacDeviceTimeAns(uint32_t* epoch, uint8_t* fraction, bool returnUnix) override;
+    int16_t getMacLinkCheckAns(uint8_t* margin, uint8_t* gatewayCount) override;
+    uint8_t getMaxPayloadLen() override;
+    uint32_t getFCntUp() override;
+    int16_t setDatarate(uint8_t datarate) override;
+    void setADR(bool enable) override;
+    float getRSSI() override;
+    float getSNR() override;
+
+private:
+    LoRaWANNode& node;
+    SX1262& radio;
+};
+
+#endif // LORA_NODE_H
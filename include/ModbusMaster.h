@@ -72,7 +72,9 @@ class ModbusMaster
     ModbusMaster();
    
     void begin(uint8_t, Stream &serial);
+    void setResponseTimeout(uint16_t);
     void idle(void (*)());
+    void frameEnd(bool (*)());
     void preTransmission(void (*)());
     void postTransmission(void (*)());
 
@@ -173,7 +175,8 @@ class ModbusMaster
     ModbusMaster response timed out exception.
     
     The entire response was not received within the timeout period, 
-    ModbusMaster::ku8MBResponseTimeout. 
+    ModbusMaster::ku16MBResponseTimeout or the one set with
+    ModbusMaster::setResponseTimeout(). 
     
     @ingroup constant
     */
@@ -188,6 +191,40 @@ class ModbusMaster
     */
     static const uint8_t ku8MBInvalidCRC                 = 0xE3;
     
+    /**
+    ModbusMaster incomplete response frame exception.
+    
+    The slave started a response but the end-of-frame callback reported a
+    silent line (see ModbusMaster::frameEnd()) before the expected number
+    of bytes arrived.
+    
+    @ingroup constant
+    */
+    static const uint8_t ku8MBIncompleteFrame            = 0xE4;
+
+    /**
+    ModbusMaster invalid request quantity exception.
+    
+    The requested quantity is outside the range allowed for the function
+    (e.g. 0 or more than ku8MaxRegisterQty registers). The request is
+    rejected locally and nothing is sent, so it must not be mistaken for
+    the slave's ku8MBIllegalDataValue exception.
+    
+    @ingroup constant
+    */
+    static const uint8_t ku8MBInvalidQuantity            = 0xE5;
+
+    /**
+    Maximum quantity of registers in a single read request.
+    
+    Limit set by the Modbus specification for functions 0x03 and 0x04
+    (250 data bytes per response). Register responses are decoded straight
+    from the ADU, so reads are not bounded by the response buffer size.
+    
+    @ingroup constant
+    */
+    static const uint8_t ku8MaxRegisterQty               = 125;
+    
     uint16_t getResponseBuffer(uint8_t);
     void     clearResponseBuffer();
     uint8_t  setTransmitBuffer(uint8_t, uint16_t);
@@ -206,7 +243,7 @@ class ModbusMaster
     uint8_t  readCoils(uint16_t, uint16_t);
     uint8_t  readDiscreteInputs(uint16_t, uint16_t);
     uint8_t  readHoldingRegisters(uint16_t, uint16_t);
-    uint8_t  readInputRegisters(uint16_t, uint8_t);
+    uint8_t  readInputRegisters(uint16_t, uint16_t);
     uint8_t  writeSingleCoil(uint16_t, uint8_t);
     uint8_t  writeSingleRegister(uint16_t, uint16_t);
     uint8_t  writeMultipleCoils(uint16_t, uint16_t);
@@ -233,6 +270,9 @@ class ModbusMaster
     uint16_t* rxBuffer; // from Wire.h -- need to clean this up Rx
     uint8_t _u8ResponseBufferIndex;
     uint8_t _u8ResponseBufferLength;
+    uint8_t _u8ModbusADU[256];                                   ///< last request/response ADU; register responses are decoded in place
+    bool _bResponseInADU;                                        ///< true when response words are read straight from _u8ModbusADU
+    uint16_t _u16ResponseTimeout;                                ///< response timeout in use [milliseconds]
     
     // Modbus function codes for bit access
     static const uint8_t ku8MBReadCoils                  = 0x01; ///< Modbus function 0x01 Read Coils
@@ -249,13 +289,18 @@ class ModbusMaster
     static const uint8_t ku8MBReadWriteMultipleRegisters = 0x17; ///< Modbus function 0x17 Read Write Multiple Registers
     
     // Modbus timeout [milliseconds]
-    static const uint16_t ku16MBResponseTimeout          = 2000; ///< Modbus timeout [milliseconds]
+    static const uint16_t ku16MBResponseTimeout          = 2000; ///< default Modbus timeout [milliseconds]
     
     // master function that conducts Modbus transactions
     uint8_t ModbusMasterTransaction(uint8_t u8MBFunction);
     
+    // response word at given index, from the ADU or the response buffer
+    uint16_t responseWord(uint8_t u8Index);
+    
     // idle callback function; gets called during idle time between TX and RX
     void (*_idle)();
+    // frameEnd callback function; reports that the line went silent after the response started
+    bool (*_frameEnd)();
     // preTransmission callback function; gets called before writing a Modbus message
     void (*_preTransmission)();
     // postTransmission callback function; gets called after a Modbus message has been sent
@@ -8,45 +8,255 @@
 
 #if defined(DEVICE_TYPE_ANALOGIC) || defined(DEVICE_TYPE_MODBUS)
 
+/**
+ * @brief Estado de salud de un esclavo Modbus, guardado en memoria RTC entre ciclos.
+ *        El tiempo de respuesta estimado fija el timeout y el circuito se abre tras
+ *        fallos repetidos para no sondear un esclavo caído en cada ciclo.
+ */
+struct ModbusSlaveHealth {
+    uint8_t bus;                  // Bus del esclavo
+    uint8_t address;              // Dirección Modbus (0 = entrada libre)
+    uint8_t failures;             // Ciclos fallidos consecutivos
+    uint8_t openCount;            // Aperturas consecutivas del circuito (backoff)
+    uint16_t srttMs;              // Tiempo de reacción suavizado, sin el tiempo de línea (0 = sin medidas)
+    uint16_t rttVarMs;            // Variación del tiempo de reacción
+    uint32_t retryCycle;          // Ciclo en que se vuelve a probar (0 = circuito cerrado)
+};
+
+/**
+ * @brief Estadísticas del bus durante un ciclo (desde beginModbus hasta endModbus).
+ */
+struct ModbusBusStats {
+    uint16_t transactions;        // Peticiones enviadas (incluye reintentos y sondeos)
+    uint16_t failures;            // Peticiones sin respuesta válida
+    uint32_t busTimeMs;           // Tiempo total esperando respuestas
+    uint32_t worstFailureMs;      // Mayor tiempo hasta dar por caído un esclavo (todos los intentos)
+};
+
+/**
+ * @brief Bloque de registros leído en una sola transacción. El planificador une los
+ *        rangos pedidos por los sensores de un mismo esclavo en el menor número de bloques.
+ */
+struct ModbusReadBlock {
+    uint8_t bus;                  // Bus del esclavo
+    uint8_t address;              // Dirección Modbus del esclavo
+    uint8_t functionCode;         // 0x03 (holding) o 0x04 (input)
+    uint16_t start;               // Registro inicial
+    uint16_t count;               // Cantidad de registros
+    uint8_t maxBlock;             // Máximo de registros por petición que admiten los dispositivos
+    uint16_t firstSource;         // Primer rango pedido que cubre (índice en la lista ordenada)
+    uint16_t sourceCount;         // Rangos pedidos unidos en este bloque
+    uint16_t offset;              // Posición de los datos en el buffer de registros
+    bool ok;                      // true si la lectura fue exitosa
+};
+
 /**
  * @brief Clase para manejar la lectura de sensores Modbus.
- *        Usa Serial2 con pines configurables para RX/TX.
- *        Utiliza la biblioteca ModbusMaster para comunicación.
+ *        Maneja uno o varios buses RS485 (DEFAULT_MODBUS_BUS_CONFIGS), cada uno con su
+ *        UART, pines y velocidad. Utiliza la biblioteca ModbusMaster para comunicación.
  */
 class ModbusSensorManager {
 public:
     /**
-     * @brief Inicializa el bus RS485/Modbus (configura Serial2 con los pines definidos)
+     * @brief Inicializa todos los buses RS485/Modbus configurados.
      *        Debe llamarse una sola vez al principio.
      */
     static void beginModbus();
 
     /**
-     * @brief Finaliza la comunicación Modbus (cierra Serial2)
+     * @brief Finaliza la comunicación Modbus (cierra las UART de todos los buses)
      *        Debe llamarse después de completar todas las lecturas Modbus
      */
     static void endModbus();
 
     /**
-     * @brief Lee un sensor Modbus de tipo ENV_SENSOR.
-     *        Regresa la lectura con valores en el siguiente orden:
-     *        [0]=Humedad(%), [1]=Temperatura(°C), [2]=Presión(kPa), [3]=Iluminación(lux)
-     * @param cfg Configuración del sensor (dirección, etc.)
-     * @return Estructura ModbusSensorReading con los valores en el orden establecido.
+     * @brief Cantidad de buses configurados.
+     */
+    static uint8_t getBusCount();
+
+    /**
+     * @brief Devuelve las estadísticas de un bus del ciclo en curso (o del último).
+     */
+    static const ModbusBusStats& getBusStats(uint8_t bus);
+
+    /**
+     * @brief Marca el inicio de un ciclo de sondeo Modbus (avanza el contador de ciclos
+     *        usado por el circuit breaker). Debe llamarse una vez por despertar.
+     */
+    static void startCycle();
+
+    /**
+     * @brief Indica si un esclavo debe sondearse en este ciclo: su circuito está cerrado
+     *        o con la prueba periódica pendiente. Un esclavo del rango buscado que no está
+     *        en el inventario empieza con el circuito abierto en lugar de excluirse.
+     * @param bus Bus del esclavo
+     * @param address Dirección Modbus del esclavo
+     */
+    static bool isSlaveAvailable(uint8_t bus, uint8_t address);
+
+    /**
+     * @brief Carga el inventario de la última búsqueda: las direcciones dentro del rango
+     *        buscado que no respondieron se sondean con el backoff del circuit breaker.
+     * @param firstAddress Primera dirección buscada
+     * @param lastAddress Última dirección buscada
+     * @param devices Esclavos que respondieron (en todos los buses)
+     */
+    static void useInventory(uint8_t firstAddress, uint8_t lastAddress,
+                             const std::vector<ModbusInventoryEntry>& devices);
+
+    /**
+     * @brief Busca esclavos en un rango de direcciones con timeouts cortos y un solo
+     *        intento. Cada dirección se identifica leyendo el primer bloque de cada mapa
+     *        de registros: el primer mapa que responde sin excepción da el tipo. El bus
+     *        debe estar alimentado e inicializado (beginModbus).
+     * @param bus Bus a recorrer
+     * @param firstAddress Primera dirección a sondear
+     * @param lastAddress Última dirección a sondear
+     * @param descriptors Mapas de registros conocidos (firmas de identificación)
+     * @return Esclavos que respondieron, con su tipo (0 si ningún mapa coincide)
+     */
+    static std::vector<ModbusInventoryEntry> scanBus(uint8_t bus, uint8_t firstAddress, uint8_t lastAddress,
+                                                     const std::vector<ModbusDeviceDescriptor>& descriptors);
+
+    /**
+     * @brief Busca el mapa de registros de un tipo de sensor.
+     * @param descriptors Mapas disponibles (ConfigManager::getModbusDeviceDescriptors)
+     * @param type Tipo de sensor Modbus
+     * @return Puntero al mapa o nullptr si el tipo no tiene mapa
+     */
+    static const ModbusDeviceDescriptor* findDescriptor(const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                                        SensorType type);
+
+    /**
+     * @brief Lee todos los sensores Modbus del ciclo: reúne los rangos de registros de
+     *        sus mapas, los une por esclavo en el menor número de transacciones y decodifica
+     *        los subvalores de cada sensor en el orden de su mapa. Los subvalores que no
+     *        pudieron leerse quedan en NAN.
+     * @param sensors Configuraciones de los sensores a leer
+     * @param descriptors Mapas de registros disponibles
+     * @param readings Vector donde se agrega una lectura por sensor, en el mismo orden
+     */
+    static void readSensors(const std::vector<ModbusSensorConfig>& sensors,
+                            const std::vector<ModbusDeviceDescriptor>& descriptors,
+                            std::vector<ModbusSensorReading>& readings);
+
+    /**
+     * @brief Lee los sensores a medida que están listos tras encender 12V: sondea el
+     *        registro de disponibilidad de cada tipo con un timeout corto y, en cuanto
+     *        devuelve un valor plausible, lee todos los sensores pendientes de ese esclavo.
+     *        Los tipos sin registro de disponibilidad (o que no se estabilizan) se leen
+     *        al cumplirse su espera máxima. Cada bus adicional se sondea en su propia
+     *        tarea, en paralelo con el bus 0.
+     * @param sensors Configuraciones de los sensores a leer
+     * @param descriptors Mapas de registros disponibles
+     * @param readings Vector donde se agrega una lectura por sensor, en el mismo orden
      */
-    static ModbusSensorReading readEnvSensor(const ModbusSensorConfig &cfg);
+    static void readSensorsWhenReady(const std::vector<ModbusSensorConfig>& sensors,
+                                     const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                     std::vector<ModbusSensorReading>& readings);
 
 private:
     /**
-     * @brief Envía un frame Modbus (Función 0x03) y recibe la respuesta utilizando ModbusMaster.
-     *        Para simplificar el ejemplo, se hace una lectura consecutiva de registros.
+     * @brief Bucle de disponibilidad y lectura para los sensores de un mismo bus.
+     */
+    static void pollWhenReady(const std::vector<ModbusSensorConfig>& sensors,
+                              const std::vector<ModbusDeviceDescriptor>& descriptors,
+                              std::vector<ModbusSensorReading>& readings);
+
+    /**
+     * @brief Tarea FreeRTOS que ejecuta pollWhenReady para un bus adicional.
+     * @param param Puntero al trabajo del bus (ModbusBusJob)
+     */
+    static void busTask(void* param);
+
+    /**
+     * @brief Lee una vez el subvalor de disponibilidad del mapa, sin reintentos y sin
+     *        afectar la salud del esclavo (un sensor arrancando puede no responder).
+     * @return true si respondió con un valor dentro del rango plausible
+     */
+    static bool probeReady(uint8_t bus, uint8_t address, const ModbusDeviceDescriptor& descriptor);
+
+    /**
+     * @brief Ejecuta una petición de lectura y la contabiliza en las estadísticas del bus.
+     */
+    static uint8_t timedRead(uint8_t bus, uint8_t functionCode, uint16_t startReg, uint16_t numRegs);
+
+    /**
+     * @brief Envía un frame Modbus de lectura (Función 0x03 o 0x04) y recibe la respuesta
+     *        utilizando ModbusMaster, con reintentos y registro de salud del esclavo.
+     * @param bus Bus del dispositivo
      * @param address Dirección Modbus del dispositivo
+     * @param functionCode 0x03 (holding) o 0x04 (input)
      * @param startReg Registro inicial
      * @param numRegs  Cantidad de registros
      * @param outData  Buffer de salida donde se almacenan los valores de cada registro
-     * @return true si la lectura fue exitosa, false en caso de error
+     * @return Código de resultado de ModbusMaster (ku8MBSuccess si la lectura fue exitosa)
+     */
+    static uint8_t readRegisters(uint8_t bus, uint8_t address, uint8_t functionCode, uint16_t startReg,
+                                 uint16_t numRegs, uint16_t* outData);
+
+    /**
+     * @brief Ordena los rangos pedidos por bus, esclavo, función y registro, y une los que se
+     *        solapan o quedan a menos de MODBUS_COALESCE_MAX_GAP registros, sin superar el
+     *        tamaño de bloque de ninguno de los dispositivos implicados.
+     * @param wanted Rangos pedidos (se ordenan en el lugar)
+     * @return Bloques a leer
+     */
+    static std::vector<ModbusReadBlock> planBlocks(std::vector<ModbusReadBlock>& wanted);
+
+    /**
+     * @brief Ejecuta los bloques planificados. Si un esclavo rechaza un bloque unido con una
+     *        excepción (p. ej. registros inexistentes en el hueco) se piden sus rangos por
+     *        separado; si no responde, se omiten el resto de sus bloques.
+     * @param blocks Bloques a leer (se agregan los bloques de reintento)
+     * @param wanted Rangos pedidos, ordenados por planBlocks
+     * @param registers Buffer donde se almacenan los registros leídos
+     */
+    static void readBlocks(std::vector<ModbusReadBlock>& blocks,
+                           const std::vector<ModbusReadBlock>& wanted,
+                           std::vector<uint16_t>& registers);
+
+    /**
+     * @brief Convierte un subvalor a partir de los registros leídos: tipo, orden de
+     *        palabras, escala y offset.
+     * @param value Descripción del subvalor
+     * @param words Registros del subvalor (1 o 2, en el orden recibido)
+     */
+    static float decodeValue(const ModbusValueDescriptor& value, const uint16_t* words);
+
+    /**
+     * @brief Devuelve la entrada de salud del esclavo, creándola si no existe.
+     */
+    static ModbusSlaveHealth& getSlaveHealth(uint8_t bus, uint8_t address);
+
+    /**
+     * @brief Tiempo que ocupan en la línea del bus un número de bytes RTU.
+     * @param bus Índice del bus (fija la velocidad)
+     * @param bytes Bytes de la trama
+     * @return Milisegundos, redondeados hacia arriba
+     */
+    static uint32_t wireTimeMs(uint8_t bus, uint16_t bytes);
+
+    /**
+     * @brief Timeout de respuesta para una lectura: reacción estimada del esclavo
+     *        (srtt + 4·rttvar, acotado entre MODBUS_MIN_RESPONSE_TIMEOUT y
+     *        MODBUS_RESPONSE_TIMEOUT) más el tiempo de línea de la respuesta esperada.
+     * @param health Estado del esclavo
+     * @param numRegs Registros pedidos
+     */
+    static uint16_t responseTimeoutFor(const ModbusSlaveHealth& health, uint16_t numRegs);
+
+    /**
+     * @brief Actualiza la estimación del tiempo de reacción y cierra el circuito.
+     * @param elapsedMs Duración total de la transacción
+     * @param responseBytes Bytes de la respuesta recibida (se descuentan con la petición)
+     */
+    static void recordSuccess(ModbusSlaveHealth& health, uint32_t elapsedMs, uint16_t responseBytes);
+
+    /**
+     * @brief Cuenta un ciclo fallido y abre el circuito al alcanzar el umbral.
      */
-    static bool readHoldingRegisters(uint8_t address, uint16_t startReg, uint16_t numRegs, uint16_t* outData);
+    static void recordFailure(ModbusSlaveHealth& health);
 };
 
 #endif // defined(DEVICE_TYPE_ANALOGIC) || defined(DEVICE_TYPE_MODBUS)
@@ -0,0 +1,207 @@
+/*******************************************************************************************
+ * Archivo: include/PayloadCodec.h
+ * Descripción: Codificación binaria compacta de las lecturas para el uplink LoRaWAN.
+ *              No depende de Arduino: el servidor puede compilar PayloadCodec.cpp tal
+ *              cual para decodificar los uplinks.
+ *
+ * Formato (versión 1), enteros en varint LEB128:
+ *   [0]   cabecera: versión (4 bits altos) | banderas (4 bits bajos: delta, más fragmentos)
+ *   [1]   secuencia del frame
+ *   [2]   keyframe: hash del esquema (2 bytes, LE) | delta: secuencia del frame de referencia
+ *   ts    timestamp Unix (delta: segundos desde la referencia, en zigzag)
+ *   vt    batería
+ *   n     sensores del esquema
+ *   map   bitmap de sensores presentes, ceil(n/8) bytes, bit 0 = sensor 0
+ *   val   valores de cada sensor presente, en el orden del esquema
+ *
+ * Cada valor se envía en punto fijo con los decimales de su tipo (decimalsFor),
+ * en zigzag + 1: el varint 0 marca un valor NAN. En un frame delta se envía la
+ * diferencia con el mismo valor del frame de referencia (0 si allí era NAN).
+ *
+ * Esquema (puerto propio, en partes): IDs de estación y dispositivo y, por sensor, ID,
+ * tipo y cantidad de valores. Se envía solo cuando cambia (su hash CRC-16 no coincide
+ * con el último enviado) o cuando el servidor lo pide por downlink.
+ *   [0]   versión (4 bits altos)
+ *   [1]   hash del esquema (2 bytes, LE)
+ *   [3]   parte (4 bits altos) | total de partes (4 bits bajos)
+ *   ...   trozo del esquema serializado (serializeSchema)
+ *******************************************************************************************/
+
+#ifndef PAYLOAD_CODEC_H
+#define PAYLOAD_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sensor_types.h"
+
+#define PAYLOAD_CODEC_VERSION     1
+#define PAYLOAD_BATTERY_DECIMALS  3     // Batería en mV
+#define PAYLOAD_MAX_DECIMALS      6
+#define PAYLOAD_MAX_FRAME_VALUES  48    // Valores que admite un frame de referencia (más: siempre keyframe)
+#define PAYLOAD_FLAG_DELTA        0x01  // Valores como diferencia con el frame de referencia
+#define PAYLOAD_FLAG_MORE         0x02  // Siguen más frames con el resto de sensores del mismo ciclo
+#define PAYLOAD_FIXED_NAN         INT32_MIN
+#define PAYLOAD_SCHEMA_PART_HEADER 4    // Bytes de cabecera de cada parte del esquema
+#define PAYLOAD_SCHEMA_MAX_PARTS  15
+#define PAYLOAD_DOWNLINK_SCHEMA_REQUEST 0x01  // Downlink (puerto DOWNLINK_FPORT_COMMAND) que pide reenviar el esquema
+
+/**
+ * @brief Sensor del esquema: el orden del esquema identifica a cada sensor en el
+ *        bitmap, por lo que los IDs no viajan en el uplink.
+ */
+struct UplinkSchemaEntry {
+    char sensorId[20];            // ID configurado del sensor
+    SensorType type;              // Tipo del sensor (fija los decimales)
+    uint8_t valueCount;           // Valores que reporta (1 para sensores de un solo valor)
+};
+
+/**
+ * @brief Disposición de los sensores habilitados de un dispositivo. El servidor la
+ *        recibe una vez y la identifica en cada keyframe por su hash.
+ */
+struct UplinkSchema {
+    char stationId[20];
+    char deviceId[20];
+    std::vector<UplinkSchemaEntry> sensors;
+};
+
+/**
+ * @brief Valores en punto fijo de un frame transmitido. El dispositivo guarda el último
+ *        enviado con éxito como referencia de los frames delta; el servidor guarda el
+ *        último decodificado.
+ */
+struct UplinkFrame {
+    bool valid;                                   // false = no hay referencia (enviar keyframe)
+    uint8_t sequence;                             // Secuencia del frame
+    uint16_t schemaHash;                          // Esquema con que se codificó
+    uint32_t timestamp;
+    int32_t battery;                              // Punto fijo (PAYLOAD_FIXED_NAN si no hay)
+    uint8_t sensorCount;
+    uint8_t valueCount;
+    int32_t values[PAYLOAD_MAX_FRAME_VALUES];     // Todos los valores en el orden del esquema
+};
+
+/**
+ * @brief Lecturas de un sensor presente en un uplink decodificado.
+ */
+struct DecodedSensor {
+    uint8_t index;                // Posición en el esquema
+    SensorType type;
+    std::vector<float> values;    // NAN para los valores marcados como no leídos
+};
+
+/**
+ * @brief Contenido de un uplink decodificado.
+ */
+struct DecodedUplink {
+    uint8_t version;
+    uint8_t flags;
+    uint8_t sequence;
+    uint32_t timestamp;
+    float battery;
+    std::vector<DecodedSensor> sensors;
+};
+
+class PayloadCodec {
+public:
+    /**
+     * @brief Construye el esquema a partir de las lecturas: sensores normales y luego
+     *        Modbus, en el orden de configuración.
+     */
+    static UplinkSchema buildSchema(const char* stationId, const char* deviceId,
+                                    const std::vector<SensorReading>& normalReadings,
+                                    const std::vector<ModbusSensorReading>& modbusReadings);
+
+    /**
+     * @brief Serializa el esquema: IDs terminados en '\0', cantidad de sensores (varint)
+     *        y, por sensor, tipo (varint), cantidad de valores (1 byte) e ID.
+     */
+    static std::vector<uint8_t> serializeSchema(const UplinkSchema& schema);
+
+    /**
+     * @brief Reconstruye un esquema serializado (partes ya concatenadas en orden).
+     * @return true si los datos forman un esquema completo
+     */
+    static bool parseSchema(const uint8_t* data, size_t length, UplinkSchema& schema);
+
+    /**
+     * @brief CRC-16 del esquema serializado; cambia con cualquier ID, tipo u orden.
+     */
+    static uint16_t schemaHash(const UplinkSchema& schema);
+
+    /**
+     * @brief Escribe una parte del esquema serializado.
+     * @param serialized Esquema serializado
+     * @param hash Hash del esquema
+     * @param part Índice de la parte (desde 0)
+     * @param chunkSize Bytes de esquema por parte
+     * @param buffer Buffer de salida (al menos PAYLOAD_SCHEMA_PART_HEADER + chunkSize)
+     * @return Tamaño de la parte, o 0 si el índice o el total de partes no son válidos
+     */
+    static size_t encodeSchemaPart(const std::vector<uint8_t>& serialized, uint16_t hash,
+                                   uint8_t part, size_t chunkSize, uint8_t* buffer);
+
+    /**
+     * @brief Lee la cabecera de una parte del esquema; los datos empiezan en
+     *        payload + PAYLOAD_SCHEMA_PART_HEADER.
+     */
+    static bool parseSchemaPart(const uint8_t* payload, size_t length,
+                                uint16_t& hash, uint8_t& part, uint8_t& partCount);
+
+    /**
+     * @brief Codifica las lecturas del ciclo. Los sensores sin ningún valor válido
+     *        quedan fuera del bitmap y no ocupan bytes. Con una referencia válida del
+     *        mismo esquema se genera un frame delta; si no, un keyframe.
+     * @param normalReadings Lecturas de sensores normales
+     * @param modbusReadings Lecturas de sensores Modbus
+     * @param battery Voltaje de batería
+     * @param timestamp Timestamp Unix
+     * @param sequence Secuencia de este frame
+     * @param schemaHash Hash del esquema de las lecturas (un cambio fuerza keyframe)
+     * @param reference Último frame recibido por el servidor (nullptr = keyframe)
+     * @param frame Frame generado, a guardar como referencia si se transmite con éxito
+     * @param buffer Buffer de salida
+     * @param bufferSize Tamaño del buffer
+     * @param selection Sensores a incluir, por posición en el esquema (nullptr = todos).
+     *        Los no seleccionados se envían como ausentes, igual que un sensor sin lectura
+     * @return Tamaño del payload, o 0 si no cabe en el buffer
+     */
+    static size_t encode(const std::vector<SensorReading>& normalReadings,
+                         const std::vector<ModbusSensorReading>& modbusReadings,
+                         float battery,
+                         uint32_t timestamp,
+                         uint8_t sequence,
+                         uint16_t schemaHash,
+                         const UplinkFrame* reference,
+                         UplinkFrame& frame,
+                         uint8_t* buffer,
+                         size_t bufferSize,
+                         const std::vector<bool>* selection = nullptr);
+
+    /**
+     * @brief Decodifica un uplink con el esquema del dispositivo que lo envió.
+     * @param payload Bytes recibidos
+     * @param length Cantidad de bytes
+     * @param schema Último esquema recibido del dispositivo
+     * @param reference Último frame decodificado del dispositivo; se reemplaza por
+     *        este si la decodificación tiene éxito
+     * @param out Contenido decodificado
+     * @return true si el payload es válido; se rechaza un keyframe de otro esquema (hay
+     *         que pedirlo por downlink) y un frame delta cuya referencia no es la
+     *         guardada (hay que esperar al siguiente keyframe)
+     */
+    static bool decode(const uint8_t* payload, size_t length,
+                       const UplinkSchema& schema,
+                       UplinkFrame& reference,
+                       DecodedUplink& out);
+
+    /**
+     * @brief Decimales con que se transmite un valor según el tipo de sensor.
+     * @param type Tipo de sensor
+     * @param valueIndex Posición del valor dentro del sensor
+     */
+    static uint8_t decimalsFor(SensorType type, uint8_t valueIndex);
+};
+
+#endif // PAYLOAD_CODEC_H
@@ -36,10 +36,15 @@ class SensorManager {
     // Devuelve la lectura (o lecturas) de un sensor NO-Modbus según su configuración.
     static SensorReading getSensorReading(const SensorConfig& cfg);
     
-    // Devuelve la lectura de un sensor Modbus según su configuración
-    static ModbusSensorReading getModbusSensorReading(const ModbusSensorConfig& cfg);
+    // Devuelve la lectura de un sensor Modbus según su configuración y el mapa de registros de su tipo
+    static ModbusSensorReading getModbusSensorReading(const ModbusSensorConfig& cfg,
+                                                      const std::vector<ModbusDeviceDescriptor>& descriptors);
     
-    // Obtiene todas las lecturas de sensores (normales y Modbus) habilitados
+    // Busca esclavos Modbus en un rango de direcciones (enciende 12V) y guarda el inventario en NVS
+    static std::vector<ModbusInventoryEntry> discoverModbusDevices(uint8_t firstAddress, uint8_t lastAddress);
+
+    // Obtiene todas las lecturas de sensores (normales y Modbus) habilitados. Los sensores
+    // con periodo que no toca medir en este ciclo se reportan como no leídos (NAN)
     static void getAllSensorReadings(std::vector<SensorReading>& normalReadings,
                                     std::vector<ModbusSensorReading>& modbusReadings,
                                     const std::vector<SensorConfig>& enabledNormalSensors,
@@ -48,6 +53,19 @@ class SensorManager {
   private:
     // Métodos de lectura internos
     static float readSensorValue(const SensorConfig &cfg, SensorReading &reading);
+
+    // Lee los sensores Modbus indicados (enciende 12V solo si hay algún esclavo disponible)
+    static void readModbusSensors(const std::vector<ModbusSensorConfig>& sensors,
+                                  const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                  std::vector<ModbusSensorReading>& modbusReadings);
+
+    // Indica si un sensor con el periodo dado (en ciclos) se mide en el ciclo actual
+    static bool isDue(uint8_t period);
+
+    // Lecturas sin medir, con la misma forma que una medida (el esquema del uplink no cambia)
+    static SensorReading skippedReading(const SensorConfig& cfg);
+    static ModbusSensorReading skippedModbusReading(const ModbusSensorConfig& cfg,
+                                                    const std::vector<ModbusDeviceDescriptor>& descriptors);
 };
 
 #endif // SENSOR_MANAGER_H
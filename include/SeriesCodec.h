@@ -0,0 +1,86 @@
+/*******************************************************************************************
+ * Archivo: include/SeriesCodec.h
+ * Descripción: Compresión de varias muestras por sensor en un solo uplink (historial).
+ *              Como PayloadCodec, no depende de Arduino: el servidor puede compilar
+ *              SeriesCodec.cpp tal cual para decodificar los bloques.
+ *
+ * Bloque (versión 1):
+ *   [0]   versión (4 bits altos)
+ *   [1]   hash del esquema (2 bytes, LE) con que se tomaron las muestras
+ *   [3]   cantidad de muestras
+ *   [4]   cantidad de series: batería y luego cada valor de cada sensor, en el orden
+ *         del esquema
+ *   ...   flujo de bits, del bit más significativo al menos significativo
+ *
+ * Timestamps: el primero en 32 bits; los siguientes como diferencia de la diferencia
+ * anterior (la primera diferencia parte de 0), en complemento a dos:
+ *   '0' = 0   '10' + 7 bits   '110' + 9 bits   '1110' + 12 bits   '1111' + 32 bits
+ * Con un ciclo de sleep fijo casi todas las muestras ocupan un bit.
+ *
+ * Valores, serie por serie (floats IEEE 754 de 32 bits, estilo Gorilla): el primero
+ * completo; los siguientes como XOR con el anterior:
+ *   '0'  = mismo valor
+ *   '10' + bits significativos, dentro de la ventana de ceros iniciales/finales anterior
+ *   '11' + ceros iniciales (5 bits) + bits significativos - 1 (5 bits) + bits significativos
+ * Los valores se redondean antes a los decimales de su tipo (quantize): lecturas iguales
+ * en punto fijo dan el mismo float, y los cambios lentos solo tocan la mantisa baja.
+ *******************************************************************************************/
+
+#ifndef SERIES_CODEC_H
+#define SERIES_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "sensor_types.h"
+
+#define SERIES_CODEC_VERSION    1
+#define SERIES_HEADER_LENGTH    5       // Bytes antes del flujo de bits
+
+/**
+ * @brief Contenido de un bloque decodificado.
+ */
+struct DecodedSeries {
+    uint16_t schemaHash;
+    std::vector<uint32_t> timestamps;
+    std::vector<std::vector<float>> series;     // series[serie][muestra]; la serie 0 es la batería
+};
+
+class SeriesCodec {
+public:
+    /**
+     * @brief Redondea un valor a los decimales indicados (NAN si no es un número).
+     */
+    static float quantize(float value, uint8_t decimals);
+
+    /**
+     * @brief Muestra de un ciclo: batería y valores de los sensores en el orden del
+     *        esquema, redondeados a los decimales de PayloadCodec::decimalsFor.
+     * @param values Salida, al menos maxValues floats
+     * @return Cantidad de series, o 0 si son más de maxValues
+     */
+    static size_t sampleOf(const std::vector<SensorReading>& normalReadings,
+                           const std::vector<ModbusSensorReading>& modbusReadings,
+                           float battery, float* values, size_t maxValues);
+
+    /**
+     * @brief Codifica un bloque de muestras.
+     * @param schemaHash Hash del esquema de las muestras
+     * @param timestamps Timestamp Unix de cada muestra
+     * @param values Muestras seguidas: values[muestra * seriesCount + serie]
+     * @param sampleCount Cantidad de muestras (al menos 1)
+     * @param seriesCount Series por muestra (al menos 1)
+     * @return Tamaño del bloque, o 0 si no cabe en el buffer
+     */
+    static size_t encode(uint16_t schemaHash, const uint32_t* timestamps, const float* values,
+                         uint8_t sampleCount, uint8_t seriesCount, uint8_t* buffer, size_t bufferSize);
+
+    /**
+     * @brief Decodifica un bloque. La serie 0 es la batería; la serie 1 en adelante
+     *        corresponde a los valores del esquema cuyo hash viene en el bloque.
+     * @return true si el bloque es válido
+     */
+    static bool decode(const uint8_t* payload, size_t length, DecodedSeries& out);
+};
+
+#endif // SERIES_CODEC_H
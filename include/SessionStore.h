@@ -0,0 +1,76 @@
+/*******************************************************************************************
+ * Archivo: include/SessionStore.h
+ * Descripción: Copia en flash (NVS) de la sesión LoRaWAN, para restaurarla tras un corte
+ *              de energía o un reset sin repetir el join ni la sincronización del RTC.
+ *
+ * La sesión en memoria RTC sigue siendo la principal; la de flash es un punto de control:
+ *   - Se graba al iniciar una sesión nueva y luego cada SESSION_FCNT_CHECKPOINT uplinks
+ *     (el resto de los cambios de la sesión viajan con el punto de control siguiente).
+ *   - Se rota entre SESSION_STORE_SLOTS claves con secuencia creciente: al restaurar se
+ *     usa la más reciente íntegra, así que una escritura interrumpida no pierde la sesión.
+ *     El nivelado de desgaste por página lo hace NVS.
+ *   - Al restaurar, el contador de uplinks se adelanta SESSION_FCNT_SKIP: los uplinks
+ *     enviados después del punto de control no se repiten con un contador ya usado.
+ *******************************************************************************************/
+
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <RadioLib.h>
+
+/**
+ * @brief Punto de control de la sesión guardado en cada clave.
+ */
+struct SessionSlot {
+    uint32_t sequence;                                      // Orden de escritura (creciente)
+    uint32_t fCntUp;                                        // Contador de uplinks al grabar
+    uint8_t session[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];     // Buffer de sesión de RadioLib
+    uint16_t crc;                                           // CRC-16/MODBUS de lo anterior
+};
+
+class SessionStore {
+public:
+    /**
+     * @brief Graba la sesión si es nueva o si el contador de uplinks avanzó
+     *        SESSION_FCNT_CHECKPOINT desde el último punto de control.
+     * @param session Buffer de sesión (node.getBufferSession())
+     * @param fCntUp Contador de uplinks actual
+     */
+    static void save(const uint8_t* session, uint32_t fCntUp);
+
+    /**
+     * @brief Obliga a grabar la sesión en el próximo save (p. ej. tras un join).
+     */
+    static void markNewSession();
+
+    /**
+     * @brief Recupera el último punto de control con el contador de uplinks adelantado.
+     * @param session Buffer donde se copia la sesión
+     * @param fCntUp Contador de uplinks con que queda la sesión
+     * @return false si no hay sesión guardada o no se pudo adelantar el contador
+     */
+    static bool restore(uint8_t* session, uint32_t& fCntUp);
+
+    /**
+     * @brief Borra todas las sesiones guardadas.
+     */
+    static void clear();
+
+private:
+    /**
+     * @brief Lee todas las claves para ubicar el último punto de control.
+     * @param latest Último punto de control íntegro (si lo hay)
+     * @return true si se encontró alguno
+     */
+    static bool scan(SessionSlot& latest);
+
+    /**
+     * @brief Adelanta el contador de uplinks dentro del buffer de sesión y vuelve a firmarlo.
+     *        Comprueba antes que el contador y la firma están donde se esperan.
+     */
+    static bool advanceFCntUp(uint8_t* session, uint32_t savedFCntUp, uint32_t skip);
+};
+
+#endif // SESSION_STORE_H
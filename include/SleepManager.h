@@ -13,6 +13,7 @@
 #include "PowerManager.h"
 #include "config.h"
 #include <RadioLib.h>
+#include "LoRaNode.h"
 #include <SPI.h>
 #include <Wire.h>
 
@@ -30,7 +31,7 @@ public:
     static void goToDeepSleep(uint32_t timeToSleep, 
                              PowerManager& powerManager,
                              SX1262* radio,
-                             LoRaWANNode& node,
+                             LoRaNode& node,
                              uint8_t* LWsession,
                              SPIClass& spi);
     
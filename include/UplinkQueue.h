@@ -0,0 +1,126 @@
+/*******************************************************************************************
+ * Archivo: include/UplinkQueue.h
+ * Descripción: Cola persistente en flash de los uplinks que no se pudieron entregar
+ *              (store-and-forward). Se vacía de a poco en los siguientes despertares.
+ *
+ * Log circular sobre la partición UPLINK_QUEUE_PARTITION, solo de escritura al final:
+ *   - Cada registro (cabecera + payload) se graba con una sola programación de página:
+ *     nunca cruza un límite de UPLINK_QUEUE_PAGE_SIZE; si no cabe, salta a la siguiente.
+ *   - Al entrar en un sector se borra. Si aún tenía registros pendientes (cola llena),
+ *     se descartan los más antiguos. El borrado recorre la partición entera antes de
+ *     repetir un sector, así que el desgaste se reparte por igual.
+ *   - Entregar un registro solo baja bits de su byte de estado (sin borrar).
+ *   - Un registro a medio escribir (corte de energía) no pasa la verificación CRC y se
+ *     ignora.
+ *
+ * Las posiciones de lectura y escritura se guardan en memoria RTC; tras un arranque en
+ * frío se reconstruyen recorriendo las cabeceras de la partición.
+ *******************************************************************************************/
+
+#ifndef UPLINK_QUEUE_H
+#define UPLINK_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UPLINK_QUEUE_PAGE_SIZE      256     // Página de programación de la flash SPI
+#define UPLINK_QUEUE_SECTOR_SIZE    4096    // Sector de borrado de la flash SPI
+#define UPLINK_QUEUE_MAX_PAYLOAD    (UPLINK_QUEUE_PAGE_SIZE - sizeof(UplinkQueueHeader))
+
+// Estado de un registro: solo se pasa de un valor a otro bajando bits
+#define UPLINK_QUEUE_STATE_ERASED    0xFF   // Flash borrada: no hay registro
+#define UPLINK_QUEUE_STATE_PENDING   0x7F   // Pendiente de entrega
+#define UPLINK_QUEUE_STATE_DELIVERED 0x00   // Entregado
+
+/**
+ * @brief Cabecera de un registro en flash. El CRC cubre desde fPort hasta el final del
+ *        payload; el estado queda fuera para poder marcarlo como entregado.
+ */
+struct UplinkQueueHeader {
+    uint8_t state;          // UPLINK_QUEUE_STATE_*
+    uint8_t reserved0;
+    uint16_t crc;           // CRC-16/MODBUS
+    uint8_t fPort;          // Puerto con que se debe enviar
+    uint8_t reserved1;
+    uint16_t length;        // Bytes de payload
+    uint32_t sequence;      // Orden de escritura (creciente)
+    uint32_t timestamp;     // Momento de la medición (Unix)
+};
+
+/**
+ * @brief Uplink leído de la cola.
+ */
+struct QueuedUplink {
+    uint8_t fPort;
+    uint32_t timestamp;
+    uint16_t length;
+    uint8_t payload[UPLINK_QUEUE_PAGE_SIZE];
+};
+
+class UplinkQueue {
+public:
+    /**
+     * @brief Localiza la partición y recupera las posiciones de la cola. Las demás
+     *        funciones la llaman si hace falta.
+     * @return false si no existe la partición (la cola queda deshabilitada)
+     */
+    static bool begin();
+
+    /**
+     * @brief Guarda un uplink no entregado al final de la cola.
+     * @param fPort Puerto LoRaWAN del payload
+     * @param timestamp Momento de la medición
+     * @param payload Bytes a enviar
+     * @param length Cantidad de bytes (hasta UPLINK_QUEUE_MAX_PAYLOAD)
+     * @return true si quedó grabado
+     */
+    static bool push(uint8_t fPort, uint32_t timestamp, const uint8_t* payload, size_t length);
+
+    /**
+     * @brief Lee el uplink pendiente más antiguo sin quitarlo.
+     * @return false si la cola está vacía
+     */
+    static bool peek(QueuedUplink& uplink);
+
+    /**
+     * @brief Marca como entregado el uplink más antiguo y avanza al siguiente.
+     */
+    static void pop();
+
+    /**
+     * @brief Uplinks pendientes de entrega.
+     */
+    static uint16_t size();
+
+    /**
+     * @brief Uplinks descartados por falta de espacio desde el último arranque en frío.
+     */
+    static uint32_t dropped();
+
+private:
+    /**
+     * @brief Recorre la partición completa para reconstruir las posiciones.
+     */
+    static void recover();
+
+    /**
+     * @brief Lee y valida el registro en una posición.
+     * @return true si hay un registro íntegro
+     */
+    static bool readRecord(uint32_t offset, UplinkQueueHeader& header, uint8_t* payload);
+
+    /**
+     * @brief Avanza una posición hasta el siguiente registro pendiente, saltando el
+     *        relleno de fin de página y los registros inválidos. Se detiene en la
+     *        posición de escritura.
+     */
+    static uint32_t seekPending(uint32_t offset);
+
+    /**
+     * @brief Borra el sector donde empieza la escritura, descartando los pendientes que
+     *        queden en él.
+     */
+    static void eraseSectorAt(uint32_t offset);
+};
+
+#endif // UPLINK_QUEUE_H
@@ -11,6 +11,9 @@
 #define I2C_SDA_PIN         48
 #define I2C_SCL_PIN         47
 
+// DS18B20 (bus 1-Wire)
+#define DS18B20_MAX_SENSORS 8   // Número máximo de sondas DS18B20 en el bus
+
 // Pines analógicos para sensores
 #define NTC100K_0_PIN       3  // IO3
 #define NTC100K_1_PIN       5  // IO5 
@@ -31,6 +34,38 @@
 #define LORA_DIO1_PIN           14
 #define MAX_LORA_PAYLOAD        200
 
+// Formato del uplink: binario compacto (PayloadCodec) o texto delimitado. Comentar para volver al texto
+#define UPLINK_BINARY_FORMAT
+#define UPLINK_FPORT_TEXT       1       // Puerto del payload de texto delimitado
+#define UPLINK_FPORT_BINARY     2       // Puerto del payload binario (el servidor elige el decodificador por puerto)
+#define UPLINK_FPORT_SCHEMA     3       // Puerto del esquema de sensores del payload binario
+#define UPLINK_FPORT_CONTROL    4       // Puerto de confirmaciones de comandos y diagnóstico (DownlinkProcessor)
+#define UPLINK_FPORT_HISTORY    5       // Puerto de los bloques de historial (SeriesCodec)
+#define UPLINK_DATARATE         3       // Data rate fijo de los uplinks (el tamaño de cada frame se ajusta a él)
+#define UPLINK_MAX_FRAGMENTS    3       // Frames por ciclo como máximo; lo que no entra pasa al ciclo siguiente
+#define UPLINK_KEYFRAME_INTERVAL 12     // Cada N uplinks binarios uno es completo; el resto, delta del anterior (1 = sin delta)
+#define UPLINK_HISTORY_SAMPLES  1       // Con N > 1 las lecturas se acumulan en memoria RTC y viajan juntas cada N ciclos (SeriesCodec)
+#define UPLINK_HISTORY_MAX_SERIES 16    // Batería + valores de sensores que admite el historial (más: un uplink por ciclo)
+
+// Cola persistente de uplinks no entregados (partición propia en partitions.csv)
+#define UPLINK_QUEUE_PARTITION          "uplinkq"
+#define UPLINK_QUEUE_PARTITION_SUBTYPE  0x40
+#define UPLINK_QUEUE_DRAIN_MAX          3       // Uplinks de la cola reenviados por despertar como máximo
+#define UPLINK_QUEUE_AIRTIME_MS         2000    // Tiempo en aire máximo por despertar para vaciar la cola
+#define UPLINK_QUEUE_FOPTS_RESERVE      2       // Bytes de FOpts reservados en los uplinks de la cola (DeviceTimeReq y LinkCheckReq)
+#define LORAWAN_FRAME_OVERHEAD          13      // MHDR + FHDR sin FOpts + FPort + MIC
+
+// Presupuesto de tiempo en aire del nodo (AirtimeBudget)
+#define AIRTIME_BUDGET_MS               15000   // Tiempo en aire por ventana (EU868: como máximo el 1 %)
+#define AIRTIME_BUDGET_WINDOW_S         3600    // Ventana del presupuesto
+#define AIRTIME_BUDGET_LOW_PCT          25      // Por debajo de este % se omiten los envíos opcionales
+
+// Comandos por downlink (DownlinkProcessor)
+#define DOWNLINK_FPORT_COMMAND          10      // Puerto de los comandos; los downlinks en otros puertos se ignoran
+#define DOWNLINK_MAX_COMMANDS           8       // Comandos por downlink que se confirman como máximo
+#define DOWNLINK_SLEEP_MIN              10      // Tiempo de sleep mínimo aceptado por downlink (segundos)
+#define DOWNLINK_SLEEP_MAX              86400   // Tiempo de sleep máximo aceptado por downlink (segundos)
+
 // SPI Clock
 #define SPI_LORA_CLOCK       1000000
 #define SPI_RTD_CLOCK        1000000
@@ -52,6 +87,14 @@
 // Deep Sleep
 #define DEFAULT_TIME_TO_SLEEP   30
 
+// Deriva del RTC (ClockSync)
+#define CLOCK_SYNC_THRESHOLD_S      2       // Error previsto con que se pide la hora al servidor (DeviceTimeReq)
+#define CLOCK_DRIFT_INITIAL_PPM     2000    // Incertidumbre de la deriva sin estimación (oscilador RC interno)
+#define CLOCK_DRIFT_MIN_PPM         20      // Incertidumbre mínima con estimación
+#define CLOCK_DRIFT_MAX_PPM         50000   // Tope de la deriva estimada (descarta medidas absurdas)
+#define CLOCK_DRIFT_MIN_INTERVAL_S  7200    // Intervalo mínimo para estimar deriva (20 ppm = 144 ms, muy por encima del error de una medida)
+#define CLOCK_CORRECTION_MIN_S      0.05    // Corrección mínima a aplicar al RTC (lo menor se acumula)
+
 // Identificadores
 #define DEFAULT_DEVICE_ID   "DEV01"
 #define DEFAULT_STATION_ID  "ST001"
@@ -63,9 +106,44 @@
 #define DEFAULT_NWK_KEY     "82,91,e9,55,19,ab,c0,6c,86,25,63,68,e7,f4,5a,89"
 
 // LoRa Region y SubBand
+// Planes de canales para el cálculo de tiempo en aire (AirtimeBudget)
+#define LORA_PLAN_EU868     0       // EU868, AS923, IN865, KR920: DR0-DR5 = SF12-SF7/125 kHz
+#define LORA_PLAN_US915     1
+#define LORA_PLAN_AU915     2
+
 #define LORA_REGION         US915
+#define LORA_REGION_PLAN    LORA_PLAN_US915     // Debe corresponder a LORA_REGION
 #define LORA_SUBBAND        2       // For US915, use 2; for other regions, use 0
 
+// Reintentos de join: espera exponencial con jitter tras cada join fallido
+#define JOIN_BACKOFF_BASE_S     60      // Espera tras el primer fallo (segundos)
+#define JOIN_BACKOFF_MAX_S      21600   // Espera máxima entre intentos (6 h)
+#define JOIN_BACKOFF_JITTER_PCT 25      // Variación aleatoria de la espera (±%), para no sincronizar nodos
+#define JOIN_DATARATES          { 3, 2, 1, 0 }  // Data rate de cada intento, en ciclo (del más corto al de más alcance)
+
+// Data rate elegido por el nodo según el enlace (LinkAdapter), con el ADR de la red
+// deshabilitado. Comentar para usar UPLINK_DATARATE fijo y el ADR de la red
+#define LINK_ADAPTATION
+#if LORA_REGION_PLAN == LORA_PLAN_US915
+#define LINK_MIN_DATARATE       1       // DR0 (11 bytes) no admite el esquema ni el texto
+#define LINK_MAX_DATARATE       3       // DR4 es de 500 kHz (un solo canal por sub-banda)
+#else
+#define LINK_MIN_DATARATE       1
+#define LINK_MAX_DATARATE       5
+#endif
+#define LINK_CHECK_INTERVAL     8       // Uplinks entre LinkCheckReq
+#define LINK_MARGIN_DB          10      // Margen de demodulación que se reserva
+#define LINK_DB_PER_STEP_X10    25      // dB (x10) entre data rates consecutivos
+#define LINK_TARGET_DELIVERY    0.9f    // Tasa de entrega mínima de un data rate
+#define LINK_DELIVERY_ALPHA     0.25f   // Peso de cada LinkCheck en la tasa de entrega
+#define LINK_DELIVERY_RECOVERY  0.05f   // Recuperación de los data rates más rápidos por LinkCheck respondido
+
+// Copia de la sesión LoRaWAN en flash (SessionStore), para sobrevivir a cortes de energía
+#define SESSION_STORE_NAMESPACE "lwsession"
+#define SESSION_STORE_SLOTS     4       // Claves en rotación (máximo 10)
+#define SESSION_FCNT_CHECKPOINT 32      // Uplinks entre puntos de control de la sesión
+#define SESSION_FCNT_SKIP       64      // Salto del contador al restaurar (> punto de control + uplinks por despertar)
+
 #define BLE_SERVICE_UUID             "180A"
 #define BLE_CHAR_SYSTEM_UUID         "2A37"
 #define BLE_CHAR_SENSORS_UUID        "2A40"
@@ -74,6 +152,8 @@
 #define BLE_CHAR_NTC10K_UUID         "2A39"
 #define BLE_CHAR_CONDUCTIVITY_UUID   "2A3C"
 #define BLE_CHAR_PH_UUID             "2A3B"
+#define BLE_CHAR_MODBUS_MAPS_UUID    "2A42"
+#define BLE_CHAR_MODBUS_SCAN_UUID    "2A43"
 #define BLE_DEVICE_PREFIX            "AGRICOS-"
 
 // Calibración batería
@@ -87,6 +167,8 @@ const double conversionFactor = (R1 + R2) / R1;
 #define NAMESPACE_LORAWAN       "lorawan"
 #define NAMESPACE_LORA_SESSION  "lorasession"
 #define NAMESPACE_SENSORS_MODBUS "sensors_modbus"
+#define NAMESPACE_MODBUS_MAPS   "modbus_maps"
+#define NAMESPACE_MODBUS_INVENTORY "modbus_inv"
 
 // Claves
 #define KEY_INITIALIZED         "initialized"
@@ -99,6 +181,9 @@ const double conversionFactor = (R1 + R2) / R1;
 #define KEY_SENSOR_ID_TEMPERATURE_SENSOR "ts"
 #define KEY_SENSOR_TYPE         "t"
 #define KEY_SENSOR_ENABLE       "e"
+#define KEY_SENSOR_PRECISION    "p"
+#define KEY_SENSOR_PRIORITY     "r"
+#define KEY_SENSOR_PERIOD       "n"
 #define KEY_LORA_JOIN_EUI       "joinEUI"
 #define KEY_LORA_DEV_EUI        "devEUI"
 #define KEY_LORA_NWK_KEY        "nwkKey"
@@ -110,20 +195,73 @@ const double conversionFactor = (R1 + R2) / R1;
 #define KEY_MODBUS_SENSOR_TYPE  "t"
 #define KEY_MODBUS_SENSOR_ADDR  "a"
 #define KEY_MODBUS_SENSOR_ENABLE "e"
+#define KEY_MODBUS_SENSOR_BUS   "b"
+#define KEY_MODBUS_SENSOR_PRIORITY "r"
+#define KEY_MODBUS_SENSOR_PERIOD "n"
+
+// Claves para el inventario de esclavos Modbus
+#define KEY_MB_INV_FIRST        "s"
+#define KEY_MB_INV_LAST         "e"
+#define KEY_MB_INV_DEVICES      "d"
+#define KEY_MB_INV_ADDR         "a"
+#define KEY_MB_INV_TYPE         "t"
+#define KEY_MB_INV_BUS          "b"
+#define KEY_MB_INV_BUSY         "p"  // "b" ya lo usa KEY_MB_INV_BUS
+
+// Claves para mapas de registros Modbus
+#define KEY_MB_MAP_TYPE         "t"
+#define KEY_MB_MAP_FUNCTION     "f"
+#define KEY_MB_MAP_MAX_BLOCK    "m"
+#define KEY_MB_MAP_MAX_WAIT     "w"
+#define KEY_MB_MAP_READY_VALUE  "q"
+#define KEY_MB_MAP_READY_MIN    "n"
+#define KEY_MB_MAP_READY_MAX    "x"
+#define KEY_MB_MAP_RANGES       "r"
+#define KEY_MB_MAP_VALUES       "v"
+#define KEY_MB_VALUE_REG        "r"
+#define KEY_MB_VALUE_TYPE       "d"
+#define KEY_MB_VALUE_ORDER      "o"
+#define KEY_MB_VALUE_SCALE      "s"
+#define KEY_MB_VALUE_OFFSET     "b"
 
 // Configuración Modbus
 #define MODBUS_RX_PIN           21
 #define MODBUS_TX_PIN           26
 #define MODBUS_BAUD_RATE        9600
 #define MODBUS_SERIAL_CONFIG    SERIAL_8N1
-#define MODBUS_RESPONSE_TIMEOUT 300  // Tiempo de espera para respuesta en ms
+#define MODBUS_RESPONSE_TIMEOUT 300  // Tiempo de reacción del esclavo en ms (inicial y máximo); el timeout le suma el tiempo de línea
+#define MODBUS_MIN_RESPONSE_TIMEOUT 50 // Límite inferior del tiempo de reacción adaptativo en ms
+#define MODBUS_REQUEST_BYTES    8     // Petición 0x03/0x04: dirección, función, inicio, cantidad y CRC
+#define MODBUS_RESPONSE_BYTES(regs) (5 + 2 * (regs)) // Respuesta: dirección, función, contador, datos y CRC
+#define MODBUS_EXCEPTION_BYTES  5     // Respuesta de excepción: dirección, función, código y CRC
 #define MODBUS_MAX_RETRY        3     // Número máximo de intentos de lectura Modbus
+#define MODBUS_RX_TIMEOUT_SYMBOLS 4   // Timeout RX de la UART (en caracteres) que dispara el evento de fin de trama
+#define MODBUS_RX_WAIT_SLICE_MS 5     // Espera máxima por evento UART antes de revisar timeouts
+#define MODBUS_MAX_SLAVES       8     // Esclavos con estado de salud guardado en memoria RTC
+#define MODBUS_MAX_BUSES        2     // Buses RS485 independientes (cada uno con su UART y tarea de sondeo)
+#define MODBUS_BUS_TASK_STACK   6144  // Pila de la tarea de sondeo de cada bus adicional
+#define MODBUS_BREAKER_THRESHOLD 2    // Ciclos fallidos consecutivos que abren el circuito de un esclavo
+#define MODBUS_BREAKER_BASE_SKIP 4    // Ciclos sin sondear tras la primera apertura (se duplica en cada reapertura)
+#define MODBUS_BREAKER_MAX_SKIP 120   // Máximo de ciclos sin sondear un esclavo caído
+#define MODBUS_MAX_RANGES       4     // Bloques de registros por descriptor de dispositivo
+#define MODBUS_MAX_VALUES       8     // Subvalores por descriptor de dispositivo
+#define MODBUS_MAX_BLOCK_REGS   57    // Registros por petición 0x03/0x04: 5 + 2*57 = 119 bytes, bajo el umbral de 120 de la FIFO RX
+#define MODBUS_COALESCE_MAX_GAP 8     // Registros sin usar que se leen de más para unir dos bloques
+#define MODBUS_READY_POLL_TIMEOUT 50   // Reacción máxima al sondear el registro de disponibilidad en ms (más tiempo de línea)
+#define MODBUS_READY_POLL_INTERVAL 100 // Pausa entre rondas de sondeo de disponibilidad en ms
+#define MODBUS_READY_MAX_WAIT   10000 // Tope absoluto de la espera máxima configurable por tipo en ms
+#define MODBUS_SCAN_ON_COLD_BOOT      // Buscar esclavos en el bus al arrancar en frío (comentar para desactivar)
+#define MODBUS_SCAN_FIRST_ADDRESS 1   // Primera dirección sondeada en la búsqueda
+#define MODBUS_SCAN_LAST_ADDRESS 32   // Última dirección sondeada en la búsqueda
+#define MODBUS_SCAN_TIMEOUT     50    // Reacción máxima por dirección durante la búsqueda en ms (más tiempo de línea)
+#define MODBUS_SCAN_STABILIZATION_TIME 5000 // Espera tras encender 12V antes de buscar (peor caso de los tipos conocidos)
 
 
 // Tamaños de documentos JSON - Centralizados
 #define JSON_DOC_SIZE_SMALL   300
 #define JSON_DOC_SIZE_MEDIUM  1024
 #define JSON_DOC_SIZE_LARGE   2048
+#define JSON_DOC_SIZE_MODBUS_MAPS 4096
 
 // Batería
 #define POWER_3V3_PIN           36
@@ -219,7 +357,7 @@ const double conversionFactor = (R1 + R2) / R1;
     {"5", "SM1",   SOILH, true}, \
     {"8", "PH",    PH, true}, \
     {"R", "RTD1",  RTD, true}, \
-    {"D", "DS1",   DS18B20, true}, \
+    {"D", "DS1",   DS18B20, true, 0.5f}, \
     {"I2C", "SHT30", SHT30, true} \
 }
 
@@ -228,6 +366,25 @@ const double conversionFactor = (R1 + R2) / R1;
     {"ModbusEnv1", ENV4, 1, false} \
 }
 
+// Buses RS485: UART, pin RX, pin TX, baudios. Los sensores Modbus eligen bus por índice
+// Para un segundo bus añadir p. ej. {1, MODBUS2_RX_PIN, MODBUS2_TX_PIN, MODBUS_BAUD_RATE}
+#define DEFAULT_MODBUS_BUS_CONFIGS { \
+    {2, MODBUS_RX_PIN, MODBUS_TX_PIN, MODBUS_BAUD_RATE} \
+}
+
+// Mapas de registros integrados (se usan si no hay uno guardado para el tipo)
+// Orden: tipo, función, bloque máx., espera máx., subvalor de disponibilidad y su rango, bloques, subvalores
+// ENV4: registros 500..507 -> [0]=Humedad(%), [1]=Temperatura(°C), [2]=Presión(kPa), [3]=Iluminación(lux)
+//       listo cuando la humedad deja de leerse en 0 (valor de arranque)
+#define DEFAULT_MODBUS_DEVICE_DESCRIPTORS { \
+    {ENV4, 0x03, 0, MODBUS_ENV4_STABILIZATION_TIME, 0, 0.1f, 100.0f, 1, {{500, 8}}, 4, { \
+        {500, MB_UINT16, MB_ORDER_ABCD, 0.1f, 0.0f}, \
+        {501, MB_INT16,  MB_ORDER_ABCD, 0.1f, 0.0f}, \
+        {505, MB_UINT16, MB_ORDER_ABCD, 0.1f, 0.0f}, \
+        {506, MB_UINT32, MB_ORDER_ABCD, 1.0f, 0.0f}  \
+    }} \
+}
+
 
 // Límites de temperatura NTC para evitar lecturas erróneas cuando esta desconectado
 #define NTC_TEMP_MIN           -20.0   // Temperatura mínima válida en °C
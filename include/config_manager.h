@@ -4,6 +4,7 @@
 #include <Arduino.h>  // Se incluye para utilizar el tipo String
 #include "sensor_types.h"
 #include <RadioLib.h> // Añadido para RADIOLIB_LORAWAN_SESSION_BUF_SIZE
+#include <ArduinoJson.h>
 #include "config.h"
 
 // Definición de la estructura para la configuración de LoRa
@@ -42,6 +43,19 @@ public:
     static void setModbusSensorsConfigs(const std::vector<ModbusSensorConfig>& configs);
     static std::vector<ModbusSensorConfig> getAllModbusSensorConfigs();
     static std::vector<ModbusSensorConfig> getEnabledModbusSensorConfigs();
+
+    // Mapas de registros por tipo de dispositivo (los guardados reemplazan a los integrados)
+    static void setModbusDeviceDescriptors(const std::vector<ModbusDeviceDescriptor>& descriptors);
+    static std::vector<ModbusDeviceDescriptor> getModbusDeviceDescriptors();
+    static void modbusDescriptorToJson(const ModbusDeviceDescriptor& descriptor, JsonObject obj);
+    static bool modbusDescriptorFromJson(JsonObjectConst obj, ModbusDeviceDescriptor& descriptor);
+
+    // Inventario de esclavos encontrados en la última búsqueda del bus
+    static void setModbusInventory(uint8_t firstAddress, uint8_t lastAddress,
+                                   const std::vector<ModbusInventoryEntry>& devices);
+    static bool getModbusInventory(uint8_t& firstAddress, uint8_t& lastAddress,
+                                   std::vector<ModbusInventoryEntry>& devices);
+    static void clearModbusInventory();
     
     /* =========================================================================
        CONFIGURACIÓN DE LORA
@@ -78,5 +92,6 @@ private:
     // Configuraciones por defecto
     static const SensorConfig defaultConfigs[]; // Configs no-Modbus
     static const ModbusSensorConfig defaultModbusSensors[]; // Configs Modbus
+    static const ModbusDeviceDescriptor defaultModbusDescriptors[]; // Mapas de registros integrados
 };
 
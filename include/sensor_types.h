@@ -8,11 +8,15 @@
 
 /************************************************************************
  * TIEMPOS DE ESTABILIZACIÓN PARA SENSORES MODBUS (en ms)
+ * Espera máxima tras encender 12V; el sensor se lee antes si su registro
+ * de disponibilidad ya devuelve un valor plausible.
  ************************************************************************/
  
 #define MODBUS_ENV4_STABILIZATION_TIME 5000   // Tiempo de estabilización para sensor ENV4 Modbus
 // Añadir aquí otros tiempos de estabilización para sensores Modbus
 
+#define MODBUS_NO_READY_VALUE 0xFF            // Sin registro de disponibilidad: se espera el tiempo máximo
+
 /**
  * @brief Estructura para variables múltiples en un solo sensor.
  *        Por ejemplo, un sensor SHT30 que da Temperature y Humidity.
@@ -74,6 +78,9 @@ struct SensorConfig {
     char sensorId[20];
     SensorType type;
     bool enable;
+    float precision;           // Precisión requerida en °C (DS18B20); 0 = máxima resolución
+    uint8_t priority;          // Orden en el uplink: menor se envía primero (0 = máxima)
+    uint8_t period;            // Se mide cada N ciclos (0 o 1 = en todos)
 };
 
 /************************************************************************
@@ -88,6 +95,87 @@ struct ModbusSensorConfig {
     SensorType type;           // Tipo de sensor Modbus
     uint8_t address;           // Dirección Modbus del dispositivo
     bool enable;               // Si está habilitado o no
+    uint8_t bus;               // Índice del bus RS485 (DEFAULT_MODBUS_BUS_CONFIGS)
+    uint8_t priority;          // Orden en el uplink: menor se envía primero (0 = máxima)
+    uint8_t period;            // Se mide cada N ciclos (0 o 1 = en todos)
+};
+
+/**
+ * @brief Configuración de un bus RS485/Modbus.
+ */
+struct ModbusBusConfig {
+    uint8_t uart;              // Número de UART del ESP32
+    int8_t rxPin;              // Pin RX
+    int8_t txPin;              // Pin TX
+    uint32_t baudRate;         // Velocidad del bus
+};
+
+/**
+ * @brief Tipos de dato de un valor dentro del mapa de registros Modbus.
+ */
+enum ModbusDataType : uint8_t {
+    MB_UINT16 = 0,   // 1 registro sin signo
+    MB_INT16  = 1,   // 1 registro con signo
+    MB_UINT32 = 2,   // 2 registros sin signo
+    MB_INT32  = 3,   // 2 registros con signo
+    MB_FLOAT32 = 4   // 2 registros IEEE-754
+};
+
+/**
+ * @brief Orden de palabras/bytes para valores de 32 bits (A = byte más significativo).
+ */
+enum ModbusWordOrder : uint8_t {
+    MB_ORDER_ABCD = 0,   // Palabra alta primero (big-endian)
+    MB_ORDER_CDAB = 1,   // Palabra baja primero
+    MB_ORDER_BADC = 2,   // Palabra alta primero con bytes intercambiados
+    MB_ORDER_DCBA = 3    // Little-endian completo
+};
+
+/**
+ * @brief Bloque contiguo de registros a leer de un dispositivo.
+ */
+struct ModbusRegisterRange {
+    uint16_t start;            // Registro inicial
+    uint8_t count;             // Cantidad de registros
+};
+
+/**
+ * @brief Descripción de un subvalor: dónde está y cómo convertirlo.
+ *        valor = dato * scale + offset
+ */
+struct ModbusValueDescriptor {
+    uint16_t reg;              // Registro (absoluto) donde empieza el dato
+    ModbusDataType dataType;   // Tipo de dato
+    ModbusWordOrder order;     // Orden de palabras (solo 32 bits)
+    float scale;               // Factor de escala
+    float offset;              // Desplazamiento
+};
+
+/**
+ * @brief Mapa de registros de un tipo de dispositivo Modbus. Los subvalores se
+ *        reportan en el orden de 'values'.
+ */
+struct ModbusDeviceDescriptor {
+    SensorType type;                                        // Tipo de sensor Modbus descrito
+    uint8_t functionCode;                                   // 0x03 (holding) o 0x04 (input)
+    uint8_t maxBlock;                                       // Máximo de registros por petición (0 = MODBUS_MAX_BLOCK_REGS)
+    uint16_t maxWait;                                       // Espera máxima tras encender 12V en ms
+    uint8_t readyValue;                                     // Subvalor sondeado hasta estar listo (MODBUS_NO_READY_VALUE = espera fija)
+    float readyMin;                                         // Rango plausible del subvalor sondeado
+    float readyMax;
+    uint8_t rangeCount;                                     // Bloques en uso
+    ModbusRegisterRange ranges[MODBUS_MAX_RANGES];          // Bloques de registros a leer
+    uint8_t valueCount;                                     // Subvalores en uso
+    ModbusValueDescriptor values[MODBUS_MAX_VALUES];        // Subvalores en orden de reporte
+};
+
+/**
+ * @brief Esclavo encontrado en la búsqueda del bus.
+ */
+struct ModbusInventoryEntry {
+    uint8_t bus;               // Bus donde se encontró
+    uint8_t address;           // Dirección que respondió
+    SensorType type;           // Tipo identificado por su mapa de registros (0 = desconocido)
 };
 
 /**
@@ -2,28 +2,102 @@
 #define DS18B20_SENSOR_H
 
 #include <Arduino.h>
+#include <vector>
 #include "config.h"
 #include "debug.h"
+#include "sensor_types.h"
 
 #if defined(DEVICE_TYPE_BASIC) || defined(DEVICE_TYPE_ANALOGIC)
+#include <OneWire.h>
 #include <DallasTemperature.h>
 
-// Variable externa
+// Variables externas
+extern OneWire oneWire;
 extern DallasTemperature dallasTemp;
 
 /**
- * @brief Clase para manejar el sensor de temperatura DS18B20
+ * @brief Caché en memoria RTC de las direcciones ROM descubiertas en el bus 1-Wire
+ *        y su asociación con los IDs de sensor configurados.
+ */
+struct DS18B20RomCache {
+    bool valid;                                     // true si la caché refleja el bus actual
+    bool parasite;                                  // true si alguna sonda usa alimentación parásita
+    uint8_t count;                                  // Número de entradas en uso
+    DeviceAddress rom[DS18B20_MAX_SENSORS];         // Código ROM de cada sonda
+    char sensorId[DS18B20_MAX_SENSORS][20];         // ID de sensor asociado ("" si no asignado)
+    uint8_t resolution[DS18B20_MAX_SENSORS];        // Resolución aplicada en bits (0 = desconocida)
+};
+
+/**
+ * @brief Clase para manejar las sondas de temperatura DS18B20 (varias en el mismo bus)
  */
 class DS18B20Sensor {
 public:
     /**
-     * @brief Lee la temperatura del sensor DS18B20
-     * 
+     * @brief Restaura las direcciones ROM desde memoria RTC (o busca en el bus si la caché
+     *        no cubre los sensores configurados) e inicia una conversión broadcast sin bloquear.
+     * @param enabledNormalSensors Vector con las configuraciones de sensores habilitados
+     */
+    static void begin(const std::vector<SensorConfig>& enabledNormalSensors);
+
+    /**
+     * @brief Lee la temperatura de la sonda asociada al ID de sensor indicado.
+     *        Espera únicamente lo que reste del tiempo de conversión iniciado en begin().
+     * @param sensorId ID del sensor configurado
      * @return float Temperatura en °C, o NAN si hay error
      */
-    static float read();
+    static float read(const char* sensorId);
+
+private:
+    /**
+     * @brief Verifica que todos los sensores DS18B20 configurados tengan una ROM asociada en caché.
+     */
+    static bool cacheCoversSensors(const std::vector<SensorConfig>& enabledNormalSensors);
+
+    /**
+     * @brief Recorre el bus 1-Wire, conserva las asociaciones ROM→ID existentes y asigna
+     *        las ROM nuevas a los IDs configurados pendientes, en orden. También detecta
+     *        si hay sondas con alimentación parásita (Read Power Supply).
+     */
+    static void discoverBus(const std::vector<SensorConfig>& enabledNormalSensors);
+
+    /**
+     * @brief Busca la entrada de caché asociada a un ID de sensor.
+     * @return Índice en la caché o -1 si no existe
+     */
+    static int findSensor(const char* sensorId);
+
+    /**
+     * @brief Devuelve la menor resolución (9-12 bits) cuyo paso cumple la precisión pedida.
+     * @param precision Precisión requerida en °C (0 = máxima resolución)
+     * @return Resolución en bits
+     */
+    static uint8_t resolutionForPrecision(float precision);
+
+    /**
+     * @brief Ajusta la resolución de cada sonda a la precisión configurada. Solo escribe
+     *        el scratchpad (y la EEPROM) cuando la resolución guardada en caché cambia.
+     *        Las DS18S20 (resolución fija) y las sondas parásitas cuentan como 12 bits.
+     * @return Mayor resolución en uso, que determina el tiempo de conversión del bus
+     */
+    static uint8_t applyResolutions(const std::vector<SensorConfig>& enabledNormalSensors);
+
+    /**
+     * @brief Inicia la conversión broadcast (Skip ROM) sin esperar. Con sondas parásitas
+     *        mantiene el pull-up fuerte mientras dura la conversión.
+     */
+    static void startConversion();
+
+    /**
+     * @brief Espera hasta que haya transcurrido el tiempo de conversión.
+     */
+    static void waitForConversion();
+
+    static bool conversionStarted;
+    static uint32_t conversionStartTime;
+    static uint16_t conversionTime;
 };
 
 #endif // defined(DEVICE_TYPE_BASIC) || defined(DEVICE_TYPE_ANALOGIC)
 
-#endif // DS18B20_SENSOR_H 
\ No newline at end of file
+#endif // DS18B20_SENSOR_H
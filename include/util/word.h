@@ -61,4 +61,29 @@ static inline uint16_t highWord(uint32_t ww)
 }
 
 
+/** @ingroup util_word
+    Combine two words into a 32-bit integer.
+
+    @param uint16_t hi high word (0x0000..0xFFFF)
+    @param uint16_t lo low word (0x0000..0xFFFF)
+    @return 32-bit integer (0x00000000..0xFFFFFFFF)
+*/
+static inline uint32_t makeLong(uint16_t hi, uint16_t lo)
+{
+  return ((uint32_t) hi << 16) | lo;
+}
+
+
+/** @ingroup util_word
+    Swap the two bytes of a word.
+
+    @param uint16_t w (0x0000..0xFFFF)
+    @return word with bytes swapped (0x0000..0xFFFF)
+*/
+static inline uint16_t swapBytes(uint16_t w)
+{
+  return (uint16_t) ((w << 8) | (w >> 8));
+}
+
+
 #endif /* _UTIL_WORD_H_ */
@@ -6,12 +6,18 @@
 void parseKeyString(const String &keyStr, uint8_t *outArray, size_t expectedSize);
 bool parseEUIString(const char* euiStr, uint64_t* eui);
 
+// Longitud máxima de formatFloatTo3Decimals para valores finitos con |valor| < 2^31
+// ("-2147483647.999"); con un buffer mayor no se usa snprintf
+#define FLOAT_3_DECIMALS_MAX_LENGTH 15
+
 /**
- * @brief Formatea un valor flotante con hasta 3 decimales, eliminando ceros finales.
+ * @brief Formatea un valor flotante con hasta 3 decimales, eliminando ceros finales
+ *        (mismo resultado que snprintf("%.3f") sin los ceros finales).
  * @param value Valor flotante a formatear.
  * @param buffer Buffer donde se almacenará la cadena formateada.
  * @param bufferSize Tamaño del buffer.
+ * @return Longitud de la cadena formateada.
  */
-void formatFloatTo3Decimals(float value, char* buffer, size_t bufferSize);
+size_t formatFloatTo3Decimals(float value, char* buffer, size_t bufferSize);
 
 #endif // UTILITIES_H
\ No newline at end of file
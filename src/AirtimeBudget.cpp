@@ -0,0 +1,151 @@
+#include "AirtimeBudget.h"
+#include <Arduino.h>
+#include <ESP32Time.h>
+#include "config.h"
+#include "debug.h"
+
+// Referencias externas
+extern ESP32Time rtc;
+
+/**
+ * @brief Cubeta del presupuesto, conservada entre despertares.
+ */
+struct AirtimeBudgetState {
+    bool initialized;       // false tras un arranque en frío (cubeta llena)
+    uint32_t refilledAt;    // Epoch del RTC del último relleno
+    float availableMs;      // Tiempo en aire disponible
+    uint16_t denied;        // Uplinks rechazados por falta de presupuesto
+};
+
+RTC_DATA_ATTR AirtimeBudgetState budgetState = {};
+
+namespace {
+
+/**
+ * @brief Modulación de un data rate LoRa y payload de aplicación máximo (N de los
+ *        parámetros regionales, sin FOpts).
+ */
+struct DatarateParams {
+    uint8_t sf;
+    uint16_t bandwidthKHz;
+    uint8_t maxPayload;
+};
+
+// Uplinks y downlinks de cada plan (SF 0 = data rate no LoRa o no definido)
+#if LORA_REGION_PLAN == LORA_PLAN_US915
+const DatarateParams datarates[] = {
+    {10, 125, 11}, {9, 125, 53}, {8, 125, 125}, {7, 125, 242}, {8, 500, 242}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {12, 500, 53}, {11, 500, 129}, {10, 500, 242}, {9, 500, 242}, {8, 500, 242}, {7, 500, 242}
+};
+#elif LORA_REGION_PLAN == LORA_PLAN_AU915
+const DatarateParams datarates[] = {
+    {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115}, {8, 125, 222}, {7, 125, 222},
+    {8, 500, 222}, {0, 0, 0}, {12, 500, 33}, {11, 500, 109}, {10, 500, 222}, {9, 500, 222},
+    {8, 500, 222}, {7, 500, 222}
+};
+#else
+// EU868 y planes con la misma tabla (AS923, IN865, KR920); DR7 es FSK
+const DatarateParams datarates[] = {
+    {12, 125, 51}, {11, 125, 51}, {10, 125, 51}, {9, 125, 115}, {8, 125, 222}, {7, 125, 222},
+    {7, 250, 222}, {0, 0, 222}
+};
+#endif
+
+#define FSK_DATARATE        7       // DR7 FSK 50 kbps (EU868 y similares)
+
+} // namespace
+
+uint32_t AirtimeBudget::loraTimeOnAirUs(uint8_t sf, uint16_t bandwidthKHz, size_t phyLength) {
+    // Duración de símbolo en µs: 2^SF / BW
+    uint32_t symbolUs = ((uint32_t)1000 << sf) / bandwidthKHz;
+    bool lowDatarateOptimize = symbolUs >= 16000;
+
+    // Símbolos de payload (cabecera explícita, CRC, CR 4/5)
+    int32_t numerator = 8 * (int32_t)phyLength - 4 * sf + 28 + 16;
+    int32_t denominator = 4 * (sf - (lowDatarateOptimize ? 2 : 0));
+    int32_t payloadSymbols = 8;
+    if (numerator > 0) {
+        payloadSymbols += ((numerator + denominator - 1) / denominator) * 5;
+    }
+
+    // Preámbulo de 8 símbolos + 4.25 de sincronización
+    return (uint32_t)((8 * 4 + 17) * symbolUs / 4) + payloadSymbols * symbolUs;
+}
+
+uint32_t AirtimeBudget::timeOnAirUs(size_t phyLength, uint8_t datarate) {
+    if (datarate >= sizeof(datarates) / sizeof(datarates[0])) {
+        return 0;
+    }
+#if LORA_REGION_PLAN != LORA_PLAN_US915 && LORA_REGION_PLAN != LORA_PLAN_AU915
+    if (datarate == FSK_DATARATE) {
+        // Preámbulo 5, sincronización 3, longitud 1, payload y CRC 2, a 50 kbps
+        return (5 + 3 + 1 + phyLength + 2) * 8 * 20;
+    }
+#endif
+    const DatarateParams& params = datarates[datarate];
+    if (params.sf == 0) {
+        return 0;
+    }
+    return loraTimeOnAirUs(params.sf, params.bandwidthKHz, phyLength);
+}
+
+uint32_t AirtimeBudget::uplinkTimeOnAirUs(size_t payloadLength, uint8_t datarate, size_t foptsLength) {
+    return timeOnAirUs(payloadLength + LORAWAN_FRAME_OVERHEAD + foptsLength, datarate);
+}
+
+uint8_t AirtimeBudget::maxPayloadLen(uint8_t datarate) {
+    if (datarate >= sizeof(datarates) / sizeof(datarates[0])) {
+        return 0;
+    }
+    return datarates[datarate].maxPayload;
+}
+
+void AirtimeBudget::refill() {
+    uint32_t now = rtc.getEpoch();
+    if (!budgetState.initialized) {
+        budgetState.initialized = true;
+        budgetState.availableMs = AIRTIME_BUDGET_MS;
+        budgetState.refilledAt = now;
+        return;
+    }
+
+    // Un salto atrás del RTC (sincronización) no rellena
+    int32_t elapsed = (int32_t)(now - budgetState.refilledAt);
+    if (elapsed > 0) {
+        float refillMs = (float)elapsed * AIRTIME_BUDGET_MS / AIRTIME_BUDGET_WINDOW_S;
+        budgetState.availableMs = min(budgetState.availableMs + refillMs, (float)AIRTIME_BUDGET_MS);
+    }
+    budgetState.refilledAt = now;
+}
+
+bool AirtimeBudget::canSend(uint32_t airtimeUs) {
+    refill();
+    return airtimeUs / 1000.0f <= budgetState.availableMs;
+}
+
+void AirtimeBudget::consume(uint32_t airtimeUs) {
+    refill();
+    budgetState.availableMs -= airtimeUs / 1000.0f;
+    if (budgetState.availableMs < 0) {
+        budgetState.availableMs = 0;
+    }
+}
+
+void AirtimeBudget::deny() {
+    if (budgetState.denied < UINT16_MAX) {
+        budgetState.denied++;
+    }
+}
+
+uint32_t AirtimeBudget::availableMs() {
+    refill();
+    return (uint32_t)budgetState.availableMs;
+}
+
+bool AirtimeBudget::low() {
+    return availableMs() * 100 < (uint32_t)AIRTIME_BUDGET_MS * AIRTIME_BUDGET_LOW_PCT;
+}
+
+uint16_t AirtimeBudget::denied() {
+    return budgetState.denied;
+}
@@ -4,12 +4,16 @@
  *******************************************************************************************/
 
 #include "BLE.h"
+#include "SensorManager.h"
 
 // Inicialización de variables estáticas
 bool BLEHandler::isConnected = false;
 unsigned long BLEHandler::connectionStartTime = 0;
 BLEServer* BLEHandler::pBLEServer = nullptr;
 bool BLEHandler::shouldExitOnDisconnect = false;
+volatile bool BLEHandler::modbusScanRequested = false;
+uint8_t BLEHandler::modbusScanFirst = MODBUS_SCAN_FIRST_ADDRESS;
+uint8_t BLEHandler::modbusScanLast = MODBUS_SCAN_LAST_ADDRESS;
 
 // Implementación de los métodos de la clase ServerCallbacks
 void BLEHandler::ServerCallbacks::onConnect(BLEServer* pServer) {
@@ -98,6 +102,13 @@ void BLEHandler::runConfigLoop() {
             }
         }
         
+        // La búsqueda Modbus tarda segundos: se ejecuta aquí y no en el callback BLE
+        if (modbusScanRequested) {
+            digitalWrite(CONFIG_LED_PIN, HIGH);
+            SensorManager::discoverModbusDevices(modbusScanFirst, modbusScanLast);
+            modbusScanRequested = false;
+        }
+        
         // Control del LED según estado de conexión
         if (BLEHandler::isConnected) {
             // Cliente conectado, LED fijo
@@ -168,6 +179,20 @@ BLEService* BLEHandler::setupService(BLEServer* pServer) {
         BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE
     );
     pLoRaConfigChar->setCallbacks(new LoRaConfigCallback());
+
+    // Característica para mapas de registros Modbus
+    BLECharacteristic* pModbusMapsChar = pService->createCharacteristic(
+        BLEUUID(BLE_CHAR_MODBUS_MAPS_UUID),
+        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE
+    );
+    pModbusMapsChar->setCallbacks(new ModbusMapsConfigCallback());
+
+    // Característica para búsqueda de esclavos Modbus e inventario
+    BLECharacteristic* pModbusScanChar = pService->createCharacteristic(
+        BLEUUID(BLE_CHAR_MODBUS_SCAN_UUID),
+        BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE
+    );
+    pModbusScanChar->setCallbacks(new ModbusScanCallback());
     
     pService->start();
     return pService;
@@ -548,6 +573,9 @@ void BLEHandler::SensorsConfigCallback::onWrite(BLECharacteristic *pCharacterist
         strncpy(config.sensorId, sensor[KEY_SENSOR_ID] | "", sizeof(config.sensorId));
         config.type = static_cast<SensorType>(sensor[KEY_SENSOR_TYPE] | 0);
         config.enable = sensor[KEY_SENSOR_ENABLE] | false;
+        config.precision = sensor[KEY_SENSOR_PRECISION] | 0.0f;
+        config.priority = sensor[KEY_SENSOR_PRIORITY] | 0;
+        config.period = sensor[KEY_SENSOR_PERIOD] | 0;
         
         DEBUG_PRINT(F("DEBUG: Sensor config parsed - key: "));
         DEBUG_PRINT(config.configKey);
@@ -586,6 +614,15 @@ void BLEHandler::SensorsConfigCallback::onRead(BLECharacteristic *pCharacteristi
         obj[KEY_SENSOR_ID]          = sensor.sensorId;
         obj[KEY_SENSOR_TYPE]        = static_cast<int>(sensor.type);
         obj[KEY_SENSOR_ENABLE]      = sensor.enable;
+        if (sensor.type == DS18B20) {
+            obj[KEY_SENSOR_PRECISION] = sensor.precision;
+        }
+        if (sensor.priority != 0) {
+            obj[KEY_SENSOR_PRIORITY] = sensor.priority;
+        }
+        if (sensor.period > 1) {
+            obj[KEY_SENSOR_PERIOD] = sensor.period;
+        }
     }
 
     String jsonString;
@@ -649,4 +686,108 @@ void BLEHandler::LoRaConfigCallback::onRead(BLECharacteristic* pCharacteristic)
     DEBUG_PRINT(F("DEBUG: LoRaConfigCallback onRead - JSON enviado: "));
     DEBUG_PRINTLN(jsonString);
     pCharacteristic->setValue(jsonString.c_str());
-} 
\ No newline at end of file
+}
+
+// Implementación de ModbusMapsConfigCallback
+void BLEHandler::ModbusMapsConfigCallback::onWrite(BLECharacteristic *pCharacteristic) {
+    DEBUG_PRINTLN(F("DEBUG: ModbusMapsConfigCallback onWrite - JSON recibido:"));
+    DEBUG_PRINTLN(pCharacteristic->getValue().c_str());
+
+    // Se espera un JSON: { "modbus_maps": [ {"t":101,"f":3,"r":[[500,8]],"v":[{"r":500,"d":0,"s":0.1}, ...]}, ... ] }
+    DynamicJsonDocument doc(JSON_DOC_SIZE_MODBUS_MAPS);
+    DeserializationError error = deserializeJson(doc, pCharacteristic->getValue());
+    if (error) {
+        DEBUG_PRINT(F("Error deserializando Modbus maps: "));
+        DEBUG_PRINTLN(error.c_str());
+        return;
+    }
+
+    // Un mapa inválido descarta toda la escritura para no dejar la configuración a medias
+    std::vector<ModbusDeviceDescriptor> descriptors;
+    for (JsonObjectConst obj : doc[NAMESPACE_MODBUS_MAPS].as<JsonArrayConst>()) {
+        ModbusDeviceDescriptor descriptor;
+        if (!ConfigManager::modbusDescriptorFromJson(obj, descriptor)) {
+            DEBUG_PRINTLN(F("Error: mapa Modbus inválido, no se guarda la configuración"));
+            return;
+        }
+        DEBUG_PRINT(F("DEBUG: Mapa Modbus parseado - type: "));
+        DEBUG_PRINT(static_cast<int>(descriptor.type));
+        DEBUG_PRINT(F(", bloques: "));
+        DEBUG_PRINT(descriptor.rangeCount);
+        DEBUG_PRINT(F(", valores: "));
+        DEBUG_PRINTLN(descriptor.valueCount);
+        descriptors.push_back(descriptor);
+    }
+
+    ConfigManager::setModbusDeviceDescriptors(descriptors);
+}
+
+void BLEHandler::ModbusMapsConfigCallback::onRead(BLECharacteristic *pCharacteristic) {
+    // Se envían los mapas efectivos (guardados + integrados)
+    DynamicJsonDocument doc(JSON_DOC_SIZE_MODBUS_MAPS);
+    JsonArray mapArray = doc.createNestedArray(NAMESPACE_MODBUS_MAPS);
+    for (const auto& descriptor : ConfigManager::getModbusDeviceDescriptors()) {
+        ConfigManager::modbusDescriptorToJson(descriptor, mapArray.createNestedObject());
+    }
+
+    String jsonString;
+    serializeJson(doc, jsonString);
+    DEBUG_PRINT(F("DEBUG: ModbusMapsConfigCallback onRead - JSON enviado: "));
+    DEBUG_PRINTLN(jsonString);
+    pCharacteristic->setValue(jsonString.c_str());
+}
+
+// Implementación de ModbusScanCallback
+void BLEHandler::ModbusScanCallback::onWrite(BLECharacteristic *pCharacteristic) {
+    DEBUG_PRINTLN(F("DEBUG: ModbusScanCallback onWrite - JSON recibido:"));
+    DEBUG_PRINTLN(pCharacteristic->getValue().c_str());
+
+    // Se espera un JSON: { "modbus_inv": { "s": 1, "e": 32 } }
+    StaticJsonDocument<JSON_DOC_SIZE_SMALL> fullDoc;
+    DeserializationError error = deserializeJson(fullDoc, pCharacteristic->getValue());
+    if (error) {
+        DEBUG_PRINT(F("Error deserializando Modbus scan: "));
+        DEBUG_PRINTLN(error.c_str());
+        return;
+    }
+    JsonObject doc = fullDoc[NAMESPACE_MODBUS_INVENTORY];
+    uint8_t first = doc[KEY_MB_INV_FIRST] | MODBUS_SCAN_FIRST_ADDRESS;
+    uint8_t last = doc[KEY_MB_INV_LAST] | MODBUS_SCAN_LAST_ADDRESS;
+    if (first < 1 || last > 247 || first > last) {
+        DEBUG_PRINTLN(F("Error: rango de direcciones Modbus inválido"));
+        return;
+    }
+
+    DEBUG_PRINTF("DEBUG: Búsqueda Modbus solicitada %u..%u\n", first, last);
+    BLEHandler::modbusScanFirst = first;
+    BLEHandler::modbusScanLast = last;
+    BLEHandler::modbusScanRequested = true;
+}
+
+void BLEHandler::ModbusScanCallback::onRead(BLECharacteristic *pCharacteristic) {
+    uint8_t first = 0, last = 0;
+    std::vector<ModbusInventoryEntry> devices;
+    bool scanned = ConfigManager::getModbusInventory(first, last, devices);
+
+    StaticJsonDocument<JSON_DOC_SIZE_MEDIUM> fullDoc;
+    JsonObject doc = fullDoc.createNestedObject(NAMESPACE_MODBUS_INVENTORY);
+    if (scanned) {
+        doc[KEY_MB_INV_FIRST] = first;
+        doc[KEY_MB_INV_LAST] = last;
+        JsonArray deviceArray = doc.createNestedArray(KEY_MB_INV_DEVICES);
+        for (const auto& device : devices) {
+            JsonObject deviceObj = deviceArray.createNestedObject();
+            deviceObj[KEY_MB_INV_ADDR] = device.address;
+            deviceObj[KEY_MB_INV_TYPE] = static_cast<int>(device.type);
+            deviceObj[KEY_MB_INV_BUS] = device.bus;
+        }
+    }
+    // Búsqueda pendiente o en curso: la app debe volver a leer
+    doc[KEY_MB_INV_BUSY] = BLEHandler::modbusScanRequested;
+
+    String jsonString;
+    serializeJson(fullDoc, jsonString);
+    DEBUG_PRINT(F("DEBUG: ModbusScanCallback onRead - JSON enviado: "));
+    DEBUG_PRINTLN(jsonString);
+    pCharacteristic->setValue(jsonString.c_str());
+}
@@ -0,0 +1,126 @@
+#include "ClockSync.h"
+#include <Arduino.h>
+#include <ESP32Time.h>
+#include <math.h>
+#include "config.h"
+#include "debug.h"
+
+// Referencias externas
+extern ESP32Time rtc;
+
+/**
+ * @brief Estado de la sincronización, conservado entre despertares.
+ */
+struct ClockSyncState {
+    bool synced;            // El RTC tiene la hora del servidor
+    bool requested;         // DeviceTimeReq pendiente de respuesta
+    uint16_t samples;       // Estimaciones de deriva acumuladas
+    double syncTime;        // Hora del servidor en la última sincronización
+    double baselineTime;    // Hora del servidor al empezar a medir la deriva
+    double baselineError;   // Error acumulado del RTC desde baselineTime
+    double correctedAt;     // Hora local de la última corrección aplicada
+    float driftPpm;         // Deriva estimada
+    float uncertaintyPpm;   // Deriva que puede quedar sin corregir
+};
+
+RTC_DATA_ATTR ClockSyncState clockState = { false, false, 0, 0, 0, 0, 0, 0, CLOCK_DRIFT_INITIAL_PPM };
+
+// Hora local al terminar de transmitir el último uplink (0 = desconocida). Solo vale
+// dentro del despertar en que se transmitió
+static double uplinkEndLocal = 0;
+
+double ClockSync::localTime() {
+    return rtc.getEpoch() + rtc.getMillis() / 1000.0;
+}
+
+void ClockSync::correct() {
+    if (!clockState.synced || clockState.driftPpm == 0) {
+        return;
+    }
+    double now = localTime();
+    double adjust = (now - clockState.correctedAt) * clockState.driftPpm / 1e6;
+    if (fabs(adjust) < CLOCK_CORRECTION_MIN_S) {
+        // Se acumula hasta el próximo despertar
+        return;
+    }
+
+    double corrected = now - adjust;
+    uint32_t seconds = (uint32_t)corrected;
+    rtc.setTime(seconds, (int)((corrected - seconds) * 1000));
+    clockState.correctedAt = corrected;
+    DEBUG_PRINTF("RTC corregido %.3f s (deriva %.1f ppm)\n", -adjust, clockState.driftPpm);
+}
+
+void ClockSync::uplinkStarting(uint32_t airtimeUs) {
+    uplinkEndLocal = localTime() + airtimeUs / 1e6;
+}
+
+void ClockSync::applyServerTime(uint32_t unixEpoch, uint8_t fraction) {
+    double server = unixEpoch + fraction / 256.0;
+
+    // La respuesta es la hora del servidor al final del uplink: se compara con la hora
+    // local de ese instante, no con la de ahora (RX1 o RX2 después)
+    double now = localTime();
+    double txEnd = (uplinkEndLocal > 0 && uplinkEndLocal <= now) ? uplinkEndLocal : now;
+    double elapsed = now - txEnd;
+    uplinkEndLocal = 0;
+
+    if (clockState.synced) {
+        // El RTC ya se corrigió con la estimación: el error es la deriva que faltaba. Se
+        // acumula entre sincronizaciones hasta cubrir CLOCK_DRIFT_MIN_INTERVAL_S
+        double error = txEnd - server;
+        double interval = server - clockState.baselineTime;
+        clockState.baselineError += error;
+        if (interval >= CLOCK_DRIFT_MIN_INTERVAL_S) {
+            float residualPpm = clockState.baselineError / interval * 1e6;
+            float drift = clockState.driftPpm + residualPpm;
+            clockState.driftPpm = constrain(drift, -CLOCK_DRIFT_MAX_PPM, CLOCK_DRIFT_MAX_PPM);
+            clockState.uncertaintyPpm = max(fabsf(residualPpm), (float)CLOCK_DRIFT_MIN_PPM);
+            clockState.samples++;
+            DEBUG_PRINTF("Error del RTC %.3f s en %.0f s: deriva %.1f ppm\n", clockState.baselineError,
+                         interval, clockState.driftPpm);
+            clockState.baselineTime = server;
+            clockState.baselineError = 0;
+        }
+    } else {
+        clockState.baselineTime = server;
+        clockState.baselineError = 0;
+    }
+
+    double corrected = server + elapsed;
+    uint32_t seconds = (uint32_t)corrected;
+    rtc.setTime(seconds, (int)((corrected - seconds) * 1000));
+    clockState.synced = true;
+    clockState.requested = false;
+    clockState.syncTime = server;
+    clockState.correctedAt = corrected;
+}
+
+void ClockSync::invalidate() {
+    clockState.synced = false;
+}
+
+bool ClockSync::syncDue() {
+    if (!clockState.synced) {
+        return true;
+    }
+    double elapsed = localTime() - clockState.syncTime;
+    return elapsed * clockState.uncertaintyPpm / 1e6 >= CLOCK_SYNC_THRESHOLD_S;
+}
+
+void ClockSync::syncRequested() {
+    clockState.requested = true;
+}
+
+bool ClockSync::awaitingAnswer() {
+    return clockState.requested;
+}
+
+uint64_t ClockSync::sleepMicros(uint32_t seconds) {
+    // Si el RTC adelanta, el temporizador cuenta más rápido: hay que pedir más tiempo
+    return (uint64_t)(seconds * 1e6 * (1.0 + clockState.driftPpm / 1e6));
+}
+
+float ClockSync::driftPpm() {
+    return clockState.driftPpm;
+}
@@ -0,0 +1,345 @@
+#include "DownlinkProcessor.h"
+#include <Arduino.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "config.h"
+#include "debug.h"
+#include "config_manager.h"
+#include "UplinkQueue.h"
+#include "sensors/BatterySensor.h"
+#include "AirtimeBudget.h"
+#include "LinkAdapter.h"
+
+// Referencias externas
+extern RTC_DATA_ATTR uint16_t bootCount;
+extern RTC_DATA_ATTR uint16_t bootCountSinceUnsuccessfulJoin;
+
+/**
+ * @brief Lo que queda por informar al servidor, conservado entre despertares hasta que
+ *        se transmite el frame de control.
+ */
+struct DownlinkControlState {
+    bool ackPending;                                // Hay confirmación por enviar
+    bool diagnosticsPending;                        // El servidor pidió diagnóstico
+    bool rejoinPending;                             // Hacer un nuevo join al despertar
+    uint16_t ackFCnt;                               // fCnt del downlink confirmado
+    uint8_t ackCount;                               // Comandos confirmados
+    uint8_t ack[DOWNLINK_MAX_COMMANDS][2];          // Código y estado de cada comando
+};
+
+RTC_DATA_ATTR DownlinkControlState controlState = {};
+
+// Configuración cambiada en este despertar (main vuelve a leer la del sistema)
+static bool configChangedThisWake = false;
+
+// El último frame de control construido sigue vigente (no llegaron comandos después)
+static bool controlFrameCurrent = false;
+
+namespace {
+
+uint32_t readU32(const uint8_t* data) {
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+float readFloat(const uint8_t* data) {
+    uint32_t bits = readU32(data);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void writeU16(uint8_t* data, uint16_t value) {
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+
+void writeU32(uint8_t* data, uint32_t value) {
+    writeU16(data, value & 0xFFFF);
+    writeU16(data + 2, value >> 16);
+}
+
+// Bytes de argumentos de cada comando conocido (-1 = desconocido)
+int argumentLength(uint8_t command) {
+    switch (command) {
+        case DOWNLINK_CMD_SCHEMA_REQUEST:
+        case DOWNLINK_CMD_DIAGNOSTICS:
+        case DOWNLINK_CMD_REJOIN:
+            return 0;
+        case DOWNLINK_CMD_SLEEP_TIME:
+            return 4;
+        case DOWNLINK_CMD_SENSOR_ENABLE:
+        case DOWNLINK_CMD_SENSOR_PERIOD:
+            return 2;
+        case DOWNLINK_CMD_CALIBRATION:
+            return 10;
+        default:
+            return -1;
+    }
+}
+
+} // namespace
+
+uint8_t DownlinkProcessor::process(const uint8_t* data, size_t length, uint32_t fCnt) {
+    uint8_t actions = 0;
+
+    // Una confirmación anterior sin enviar se reemplaza: el servidor ve la más reciente
+    controlState.ackPending = true;
+    controlState.ackFCnt = fCnt & 0xFFFF;
+    controlState.ackCount = 0;
+    controlFrameCurrent = false;
+
+    size_t offset = 0;
+    while (offset < length) {
+        uint8_t command = data[offset++];
+        size_t used = 0;
+        uint8_t status = execute(command, data + offset, length - offset, used, actions);
+        offset += used;
+        DEBUG_PRINTF("Comando downlink 0x%02X: estado %u\n", command, status);
+
+        if (controlState.ackCount < DOWNLINK_MAX_COMMANDS) {
+            controlState.ack[controlState.ackCount][0] = command;
+            controlState.ack[controlState.ackCount][1] = status;
+            controlState.ackCount++;
+        }
+        if (status == DOWNLINK_STATUS_UNKNOWN || status == DOWNLINK_STATUS_BAD_LENGTH) {
+            break;
+        }
+    }
+
+    if (actions & DOWNLINK_ACTION_CONFIG_CHANGED) {
+        configChangedThisWake = true;
+    }
+    return actions;
+}
+
+uint8_t DownlinkProcessor::execute(uint8_t command, const uint8_t* args, size_t available, size_t& used,
+                                   uint8_t& actions) {
+    int needed = argumentLength(command);
+    if (needed < 0) {
+        return DOWNLINK_STATUS_UNKNOWN;
+    }
+    if ((size_t)needed > available) {
+        used = available;
+        return DOWNLINK_STATUS_BAD_LENGTH;
+    }
+    used = needed;
+
+    uint8_t status = DOWNLINK_STATUS_OK;
+    switch (command) {
+        case DOWNLINK_CMD_SCHEMA_REQUEST:
+            actions |= DOWNLINK_ACTION_SEND_SCHEMA;
+            break;
+        case DOWNLINK_CMD_DIAGNOSTICS:
+            controlState.diagnosticsPending = true;
+            break;
+        case DOWNLINK_CMD_REJOIN:
+            controlState.rejoinPending = true;
+            break;
+        case DOWNLINK_CMD_SLEEP_TIME:
+            status = setSleepTime(readU32(args));
+            break;
+        case DOWNLINK_CMD_SENSOR_ENABLE:
+            status = setSensorEnabled(args[0], args[1]);
+            break;
+        case DOWNLINK_CMD_SENSOR_PERIOD:
+            status = setSensorPeriod(args[0], args[1]);
+            break;
+        case DOWNLINK_CMD_CALIBRATION:
+            status = setCalibration(args[0], args[1], readFloat(args + 2), readFloat(args + 6));
+            break;
+    }
+
+    if (status == DOWNLINK_STATUS_OK && command >= DOWNLINK_CMD_SLEEP_TIME) {
+        actions |= DOWNLINK_ACTION_CONFIG_CHANGED;
+    }
+    return status;
+}
+
+uint8_t DownlinkProcessor::setSleepTime(uint32_t seconds) {
+    if (seconds < DOWNLINK_SLEEP_MIN || seconds > DOWNLINK_SLEEP_MAX) {
+        return DOWNLINK_STATUS_BAD_ARGUMENT;
+    }
+    bool initialized;
+    uint32_t sleepTime;
+    String deviceId, stationId;
+    ConfigManager::getSystemConfig(initialized, sleepTime, deviceId, stationId);
+    ConfigManager::setSystemConfig(initialized, seconds, deviceId, stationId);
+    return DOWNLINK_STATUS_OK;
+}
+
+uint8_t DownlinkProcessor::setSensorEnabled(uint8_t ref, uint8_t enabled) {
+    if (enabled > 1) {
+        return DOWNLINK_STATUS_BAD_ARGUMENT;
+    }
+    uint8_t index = ref & ~DOWNLINK_SENSOR_MODBUS;
+    if (ref & DOWNLINK_SENSOR_MODBUS) {
+        std::vector<ModbusSensorConfig> configs = ConfigManager::getAllModbusSensorConfigs();
+        if (index >= configs.size()) {
+            return DOWNLINK_STATUS_BAD_ARGUMENT;
+        }
+        configs[index].enable = enabled;
+        ConfigManager::setModbusSensorsConfigs(configs);
+    } else {
+        std::vector<SensorConfig> configs = ConfigManager::getAllSensorConfigs();
+        if (index >= configs.size()) {
+            return DOWNLINK_STATUS_BAD_ARGUMENT;
+        }
+        configs[index].enable = enabled;
+        ConfigManager::setSensorsConfigs(configs);
+    }
+    return DOWNLINK_STATUS_OK;
+}
+
+uint8_t DownlinkProcessor::setSensorPeriod(uint8_t ref, uint8_t period) {
+    uint8_t index = ref & ~DOWNLINK_SENSOR_MODBUS;
+    if (ref & DOWNLINK_SENSOR_MODBUS) {
+        std::vector<ModbusSensorConfig> configs = ConfigManager::getAllModbusSensorConfigs();
+        if (index >= configs.size()) {
+            return DOWNLINK_STATUS_BAD_ARGUMENT;
+        }
+        configs[index].period = period;
+        ConfigManager::setModbusSensorsConfigs(configs);
+    } else {
+        std::vector<SensorConfig> configs = ConfigManager::getAllSensorConfigs();
+        if (index >= configs.size()) {
+            return DOWNLINK_STATUS_BAD_ARGUMENT;
+        }
+        configs[index].period = period;
+        ConfigManager::setSensorsConfigs(configs);
+    }
+    return DOWNLINK_STATUS_OK;
+}
+
+uint8_t DownlinkProcessor::setCalibration(uint8_t target, uint8_t point, float x, float y) {
+    if (!isfinite(x) || !isfinite(y) || point > 3) {
+        return DOWNLINK_STATUS_BAD_ARGUMENT;
+    }
+
+    switch (target) {
+        case 1:   // NTC 100K: (temperatura, resistencia)
+        case 2: { // NTC 10K
+            if (point > 2) {
+                return DOWNLINK_STATUS_BAD_ARGUMENT;
+            }
+            double t[3], r[3];
+            if (target == 1) {
+                ConfigManager::getNTC100KConfig(t[0], r[0], t[1], r[1], t[2], r[2]);
+            } else {
+                ConfigManager::getNTC10KConfig(t[0], r[0], t[1], r[1], t[2], r[2]);
+            }
+            t[point] = x;
+            r[point] = y;
+            if (target == 1) {
+                ConfigManager::setNTC100KConfig(t[0], r[0], t[1], r[1], t[2], r[2]);
+            } else {
+                ConfigManager::setNTC10KConfig(t[0], r[0], t[1], r[1], t[2], r[2]);
+            }
+            return DOWNLINK_STATUS_OK;
+        }
+        case 3: { // Conductividad: (voltaje, valor) o (calTemp, coefComp)
+            float calTemp, coefComp, v[3], c[3];
+            ConfigManager::getConductivityConfig(calTemp, coefComp, v[0], c[0], v[1], c[1], v[2], c[2]);
+            if (point == 3) {
+                calTemp = x;
+                coefComp = y;
+            } else {
+                v[point] = x;
+                c[point] = y;
+            }
+            ConfigManager::setConductivityConfig(calTemp, coefComp, v[0], c[0], v[1], c[1], v[2], c[2]);
+            return DOWNLINK_STATUS_OK;
+        }
+        case 4: { // pH: (voltaje, valor) o (defaultTemp, -)
+            float v[3], p[3], defaultTemp;
+            ConfigManager::getPHConfig(v[0], p[0], v[1], p[1], v[2], p[2], defaultTemp);
+            if (point == 3) {
+                defaultTemp = x;
+            } else {
+                v[point] = x;
+                p[point] = y;
+            }
+            ConfigManager::setPHConfig(v[0], p[0], v[1], p[1], v[2], p[2], defaultTemp);
+            return DOWNLINK_STATUS_OK;
+        }
+        default:
+            return DOWNLINK_STATUS_BAD_ARGUMENT;
+    }
+}
+
+bool DownlinkProcessor::configChanged() {
+    return configChangedThisWake;
+}
+
+bool DownlinkProcessor::rejoinRequested() {
+    return controlState.rejoinPending;
+}
+
+void DownlinkProcessor::clearRejoin() {
+    controlState.rejoinPending = false;
+}
+
+bool DownlinkProcessor::hasControlFrame() {
+    return controlState.ackPending || controlState.diagnosticsPending;
+}
+
+size_t DownlinkProcessor::buildControlFrame(uint8_t* buffer, size_t bufferSize) {
+    size_t offset = 0;
+
+    if (controlState.ackPending) {
+        size_t recordLength = 2 + 2 * controlState.ackCount;
+        if (offset + 2 + recordLength > bufferSize) {
+            return 0;
+        }
+        buffer[offset++] = CONTROL_RECORD_ACK;
+        buffer[offset++] = recordLength;
+        writeU16(buffer + offset, controlState.ackFCnt);
+        offset += 2;
+        for (uint8_t i = 0; i < controlState.ackCount; i++) {
+            buffer[offset++] = controlState.ack[i][0];
+            buffer[offset++] = controlState.ack[i][1];
+        }
+    }
+
+    if (controlState.diagnosticsPending) {
+        if (offset + 4 + CONTROL_DIAGNOSTICS_LENGTH + CONTROL_LINK_LENGTH > bufferSize) {
+            return 0;
+        }
+        bool initialized;
+        uint32_t sleepTime;
+        String deviceId, stationId;
+        ConfigManager::getSystemConfig(initialized, sleepTime, deviceId, stationId);
+        float battery = BatterySensor::readVoltage();
+        uint32_t dropped = UplinkQueue::dropped();
+
+        buffer[offset++] = CONTROL_RECORD_DIAGNOSTICS;
+        buffer[offset++] = CONTROL_DIAGNOSTICS_LENGTH;
+        writeU16(buffer + offset, bootCount);
+        writeU16(buffer + offset + 2, (isnan(battery) || battery <= 0) ? 0 : (uint16_t)lroundf(battery * 1000.0f));
+        writeU32(buffer + offset + 4, sleepTime);
+        writeU16(buffer + offset + 8, UplinkQueue::size());
+        writeU16(buffer + offset + 10, dropped > 0xFFFF ? 0xFFFF : dropped);
+        writeU16(buffer + offset + 12, bootCountSinceUnsuccessfulJoin);
+        writeU32(buffer + offset + 14, AirtimeBudget::availableMs());
+        writeU16(buffer + offset + 18, AirtimeBudget::denied());
+        offset += CONTROL_DIAGNOSTICS_LENGTH;
+
+        buffer[offset++] = CONTROL_RECORD_LINK;
+        buffer[offset++] = CONTROL_LINK_LENGTH;
+        offset += LinkAdapter::writeDiagnostics(buffer + offset, bufferSize - offset);
+    }
+
+    controlFrameCurrent = offset > 0;
+    return offset;
+}
+
+void DownlinkProcessor::controlFrameSent() {
+    // Si el downlink de este mismo envío trajo comandos, su confirmación queda pendiente
+    if (!controlFrameCurrent) {
+        return;
+    }
+    controlFrameCurrent = false;
+    controlState.ackPending = false;
+    controlState.diagnosticsPending = false;
+    controlState.ackCount = 0;
+}
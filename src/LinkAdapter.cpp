@@ -0,0 +1,162 @@
+#include "LinkAdapter.h"
+#include <Arduino.h>
+#include <math.h>
+#include "config.h"
+#include "debug.h"
+
+#define LINK_DATARATE_COUNT  (LINK_MAX_DATARATE + 1)
+
+/**
+ * @brief Historial del enlace, conservado entre despertares.
+ */
+struct LinkAdapterState {
+    bool initialized;                           // false tras un arranque en frío
+    bool awaiting;                              // LinkCheckReq pendiente de resolver
+    uint8_t datarate;                           // Data rate elegido
+    uint8_t uplinksSinceCheck;                  // Uplinks desde el último LinkCheck
+    uint8_t margin;                             // Último margen informado
+    uint8_t gatewayCount;                       // Últimos gateways informados
+    uint8_t lastReason;                         // LINK_REASON_* del último cambio
+    uint16_t changes;                           // Cambios de data rate
+    float rssi;                                 // RSSI medio de los downlinks
+    float snr;                                  // SNR medio de los downlinks
+    float delivery[LINK_DATARATE_COUNT];        // Tasa de entrega por data rate
+};
+
+RTC_DATA_ATTR LinkAdapterState linkState = {};
+
+namespace {
+
+void initialize() {
+    if (linkState.initialized) {
+        return;
+    }
+    linkState = {};
+    linkState.initialized = true;
+    linkState.datarate = constrain(UPLINK_DATARATE, LINK_MIN_DATARATE, LINK_MAX_DATARATE);
+    linkState.uplinksSinceCheck = LINK_CHECK_INTERVAL;     // Primer LinkCheck cuanto antes
+    linkState.rssi = NAN;
+    linkState.snr = NAN;
+    for (uint8_t i = 0; i < LINK_DATARATE_COUNT; i++) {
+        linkState.delivery[i] = 1.0f;
+    }
+}
+
+void updateDelivery(uint8_t datarate, bool delivered) {
+    if (datarate < LINK_DATARATE_COUNT) {
+        float& ratio = linkState.delivery[datarate];
+        ratio += LINK_DELIVERY_ALPHA * ((delivered ? 1.0f : 0.0f) - ratio);
+    }
+}
+
+float smooth(float average, float sample) {
+    return isnan(average) ? sample : average + LINK_DELIVERY_ALPHA * (sample - average);
+}
+
+} // namespace
+
+uint8_t LinkAdapter::datarate() {
+    initialize();
+    return linkState.datarate;
+}
+
+bool LinkAdapter::linkCheckDue() {
+    initialize();
+    return !linkState.awaiting && linkState.uplinksSinceCheck >= LINK_CHECK_INTERVAL;
+}
+
+void LinkAdapter::linkCheckRequested() {
+    linkState.awaiting = true;
+}
+
+bool LinkAdapter::awaitingLinkCheck() {
+    return linkState.awaiting;
+}
+
+void LinkAdapter::linkCheckAnswered(uint8_t datarate, uint8_t margin, uint8_t gatewayCount) {
+    initialize();
+    linkState.awaiting = false;
+    linkState.uplinksSinceCheck = 0;
+    linkState.margin = margin;
+    linkState.gatewayCount = gatewayCount;
+    updateDelivery(datarate, true);
+
+    // Los data rates más rápidos recuperan de a poco la confianza mientras el enlace responde
+    for (uint8_t i = datarate + 1; i < LINK_DATARATE_COUNT; i++) {
+        linkState.delivery[i] += LINK_DELIVERY_RECOVERY * (1.0f - linkState.delivery[i]);
+    }
+
+    // Pasos de data rate que permite el margen (cada paso de SF cuesta ~2.5 dB)
+    int steps = ((int)margin - LINK_MARGIN_DB) * 10 / LINK_DB_PER_STEP_X10;
+    if ((int)margin < LINK_MARGIN_DB) {
+        steps = -(((LINK_MARGIN_DB - (int)margin) * 10 + LINK_DB_PER_STEP_X10 - 1) / LINK_DB_PER_STEP_X10);
+    }
+    int target = constrain((int)datarate + steps, LINK_MIN_DATARATE, LINK_MAX_DATARATE);
+    while (target > datarate && linkState.delivery[target] < LINK_TARGET_DELIVERY) {
+        target--;
+    }
+
+    DEBUG_PRINTF("LinkCheck: margen %u dB, %u gateways en DR%u -> DR%d\n", margin, gatewayCount, datarate, target);
+    if (target != linkState.datarate) {
+        select(target, target > linkState.datarate ? LINK_REASON_MARGIN_UP : LINK_REASON_MARGIN_DOWN);
+    }
+}
+
+void LinkAdapter::linkCheckLost(uint8_t datarate) {
+    initialize();
+    linkState.awaiting = false;
+    updateDelivery(datarate, false);
+    DEBUG_PRINTF("LinkCheck sin respuesta en DR%u (entrega %.2f)\n", datarate,
+                 datarate < LINK_DATARATE_COUNT ? linkState.delivery[datarate] : 0.0f);
+
+    if (datarate < LINK_DATARATE_COUNT && linkState.delivery[datarate] < LINK_TARGET_DELIVERY &&
+        linkState.datarate > LINK_MIN_DATARATE) {
+        select(linkState.datarate - 1, LINK_REASON_DELIVERY);
+        linkState.uplinksSinceCheck = LINK_CHECK_INTERVAL;     // Comprobar el nuevo cuanto antes
+    } else {
+        linkState.uplinksSinceCheck = LINK_CHECK_INTERVAL / 2;
+    }
+}
+
+void LinkAdapter::uplinkSent() {
+    initialize();
+    if (linkState.uplinksSinceCheck < UINT8_MAX) {
+        linkState.uplinksSinceCheck++;
+    }
+}
+
+void LinkAdapter::downlinkReceived(float rssi, float snr) {
+    initialize();
+    linkState.rssi = smooth(linkState.rssi, rssi);
+    linkState.snr = smooth(linkState.snr, snr);
+}
+
+void LinkAdapter::select(uint8_t datarate, uint8_t reason) {
+    DEBUG_PRINTF("Data rate DR%u -> DR%u (motivo %u)\n", linkState.datarate, datarate, reason);
+    linkState.datarate = datarate;
+    linkState.lastReason = reason;
+    if (linkState.changes < UINT16_MAX) {
+        linkState.changes++;
+    }
+}
+
+size_t LinkAdapter::writeDiagnostics(uint8_t* buffer, size_t bufferSize) {
+    initialize();
+    if (bufferSize < CONTROL_LINK_LENGTH) {
+        return 0;
+    }
+    int16_t rssi = isnan(linkState.rssi) ? INT16_MIN : (int16_t)lroundf(linkState.rssi);
+    int8_t snr = isnan(linkState.snr) ? INT8_MIN : (int8_t)constrain(lroundf(linkState.snr), -127, 127);
+    uint8_t delivery = (uint8_t)lroundf(linkState.delivery[linkState.datarate] * 100);
+
+    buffer[0] = linkState.datarate;
+    buffer[1] = linkState.margin;
+    buffer[2] = linkState.gatewayCount;
+    buffer[3] = (uint8_t)snr;
+    buffer[4] = (uint16_t)rssi & 0xFF;
+    buffer[5] = (uint16_t)rssi >> 8;
+    buffer[6] = delivery;
+    buffer[7] = min(linkState.changes, (uint16_t)UINT8_MAX);
+    buffer[8] = linkState.lastReason;
+    return CONTROL_LINK_LENGTH;
+}
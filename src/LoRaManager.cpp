@@ -15,29 +15,56 @@
 #include "sensor_types.h"  // Incluido para acceder a ModbusSensorReading
 #include "config_manager.h"
 #include "sensors/BatterySensor.h"
+#include "PayloadCodec.h"
+#include "SeriesCodec.h"
+#include "UplinkQueue.h"
+#include "DownlinkProcessor.h"
+#include "SessionStore.h"
+#include "ClockSync.h"
+#include "AirtimeBudget.h"
+#include "LinkAdapter.h"
+#include <algorithm>
 
 // Inicialización de variables estáticas
-LoRaWANNode* LoRaManager::node = nullptr;
-SX1262* LoRaManager::radioModule = nullptr;
+bool LoRaManager::sessionActive = false;
+uint8_t LoRaManager::currentDatarate = UPLINK_DATARATE;
 
 // Referencias externas
 extern RTC_DATA_ATTR uint8_t LWsession[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];
 extern RTC_DATA_ATTR uint16_t bootCountSinceUnsuccessfulJoin;
 extern ESP32Time rtc;
 
-int16_t LoRaManager::begin(SX1262* radio, const LoRaWANBand_t* region, uint8_t subBand) {
-    radioModule = radio;
-    int16_t state = radioModule->begin();
-    if (state != RADIOLIB_ERR_NONE) {
-        return state;
-    }
-    
-    // Crear el nodo LoRaWAN
-    node = new LoRaWANNode(radio, region, subBand);
-    return RADIOLIB_ERR_NONE;
-}
+// Último frame binario transmitido (referencia de los frames delta), sobrevive al deep sleep
+RTC_DATA_ATTR UplinkFrame uplinkReference = {};
+RTC_DATA_ATTR uint8_t uplinkSequence = 0;
+RTC_DATA_ATTR uint8_t uplinksSinceKeyframe = 0;
+
+// Sensores (por posición en el esquema) que no cupieron en el ciclo anterior
+RTC_DATA_ATTR uint64_t uplinkDeferred = 0;
+
+// Hash del último esquema enviado completo; false = enviarlo antes del próximo keyframe
+RTC_DATA_ATTR uint16_t uplinkSchemaHash = 0;
+RTC_DATA_ATTR bool uplinkSchemaSent = false;
+
+#if UPLINK_HISTORY_SAMPLES > 1
+/**
+ * @brief Muestras acumuladas para el próximo bloque de historial, en memoria RTC.
+ */
+struct UplinkHistory {
+    uint16_t schemaHash;                                            // Esquema de las muestras
+    uint8_t count;                                                  // Muestras acumuladas
+    uint8_t seriesCount;                                            // Batería + valores por muestra
+    uint32_t timestamps[UPLINK_HISTORY_SAMPLES];
+    float values[UPLINK_HISTORY_SAMPLES * UPLINK_HISTORY_MAX_SERIES];   // [muestra * seriesCount + serie]
+};
+
+RTC_DATA_ATTR UplinkHistory uplinkHistory = {};
+#endif
+
+// Momento (epoch del RTC) a partir del cual toca el próximo join tras un fallo
+RTC_DATA_ATTR uint32_t nextJoinAttempt = 0;
 
-int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
+int16_t LoRaManager::lwActivate(LoRaNode& node) {
     int16_t state = RADIOLIB_ERR_UNKNOWN;
     Preferences store;
     
@@ -67,7 +94,11 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
         store.getBytes("nonces", buffer, RADIOLIB_LORAWAN_NONCES_BUF_SIZE);
         state = node.setBufferNonces(buffer);
         
-        if (state == RADIOLIB_ERR_NONE) {
+        // Con un rejoin pedido por downlink no se restaura la sesión: los nonces sí, para
+        // que el DevNonce del nuevo join siga creciendo
+        if (state == RADIOLIB_ERR_NONE && DownlinkProcessor::rejoinRequested()) {
+            DEBUG_PRINTLN("Rejoin pedido por el servidor - iniciando nuevo join");
+        } else if (state == RADIOLIB_ERR_NONE) {
             // Intentar restaurar sesión desde RTC
             state = node.setBufferSession(LWsession);
             
@@ -76,6 +107,24 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
                 
                 if (state == RADIOLIB_LORAWAN_SESSION_RESTORED) {
                     store.end();
+                    sessionActive = true;
+                    LoRaManager::queueMacRequests(node);
+                    return state;
+                }
+            }
+
+            // Sin sesión en RTC (corte de energía o reset): último punto de control en flash
+            uint8_t session[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];
+            uint32_t fCntUp;
+            if (SessionStore::restore(session, fCntUp) && node.setBufferSession(session) == RADIOLIB_ERR_NONE) {
+                state = node.activateOTAA();
+                if (state == RADIOLIB_LORAWAN_SESSION_RESTORED) {
+                    DEBUG_PRINTF("Sesión restaurada desde flash (FCntUp %lu)\n", (unsigned long)fCntUp);
+                    store.end();
+                    sessionActive = true;
+                    // La hora del RTC se perdió con la sesión: pedirla al servidor
+                    ClockSync::invalidate();
+                    LoRaManager::queueMacRequests(node);
                     return state;
                 }
             }
@@ -84,10 +133,25 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
         DEBUG_PRINTLN("No hay nonces guardados - iniciando nuevo join");
     }
 
-    // Si llegamos aquí, necesitamos hacer un nuevo join
+    // Si llegamos aquí, necesitamos hacer un nuevo join. Tras fallos se espera a que
+    // toque el próximo intento: las lecturas se guardan en la cola mientras tanto
+    uint32_t now = rtc.getEpoch();
+    if (bootCountSinceUnsuccessfulJoin > 0 && (int32_t)(now - nextJoinAttempt) < 0) {
+        DEBUG_PRINTF("Join pospuesto %lu s (%u fallos)\n", (unsigned long)(nextJoinAttempt - now),
+                     bootCountSinceUnsuccessfulJoin);
+        store.end();
+        return RADIOLIB_ERR_JOIN_DEFERRED;
+    }
+
+    // Cada intento con el siguiente data rate de la lista
+    static const uint8_t joinDatarates[] = JOIN_DATARATES;
+    uint8_t joinDatarate = joinDatarates[bootCountSinceUnsuccessfulJoin % sizeof(joinDatarates)];
+    DEBUG_PRINTF("Join (intento %u, DR%u)\n", bootCountSinceUnsuccessfulJoin + 1, joinDatarate);
+
     state = RADIOLIB_ERR_NETWORK_NOT_JOINED;
     while (state != RADIOLIB_LORAWAN_NEW_SESSION) {
-        state = node.activateOTAA();
+        state = node.activateOTAA(joinDatarate);
+        AirtimeBudget::consume(AirtimeBudget::timeOnAirUs(LORAWAN_JOIN_REQUEST_LENGTH, joinDatarate));
 
         // Guardar nonces en flash si el join fue exitoso
         if (state == RADIOLIB_LORAWAN_NEW_SESSION) {
@@ -98,7 +162,7 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
 
             // Solicitar DeviceTime después de un join exitoso
             delay(1000); // Pausa para estabilización
-            node.setDatarate(3);
+            LoRaManager::applyUplinkDatarate(node, UPLINK_DATARATE);
             
             // Variable para controlar el número de intentos
             int rtcAttempts = 0;
@@ -108,6 +172,15 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
             // Intentar solicitar y actualizar el tiempo del RTC hasta 3 veces
             while (!rtcUpdated && rtcAttempts < maxAttempts) {
                 rtcAttempts++;
+
+                // El uplink vacío con DeviceTimeReq también sale del presupuesto de tiempo en aire
+                uint32_t airtimeUs = AirtimeBudget::uplinkTimeOnAirUs(0, currentDatarate, 1);
+                if (!AirtimeBudget::canSend(airtimeUs)) {
+                    DEBUG_PRINTF("Sin presupuesto de tiempo en aire para DeviceTime (%lu ms disponibles)\n",
+                                 (unsigned long)AirtimeBudget::availableMs());
+                    AirtimeBudget::deny();
+                    break;
+                }
                 
                 bool macCommandSuccess = node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_DEVICE_TIME);
                 if (macCommandSuccess) {
@@ -116,7 +189,10 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
                     uint8_t downlinkPayload[255];
                     size_t downlinkSize = 0;
                     
+                    ClockSync::uplinkStarting(airtimeUs);
                     int16_t rxState = node.sendReceive(nullptr, 0, fPort, downlinkPayload, &downlinkSize, true);
+                    AirtimeBudget::consume(airtimeUs);
+                    LinkAdapter::uplinkSent();
                     if (rxState == RADIOLIB_ERR_NONE) {
                         // Obtener y procesar DeviceTime
                         uint32_t unixEpoch;
@@ -126,7 +202,7 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
                             DEBUG_PRINTF("DeviceTime recibido: epoch = %lu s, fraction = %u\n", unixEpoch, fraction);
                             
                             // Configurar el RTC interno con el tiempo Unix
-                            rtc.setTime(unixEpoch);
+                            ClockSync::applyServerTime(unixEpoch, fraction);
                             
                             // Verificar si se ajustó correctamente
                             if (abs((int32_t)rtc.getEpoch() - (int32_t)unixEpoch) < 10) {
@@ -174,16 +250,23 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
             if (!rtcUpdated) {
                 DEBUG_PRINTLN("No se pudo actualizar el RTC después de los intentos máximos, entrando en deep sleep");
                 bootCountSinceUnsuccessfulJoin = 0;
+                sessionActive = true;
+                SessionStore::markNewSession();
                 store.end();
                 return RADIOLIB_ERR_RTC_SYNC_FAILED; // Error personalizado para indicar fallo en sincronización RTC
             }
             
             bootCountSinceUnsuccessfulJoin = 0;
+            DownlinkProcessor::clearRejoin();
+            sessionActive = true;
+            SessionStore::markNewSession();
             store.end();
             return RADIOLIB_LORAWAN_NEW_SESSION;
         } else {
-            DEBUG_PRINTF("Join falló: %d\n", state);
             bootCountSinceUnsuccessfulJoin++;
+            uint32_t backoff = LoRaManager::joinBackoffSeconds(bootCountSinceUnsuccessfulJoin);
+            nextJoinAttempt = rtc.getEpoch() + backoff;
+            DEBUG_PRINTF("Join falló: %d, próximo intento en %lu s\n", state, (unsigned long)backoff);
             store.end();
             return state;
         }
@@ -193,8 +276,159 @@ int16_t LoRaManager::lwActivate(LoRaWANNode& node) {
     return state;
 }
 
+uint32_t LoRaManager::joinBackoffSeconds(uint16_t failures) {
+    uint32_t backoff = JOIN_BACKOFF_BASE_S;
+    for (uint16_t i = 1; i < failures && backoff < JOIN_BACKOFF_MAX_S; i++) {
+        backoff *= 2;
+    }
+    backoff = min(backoff, (uint32_t)JOIN_BACKOFF_MAX_S);
+
+    // Jitter uniforme en ±JOIN_BACKOFF_JITTER_PCT %
+    uint32_t span = backoff * JOIN_BACKOFF_JITTER_PCT / 100;
+    if (span > 0) {
+        backoff = backoff - span + esp_random() % (2 * span + 1);
+    }
+    return backoff;
+}
+
+namespace {
+
+/**
+ * @brief Escritor secuencial del payload delimitado. Escribe directamente en el buffer
+ *        de salida y comprueba el espacio una vez por campo; si un campo no cabe, el
+ *        escritor queda lleno y descarta todo lo que siga.
+ */
+struct DelimitedWriter {
+    char* buffer;
+    size_t size;
+    size_t offset;
+    bool full;
+
+    /**
+     * @brief Reserva espacio para un campo de hasta length caracteres más el terminador.
+     */
+    bool reserve(size_t length) {
+        if (full || size - offset <= length) {
+            full = true;
+            return false;
+        }
+        return true;
+    }
+
+    void putChar(char c) {
+        if (reserve(1)) {
+            buffer[offset++] = c;
+        }
+    }
+
+    void putString(const char* text, size_t length) {
+        if (reserve(length)) {
+            memcpy(buffer + offset, text, length);
+            offset += length;
+        }
+    }
+
+    void putUint(uint32_t value) {
+        char digits[10];
+        size_t count = 0;
+        do {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        if (reserve(count)) {
+            while (count > 0) {
+                buffer[offset++] = digits[--count];
+            }
+        }
+    }
+
+    void putFloat(float value) {
+        // Mismo límite que el buffer temporal que se usaba antes por valor
+        if (reserve(FLOAT_3_DECIMALS_MAX_LENGTH)) {
+            offset += formatFloatTo3Decimals(value, buffer + offset, FLOAT_3_DECIMALS_MAX_LENGTH + 1);
+        }
+    }
+
+    /**
+     * @brief Encabezado: st|d|vt|ts
+     */
+    void putHeader(const String& stationId, const String& deviceId, float battery, uint32_t timestamp) {
+        putString(stationId.c_str(), stationId.length());
+        putChar('|');
+        putString(deviceId.c_str(), deviceId.length());
+        putChar('|');
+        putFloat(battery);
+        putChar('|');
+        putUint(timestamp);
+    }
+
+    /**
+     * @brief Comienza un sensor: |id,tipo
+     * @return Posición previa al sensor, para descartarlo si no cabe entero
+     */
+    size_t beginSensor(const char* sensorId, SensorType type) {
+        size_t start = offset;
+        putChar('|');
+        putString(sensorId, strnlen(sensorId, sizeof(SensorReading::sensorId)));
+        putChar(',');
+        putUint((uint32_t)type);
+        return start;
+    }
+
+    void putValue(float value) {
+        putChar(',');
+        putFloat(value);
+    }
+
+    /**
+     * @brief Cierra un sensor: si no cupo entero se quita del payload.
+     * @return false si el buffer está lleno
+     */
+    bool endSensor(size_t start) {
+        if (full) {
+            offset = start;
+        }
+        return !full;
+    }
+
+    size_t finish() {
+        buffer[offset] = '\0';
+        return offset;
+    }
+};
+
+/**
+ * @brief Escribe un sensor estándar: un solo valor o sus subvalores.
+ */
+bool writeSensor(DelimitedWriter& writer, const SensorReading& reading) {
+    size_t start = writer.beginSensor(reading.sensorId, reading.type);
+    if (reading.subValues.empty()) {
+        writer.putValue(reading.value);
+    } else {
+        for (const auto& sv : reading.subValues) {
+            writer.putValue(sv.value);
+        }
+    }
+    return writer.endSensor(start);
+}
+
+/**
+ * @brief Escribe un sensor Modbus con todos sus subvalores.
+ */
+bool writeSensor(DelimitedWriter& writer, const ModbusSensorReading& reading) {
+    size_t start = writer.beginSensor(reading.sensorId, reading.type);
+    for (const auto& sv : reading.subValues) {
+        writer.putValue(sv.value);
+    }
+    return writer.endSensor(start);
+}
+
+} // namespace
+
 /**
  * @brief Crea un payload optimizado con formato delimitado por | y , en lugar de JSON.
+ *        Formato: st|d|vt|ts|sensor1_id,sensor1_type,val1,val2,...|sensor2_id,...
+ *        Los sensores que no caben enteros en el buffer se omiten.
  * @param readings Vector con lecturas de sensores.
  * @param deviceId ID del dispositivo.
  * @param stationId ID de la estación.
@@ -213,55 +447,14 @@ size_t LoRaManager::createDelimitedPayload(
     char* buffer,
     size_t bufferSize
 ) {
-    // Inicializar buffer
-    buffer[0] = '\0';
-    size_t offset = 0;
-    
-    // Formatear batería con hasta 3 decimales
-    char batteryStr[16];
-    formatFloatTo3Decimals(battery, batteryStr, sizeof(batteryStr));
-    
-    // Formato: st|d|vt|ts|sensor1_id,sensor1_type,val1,val2,...|sensor2_id,...
-    
-    // Añadir encabezado: st|d|vt|ts
-    offset += snprintf(buffer + offset, bufferSize - offset, 
-                      "%s|%s|%s|%lu", 
-                      stationId.c_str(), 
-                      deviceId.c_str(), 
-                      batteryStr, 
-                      timestamp);
-    
-    // Añadir cada sensor
+    DelimitedWriter writer = {buffer, bufferSize, 0, false};
+    writer.putHeader(stationId, deviceId, battery, timestamp);
     for (const auto& reading : readings) {
-        if (offset >= bufferSize - 1) break; // Evitar desbordamiento
-        
-        // Añadir separador de sensor
-        buffer[offset++] = '|';
-        buffer[offset] = '\0';
-        
-        // Añadir ID y tipo del sensor
-        offset += snprintf(buffer + offset, bufferSize - offset, 
-                          "%s,%d", 
-                          reading.sensorId, 
-                          reading.type);
-        
-        // Añadir valores
-        if (reading.subValues.empty()) {
-            // Un solo valor
-            char valStr[16];
-            formatFloatTo3Decimals(reading.value, valStr, sizeof(valStr));
-            offset += snprintf(buffer + offset, bufferSize - offset, ",%s", valStr);
-        } else {
-            // Múltiples valores (subValues)
-            for (const auto& sv : reading.subValues) {
-                char valStr[16];
-                formatFloatTo3Decimals(sv.value, valStr, sizeof(valStr));
-                offset += snprintf(buffer + offset, bufferSize - offset, ",%s", valStr);
-            }
+        if (!writeSensor(writer, reading)) {
+            break;
         }
     }
-    
-    return offset;
+    return writer.finish();
 }
 
 #if defined(DEVICE_TYPE_ANALOGIC) || defined(DEVICE_TYPE_MODBUS)
@@ -287,77 +480,19 @@ size_t LoRaManager::createDelimitedPayload(
     char* buffer,
     size_t bufferSize
 ) {
-    // Inicializar buffer
-    buffer[0] = '\0';
-    size_t offset = 0;
-    
-    // Formatear batería con hasta 3 decimales
-    char batteryStr[16];
-    formatFloatTo3Decimals(battery, batteryStr, sizeof(batteryStr));
-    
-    // Formato: st|d|vt|ts|sensor1_id,sensor1_type,val1,val2,...|sensor2_id,...
-    
-    // Añadir encabezado: st|d|vt|ts
-    offset += snprintf(buffer + offset, bufferSize - offset, 
-                      "%s|%s|%s|%lu", 
-                      stationId.c_str(), 
-                      deviceId.c_str(), 
-                      batteryStr, 
-                      timestamp);
-    
-    // Añadir sensores normales
+    DelimitedWriter writer = {buffer, bufferSize, 0, false};
+    writer.putHeader(stationId, deviceId, battery, timestamp);
     for (const auto& reading : normalReadings) {
-        if (offset >= bufferSize - 1) break; // Evitar desbordamiento
-        
-        // Añadir separador de sensor
-        buffer[offset++] = '|';
-        buffer[offset] = '\0';
-        
-        // Añadir ID y tipo del sensor
-        offset += snprintf(buffer + offset, bufferSize - offset, 
-                          "%s,%d", 
-                          reading.sensorId, 
-                          reading.type);
-        
-        // Añadir valores
-        if (reading.subValues.empty()) {
-            // Un solo valor
-            char valStr[16];
-            formatFloatTo3Decimals(reading.value, valStr, sizeof(valStr));
-            offset += snprintf(buffer + offset, bufferSize - offset, ",%s", valStr);
-        } else {
-            // Múltiples valores (subValues)
-            for (const auto& sv : reading.subValues) {
-                char valStr[16];
-                formatFloatTo3Decimals(sv.value, valStr, sizeof(valStr));
-                offset += snprintf(buffer + offset, bufferSize - offset, ",%s", valStr);
-            }
+        if (!writeSensor(writer, reading)) {
+            return writer.finish();
         }
     }
-    
-    // Añadir sensores Modbus
     for (const auto& reading : modbusReadings) {
-        if (offset >= bufferSize - 1) break; // Evitar desbordamiento
-        
-        // Añadir separador de sensor
-        buffer[offset++] = '|';
-        buffer[offset] = '\0';
-        
-        // Añadir ID y tipo del sensor
-        offset += snprintf(buffer + offset, bufferSize - offset, 
-                          "%s,%d", 
-                          reading.sensorId, 
-                          reading.type);
-        
-        // Añadir valores
-        for (const auto& sv : reading.subValues) {
-            char valStr[16];
-            formatFloatTo3Decimals(sv.value, valStr, sizeof(valStr));
-            offset += snprintf(buffer + offset, bufferSize - offset, ",%s", valStr);
+        if (!writeSensor(writer, reading)) {
+            break;
         }
     }
-    
-    return offset;
+    return writer.finish();
 }
 #endif
 
@@ -371,7 +506,7 @@ size_t LoRaManager::createDelimitedPayload(
  */
 void LoRaManager::sendDelimitedPayload(
     const std::vector<SensorReading>& readings, 
-    LoRaWANNode& node,
+    LoRaNode& node,
     const String& deviceId, 
     const String& stationId, 
     ESP32Time& rtc) 
@@ -384,7 +519,15 @@ void LoRaManager::sendDelimitedPayload(
     // Obtener timestamp
     uint32_t timestamp = rtc.getEpoch();
 
-    // Crear payload
+    // Mismo data rate que el payload JSON (texto largo), o el de LinkAdapter
+    LoRaManager::applyUplinkDatarate(node, UPLINK_DATARATE);
+    
+    // Primero las confirmaciones de comandos y lo que quedó pendiente de ciclos anteriores
+    LoRaManager::sendControlFrame(node);
+    LoRaManager::drainUplinkQueue(node);
+
+    // Crear payload con el máximo del data rate elegido (los sensores que no caben se omiten)
+    size_t maxPayload = min((size_t)node.getMaxPayloadLen(), (size_t)MAX_LORA_PAYLOAD) + 1;
     size_t payloadSize = createDelimitedPayload(
         readings, 
         deviceId, 
@@ -392,32 +535,21 @@ void LoRaManager::sendDelimitedPayload(
         battery, 
         timestamp, 
         payloadBuffer, 
-        sizeof(payloadBuffer)
+        maxPayload
     );
     
-    DEBUG_PRINTF("Enviando payload delimitado con tamaño %d bytes\n", payloadSize);
+    DEBUG_PRINTF("Enviando payload delimitado con tamaño %d/%d bytes\n", payloadSize, maxPayload - 1);
     DEBUG_PRINTLN(payloadBuffer);
-    
-    // Enviar
-    uint8_t fPort = 1;
-    uint8_t downlinkPayload[255];
-    size_t downlinkSize = 0;
-    
-    int16_t state = node.sendReceive(
-        (uint8_t*)payloadBuffer, 
-        payloadSize, 
-        fPort, 
-        downlinkPayload, 
-        &downlinkSize
-    );
+
+    // Enviar (el downlink que llegue se procesa como comandos)
+    uint8_t fPort = UPLINK_FPORT_TEXT;
+    int16_t state = LoRaManager::sendAndProcessDownlink(node, (uint8_t*)payloadBuffer, payloadSize, fPort);
     
     if (state == RADIOLIB_ERR_NONE) {
         DEBUG_PRINTLN("Transmisión exitosa!");
-        if (downlinkSize > 0) {
-            DEBUG_PRINTF("Recibidos %d bytes de downlink\n", downlinkSize);
-        }
     } else {
         DEBUG_PRINTF("Error en transmisión: %d\n", state);
+        LoRaManager::queueUplink(fPort, timestamp, (uint8_t*)payloadBuffer, payloadSize);
     }
 }
 
@@ -434,7 +566,7 @@ void LoRaManager::sendDelimitedPayload(
 void LoRaManager::sendDelimitedPayload(
     const std::vector<SensorReading>& normalReadings, 
     const std::vector<ModbusSensorReading>& modbusReadings,
-    LoRaWANNode& node,
+    LoRaNode& node,
     const String& deviceId, 
     const String& stationId, 
     ESP32Time& rtc)
@@ -447,26 +579,6 @@ void LoRaManager::sendDelimitedPayload(
     // Obtener timestamp
     uint32_t timestamp = rtc.getEpoch();
 
-    // Crear payload
-    size_t payloadSize = createDelimitedPayload(
-        normalReadings, 
-        modbusReadings, 
-        deviceId, 
-        stationId, 
-        battery, 
-        timestamp, 
-        payloadBuffer, 
-        sizeof(payloadBuffer)
-    );
-    
-    DEBUG_PRINTF("Enviando payload delimitado con tamaño %d bytes\n", payloadSize);
-    DEBUG_PRINTLN(payloadBuffer);
-    
-    // Enviar
-    uint8_t fPort = 1;
-    uint8_t downlinkPayload[255];
-    size_t downlinkSize = 0;
-
     /*
     Lista de Data Rates (DR) para LoRaWAN US915
 
@@ -501,40 +613,674 @@ void LoRaManager::sendDelimitedPayload(
     - DR8 a DR13 se usan para **downlink** en los 8 canales de 500kHz.
     - El payload máximo puede verse afectado por la opción **FOpt** en el MAC layer.
     */
-    LoRaManager::setDatarate(node, 3);
+    LoRaManager::applyUplinkDatarate(node, UPLINK_DATARATE);
 
-    
-    // int16_t state = node.sendReceive(
-    //     (uint8_t*)payloadBuffer, 
-    //     payloadLength, 
-    //     fPort, 
-    //     downlinkPayload, 
-    //     &downlinkSize
-    // );
-
-    int16_t state = node.uplink(
-        (uint8_t*)payloadBuffer, 
-        payloadSize, 
-        fPort
+    // Primero las confirmaciones de comandos y lo que quedó pendiente de ciclos anteriores
+    LoRaManager::sendControlFrame(node);
+    LoRaManager::drainUplinkQueue(node);
+
+    // Crear payload con el máximo del data rate elegido: con LINK_ADAPTATION puede bajar
+    // hasta LINK_MIN_DATARATE (los sensores que no caben se omiten)
+    size_t maxPayload = min((size_t)node.getMaxPayloadLen(), (size_t)MAX_LORA_PAYLOAD) + 1;
+    size_t payloadSize = createDelimitedPayload(
+        normalReadings, 
+        modbusReadings, 
+        deviceId, 
+        stationId, 
+        battery, 
+        timestamp, 
+        payloadBuffer, 
+        maxPayload
     );
     
+    DEBUG_PRINTF("Enviando payload delimitado con tamaño %d/%d bytes\n", payloadSize, maxPayload - 1);
+    DEBUG_PRINTLN(payloadBuffer);
+    
+    // Enviar
+    uint8_t fPort = UPLINK_FPORT_TEXT;
+
+    // sendReceive (no uplink) para abrir las ventanas RX y recibir comandos
+    int16_t state = LoRaManager::sendAndProcessDownlink(node, (uint8_t*)payloadBuffer, payloadSize, fPort);
+    
     if (state == RADIOLIB_ERR_NONE) {
         DEBUG_PRINTLN("Transmisión exitosa!");
-        if (downlinkSize > 0) {
-            DEBUG_PRINTF("Recibidos %d bytes de downlink\n", downlinkSize);
-        }
     } else {
         DEBUG_PRINTF("Error en transmisión: %d\n", state);
+        LoRaManager::queueUplink(fPort, timestamp, (uint8_t*)payloadBuffer, payloadSize);
     }
 }
 #endif
 
+/**
+ * @brief Envía las lecturas con el formato binario compacto de PayloadCodec, repartidas
+ *        en tantos frames como haga falta para el payload máximo del data rate actual.
+ * @param normalReadings Vector con lecturas de sensores estándar
+ * @param modbusReadings Vector con lecturas de sensores Modbus (vacío si no hay)
+ * @param priorities Prioridad de cada sensor en el orden del esquema (menor = antes)
+ * @param node Referencia al nodo LoRaWAN
+ * @param deviceId ID del dispositivo (solo viaja en el esquema)
+ * @param stationId ID de la estación (solo viaja en el esquema)
+ * @param rtc Referencia al RTC para obtener timestamp
+ */
+void LoRaManager::sendBinaryPayload(
+    const std::vector<SensorReading>& normalReadings,
+    const std::vector<ModbusSensorReading>& modbusReadings,
+    const std::vector<uint8_t>& priorities,
+    LoRaNode& node,
+    const String& deviceId,
+    const String& stationId,
+    ESP32Time& rtc)
+{
+    uint8_t payloadBuffer[MAX_LORA_PAYLOAD];
+
+    float battery = BatterySensor::readVoltage();
+    uint32_t timestamp = rtc.getEpoch();
+
+    LoRaManager::applyUplinkDatarate(node, UPLINK_DATARATE);
+
+    // Confirmaciones de comandos primero: su downlink puede pedir el esquema
+    LoRaManager::sendControlFrame(node);
+
+    // Los IDs viajan solo en el esquema; cada keyframe lleva su hash
+    UplinkSchema schema = PayloadCodec::buildSchema(stationId.c_str(), deviceId.c_str(),
+                                                    normalReadings, modbusReadings);
+    uint16_t schemaHash = PayloadCodec::schemaHash(schema);
+#if UPLINK_HISTORY_SAMPLES > 1
+    // Las muestras de un esquema anterior salen antes de anunciar el nuevo
+    if (uplinkHistory.count > 0 && uplinkHistory.schemaHash != schemaHash) {
+        LoRaManager::flushHistory(node);
+    }
+#endif
+    if (!uplinkSchemaSent || uplinkSchemaHash != schemaHash) {
+        uplinkSchemaSent = LoRaManager::sendSchema(node, schema, schemaHash);
+        uplinkSchemaHash = schemaHash;
+    }
+
+    // Lo pendiente de ciclos anteriores va antes (con el esquema ya enviado)
+    LoRaManager::drainUplinkQueue(node);
+
+#if UPLINK_HISTORY_SAMPLES > 1
+    // Historial: las lecturas viajan juntas cada UPLINK_HISTORY_SAMPLES ciclos
+    if (LoRaManager::appendHistory(normalReadings, modbusReadings, battery, timestamp, schemaHash)) {
+        if (uplinkHistory.count >= UPLINK_HISTORY_SAMPLES) {
+            LoRaManager::flushHistory(node);
+        }
+        return;
+    }
+#endif
+
+    // Orden de envío: primero lo diferido en el ciclo anterior, luego por prioridad
+    size_t sensorCount = normalReadings.size() + modbusReadings.size();
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < sensorCount; i++) {
+        pending.push_back(i);
+    }
+    auto deferred = [](size_t index) {
+        return index < 64 && (uplinkDeferred & (1ULL << index)) != 0;
+    };
+    std::stable_sort(pending.begin(), pending.end(), [&](size_t a, size_t b) {
+        if (deferred(a) != deferred(b)) {
+            return deferred(a);
+        }
+        uint8_t pa = (a < priorities.size()) ? priorities[a] : 0;
+        uint8_t pb = (b < priorities.size()) ? priorities[b] : 0;
+        return pa < pb;
+    });
+    uplinkDeferred = 0;
+
+    for (uint8_t fragment = 0; fragment < UPLINK_MAX_FRAGMENTS && (fragment == 0 || !pending.empty()); fragment++) {
+        // Payload máximo del data rate actual, descontando los comandos MAC pendientes (FOpts)
+        size_t maxPayload = min((size_t)node.getMaxPayloadLen(), sizeof(payloadBuffer));
+
+        // Con poco presupuesto de tiempo en aire, lo que falta espera al próximo ciclo
+        if (fragment > 0 && AirtimeBudget::low()) {
+            DEBUG_PRINTLN("Presupuesto de tiempo en aire bajo: el resto se difiere");
+            break;
+        }
+
+        // Keyframe periódico para que el servidor pueda resincronizarse (se posterga con
+        // poco presupuesto: un delta ocupa menos)
+        bool keyframe = !uplinkReference.valid ||
+                        (uplinksSinceKeyframe + 1 >= UPLINK_KEYFRAME_INTERVAL && !AirtimeBudget::low());
+        const UplinkFrame* reference = keyframe ? nullptr : &uplinkReference;
+
+        // Llenar el frame en orden de prioridad; lo que no cabe queda para el siguiente
+        std::vector<bool> selection(sensorCount, false);
+        std::vector<size_t> remaining;
+        UplinkFrame frame;
+        for (size_t index : pending) {
+            selection[index] = true;
+            if (PayloadCodec::encode(normalReadings, modbusReadings, battery, timestamp, uplinkSequence,
+                                     schemaHash, reference, frame, payloadBuffer, maxPayload, &selection) == 0) {
+                selection[index] = false;
+                remaining.push_back(index);
+            }
+        }
+
+        size_t payloadSize = PayloadCodec::encode(normalReadings, modbusReadings, battery, timestamp,
+                                                  uplinkSequence, schemaHash, reference, frame,
+                                                  payloadBuffer, maxPayload, &selection);
+        if (payloadSize == 0 || (!pending.empty() && remaining.size() == pending.size())) {
+            DEBUG_PRINTF("Error: ningún sensor cabe en el payload máximo de %u bytes\n", (unsigned)maxPayload);
+            break;
+        }
+        pending = remaining;
+
+        bool more = !pending.empty() && fragment + 1 < UPLINK_MAX_FRAGMENTS;
+        if (more) {
+            payloadBuffer[0] |= PAYLOAD_FLAG_MORE;
+        }
+
+        bool delta = (payloadBuffer[0] & PAYLOAD_FLAG_DELTA) != 0;
+        DEBUG_PRINTF("Enviando payload binario v%d (%s, secuencia %u%s) con tamaño %d/%u bytes:",
+                     PAYLOAD_CODEC_VERSION, delta ? "delta" : "keyframe", uplinkSequence,
+                     more ? ", siguen más" : "", payloadSize, (unsigned)maxPayload);
+        for (size_t i = 0; i < payloadSize; i++) {
+            DEBUG_PRINTF(" %02X", payloadBuffer[i]);
+        }
+        DEBUG_PRINTLN();
+
+        int16_t state = LoRaManager::sendAndProcessDownlink(node, payloadBuffer, payloadSize, UPLINK_FPORT_BINARY);
+        uplinkSequence++;
+
+        if (state == RADIOLIB_ERR_NONE) {
+            DEBUG_PRINTLN("Transmisión exitosa!");
+            // El frame enviado pasa a ser la referencia del siguiente delta
+            uplinkReference = frame;
+            uplinksSinceKeyframe = delta ? uplinksSinceKeyframe + 1 : 0;
+        } else {
+            DEBUG_PRINTF("Error en transmisión: %d\n", state);
+            // El servidor puede no tener la referencia: el próximo frame será keyframe
+            uplinkReference.valid = false;
+
+            // Sus sensores se guardan con el resto de lo pendiente. No se insiste en este ciclo
+            std::vector<size_t> unsent;
+            for (size_t i = 0; i < sensorCount; i++) {
+                if (selection[i]) {
+                    unsent.push_back(i);
+                }
+            }
+            pending.insert(pending.begin(), unsent.begin(), unsent.end());
+            break;
+        }
+    }
+
+    // Lo que no se envió (fragmentos agotados, presupuesto bajo o error) se guarda como
+    // keyframe en la cola (un delta no se podría decodificar más tarde); solo lo que no
+    // se pudo guardar sale primero en el próximo ciclo, con las lecturas de entonces
+    if (!pending.empty()) {
+        pending = LoRaManager::queueKeyframes(normalReadings, modbusReadings, battery, timestamp,
+                                              schemaHash, pending);
+    }
+    for (size_t index : pending) {
+        if (index < 64) {
+            uplinkDeferred |= 1ULL << index;
+        }
+    }
+    if (!pending.empty()) {
+        DEBUG_PRINTF("%u sensores diferidos al próximo ciclo\n", (unsigned)pending.size());
+    }
+}
+
+/**
+ * @brief Envía el esquema de sensores por UPLINK_FPORT_SCHEMA, partido según el
+ *        payload máximo del data rate actual.
+ * @return true si se transmitieron todas las partes
+ */
+bool LoRaManager::sendSchema(LoRaNode& node, const UplinkSchema& schema, uint16_t schemaHash) {
+    uint8_t payloadBuffer[MAX_LORA_PAYLOAD];
+    std::vector<uint8_t> serialized = PayloadCodec::serializeSchema(schema);
+
+    size_t maxPayload = min((size_t)node.getMaxPayloadLen(), sizeof(payloadBuffer));
+    if (maxPayload <= PAYLOAD_SCHEMA_PART_HEADER) {
+        DEBUG_PRINTF("Error: el esquema no cabe en el payload máximo de %u bytes\n", (unsigned)maxPayload);
+        return false;
+    }
+    size_t chunkSize = maxPayload - PAYLOAD_SCHEMA_PART_HEADER;
+    size_t partCount = (serialized.size() + chunkSize - 1) / chunkSize;
+    if (partCount > PAYLOAD_SCHEMA_MAX_PARTS) {
+        DEBUG_PRINTF("Error: el esquema de %u bytes necesita más de %d partes\n",
+                     (unsigned)serialized.size(), PAYLOAD_SCHEMA_MAX_PARTS);
+        return false;
+    }
+
+    DEBUG_PRINTF("Enviando esquema %04X (%u sensores, %u bytes) en %u partes\n", schemaHash,
+                 (unsigned)schema.sensors.size(), (unsigned)serialized.size(), (unsigned)partCount);
+    for (size_t part = 0; part < partCount; part++) {
+        size_t payloadSize = PayloadCodec::encodeSchemaPart(serialized, schemaHash, (uint8_t)part,
+                                                            chunkSize, payloadBuffer);
+        int16_t state = LoRaManager::sendAndProcessDownlink(node, payloadBuffer, payloadSize, UPLINK_FPORT_SCHEMA);
+        if (state != RADIOLIB_ERR_NONE) {
+            DEBUG_PRINTF("Error en transmisión del esquema: %d\n", state);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Guarda las lecturas de un ciclo sin red (p. ej. sin join) en la cola persistente,
+ *        en el formato de uplink configurado. Los frames binarios se guardan como keyframe.
+ * @param normalReadings Vector con lecturas de sensores estándar
+ * @param modbusReadings Vector con lecturas de sensores Modbus
+ * @param deviceId ID del dispositivo
+ * @param stationId ID de la estación
+ * @param rtc Referencia al RTC para obtener timestamp
+ */
+void LoRaManager::queueReadings(
+    const std::vector<SensorReading>& normalReadings,
+    const std::vector<ModbusSensorReading>& modbusReadings,
+    const String& deviceId,
+    const String& stationId,
+    ESP32Time& rtc)
+{
+    float battery = BatterySensor::readVoltage();
+    uint32_t timestamp = rtc.getEpoch();
+
+#ifdef UPLINK_BINARY_FORMAT
+    UplinkSchema schema = PayloadCodec::buildSchema(stationId.c_str(), deviceId.c_str(),
+                                                    normalReadings, modbusReadings);
+#if UPLINK_HISTORY_SAMPLES > 1
+    // Con historial la muestra espera en memoria RTC al próximo bloque
+    if (LoRaManager::appendHistory(normalReadings, modbusReadings, battery, timestamp,
+                                   PayloadCodec::schemaHash(schema))) {
+        return;
+    }
+#endif
+    // Keyframes que se puedan reenviar a cualquier data rate
+    std::vector<size_t> sensors(normalReadings.size() + modbusReadings.size());
+    for (size_t i = 0; i < sensors.size(); i++) {
+        sensors[i] = i;
+    }
+    std::vector<size_t> lost = LoRaManager::queueKeyframes(normalReadings, modbusReadings, battery, timestamp,
+                                                           PayloadCodec::schemaHash(schema), sensors);
+    if (!lost.empty()) {
+        DEBUG_PRINTF("%u sensores sin guardar en la cola\n", (unsigned)lost.size());
+    }
+#else
+    char payloadBuffer[MAX_LORA_PAYLOAD + 1];
+    size_t payloadSize = createDelimitedPayload(normalReadings, modbusReadings, deviceId, stationId,
+                                                battery, timestamp, payloadBuffer, sizeof(payloadBuffer));
+    if (payloadSize > 0) {
+        LoRaManager::queueUplink(UPLINK_FPORT_TEXT, timestamp, (const uint8_t*)payloadBuffer, payloadSize);
+    }
+#endif
+}
+
+#if UPLINK_HISTORY_SAMPLES > 1
+/**
+ * @brief Agrega la muestra del ciclo al historial. Si el historial está lleno se descarta
+ *        la muestra más antigua; si es de otro esquema, se descartan las anteriores.
+ * @return false si la muestra tiene más de UPLINK_HISTORY_MAX_SERIES series (se envía
+ *         como un uplink normal)
+ */
+bool LoRaManager::appendHistory(const std::vector<SensorReading>& normalReadings,
+                                const std::vector<ModbusSensorReading>& modbusReadings,
+                                float battery, uint32_t timestamp, uint16_t schemaHash) {
+    float sample[UPLINK_HISTORY_MAX_SERIES];
+    size_t seriesCount = SeriesCodec::sampleOf(normalReadings, modbusReadings, battery,
+                                               sample, UPLINK_HISTORY_MAX_SERIES);
+    if (seriesCount == 0) {
+        return false;
+    }
+
+    if (uplinkHistory.count > 0 &&
+        (uplinkHistory.schemaHash != schemaHash || uplinkHistory.seriesCount != seriesCount)) {
+        DEBUG_PRINTF("Esquema nuevo: se descartan %u muestras del historial\n", uplinkHistory.count);
+        uplinkHistory.count = 0;
+    }
+    if (uplinkHistory.count >= UPLINK_HISTORY_SAMPLES) {
+        DEBUG_PRINTLN("Historial lleno: se descarta la muestra más antigua");
+        LoRaManager::dropHistorySamples(1);
+    }
+
+    uint8_t index = uplinkHistory.count++;
+    uplinkHistory.schemaHash = schemaHash;
+    uplinkHistory.seriesCount = (uint8_t)seriesCount;
+    uplinkHistory.timestamps[index] = timestamp;
+    memcpy(&uplinkHistory.values[index * seriesCount], sample, seriesCount * sizeof(float));
+    DEBUG_PRINTF("Muestra %u/%u guardada en el historial\n", uplinkHistory.count, UPLINK_HISTORY_SAMPLES);
+    return true;
+}
+
+/**
+ * @brief Quita las muestras más antiguas del historial.
+ */
+void LoRaManager::dropHistorySamples(uint8_t count) {
+    if (count >= uplinkHistory.count) {
+        uplinkHistory.count = 0;
+        return;
+    }
+    uint8_t remaining = uplinkHistory.count - count;
+    memmove(uplinkHistory.timestamps, uplinkHistory.timestamps + count, remaining * sizeof(uint32_t));
+    memmove(uplinkHistory.values, uplinkHistory.values + count * uplinkHistory.seriesCount,
+            remaining * uplinkHistory.seriesCount * sizeof(float));
+    uplinkHistory.count = remaining;
+}
+
+/**
+ * @brief Envía el historial por UPLINK_FPORT_HISTORY en bloques con tantas muestras como
+ *        quepan en el payload máximo del data rate actual. Un bloque no transmitido se
+ *        guarda en la cola persistente; lo que no sale en este ciclo queda para el siguiente.
+ * @param node Referencia al nodo LoRaWAN
+ */
+void LoRaManager::flushHistory(LoRaNode& node) {
+    uint8_t payloadBuffer[MAX_LORA_PAYLOAD];
+
+    for (uint8_t fragment = 0; fragment < UPLINK_MAX_FRAGMENTS && uplinkHistory.count > 0; fragment++) {
+        if (fragment > 0 && AirtimeBudget::low()) {
+            DEBUG_PRINTLN("Presupuesto de tiempo en aire bajo: el resto del historial se difiere");
+            break;
+        }
+
+        // Las muestras más antiguas que quepan en un frame
+        size_t maxPayload = min((size_t)node.getMaxPayloadLen(), sizeof(payloadBuffer));
+        uint8_t samples = uplinkHistory.count;
+        size_t payloadSize = 0;
+        while (samples > 0 && (payloadSize = SeriesCodec::encode(uplinkHistory.schemaHash, uplinkHistory.timestamps,
+                                                                 uplinkHistory.values, samples,
+                                                                 uplinkHistory.seriesCount, payloadBuffer,
+                                                                 maxPayload)) == 0) {
+            samples--;
+        }
+        if (payloadSize == 0) {
+            DEBUG_PRINTF("Error: ninguna muestra del historial cabe en %u bytes; se descartan\n", (unsigned)maxPayload);
+            uplinkHistory.count = 0;
+            break;
+        }
+
+        DEBUG_PRINTF("Enviando historial (%u de %u muestras, %u series) con tamaño %u/%u bytes\n",
+                     samples, uplinkHistory.count, uplinkHistory.seriesCount, (unsigned)payloadSize,
+                     (unsigned)maxPayload);
+        int16_t state = LoRaManager::sendAndProcessDownlink(node, payloadBuffer, payloadSize, UPLINK_FPORT_HISTORY);
+        if (state != RADIOLIB_ERR_NONE) {
+            DEBUG_PRINTF("Error en transmisión: %d\n", state);
+            // En la cola va un bloque que se pueda reenviar a cualquier data rate
+            size_t queueLimit = LoRaManager::queuedPayloadLimit();
+            if (payloadSize > queueLimit) {
+                while (samples > 0 && (payloadSize = SeriesCodec::encode(uplinkHistory.schemaHash,
+                                                                         uplinkHistory.timestamps,
+                                                                         uplinkHistory.values, samples,
+                                                                         uplinkHistory.seriesCount,
+                                                                         payloadBuffer, queueLimit)) == 0) {
+                    samples--;
+                }
+            }
+            if (payloadSize > 0 && LoRaManager::queueUplink(UPLINK_FPORT_HISTORY, uplinkHistory.timestamps[0],
+                                                        payloadBuffer, payloadSize)) {
+                LoRaManager::dropHistorySamples(samples);
+            }
+            break;
+        }
+        DEBUG_PRINTLN("Transmisión exitosa!");
+        LoRaManager::dropHistorySamples(samples);
+    }
+}
+#endif
+
+/**
+ * @brief Reenvía los uplinks más antiguos de la cola persistente como uplinks confirmados:
+ *        hasta UPLINK_QUEUE_DRAIN_MAX y UPLINK_QUEUE_AIRTIME_MS de tiempo en aire, y sin
+ *        bajar el presupuesto del nodo del umbral de envíos opcionales. Se detiene en el
+ *        primero que no se confirma. Uno que no cabe en el data rate actual (grabado antes
+ *        de limitar la cola a LINK_MIN_DATARATE) pasa al final, detrás de los que sí caben.
+ * @param node Referencia al nodo LoRaWAN
+ * @return Uplinks entregados
+ */
+uint16_t LoRaManager::drainUplinkQueue(LoRaNode& node) {
+    QueuedUplink uplink;
+    uint32_t airtimeMs = 0;
+    uint16_t delivered = 0;
+    uint16_t moved = 0;
+
+    while (delivered < UPLINK_QUEUE_DRAIN_MAX && UplinkQueue::peek(uplink)) {
+        if (uplink.length > node.getMaxPayloadLen()) {
+            // Se recorrió la cola entera sin encontrar uno que quepa
+            if (moved >= UplinkQueue::size()) {
+                break;
+            }
+            DEBUG_PRINTF("Uplink en cola de %u bytes aplazado: supera el payload máximo (%u)\n",
+                         uplink.length, (unsigned)node.getMaxPayloadLen());
+            // Se graba la copia antes de quitarlo; si la cola estaba llena, grabarla ya
+            // descartó el original junto con los más antiguos
+            uint32_t dropped = UplinkQueue::dropped();
+            if (!UplinkQueue::push(uplink.fPort, uplink.timestamp, uplink.payload, uplink.length)) {
+                break;
+            }
+            if (UplinkQueue::dropped() == dropped) {
+                UplinkQueue::pop();
+            }
+            moved++;
+            continue;
+        }
+        uint32_t frameAirtimeMs = AirtimeBudget::uplinkTimeOnAirUs(uplink.length, currentDatarate) / 1000;
+        if (airtimeMs + frameAirtimeMs > UPLINK_QUEUE_AIRTIME_MS || AirtimeBudget::low()) {
+            break;
+        }
+        airtimeMs += frameAirtimeMs;
+
+        DEBUG_PRINTF("Reenviando uplink en cola (puerto %u, medido en %lu, %u bytes, %u pendientes)\n",
+                     uplink.fPort, (unsigned long)uplink.timestamp, uplink.length, UplinkQueue::size());
+        int16_t state = LoRaManager::sendAndProcessDownlink(node, uplink.payload, uplink.length,
+                                                            uplink.fPort, true);
+        if (state != RADIOLIB_ERR_NONE) {
+            DEBUG_PRINTF("Uplink en cola sin confirmar: %d\n", state);
+            break;
+        }
+        UplinkQueue::pop();
+        delivered++;
+
+        // El servidor toma este keyframe como referencia: el próximo frame no puede ser delta
+        if (uplink.fPort == UPLINK_FPORT_BINARY) {
+            uplinkReference.valid = false;
+        }
+    }
+    return delivered;
+}
+
+/**
+ * @brief Guarda en la cola persistente un uplink que no se pudo entregar.
+ * @return true si quedó guardado
+ */
+bool LoRaManager::queueUplink(uint8_t fPort, uint32_t timestamp, const uint8_t* payload, size_t size) {
+    if (!UplinkQueue::push(fPort, timestamp, payload, size)) {
+        DEBUG_PRINTLN("No se pudo guardar el uplink en la cola");
+        return false;
+    }
+    DEBUG_PRINTF("Uplink guardado en la cola (%u pendientes)\n", UplinkQueue::size());
+    return true;
+}
+
+/**
+ * @brief Guarda en la cola persistente los sensores indicados como keyframes: cada frame
+ *        se llena en el orden recibido con los que caben en queuedPayloadLimit() bytes.
+ * @return Sensores que no se pudieron guardar
+ */
+std::vector<size_t> LoRaManager::queueKeyframes(const std::vector<SensorReading>& normalReadings,
+                                                const std::vector<ModbusSensorReading>& modbusReadings,
+                                                float battery, uint32_t timestamp, uint16_t schemaHash,
+                                                const std::vector<size_t>& sensors) {
+    uint8_t payloadBuffer[MAX_LORA_PAYLOAD];
+    size_t maxPayload = LoRaManager::queuedPayloadLimit();
+    size_t sensorCount = normalReadings.size() + modbusReadings.size();
+    std::vector<size_t> pending = sensors;
+
+    // Sin sensores se guarda igual un frame (batería y timestamp)
+    for (bool first = true; first || !pending.empty(); first = false) {
+        std::vector<bool> selection(sensorCount, false);
+        std::vector<size_t> remaining;
+        UplinkFrame frame;
+        for (size_t index : pending) {
+            selection[index] = true;
+            if (PayloadCodec::encode(normalReadings, modbusReadings, battery, timestamp, uplinkSequence,
+                                     schemaHash, nullptr, frame, payloadBuffer, maxPayload, &selection) == 0) {
+                selection[index] = false;
+                remaining.push_back(index);
+            }
+        }
+
+        size_t payloadSize = PayloadCodec::encode(normalReadings, modbusReadings, battery, timestamp,
+                                                  uplinkSequence, schemaHash, nullptr, frame,
+                                                  payloadBuffer, maxPayload, &selection);
+        if (payloadSize == 0 || (!pending.empty() && remaining.size() == pending.size())) {
+            DEBUG_PRINTF("Error: ningún sensor cabe en un keyframe de %u bytes\n", (unsigned)maxPayload);
+            return pending;
+        }
+        if (!LoRaManager::queueUplink(UPLINK_FPORT_BINARY, timestamp, payloadBuffer, payloadSize)) {
+            return pending;
+        }
+        uplinkSequence++;
+        pending = remaining;
+    }
+    return pending;
+}
+
+/**
+ * @brief Payload máximo de los uplinks de la cola: el de LINK_MIN_DATARATE sin los FOpts
+ *        reservados, así ningún registro queda esperando un data rate más rápido.
+ */
+size_t LoRaManager::queuedPayloadLimit() {
+    size_t limit = AirtimeBudget::maxPayloadLen(LINK_MIN_DATARATE);
+    limit = (limit > UPLINK_QUEUE_FOPTS_RESERVE) ? limit - UPLINK_QUEUE_FOPTS_RESERVE : 0;
+    return min(limit, (size_t)MAX_LORA_PAYLOAD);
+}
+
+/**
+ * @brief Transmite el frame de control pendiente (confirmaciones y diagnóstico).
+ */
+void LoRaManager::sendControlFrame(LoRaNode& node) {
+    if (!DownlinkProcessor::hasControlFrame()) {
+        return;
+    }
+    uint8_t payloadBuffer[MAX_LORA_PAYLOAD];
+    size_t maxPayload = min((size_t)node.getMaxPayloadLen(), sizeof(payloadBuffer));
+    size_t payloadSize = DownlinkProcessor::buildControlFrame(payloadBuffer, maxPayload);
+    if (payloadSize == 0) {
+        return;
+    }
+
+    DEBUG_PRINTF("Enviando frame de control (%u bytes)\n", (unsigned)payloadSize);
+    int16_t state = LoRaManager::sendAndProcessDownlink(node, payloadBuffer, payloadSize, UPLINK_FPORT_CONTROL);
+    if (state == RADIOLIB_ERR_NONE) {
+        DownlinkProcessor::controlFrameSent();
+    } else {
+        DEBUG_PRINTF("Error enviando frame de control: %d\n", state);
+    }
+}
+
+/**
+ * @brief Transmite un uplink y atiende el downlink recibido en sus ventanas RX.
+ * @param confirmed true para pedir confirmación al servidor
+ * @return RADIOLIB_ERR_NONE si se transmitió (y, si se pidió, fue confirmado)
+ */
+int16_t LoRaManager::sendAndProcessDownlink(LoRaNode& node, uint8_t* payload, size_t size, uint8_t fPort,
+                                            bool confirmed) {
+    uint8_t downlinkPayload[255];
+    size_t downlinkSize = 0;
+    LoRaWANEvent_t eventDown = {};
+
+    // Sin presupuesto de tiempo en aire no se transmite (el llamador lo guarda o lo difiere)
+    uint32_t airtimeUs = AirtimeBudget::uplinkTimeOnAirUs(size, currentDatarate);
+    if (!AirtimeBudget::canSend(airtimeUs)) {
+        DEBUG_PRINTF("Sin presupuesto de tiempo en aire (%lu ms disponibles)\n",
+                     (unsigned long)AirtimeBudget::availableMs());
+        AirtimeBudget::deny();
+        return RADIOLIB_ERR_AIRTIME_BUDGET;
+    }
+
+    // sendReceive espera las ventanas RX1/RX2: un frame siguiente no pisa el downlink
+    ClockSync::uplinkStarting(airtimeUs);
+    int16_t state = node.sendReceive(payload, size, fPort, downlinkPayload, &downlinkSize, confirmed,
+                                     nullptr, &eventDown);
+    AirtimeBudget::consume(airtimeUs);
+    LinkAdapter::uplinkSent();
+
+    // Calidad del enlace: el downlink y la respuesta al LinkCheckReq que llevaba este uplink
+    if (state == RADIOLIB_ERR_NONE) {
+        LinkAdapter::downlinkReceived(node.getRSSI(), node.getSNR());
+    }
+    if (LinkAdapter::awaitingLinkCheck() && (state == RADIOLIB_ERR_NONE || state == RADIOLIB_ERR_RX_TIMEOUT)) {
+        uint8_t margin, gatewayCount;
+        if (state == RADIOLIB_ERR_NONE && node.getMacLinkCheckAns(&margin, &gatewayCount) == RADIOLIB_ERR_NONE) {
+            LinkAdapter::linkCheckAnswered(currentDatarate, margin, gatewayCount);
+        } else {
+            LinkAdapter::linkCheckLost(currentDatarate);
+        }
+    }
+    if (state == RADIOLIB_ERR_RX_TIMEOUT) {
+        // Sin downlink: el uplink se transmitió igual, pero sin confirmación
+        return confirmed ? state : RADIOLIB_ERR_NONE;
+    }
+    if (state == RADIOLIB_ERR_NONE && ClockSync::awaitingAnswer()) {
+        uint32_t unixEpoch;
+        uint8_t fraction;
+        if (node.getMacDeviceTimeAns(&unixEpoch, &fraction, true) == RADIOLIB_ERR_NONE) {
+            DEBUG_PRINTF("DeviceTime recibido: epoch = %lu s\n", (unsigned long)unixEpoch);
+            ClockSync::applyServerTime(unixEpoch, fraction);
+        }
+    }
+    if (state == RADIOLIB_ERR_NONE && downlinkSize > 0 && eventDown.port != DOWNLINK_FPORT_COMMAND) {
+        // Sólo el puerto de comandos lleva comandos: otro payload no se interpreta como tal
+        DEBUG_PRINTF("Downlink en puerto %u ignorado (%u bytes)\n", eventDown.port, (unsigned)downlinkSize);
+    } else if (state == RADIOLIB_ERR_NONE && downlinkSize > 0) {
+        DEBUG_PRINTF("Downlink recibido (%u bytes)\n", (unsigned)downlinkSize);
+        uint8_t actions = DownlinkProcessor::process(downlinkPayload, downlinkSize, eventDown.fcnt);
+        if (actions & DOWNLINK_ACTION_SEND_SCHEMA) {
+            // El servidor no conoce el esquema del último keyframe: reenviarlo en el próximo envío
+            DEBUG_PRINTLN("El servidor pide el esquema de sensores");
+            uplinkSchemaSent = false;
+        }
+    }
+    if (state == RADIOLIB_ERR_NONE && confirmed && !eventDown.confirming) {
+        // Hubo downlink pero no confirma este uplink
+        return RADIOLIB_ERR_RX_TIMEOUT;
+    }
+    return state;
+}
+
+/**
+ * @brief Agrega al próximo uplink DeviceTimeReq si el error previsto del RTC lo pide y
+ *        LinkCheckReq si toca evaluar el enlace.
+ */
+void LoRaManager::queueMacRequests(LoRaNode& node) {
+    if (ClockSync::syncDue() && node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_DEVICE_TIME)) {
+        DEBUG_PRINTLN("DeviceTimeReq agregado al próximo uplink");
+        ClockSync::syncRequested();
+    }
+#ifdef LINK_ADAPTATION
+    if (LinkAdapter::linkCheckDue() && node.sendMacCommandReq(RADIOLIB_LORAWAN_MAC_LINK_CHECK)) {
+        DEBUG_PRINTLN("LinkCheckReq agregado al próximo uplink");
+        LinkAdapter::linkCheckRequested();
+    }
+#endif
+}
+
+/**
+ * @brief Fija el data rate de los uplinks: el elegido por LinkAdapter (sin ADR de la red)
+ *        o, sin LINK_ADAPTATION, el data rate fijo indicado.
+ */
+void LoRaManager::applyUplinkDatarate(LoRaNode& node, uint8_t fixedDatarate) {
+#ifdef LINK_ADAPTATION
+    node.setADR(false);
+    LoRaManager::setDatarate(node, LinkAdapter::datarate());
+#else
+    LoRaManager::setDatarate(node, fixedDatarate);
+#endif
+}
+
+void LoRaManager::persistSession(LoRaNode& node) {
+    if (sessionActive) {
+        SessionStore::save(node.getBufferSession(), node.getFCntUp());
+    }
+}
+
 void LoRaManager::prepareForSleep(SX1262* radio) {
     if (radio) {
         radio->sleep(true);
     }
 }
 
-void LoRaManager::setDatarate(LoRaWANNode& node, uint8_t datarate) {
+void LoRaManager::setDatarate(LoRaNode& node, uint8_t datarate) {
     node.setDatarate(datarate);
+    currentDatarate = datarate;
 }
@@ -0,0 +1,69 @@
+#include "LoRaNode.h"
+
+RadioLibNode::RadioLibNode(LoRaWANNode& node, SX1262& radio) : node(node), radio(radio) {}
+
+void RadioLibNode::beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey, uint8_t* appKey) {
+    node.beginOTAA(joinEUI, devEUI, nwkKey, appKey);
+}
+
+int16_t RadioLibNode::activateOTAA(uint8_t datarate) {
+    return node.activateOTAA(datarate);
+}
+
+uint8_t* RadioLibNode::getBufferNonces() {
+    return node.getBufferNonces();
+}
+
+int16_t RadioLibNode::setBufferNonces(uint8_t* buffer) {
+    return node.setBufferNonces(buffer);
+}
+
+uint8_t* RadioLibNode::getBufferSession() {
+    return node.getBufferSession();
+}
+
+int16_t RadioLibNode::setBufferSession(uint8_t* buffer) {
+    return node.setBufferSession(buffer);
+}
+
+int16_t RadioLibNode::sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown,
+                                  size_t* lenDown, bool confirmed,
+                                  LoRaWANEvent_t* eventUp, LoRaWANEvent_t* eventDown) {
+    return node.sendReceive(dataUp, lenUp, fPort, dataDown, lenDown, confirmed, eventUp, eventDown);
+}
+
+bool RadioLibNode::sendMacCommandReq(uint8_t cid) {
+    return node.sendMacCommandReq(cid);
+}
+
+int16_t RadioLibNode::getMacDeviceTimeAns(uint32_t* epoch, uint8_t* fraction, bool returnUnix) {
+    return node.getMacDeviceTimeAns(epoch, fraction, returnUnix);
+}
+
+int16_t RadioLibNode::getMacLinkCheckAns(uint8_t* margin, uint8_t* gatewayCount) {
+    return node.getMacLinkCheckAns(margin, gatewayCount);
+}
+
+uint8_t RadioLibNode::getMaxPayloadLen() {
+    return node.getMaxPayloadLen();
+}
+
+uint32_t RadioLibNode::getFCntUp() {
+    return node.getFCntUp();
+}
+
+int16_t RadioLibNode::setDatarate(uint8_t datarate) {
+    return node.setDatarate(datarate);
+}
+
+void RadioLibNode::setADR(bool enable) {
+    node.setADR(enable);
+}
+
+float RadioLibNode::getRSSI() {
+    return radio.getRSSI();
+}
+
+float RadioLibNode::getSNR() {
+    return radio.getSNR();
+}
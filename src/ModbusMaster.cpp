@@ -44,8 +44,13 @@ Creates class object; initialize it using ModbusMaster::begin().
 ModbusMaster::ModbusMaster(void)
 {
   _idle = 0;
+  _frameEnd = 0;
   _preTransmission = 0;
   _postTransmission = 0;
+  _bResponseInADU = false;
+  _u16ResponseTimeout = ku16MBResponseTimeout;
+  _u8ResponseBufferIndex = 0;
+  _u8ResponseBufferLength = 0;
 }
 
 /**
@@ -73,6 +78,21 @@ void ModbusMaster::begin(uint8_t slave, Stream &serial)
 }
 
 
+/**
+Set response timeout.
+
+Maximum time to wait for the complete response after the request has
+been sent. Defaults to ModbusMaster::ku16MBResponseTimeout.
+
+@param u16Timeout response timeout [milliseconds]
+@ingroup setup
+*/
+void ModbusMaster::setResponseTimeout(uint16_t u16Timeout)
+{
+  _u16ResponseTimeout = u16Timeout;
+}
+
+
 void ModbusMaster::beginTransmission(uint16_t u16Address)
 {
   _u16WriteAddress = u16Address;
@@ -153,7 +173,7 @@ uint16_t ModbusMaster::receive(void)
 {
   if (_u8ResponseBufferIndex < _u8ResponseBufferLength)
   {
-    return _u16ResponseBuffer[_u8ResponseBufferIndex++];
+    return responseWord(_u8ResponseBufferIndex++);
   }
   else
   {
@@ -183,6 +203,28 @@ void ModbusMaster::idle(void (*idle)())
   _idle = idle;
 }
 
+/**
+Set end-of-frame callback function.
+
+Once a response has started and the serial buffer is empty, this function
+is asked whether the line has gone silent since the last byte (3.5
+character times in Modbus RTU). It should report the UART's own receive
+timeout rather than software timing: a UART that hands bytes over in FIFO
+sized bursts leaves long pauses in the buffer while the frame is still on
+the wire. A truncated or malformed response then fails with
+ModbusMaster::ku8MBIncompleteFrame right away instead of waiting for the
+full response timeout.
+
+The callback must only report silence observed after the current request
+was sent (e.g. clear its flag from the preTransmission callback).
+
+@see ModbusMaster::ModbusMasterTransaction()
+*/
+void ModbusMaster::frameEnd(bool (*frameEnd)())
+{
+  _frameEnd = frameEnd;
+}
+
 /**
 Set pre-transmission callback function.
 
@@ -227,14 +269,7 @@ Retrieve data from response buffer.
 */
 uint16_t ModbusMaster::getResponseBuffer(uint8_t u8Index)
 {
-  if (u8Index < ku8MaxBufferSize)
-  {
-    return _u16ResponseBuffer[u8Index];
-  }
-  else
-  {
-    return 0xFFFF;
-  }
+  return responseWord(u8Index);
 }
 
 
@@ -248,6 +283,7 @@ void ModbusMaster::clearResponseBuffer()
 {
   uint8_t i;
   
+  _bResponseInADU = false;
   for (i = 0; i < ku8MaxBufferSize; i++)
   {
     _u16ResponseBuffer[i] = 0;
@@ -370,13 +406,17 @@ The register data in the response buffer is packed as one word per
 register.
 
 @param u16ReadAddress address of the first holding register (0x0000..0xFFFF)
-@param u16ReadQty quantity of holding registers to read (1..125, enforced by remote device)
+@param u16ReadQty quantity of holding registers to read (1..ku8MaxRegisterQty)
 @return 0 on success; exception number on failure
 @ingroup register
 */
 uint8_t ModbusMaster::readHoldingRegisters(uint16_t u16ReadAddress,
   uint16_t u16ReadQty)
 {
+  if (u16ReadQty == 0 || u16ReadQty > ku8MaxRegisterQty)
+  {
+    return ku8MBInvalidQuantity;
+  }
   _u16ReadAddress = u16ReadAddress;
   _u16ReadQty = u16ReadQty;
   return ModbusMasterTransaction(ku8MBReadHoldingRegisters);
@@ -395,13 +435,17 @@ The register data in the response buffer is packed as one word per
 register.
 
 @param u16ReadAddress address of the first input register (0x0000..0xFFFF)
-@param u16ReadQty quantity of input registers to read (1..125, enforced by remote device)
+@param u16ReadQty quantity of input registers to read (1..ku8MaxRegisterQty)
 @return 0 on success; exception number on failure
 @ingroup register
 */
 uint8_t ModbusMaster::readInputRegisters(uint16_t u16ReadAddress,
-  uint8_t u16ReadQty)
+  uint16_t u16ReadQty)
 {
+  if (u16ReadQty == 0 || u16ReadQty > ku8MaxRegisterQty)
+  {
+    return ku8MBInvalidQuantity;
+  }
   _u16ReadAddress = u16ReadAddress;
   _u16ReadQty = u16ReadQty;
   return ModbusMasterTransaction(ku8MBReadInputRegisters);
@@ -584,6 +628,35 @@ uint8_t ModbusMaster::readWriteMultipleRegisters(uint16_t u16ReadAddress,
 
 
 /* _____PRIVATE FUNCTIONS____________________________________________________ */
+/**
+Return a response word.
+
+Register responses are left in the ADU and decoded on access (bytes are
+ordered H, L, H, L, ...); coil/discrete input responses are unpacked into
+the response buffer by ModbusMasterTransaction().
+
+@param u8Index index of response word
+@return response word (0x0000..0xFFFF); 0xFFFF if out of range
+*/
+uint16_t ModbusMaster::responseWord(uint8_t u8Index)
+{
+  if (_bResponseInADU)
+  {
+    if (u8Index < _u8ResponseBufferLength)
+    {
+      return word(_u8ModbusADU[2 * u8Index + 3], _u8ModbusADU[2 * u8Index + 4]);
+    }
+    return 0xFFFF;
+  }
+  
+  if (u8Index < ku8MaxBufferSize)
+  {
+    return _u16ResponseBuffer[u8Index];
+  }
+  return 0xFFFF;
+}
+
+
 /**
 Modbus transaction engine.
 Sequence:
@@ -599,7 +672,7 @@ Sequence:
 */
 uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
 {
-  uint8_t u8ModbusADU[256];
+  uint8_t *u8ModbusADU = _u8ModbusADU;
   uint8_t u8ModbusADUSize = 0;
   uint8_t i, u8Qty;
   uint16_t u16CRC;
@@ -608,6 +681,7 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
   uint8_t u8MBStatus = ku8MBSuccess;
   
   // assemble Modbus Request Application Data Unit
+  _bResponseInADU = false;
   u8ModbusADU[u8ModbusADUSize++] = _u8MBSlave;
   u8ModbusADU[u8ModbusADUSize++] = u8MBFunction;
   
@@ -692,11 +766,7 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
   }
   
   // append CRC
-  u16CRC = 0xFFFF;
-  for (i = 0; i < u8ModbusADUSize; i++)
-  {
-    u16CRC = crc16_update(u16CRC, u8ModbusADU[i]);
-  }
+  u16CRC = crc16_modbus(u8ModbusADU, u8ModbusADUSize);
   u8ModbusADU[u8ModbusADUSize++] = lowByte(u16CRC);
   u8ModbusADU[u8ModbusADUSize++] = highByte(u16CRC);
   u8ModbusADU[u8ModbusADUSize] = 0;
@@ -730,7 +800,15 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
 #if __MODBUSMASTER_DEBUG__
       digitalWrite(__MODBUSMASTER_DEBUG_PIN_A__, true);
 #endif
-      u8ModbusADU[u8ModbusADUSize++] = _serial->read();
+      // a corrupt byte count cannot overrun the ADU; the CRC check rejects the frame
+      if (u8ModbusADUSize < sizeof(_u8ModbusADU) - 1)
+      {
+        u8ModbusADU[u8ModbusADUSize++] = _serial->read();
+      }
+      else
+      {
+        _serial->read();
+      }
       u8BytesLeft--;
 #if __MODBUSMASTER_DEBUG__
       digitalWrite(__MODBUSMASTER_DEBUG_PIN_A__, false);
@@ -741,6 +819,13 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
 #if __MODBUSMASTER_DEBUG__
       digitalWrite(__MODBUSMASTER_DEBUG_PIN_B__, true);
 #endif
+      // response started but the line went silent: the frame is over
+      // (re-check the buffer: the UART may have delivered its last burst meanwhile)
+      if (_frameEnd && u8ModbusADUSize && _frameEnd() && !_serial->available())
+      {
+        u8MBStatus = ku8MBIncompleteFrame;
+        break;
+      }
       if (_idle)
       {
         _idle();
@@ -797,7 +882,7 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
           break;
       }
     }
-    if ((millis() - u32StartTime) > ku16MBResponseTimeout)
+    if ((millis() - u32StartTime) > _u16ResponseTimeout)
     {
       u8MBStatus = ku8MBResponseTimedOut;
     }
@@ -807,11 +892,7 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
   if (!u8MBStatus && u8ModbusADUSize >= 5)
   {
     // calculate CRC
-    u16CRC = 0xFFFF;
-    for (i = 0; i < (u8ModbusADUSize - 2); i++)
-    {
-      u16CRC = crc16_update(u16CRC, u8ModbusADU[i]);
-    }
+    u16CRC = crc16_modbus(u8ModbusADU, u8ModbusADUSize - 2);
     
     // verify CRC
     if (!u8MBStatus && (lowByte(u16CRC) != u8ModbusADU[u8ModbusADUSize - 2] ||
@@ -855,16 +936,9 @@ uint8_t ModbusMaster::ModbusMasterTransaction(uint8_t u8MBFunction)
       case ku8MBReadInputRegisters:
       case ku8MBReadHoldingRegisters:
       case ku8MBReadWriteMultipleRegisters:
-        // load bytes into word; response bytes are ordered H, L, H, L, ...
-        for (i = 0; i < (u8ModbusADU[2] >> 1); i++)
-        {
-          if (i < ku8MaxBufferSize)
-          {
-            _u16ResponseBuffer[i] = word(u8ModbusADU[2 * i + 3], u8ModbusADU[2 * i + 4]);
-          }
-          
-          _u8ResponseBufferLength = i;
-        }
+        // words stay in the ADU and are decoded on access (no copy)
+        _bResponseInADU = true;
+        _u8ResponseBufferLength = u8ModbusADU[2] >> 1;
         break;
     }
   }
@@ -1,5 +1,5 @@
 #include "ModbusSensorManager.h"
-#include "config.h"    // Para MODBUS_BAUD_RATE y MODBUS_SERIAL_CONFIG
+#include "config.h"    // Para MODBUS_SERIAL_CONFIG y DEFAULT_MODBUS_BUS_CONFIGS
 
 #if defined(DEVICE_TYPE_ANALOGIC) || defined(DEVICE_TYPE_MODBUS)
 
@@ -8,12 +8,100 @@
 #include "sensor_types.h" // Para todos los tipos y constantes de sensores
 #include "utilities.h"
 #include <string.h>
+#include <algorithm>
 
-// Crear una instancia global de ModbusMaster
-ModbusMaster modbus;
+// Buses RS485 configurados (UART, pines y velocidad)
+static const ModbusBusConfig modbusBusConfigs[] = DEFAULT_MODBUS_BUS_CONFIGS;
+static const uint8_t modbusBusCount = min((uint8_t)(sizeof(modbusBusConfigs) / sizeof(modbusBusConfigs[0])),
+                                          (uint8_t)MODBUS_MAX_BUSES);
 
-// Definir Serial2 para la comunicación Modbus
-HardwareSerial modbusSerial(2); // Usar Serial2 para comunicación Modbus
+/**
+ * @brief Contexto de un bus: cada uno tiene su maestro, su UART y su semáforo de fin
+ *        de trama, de modo que dos buses pueden sondearse a la vez desde tareas distintas.
+ */
+struct ModbusBus {
+    ModbusMaster master;
+    HardwareSerial* serial;
+    SemaphoreHandle_t rxSemaphore;    // Liberado por la UART al detectar silencio (fin de trama)
+    volatile bool frameEnded;         // Evento de timeout RX recibido desde el último envío
+    uint32_t baudRate;                // Velocidad del bus, para el tiempo de línea de cada trama
+    ModbusBusStats stats;             // Estadísticas del ciclo en curso
+};
+static ModbusBus modbusBuses[MODBUS_MAX_BUSES];
+
+/**
+ * @brief Trabajo de sondeo de un bus: sensores asignados, su posición en la lista
+ *        original y el semáforo que avisa al terminar.
+ */
+struct ModbusBusJob {
+    std::vector<ModbusSensorConfig> sensors;
+    std::vector<size_t> index;
+    std::vector<ModbusSensorReading> readings;
+    const std::vector<ModbusDeviceDescriptor>* descriptors;
+    SemaphoreHandle_t done;
+};
+
+// Estado de salud por esclavo y contador de ciclos, sobreviven al deep sleep
+RTC_DATA_ATTR ModbusSlaveHealth modbusSlaveHealth[MODBUS_MAX_SLAVES] = {};
+RTC_DATA_ATTR uint32_t modbusPollCycle = 0;
+
+// Protege la asignación de entradas de salud entre las tareas de los buses
+static portMUX_TYPE modbusHealthMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Inventario de la última búsqueda (cargado en cada ciclo desde NVS)
+static bool modbusInventoryActive = false;
+static uint8_t modbusInventoryFirst = 0;
+static uint8_t modbusInventoryLast = 0;
+static std::vector<ModbusInventoryEntry> modbusInventory;
+
+/**
+ * @brief Callback de la UART: se ejecuta al vencer el timeout RX, es decir,
+ *        cuando la línea queda en silencio tras recibir datos.
+ */
+template <uint8_t BUS>
+static void onModbusReceive() {
+    // La UART ya volcó su FIFO al buffer antes de avisar: la trama está completa o truncada
+    modbusBuses[BUS].frameEnded = true;
+    if (modbusBuses[BUS].rxSemaphore) {
+        xSemaphoreGive(modbusBuses[BUS].rxSemaphore);
+    }
+}
+
+/**
+ * @brief Callback idle de ModbusMaster: en lugar de sondear available() en un bucle,
+ *        bloquea la tarea hasta el evento de la UART (la CPU queda libre para dormir).
+ */
+template <uint8_t BUS>
+static void waitForModbusData() {
+    if (modbusBuses[BUS].rxSemaphore) {
+        xSemaphoreTake(modbusBuses[BUS].rxSemaphore, pdMS_TO_TICKS(MODBUS_RX_WAIT_SLICE_MS));
+    }
+}
+
+/**
+ * @brief Callback preTransmission de ModbusMaster: descarta el evento de fin de trama
+ *        de la respuesta anterior antes de enviar la petición.
+ */
+template <uint8_t BUS>
+static void armModbusFrameEnd() {
+    modbusBuses[BUS].frameEnded = false;
+}
+
+/**
+ * @brief Callback frameEnd de ModbusMaster: fin de trama según el timeout RX de la UART.
+ *        Con onReceive(cb, true) la FIFO solo se vuelca cada 120 bytes o al vencer el
+ *        timeout, así que medir pausas en el buffer cortaría las respuestas largas.
+ */
+template <uint8_t BUS>
+static bool hasModbusFrameEnded() {
+    return modbusBuses[BUS].frameEnded;
+}
+
+// Los callbacks no reciben contexto: una instancia por bus
+static void (*const modbusReceiveCallbacks[MODBUS_MAX_BUSES])() = {onModbusReceive<0>, onModbusReceive<1>};
+static void (*const modbusIdleCallbacks[MODBUS_MAX_BUSES])() = {waitForModbusData<0>, waitForModbusData<1>};
+static void (*const modbusArmCallbacks[MODBUS_MAX_BUSES])() = {armModbusFrameEnd<0>, armModbusFrameEnd<1>};
+static bool (*const modbusFrameEndCallbacks[MODBUS_MAX_BUSES])() = {hasModbusFrameEnded<0>, hasModbusFrameEnded<1>};
 
 /**
  * @note 
@@ -23,122 +111,649 @@ HardwareSerial modbusSerial(2); // Usar Serial2 para comunicación Modbus
  */
 
 void ModbusSensorManager::beginModbus() {
-    // Configurar Serial2 usando los parámetros definidos en config.h
-    modbusSerial.begin(MODBUS_BAUD_RATE, MODBUS_SERIAL_CONFIG, MODBUS_RX_PIN, MODBUS_TX_PIN);
-    
-    // Inicializar ModbusMaster con Serial2
-    modbus.begin(0, modbusSerial); // El slave ID se configurará en cada petición
+    for (uint8_t b = 0; b < modbusBusCount; b++) {
+        const ModbusBusConfig& config = modbusBusConfigs[b];
+        ModbusBus& bus = modbusBuses[b];
+
+        if (bus.serial == nullptr) {
+            bus.serial = new HardwareSerial(config.uart);
+        }
+        bus.serial->begin(config.baudRate, MODBUS_SERIAL_CONFIG, config.rxPin, config.txPin);
+        bus.baudRate = config.baudRate;
+
+        // Fin de trama por silencio: la UART avisa tras MODBUS_RX_TIMEOUT_SYMBOLS caracteres sin datos
+        if (bus.rxSemaphore == nullptr) {
+            bus.rxSemaphore = xSemaphoreCreateBinary();
+        }
+        bus.serial->setRxTimeout(MODBUS_RX_TIMEOUT_SYMBOLS);
+        bus.serial->onReceive(modbusReceiveCallbacks[b], true);
+
+        // El slave ID se configurará en cada petición
+        bus.master.begin(0, *bus.serial);
+        bus.master.idle(modbusIdleCallbacks[b]);
+        bus.master.preTransmission(modbusArmCallbacks[b]);
+        bus.master.frameEnd(modbusFrameEndCallbacks[b]);
+
+        bus.stats = {};
+    }
 }
 
 void ModbusSensorManager::endModbus() {
-    // Finalizar la comunicación Serial2 de Modbus
-    modbusSerial.end();
+    for (uint8_t b = 0; b < modbusBusCount; b++) {
+        ModbusBus& bus = modbusBuses[b];
+        const ModbusBusStats& stats = bus.stats;
+        DEBUG_PRINTF("Bus Modbus %u: %u peticiones (%u fallidas) en %lu ms, %.1f peticiones/s, peor detección de fallo %lu ms\n",
+                     b, stats.transactions, stats.failures, (unsigned long)stats.busTimeMs,
+                     stats.busTimeMs ? stats.transactions * 1000.0f / stats.busTimeMs : 0.0f,
+                     (unsigned long)stats.worstFailureMs);
+
+        // Finalizar la UART del bus
+        if (bus.serial) {
+            bus.serial->onReceive(NULL);
+            bus.serial->end();
+        }
+    }
+}
+
+uint8_t ModbusSensorManager::getBusCount() {
+    return modbusBusCount;
+}
+
+const ModbusBusStats& ModbusSensorManager::getBusStats(uint8_t bus) {
+    return modbusBuses[bus < modbusBusCount ? bus : 0].stats;
+}
+
+uint8_t ModbusSensorManager::timedRead(uint8_t bus, uint8_t functionCode, uint16_t startReg, uint16_t numRegs) {
+    ModbusBus& context = modbusBuses[bus];
+    uint32_t startTime = millis();
+    uint8_t result = (functionCode == 0x04)
+        ? context.master.readInputRegisters(startReg, numRegs)
+        : context.master.readHoldingRegisters(startReg, numRegs);
+
+    // Cantidad rechazada localmente: no salió nada al bus
+    if (result == ModbusMaster::ku8MBInvalidQuantity) {
+        return result;
+    }
+    context.stats.transactions++;
+    context.stats.busTimeMs += millis() - startTime;
+    if (result != ModbusMaster::ku8MBSuccess) {
+        context.stats.failures++;
+    }
+    return result;
+}
+
+void ModbusSensorManager::startCycle() {
+    modbusPollCycle++;
+}
+
+void ModbusSensorManager::useInventory(uint8_t firstAddress, uint8_t lastAddress,
+                                       const std::vector<ModbusInventoryEntry>& devices) {
+    modbusInventoryActive = true;
+    modbusInventoryFirst = firstAddress;
+    modbusInventoryLast = lastAddress;
+    modbusInventory = devices;
+}
+
+bool ModbusSensorManager::isSlaveAvailable(uint8_t bus, uint8_t address) {
+    // Bus no configurado: no hay UART donde preguntar
+    if (bus >= modbusBusCount) {
+        return false;
+    }
+
+    ModbusSlaveHealth& health = getSlaveHealth(bus, address);
+
+    // Dirección buscada que no respondió: un solo sondeo pudo fallar (arranque lento, trama
+    // con ruido), así que no se excluye sino que empieza con el circuito abierto. Si ya
+    // respondió desde la búsqueda (srtt medido y circuito cerrado) se sondea normalmente.
+    if (modbusInventoryActive && address >= modbusInventoryFirst && address <= modbusInventoryLast) {
+        bool found = false;
+        for (const auto& device : modbusInventory) {
+            if (device.bus == bus && device.address == address) {
+                found = true;
+                break;
+            }
+        }
+        if (!found && health.retryCycle == 0 && health.srttMs == 0) {
+            health.failures = MODBUS_BREAKER_THRESHOLD;
+            health.openCount = 1;
+            health.retryCycle = modbusPollCycle + MODBUS_BREAKER_BASE_SKIP;
+            DEBUG_PRINTF("Esclavo %u/%u no inventariado: se reintenta en %u ciclos\n", bus, address,
+                         MODBUS_BREAKER_BASE_SKIP);
+        }
+    }
+
+    return health.retryCycle == 0 || modbusPollCycle >= health.retryCycle;
 }
 
-bool ModbusSensorManager::readHoldingRegisters(uint8_t address, uint16_t startReg, uint16_t numRegs, uint16_t* outData) {
-    // Guardar los bytes recibidos para depuración posterior
-    uint8_t result;
+uint8_t ModbusSensorManager::readRegisters(uint8_t bus, uint8_t address, uint8_t functionCode, uint16_t startReg,
+                                           uint16_t numRegs, uint16_t* outData) {
+    uint8_t result = ModbusMaster::ku8MBResponseTimedOut;
+
+    // Fuera del inventario o circuito abierto: no gastar tiempo de bus
+    if (!isSlaveAvailable(bus, address)) {
+        DEBUG_PRINTF("Esclavo %u/%u omitido (bus no configurado o circuito abierto)\n",
+                     bus, address);
+        return result;
+    }
+    ModbusSlaveHealth& health = getSlaveHealth(bus, address);
+    ModbusMaster& modbus = modbusBuses[bus].master;
     
-    // Establecer el slave ID
-    modbus.begin(address, modbusSerial);
+    // Establecer el slave ID y el timeout estimado para este esclavo
+    modbus.begin(address, *modbusBuses[bus].serial);
+    modbus.setResponseTimeout(responseTimeoutFor(health, numRegs));
     
-    // Implementar reintentos de lectura
-    for (uint8_t retry = 0; retry < MODBUS_MAX_RETRY; retry++) {
-        // Registrar el tiempo de inicio para implementar timeout manual
+    // En la prueba de un circuito abierto basta un intento
+    uint8_t attempts = (health.retryCycle != 0) ? 1 : MODBUS_MAX_RETRY;
+    uint32_t firstAttemptTime = millis();
+    for (uint8_t retry = 0; retry < attempts; retry++) {
         uint32_t startTime = millis();
         
-        // Realizar la petición Modbus para leer registros holding
-        result = modbus.readHoldingRegisters(startReg, numRegs);
+        // Realizar la petición Modbus según la función del mapa (0x04 input, 0x03 holding)
+        result = timedRead(bus, functionCode, startReg, numRegs);
+
+        // Petición mal formada: no dice nada del esclavo, ni éxito ni fallo
+        if (result == modbus.ku8MBInvalidQuantity) {
+            DEBUG_PRINTF("Lectura de %u registros desde %u no válida, no se envía\n", numRegs, startReg);
+            return result;
+        }
         
         // Verificar si la lectura fue exitosa
         if (result == modbus.ku8MBSuccess) {
+            recordSuccess(health, millis() - startTime, MODBUS_RESPONSE_BYTES(numRegs));
+
             // Extraer datos de los registros
-            for (uint8_t i = 0; i < numRegs; i++) {
+            for (uint16_t i = 0; i < numRegs; i++) {
                 outData[i] = modbus.getResponseBuffer(i);
             }
             
-            return true;
+            return result;
         }
-        
-        // Verificar si se agotó el tiempo (timeout personalizado)
-        if ((millis() - startTime) >= MODBUS_RESPONSE_TIMEOUT) {
-            DEBUG_PRINTLN("Timeout en comunicación Modbus");
-            break; // Salir del bucle de reintentos si se agota el tiempo
+
+        // Respuesta de excepción: el esclavo está vivo pero rechaza el bloque, reintentar no sirve
+        if (result >= modbus.ku8MBIllegalFunction && result <= modbus.ku8MBSlaveDeviceFailure) {
+            recordSuccess(health, millis() - startTime, MODBUS_EXCEPTION_BYTES);
+            DEBUG_PRINTF("Esclavo %u/%u rechazó registros %u..%u, excepción: %d\n",
+                         bus, address, startReg, startReg + numRegs - 1, result);
+            return result;
         }
         
-        // Si no es el último intento, continuar con el siguiente intento
         DEBUG_PRINTF("Intento %d fallido, código: %d\n", retry + 1, result);
     }
     
     // Si llegamos aquí, todos los intentos fallaron
-    DEBUG_PRINTF("Error Modbus después de %d intentos\n", MODBUS_MAX_RETRY);
-    return false;
+    ModbusBusStats& stats = modbusBuses[bus].stats;
+    stats.worstFailureMs = max(stats.worstFailureMs, (uint32_t)(millis() - firstAttemptTime));
+    recordFailure(health);
+    DEBUG_PRINTF("Error Modbus después de %d intentos\n", attempts);
+    return result;
 }
 
-ModbusSensorReading ModbusSensorManager::readEnvSensor(const ModbusSensorConfig &cfg) {
-    ModbusSensorReading reading;
-    strncpy(reading.sensorId, cfg.sensorId, sizeof(reading.sensorId));
-    reading.type = cfg.type;
-    reading.subValues.clear();
+ModbusSlaveHealth& ModbusSensorManager::getSlaveHealth(uint8_t bus, uint8_t address) {
+    ModbusSlaveHealth* found = nullptr;
+    ModbusSlaveHealth* freeSlot = nullptr;
 
-    // Lectura de 8 registros (500..507)
-    const uint16_t startReg = 500;
-    const uint16_t numRegs = 8;
-    uint16_t rawData[8];
-    memset(rawData, 0, sizeof(rawData));
-    
-    bool ok = readHoldingRegisters(cfg.address, startReg, numRegs, rawData);
-    if (!ok) {
-        // Llenar con NAN si falló
-        // Respetamos el orden: [0]=Humedad, [1]=Temperatura, [2]=Presión, [3]=Iluminación
-        for (int i=0; i<4; i++){
-            SubValue sv;
-            sv.value = NAN;
-            reading.subValues.push_back(sv);
+    portENTER_CRITICAL(&modbusHealthMux);
+    for (auto& health : modbusSlaveHealth) {
+        if (health.address == address && health.bus == bus) {
+            found = &health;
+            break;
         }
-        return reading;
+        if (health.address == 0 && freeSlot == nullptr) {
+            freeSlot = &health;
+        }
+    }
+    if (found == nullptr && freeSlot != nullptr) {
+        *freeSlot = {};
+        freeSlot->bus = bus;
+        freeSlot->address = address;
+        found = freeSlot;
+    }
+    portEXIT_CRITICAL(&modbusHealthMux);
+
+    if (found == nullptr) {
+        // Tabla llena: estado temporal por bus, no se conserva entre ciclos
+        static ModbusSlaveHealth overflow[MODBUS_MAX_BUSES];
+        found = &overflow[bus < MODBUS_MAX_BUSES ? bus : 0];
+        *found = {};
+        found->bus = bus;
+        found->address = address;
     }
+    return *found;
+}
+
 
-    // Extraer según datasheet (versión 4 en 1):
-    // rawData[0] = Humedad entera *10
-    // rawData[1] = Temp entera *10 (16 bits con posible signo)
-    // rawData[5] = Presión *10 (en kPa)
-    // rawData[6] = LuxHigh (32 bits -> parte alta)
-    // rawData[7] = LuxLow  (32 bits -> parte baja)
-    // Los demás registros (ruido, PM2.5, PM10) vienen en 0 y se ignoran
+uint32_t ModbusSensorManager::wireTimeMs(uint8_t bus, uint16_t bytes) {
+    uint32_t baud = modbusBuses[bus].baudRate ? modbusBuses[bus].baudRate : 9600;
+    // 11 bits por carácter (inicio, 8 datos, paridad o segundo stop, stop), redondeado hacia arriba
+    return ((uint32_t)bytes * 11000UL + baud - 1) / baud;
+}
 
-    // Agregar Humedad como primer valor [0]
-    {
-        SubValue sH;
-        sH.value = rawData[0] / 10.0f;
-        reading.subValues.push_back(sH);
+uint16_t ModbusSensorManager::responseTimeoutFor(const ModbusSlaveHealth& health, uint16_t numRegs) {
+    uint32_t turnaround = MODBUS_RESPONSE_TIMEOUT;
+    if (health.srttMs != 0) {
+        turnaround = constrain((uint32_t)health.srttMs + 4UL * health.rttVarMs,
+                               (uint32_t)MODBUS_MIN_RESPONSE_TIMEOUT, (uint32_t)MODBUS_RESPONSE_TIMEOUT);
     }
-    
-    // Agregar Temperatura como segundo valor [1]
-    {
-        SubValue sT;
-        // Ver si es negativo
-        int16_t temp16 = (int16_t)rawData[1];
-        sT.value = temp16 / 10.0f;
-        reading.subValues.push_back(sT);
+    // El timeout cuenta desde el fin del envío hasta el último byte: nunca por debajo del tiempo de línea
+    uint32_t timeout = turnaround + wireTimeMs(health.bus, MODBUS_RESPONSE_BYTES(numRegs));
+    return (uint16_t)min(timeout, (uint32_t)UINT16_MAX);
+}
+
+void ModbusSensorManager::recordSuccess(ModbusSlaveHealth& health, uint32_t elapsedMs, uint16_t responseBytes) {
+    // Solo se estima la reacción del esclavo: se descuenta la petición y la respuesta en la línea
+    uint32_t wire = wireTimeMs(health.bus, MODBUS_REQUEST_BYTES + responseBytes);
+    uint32_t turnaround = (elapsedMs > wire) ? (elapsedMs - wire) : 0;
+    uint16_t rtt = (uint16_t)constrain(turnaround, (uint32_t)1, (uint32_t)UINT16_MAX);
+
+    // Estimador tipo RFC 6298: srtt = 7/8·srtt + 1/8·rtt, rttvar = 3/4·rttvar + 1/4·|srtt - rtt|
+    if (health.srttMs == 0) {
+        health.srttMs = rtt;
+        health.rttVarMs = rtt / 2;
+    } else {
+        uint16_t delta = (health.srttMs > rtt) ? (health.srttMs - rtt) : (rtt - health.srttMs);
+        health.rttVarMs = (uint16_t)((3UL * health.rttVarMs + delta) / 4);
+        health.srttMs = (uint16_t)((7UL * health.srttMs + rtt) / 8);
     }
-    
-    // Agregar Presión Atmosférica como tercer valor [2]
-    {
-        SubValue sP;
-        sP.value = rawData[5] / 10.0f;
-        reading.subValues.push_back(sP);
+
+    health.failures = 0;
+    health.openCount = 0;
+    health.retryCycle = 0;
+}
+
+void ModbusSensorManager::recordFailure(ModbusSlaveHealth& health) {
+    if (health.failures < UINT8_MAX) {
+        health.failures++;
     }
-    
-    // Agregar Iluminación como cuarto valor [3]
-    {
-        SubValue sL;
-        uint32_t lux = ((uint32_t)rawData[6] << 16) | rawData[7];
-        sL.value = (float)lux;
-        reading.subValues.push_back(sL);
+    if (health.failures < MODBUS_BREAKER_THRESHOLD) {
+        return;
+    }
+
+    // Abrir (o reabrir) el circuito con backoff exponencial
+    if (health.openCount < 16) {
+        health.openCount++;
+    }
+    uint32_t skip = min((uint32_t)MODBUS_BREAKER_BASE_SKIP << (health.openCount - 1),
+                        (uint32_t)MODBUS_BREAKER_MAX_SKIP);
+    health.retryCycle = modbusPollCycle + skip;
+    DEBUG_PRINTF("Esclavo %u/%u sin respuesta: circuito abierto por %lu ciclos\n", health.bus,
+                 health.address, (unsigned long)skip);
+}
+
+bool ModbusSensorManager::probeReady(uint8_t bus, uint8_t address, const ModbusDeviceDescriptor& descriptor) {
+    const ModbusValueDescriptor& value = descriptor.values[descriptor.readyValue];
+    uint8_t words = (value.dataType >= MB_UINT32) ? 2 : 1;
+    ModbusMaster& modbus = modbusBuses[bus].master;
+
+    modbus.begin(address, *modbusBuses[bus].serial);
+    modbus.setResponseTimeout(MODBUS_READY_POLL_TIMEOUT + wireTimeMs(bus, MODBUS_RESPONSE_BYTES(words)));
+    uint8_t result = timedRead(bus, descriptor.functionCode, value.reg, words);
+    if (result != modbus.ku8MBSuccess) {
+        return false;
+    }
+
+    uint16_t raw[2] = {modbus.getResponseBuffer(0), modbus.getResponseBuffer(1)};
+    float decoded = decodeValue(value, raw);
+    return !isnan(decoded) && decoded >= descriptor.readyMin && decoded <= descriptor.readyMax;
+}
+
+void ModbusSensorManager::readSensorsWhenReady(const std::vector<ModbusSensorConfig>& sensors,
+                                               const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                               std::vector<ModbusSensorReading>& readings) {
+    // Repartir los sensores por bus (un bus no configurado se resuelve en el bus 0 como no disponible)
+    ModbusBusJob jobs[MODBUS_MAX_BUSES];
+    for (size_t i = 0; i < sensors.size(); i++) {
+        uint8_t bus = (sensors[i].bus < modbusBusCount) ? sensors[i].bus : 0;
+        jobs[bus].sensors.push_back(sensors[i]);
+        jobs[bus].index.push_back(i);
+    }
+
+    // Cada bus adicional en su tarea; el bus 0 en la tarea actual
+    for (uint8_t b = 0; b < modbusBusCount; b++) {
+        jobs[b].descriptors = &descriptors;
+        jobs[b].done = nullptr;
+        if (b == 0 || jobs[b].sensors.empty()) {
+            continue;
+        }
+        jobs[b].done = xSemaphoreCreateBinary();
+        if (jobs[b].done == nullptr ||
+            xTaskCreate(busTask, "modbusBus", MODBUS_BUS_TASK_STACK, &jobs[b],
+                        uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+            // Sin memoria para la tarea: este bus se sondea después del bus 0
+            if (jobs[b].done) {
+                vSemaphoreDelete(jobs[b].done);
+            }
+            jobs[b].done = nullptr;
+            DEBUG_PRINTF("Bus Modbus %u: no se pudo crear la tarea, sondeo secuencial\n", b);
+        }
+    }
+
+    pollWhenReady(jobs[0].sensors, descriptors, jobs[0].readings);
+
+    std::vector<ModbusSensorReading> results(sensors.size());
+    for (uint8_t b = 0; b < modbusBusCount; b++) {
+        if (jobs[b].done) {
+            xSemaphoreTake(jobs[b].done, portMAX_DELAY);
+            vSemaphoreDelete(jobs[b].done);
+        } else if (b > 0) {
+            pollWhenReady(jobs[b].sensors, descriptors, jobs[b].readings);
+        }
+
+        // Devolver las lecturas en el orden de la lista original
+        for (size_t k = 0; k < jobs[b].index.size(); k++) {
+            results[jobs[b].index[k]] = jobs[b].readings[k];
+        }
+    }
+
+    readings.insert(readings.end(), results.begin(), results.end());
+}
+
+void ModbusSensorManager::busTask(void* param) {
+    ModbusBusJob* job = static_cast<ModbusBusJob*>(param);
+    pollWhenReady(job->sensors, *job->descriptors, job->readings);
+    xSemaphoreGive(job->done);
+    vTaskDelete(NULL);
+}
+
+void ModbusSensorManager::pollWhenReady(const std::vector<ModbusSensorConfig>& sensors,
+                                        const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                        std::vector<ModbusSensorReading>& readings) {
+    std::vector<ModbusSensorReading> results(sensors.size());
+    std::vector<bool> done(sensors.size(), false);
+    size_t remaining = sensors.size();
+    uint32_t powerOnTime = millis();
+
+    while (remaining > 0) {
+        uint32_t elapsed = millis() - powerOnTime;
+
+        for (size_t i = 0; i < sensors.size(); i++) {
+            if (done[i]) {
+                continue;
+            }
+
+            // Sin mapa o esclavo en espera: se resuelve sin esperar (lectura vacía o NAN)
+            const ModbusDeviceDescriptor* descriptor = findDescriptor(descriptors, sensors[i].type);
+            bool ready = (descriptor == nullptr) || !isSlaveAvailable(sensors[i].bus, sensors[i].address) ||
+                         elapsed >= descriptor->maxWait;
+            if (!ready && descriptor->readyValue < descriptor->valueCount) {
+                ready = probeReady(sensors[i].bus, sensors[i].address, *descriptor);
+            }
+            if (!ready) {
+                continue;
+            }
+
+            // Leer juntos todos los sensores pendientes del mismo esclavo
+            std::vector<ModbusSensorConfig> group;
+            std::vector<size_t> groupIndex;
+            for (size_t j = i; j < sensors.size(); j++) {
+                if (!done[j] && sensors[j].bus == sensors[i].bus && sensors[j].address == sensors[i].address) {
+                    group.push_back(sensors[j]);
+                    groupIndex.push_back(j);
+                }
+            }
+            DEBUG_PRINTF("Esclavo %u/%u listo a los %lu ms\n", sensors[i].bus, sensors[i].address,
+                         (unsigned long)elapsed);
+
+            std::vector<ModbusSensorReading> groupReadings;
+            readSensors(group, descriptors, groupReadings);
+            for (size_t k = 0; k < groupIndex.size(); k++) {
+                results[groupIndex[k]] = groupReadings[k];
+                done[groupIndex[k]] = true;
+                remaining--;
+            }
+        }
+
+        if (remaining > 0) {
+            delay(MODBUS_READY_POLL_INTERVAL);
+        }
+    }
+
+    readings.insert(readings.end(), results.begin(), results.end());
+}
+
+std::vector<ModbusInventoryEntry> ModbusSensorManager::scanBus(uint8_t bus, uint8_t firstAddress, uint8_t lastAddress,
+                                                               const std::vector<ModbusDeviceDescriptor>& descriptors) {
+    std::vector<ModbusInventoryEntry> devices;
+    if (bus >= modbusBusCount) {
+        return devices;
+    }
+    ModbusMaster& modbus = modbusBuses[bus].master;
+    modbus.setResponseTimeout(MODBUS_SCAN_TIMEOUT + wireTimeMs(bus, MODBUS_RESPONSE_BYTES(1)));
+
+    for (uint16_t address = firstAddress; address <= lastAddress; address++) {
+        modbus.begin((uint8_t)address, *modbusBuses[bus].serial);
+        bool responded = false;
+        SensorType type = static_cast<SensorType>(0);
+
+        // Firma: primer registro del primer bloque de cada mapa conocido
+        for (const auto& descriptor : descriptors) {
+            uint8_t result = timedRead(bus, descriptor.functionCode, descriptor.ranges[0].start, 1);
+
+            if (result == modbus.ku8MBSuccess) {
+                responded = true;
+                type = descriptor.type;
+                break;
+            }
+            if (result >= modbus.ku8MBIllegalFunction && result <= modbus.ku8MBSlaveDeviceFailure) {
+                // Responde pero no tiene estos registros: probar el siguiente mapa
+                responded = true;
+                continue;
+            }
+            // Sin respuesta: no hay esclavo en esta dirección
+            break;
+        }
+
+        if (responded) {
+            ModbusInventoryEntry device;
+            device.bus = bus;
+            device.address = (uint8_t)address;
+            device.type = type;
+            devices.push_back(device);
+
+            // Un esclavo encontrado empieza con el circuito cerrado
+            ModbusSlaveHealth& health = getSlaveHealth(bus, device.address);
+            health = {};
+            health.bus = bus;
+            health.address = device.address;
+            DEBUG_PRINTF("Esclavo Modbus en bus %u, dirección %u, tipo %d\n", bus, device.address, (int)type);
+        }
+    }
+
+    return devices;
+}
+
+
+const ModbusDeviceDescriptor* ModbusSensorManager::findDescriptor(
+        const std::vector<ModbusDeviceDescriptor>& descriptors, SensorType type) {
+    for (const auto& descriptor : descriptors) {
+        if (descriptor.type == type) {
+            return &descriptor;
+        }
+    }
+    return nullptr;
+}
+
+float ModbusSensorManager::decodeValue(const ModbusValueDescriptor& value, const uint16_t* words) {
+    float raw;
+    switch (value.dataType) {
+        case MB_UINT16:
+            raw = (float)words[0];
+            break;
+        case MB_INT16:
+            raw = (float)(int16_t)words[0];
+            break;
+        default: {
+            // Reordenar a ABCD (palabra alta primero, byte alto primero)
+            uint16_t hi = words[0];
+            uint16_t lo = words[1];
+            switch (value.order) {
+                case MB_ORDER_CDAB: hi = words[1];            lo = words[0];            break;
+                case MB_ORDER_BADC: hi = swapBytes(words[0]); lo = swapBytes(words[1]); break;
+                case MB_ORDER_DCBA: hi = swapBytes(words[1]); lo = swapBytes(words[0]); break;
+                default: break;
+            }
+            uint32_t bits = makeLong(hi, lo);
+            if (value.dataType == MB_INT32) {
+                raw = (float)(int32_t)bits;
+            } else if (value.dataType == MB_FLOAT32) {
+                memcpy(&raw, &bits, sizeof(raw));
+            } else {
+                raw = (float)bits;
+            }
+            break;
+        }
+    }
+    return raw * value.scale + value.offset;
+}
+
+std::vector<ModbusReadBlock> ModbusSensorManager::planBlocks(std::vector<ModbusReadBlock>& wanted) {
+    std::sort(wanted.begin(), wanted.end(), [](const ModbusReadBlock& a, const ModbusReadBlock& b) {
+        if (a.bus != b.bus) return a.bus < b.bus;
+        if (a.address != b.address) return a.address < b.address;
+        if (a.functionCode != b.functionCode) return a.functionCode < b.functionCode;
+        return a.start < b.start;
+    });
+
+    std::vector<ModbusReadBlock> blocks;
+    for (uint16_t i = 0; i < wanted.size(); i++) {
+        const ModbusReadBlock& range = wanted[i];
+
+        // Extender el último bloque si es del mismo esclavo y función, está cerca y cabe
+        if (!blocks.empty()) {
+            ModbusReadBlock& last = blocks.back();
+            uint32_t lastEnd = (uint32_t)last.start + last.count;
+            uint32_t end = max(lastEnd, (uint32_t)range.start + range.count);
+            uint8_t limit = min(last.maxBlock, range.maxBlock);
+            if (last.bus == range.bus && last.address == range.address &&
+                last.functionCode == range.functionCode &&
+                range.start <= lastEnd + MODBUS_COALESCE_MAX_GAP && end - last.start <= limit) {
+                last.count = end - last.start;
+                last.maxBlock = limit;
+                last.sourceCount++;
+                continue;
+            }
+        }
+
+        ModbusReadBlock block = range;
+        block.firstSource = i;
+        block.sourceCount = 1;
+        blocks.push_back(block);
+    }
+    return blocks;
+}
+
+void ModbusSensorManager::readBlocks(std::vector<ModbusReadBlock>& blocks,
+                                     const std::vector<ModbusReadBlock>& wanted,
+                                     std::vector<uint16_t>& registers) {
+    std::vector<uint16_t> silentSlaves;        // (bus << 8) | dirección
+    size_t planned = blocks.size();
+
+    // Los bloques de reintento se agregan al final y se recorren en el mismo bucle
+    for (size_t b = 0; b < blocks.size(); b++) {
+        blocks[b].ok = false;
+        uint16_t slave = ((uint16_t)blocks[b].bus << 8) | blocks[b].address;
+        if (std::find(silentSlaves.begin(), silentSlaves.end(), slave) != silentSlaves.end()) {
+            continue;
+        }
+
+        blocks[b].offset = registers.size();
+        registers.resize(registers.size() + blocks[b].count);
+        uint8_t result = readRegisters(blocks[b].bus, blocks[b].address, blocks[b].functionCode,
+                                       blocks[b].start, blocks[b].count, &registers[blocks[b].offset]);
+        blocks[b].ok = (result == ModbusMaster::ku8MBSuccess);
+        if (blocks[b].ok) {
+            continue;
+        }
+
+        bool exception = (result >= ModbusMaster::ku8MBIllegalFunction &&
+                          result <= ModbusMaster::ku8MBSlaveDeviceFailure);
+        if (result == ModbusMaster::ku8MBInvalidQuantity) {
+            // Bloque mal planificado: el esclavo no llegó a recibir la petición
+            continue;
+        }
+        if (!exception) {
+            // Sin respuesta del esclavo: no insistir con el resto de sus bloques
+            silentSlaves.push_back(slave);
+        } else if (b < planned && blocks[b].sourceCount > 1) {
+            DEBUG_PRINTF("Esclavo %u/%u rechazó el bloque unido %u..%u, se piden sus %u rangos por separado\n",
+                         blocks[b].bus, blocks[b].address, blocks[b].start, blocks[b].start + blocks[b].count - 1,
+                         blocks[b].sourceCount);
+            uint16_t first = blocks[b].firstSource;
+            uint16_t last = first + blocks[b].sourceCount;
+            for (uint16_t i = first; i < last; i++) {
+                // Rangos idénticos (varios sensores iguales en el esclavo) se piden una vez
+                if (i > first && wanted[i].start == wanted[i - 1].start && wanted[i].count == wanted[i - 1].count) {
+                    continue;
+                }
+                ModbusReadBlock single = wanted[i];
+                single.firstSource = i;
+                single.sourceCount = 1;
+                blocks.push_back(single);
+            }
+        }
+    }
+}
+
+void ModbusSensorManager::readSensors(const std::vector<ModbusSensorConfig>& sensors,
+                                      const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                      std::vector<ModbusSensorReading>& readings) {
+    // Rangos pedidos por todos los sensores del ciclo
+    std::vector<ModbusReadBlock> wanted;
+    for (const auto& sensor : sensors) {
+        const ModbusDeviceDescriptor* descriptor = findDescriptor(descriptors, sensor.type);
+        if (descriptor == nullptr) {
+            continue;
+        }
+        for (uint8_t i = 0; i < descriptor->rangeCount; i++) {
+            ModbusReadBlock range = {};
+            range.bus = sensor.bus;
+            range.address = sensor.address;
+            range.functionCode = descriptor->functionCode;
+            range.start = descriptor->ranges[i].start;
+            range.count = descriptor->ranges[i].count;
+            range.maxBlock = descriptor->maxBlock ? descriptor->maxBlock : MODBUS_MAX_BLOCK_REGS;
+            wanted.push_back(range);
+        }
+    }
+
+    std::vector<ModbusReadBlock> blocks = planBlocks(wanted);
+    DEBUG_PRINTF("Modbus: %u rangos pedidos en %u transacciones\n",
+                 (unsigned)wanted.size(), (unsigned)blocks.size());
+
+    std::vector<uint16_t> registers;
+    readBlocks(blocks, wanted, registers);
+
+    // Decodificar cada subvalor desde un bloque leído que lo contenga
+    for (const auto& sensor : sensors) {
+        ModbusSensorReading reading;
+        strncpy(reading.sensorId, sensor.sensorId, sizeof(reading.sensorId));
+        reading.type = sensor.type;
+        reading.subValues.clear();
+
+        const ModbusDeviceDescriptor* descriptor = findDescriptor(descriptors, sensor.type);
+        if (descriptor == nullptr) {
+            DEBUG_PRINTLN("Tipo de sensor Modbus sin mapa de registros");
+            readings.push_back(reading);
+            continue;
+        }
+
+        for (uint8_t v = 0; v < descriptor->valueCount; v++) {
+            const ModbusValueDescriptor& value = descriptor->values[v];
+            uint8_t words = (value.dataType >= MB_UINT32) ? 2 : 1;
+
+            SubValue sv;
+            sv.value = NAN;
+            for (const auto& block : blocks) {
+                if (block.ok && block.bus == sensor.bus && block.address == sensor.address &&
+                    block.functionCode == descriptor->functionCode &&
+                    value.reg >= block.start && value.reg + words <= block.start + block.count) {
+                    sv.value = decodeValue(value, &registers[block.offset + (value.reg - block.start)]);
+                    break;
+                }
+            }
+            reading.subValues.push_back(sv);
+        }
+        readings.push_back(reading);
     }
-    
-    return reading;
 }
 
 #endif // defined(DEVICE_TYPE_ANALOGIC) || defined(DEVICE_TYPE_MODBUS)
\ No newline at end of file
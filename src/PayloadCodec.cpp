@@ -0,0 +1,470 @@
+/*******************************************************************************************
+ * Archivo: src/PayloadCodec.cpp
+ * Descripción: Codificación binaria compacta de las lecturas para el uplink LoRaWAN.
+ *              Sin dependencias de Arduino (se compila también en el servidor).
+ *******************************************************************************************/
+
+#include "PayloadCodec.h"
+#include <math.h>
+#include <string.h>
+#include "util/crc16.h"
+
+namespace {
+
+const double kPow10[PAYLOAD_MAX_DECIMALS + 1] = {1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0};
+
+/**
+ * @brief Escritor secuencial sobre un buffer fijo; marca desbordamiento en lugar de escribir fuera.
+ */
+struct ByteWriter {
+    uint8_t* data;
+    size_t size;
+    size_t length;
+    bool overflow;
+
+    void put(uint8_t byte) {
+        if (length >= size) {
+            overflow = true;
+            return;
+        }
+        data[length++] = byte;
+    }
+
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            put((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        put((uint8_t)value);
+    }
+};
+
+/**
+ * @brief Lector secuencial; cualquier lectura fuera del payload lo marca como inválido.
+ */
+struct ByteReader {
+    const uint8_t* data;
+    size_t length;
+    size_t offset;
+    bool error;
+
+    uint8_t get() {
+        if (offset >= length) {
+            error = true;
+            return 0;
+        }
+        return data[offset++];
+    }
+
+    uint64_t getVarint() {
+        uint64_t value = 0;
+        for (uint8_t shift = 0; shift < 64; shift += 7) {
+            uint8_t byte = get();
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        error = true;
+        return 0;
+    }
+};
+
+/**
+ * @brief Valor en punto fijo con los decimales indicados; saturado a ±INT32_MAX.
+ */
+int32_t toFixed(float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) {
+        return PAYLOAD_FIXED_NAN;
+    }
+    double scaled = round((double)value * kPow10[decimals]);
+    if (scaled > INT32_MAX) scaled = INT32_MAX;
+    if (scaled < -INT32_MAX) scaled = -INT32_MAX;
+    return (int32_t)scaled;
+}
+
+float fromFixed(int32_t fixed, uint8_t decimals) {
+    if (fixed == PAYLOAD_FIXED_NAN) {
+        return NAN;
+    }
+    return (float)(fixed / kPow10[decimals]);
+}
+
+uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * @brief Código transmitido de un valor: 0 = NAN, si no zigzag(valor - base) + 1.
+ *        Los keyframes usan base 0; un valor de referencia NAN también cuenta como 0.
+ */
+uint64_t valueCode(int32_t value, int32_t base) {
+    if (value == PAYLOAD_FIXED_NAN) {
+        return 0;
+    }
+    if (base == PAYLOAD_FIXED_NAN) {
+        base = 0;
+    }
+    return zigzag((int64_t)value - base) + 1;
+}
+
+int32_t fromCode(uint64_t code, int32_t base, bool& error) {
+    if (code == 0) {
+        return PAYLOAD_FIXED_NAN;
+    }
+    if (base == PAYLOAD_FIXED_NAN) {
+        base = 0;
+    }
+    int64_t value = unzigzag(code - 1) + base;
+    if (value > INT32_MAX || value < -INT32_MAX) {
+        error = true;
+        return PAYLOAD_FIXED_NAN;
+    }
+    return (int32_t)value;
+}
+
+/**
+ * @brief Valores de una lectura normal: 'value' si no tiene subvalores.
+ */
+void valuesOf(const SensorReading& reading, std::vector<float>& values) {
+    values.clear();
+    if (reading.subValues.empty()) {
+        values.push_back(reading.value);
+    } else {
+        for (const auto& sv : reading.subValues) {
+            values.push_back(sv.value);
+        }
+    }
+}
+
+void valuesOf(const ModbusSensorReading& reading, std::vector<float>& values) {
+    values.clear();
+    for (const auto& sv : reading.subValues) {
+        values.push_back(sv.value);
+    }
+}
+
+} // namespace
+
+UplinkSchema PayloadCodec::buildSchema(const char* stationId, const char* deviceId,
+                                       const std::vector<SensorReading>& normalReadings,
+                                       const std::vector<ModbusSensorReading>& modbusReadings) {
+    UplinkSchema schema;
+    strncpy(schema.stationId, stationId, sizeof(schema.stationId) - 1);
+    schema.stationId[sizeof(schema.stationId) - 1] = '\0';
+    strncpy(schema.deviceId, deviceId, sizeof(schema.deviceId) - 1);
+    schema.deviceId[sizeof(schema.deviceId) - 1] = '\0';
+
+    schema.sensors.reserve(normalReadings.size() + modbusReadings.size());
+    UplinkSchemaEntry entry;
+    for (const auto& reading : normalReadings) {
+        memcpy(entry.sensorId, reading.sensorId, sizeof(entry.sensorId));
+        entry.sensorId[sizeof(entry.sensorId) - 1] = '\0';
+        entry.type = reading.type;
+        entry.valueCount = (uint8_t)(reading.subValues.empty() ? 1 : reading.subValues.size());
+        schema.sensors.push_back(entry);
+    }
+    for (const auto& reading : modbusReadings) {
+        memcpy(entry.sensorId, reading.sensorId, sizeof(entry.sensorId));
+        entry.sensorId[sizeof(entry.sensorId) - 1] = '\0';
+        entry.type = reading.type;
+        entry.valueCount = (uint8_t)reading.subValues.size();
+        schema.sensors.push_back(entry);
+    }
+    return schema;
+}
+
+std::vector<uint8_t> PayloadCodec::serializeSchema(const UplinkSchema& schema) {
+    std::vector<uint8_t> data;
+    auto putString = [&data](const char* text) {
+        data.insert(data.end(), text, text + strlen(text) + 1);
+    };
+    auto putVarint = [&data](uint32_t value) {
+        while (value >= 0x80) {
+            data.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        data.push_back((uint8_t)value);
+    };
+
+    putString(schema.stationId);
+    putString(schema.deviceId);
+    putVarint((uint32_t)schema.sensors.size());
+    for (const auto& sensor : schema.sensors) {
+        putVarint((uint32_t)sensor.type);
+        data.push_back(sensor.valueCount);
+        putString(sensor.sensorId);
+    }
+    return data;
+}
+
+bool PayloadCodec::parseSchema(const uint8_t* data, size_t length, UplinkSchema& schema) {
+    ByteReader reader = {data, length, 0, false};
+    auto getString = [&reader](char* text, size_t size) {
+        size_t n = 0;
+        uint8_t c;
+        while ((c = reader.get()) != 0 && !reader.error) {
+            if (n + 1 < size) {
+                text[n++] = (char)c;
+            }
+        }
+        text[n] = '\0';
+    };
+
+    getString(schema.stationId, sizeof(schema.stationId));
+    getString(schema.deviceId, sizeof(schema.deviceId));
+    uint64_t sensorCount = reader.getVarint();
+    schema.sensors.clear();
+    for (uint64_t i = 0; i < sensorCount && !reader.error; i++) {
+        UplinkSchemaEntry entry;
+        entry.type = static_cast<SensorType>(reader.getVarint());
+        entry.valueCount = reader.get();
+        getString(entry.sensorId, sizeof(entry.sensorId));
+        schema.sensors.push_back(entry);
+    }
+    return !reader.error && reader.offset == length;
+}
+
+uint16_t PayloadCodec::schemaHash(const UplinkSchema& schema) {
+    std::vector<uint8_t> data = serializeSchema(schema);
+    return crc16_modbus(data.data(), data.size());
+}
+
+size_t PayloadCodec::encodeSchemaPart(const std::vector<uint8_t>& serialized, uint16_t hash,
+                                      uint8_t part, size_t chunkSize, uint8_t* buffer) {
+    if (chunkSize == 0) {
+        return 0;
+    }
+    size_t partCount = (serialized.size() + chunkSize - 1) / chunkSize;
+    if (partCount == 0 || partCount > PAYLOAD_SCHEMA_MAX_PARTS || part >= partCount) {
+        return 0;
+    }
+
+    size_t start = part * chunkSize;
+    size_t count = (serialized.size() - start < chunkSize) ? serialized.size() - start : chunkSize;
+    buffer[0] = (uint8_t)(PAYLOAD_CODEC_VERSION << 4);
+    buffer[1] = (uint8_t)(hash & 0xFF);
+    buffer[2] = (uint8_t)(hash >> 8);
+    buffer[3] = (uint8_t)((part << 4) | partCount);
+    memcpy(buffer + PAYLOAD_SCHEMA_PART_HEADER, serialized.data() + start, count);
+    return PAYLOAD_SCHEMA_PART_HEADER + count;
+}
+
+bool PayloadCodec::parseSchemaPart(const uint8_t* payload, size_t length,
+                                   uint16_t& hash, uint8_t& part, uint8_t& partCount) {
+    if (length <= PAYLOAD_SCHEMA_PART_HEADER || (payload[0] >> 4) != PAYLOAD_CODEC_VERSION) {
+        return false;
+    }
+    hash = (uint16_t)(payload[1] | (payload[2] << 8));
+    part = payload[3] >> 4;
+    partCount = payload[3] & 0x0F;
+    return part < partCount;
+}
+
+size_t PayloadCodec::encode(const std::vector<SensorReading>& normalReadings,
+                            const std::vector<ModbusSensorReading>& modbusReadings,
+                            float battery,
+                            uint32_t timestamp,
+                            uint8_t sequence,
+                            uint16_t schemaHash,
+                            const UplinkFrame* reference,
+                            UplinkFrame& frame,
+                            uint8_t* buffer,
+                            size_t bufferSize,
+                            const std::vector<bool>* selection) {
+    // Valores en punto fijo de todos los sensores, en el orden del esquema
+    size_t sensorCount = normalReadings.size() + modbusReadings.size();
+    std::vector<uint8_t> counts;
+    std::vector<int32_t> fixed;
+    std::vector<float> values;
+    counts.reserve(sensorCount);
+    for (size_t i = 0; i < sensorCount; i++) {
+        SensorType type;
+        if (i < normalReadings.size()) {
+            valuesOf(normalReadings[i], values);
+            type = normalReadings[i].type;
+        } else {
+            valuesOf(modbusReadings[i - normalReadings.size()], values);
+            type = modbusReadings[i - normalReadings.size()].type;
+        }
+        // Un sensor no seleccionado viaja como ausente: el servidor lo verá como NAN
+        bool selected = (selection == nullptr) || (i < selection->size() && (*selection)[i]);
+        counts.push_back((uint8_t)values.size());
+        for (size_t v = 0; v < values.size(); v++) {
+            fixed.push_back(selected ? toFixed(values[v], decimalsFor(type, (uint8_t)v)) : PAYLOAD_FIXED_NAN);
+        }
+    }
+
+    frame.valid = (fixed.size() <= PAYLOAD_MAX_FRAME_VALUES && sensorCount <= UINT8_MAX);
+    frame.sequence = sequence;
+    frame.schemaHash = schemaHash;
+    frame.timestamp = timestamp;
+    frame.battery = toFixed(battery, PAYLOAD_BATTERY_DECIMALS);
+    frame.sensorCount = (uint8_t)sensorCount;
+    frame.valueCount = frame.valid ? (uint8_t)fixed.size() : 0;
+    for (size_t i = 0; i < frame.valueCount; i++) {
+        frame.values[i] = fixed[i];
+    }
+
+    // Delta solo contra una referencia con el mismo esquema
+    bool delta = frame.valid && reference != nullptr && reference->valid && reference->schemaHash == schemaHash &&
+                 reference->sensorCount == frame.sensorCount && reference->valueCount == frame.valueCount;
+
+    ByteWriter writer = {buffer, bufferSize, 0, false};
+    writer.put((uint8_t)((PAYLOAD_CODEC_VERSION << 4) | (delta ? PAYLOAD_FLAG_DELTA : 0)));
+    writer.put(sequence);
+    if (delta) {
+        writer.put(reference->sequence);
+        writer.putVarint(zigzag((int64_t)timestamp - reference->timestamp));
+    } else {
+        // El keyframe identifica el esquema: el servidor puede pedirlo si no lo conoce
+        writer.put((uint8_t)(schemaHash & 0xFF));
+        writer.put((uint8_t)(schemaHash >> 8));
+        writer.putVarint(timestamp);
+    }
+    writer.putVarint(valueCode(frame.battery, delta ? reference->battery : 0));
+    writer.putVarint((uint32_t)sensorCount);
+
+    // Bitmap de presencia: un sensor sin ningún valor válido no se transmite
+    std::vector<bool> present(sensorCount, false);
+    for (size_t i = 0, first = 0; i < sensorCount; first += counts[i], i++) {
+        for (size_t v = first; v < first + counts[i]; v++) {
+            if (fixed[v] != PAYLOAD_FIXED_NAN) {
+                present[i] = true;
+                break;
+            }
+        }
+    }
+    for (size_t base = 0; base < sensorCount; base += 8) {
+        uint8_t bits = 0;
+        for (size_t i = base; i < sensorCount && i < base + 8; i++) {
+            if (present[i]) {
+                bits |= (uint8_t)(1 << (i - base));
+            }
+        }
+        writer.put(bits);
+    }
+
+    for (size_t i = 0, first = 0; i < sensorCount; first += counts[i], i++) {
+        if (!present[i]) {
+            continue;
+        }
+        for (size_t v = first; v < first + counts[i]; v++) {
+            writer.putVarint(valueCode(fixed[v], delta ? reference->values[v] : 0));
+        }
+    }
+
+    return writer.overflow ? 0 : writer.length;
+}
+
+bool PayloadCodec::decode(const uint8_t* payload, size_t length,
+                          const UplinkSchema& schema,
+                          UplinkFrame& reference,
+                          DecodedUplink& out) {
+    ByteReader reader = {payload, length, 0, false};
+    uint8_t header = reader.get();
+    out.version = header >> 4;
+    out.flags = header & 0x0F;
+    out.sequence = reader.get();
+    if (reader.error || out.version != PAYLOAD_CODEC_VERSION) {
+        return false;
+    }
+
+    const std::vector<UplinkSchemaEntry>& sensors = schema.sensors;
+    size_t totalValues = 0;
+    for (const auto& entry : sensors) {
+        totalValues += entry.valueCount;
+    }
+
+    UplinkFrame frame = {};
+    frame.valid = (totalValues <= PAYLOAD_MAX_FRAME_VALUES && sensors.size() <= UINT8_MAX);
+    frame.sequence = out.sequence;
+    frame.schemaHash = schemaHash(schema);
+    frame.sensorCount = (uint8_t)sensors.size();
+    frame.valueCount = frame.valid ? (uint8_t)totalValues : 0;
+
+    // Un frame delta solo se decodifica contra el frame del que parte
+    bool delta = (out.flags & PAYLOAD_FLAG_DELTA) != 0;
+    if (delta) {
+        uint8_t referenceSequence = reader.get();
+        if (reader.error || !reference.valid || !frame.valid || reference.sequence != referenceSequence ||
+            reference.schemaHash != frame.schemaHash) {
+            return false;
+        }
+        frame.timestamp = (uint32_t)((int64_t)reference.timestamp + unzigzag(reader.getVarint()));
+    } else {
+        uint16_t hash = reader.get();
+        hash |= (uint16_t)reader.get() << 8;
+        if (reader.error || hash != frame.schemaHash) {
+            return false;
+        }
+        frame.timestamp = (uint32_t)reader.getVarint();
+    }
+    bool error = false;
+    frame.battery = fromCode(reader.getVarint(), delta ? reference.battery : 0, error);
+    uint64_t sensorCount = reader.getVarint();
+    if (reader.error || error || sensorCount != sensors.size()) {
+        return false;
+    }
+
+    std::vector<uint8_t> bitmap((sensorCount + 7) / 8);
+    for (auto& bits : bitmap) {
+        bits = reader.get();
+    }
+
+    out.timestamp = frame.timestamp;
+    out.battery = fromFixed(frame.battery, PAYLOAD_BATTERY_DECIMALS);
+    out.sensors.clear();
+    for (size_t i = 0, first = 0; i < sensorCount; first += sensors[i].valueCount, i++) {
+        bool present = (bitmap[i / 8] & (1 << (i % 8))) != 0;
+        DecodedSensor sensor;
+        sensor.index = (uint8_t)i;
+        sensor.type = sensors[i].type;
+        for (uint8_t v = 0; v < sensors[i].valueCount; v++) {
+            int32_t value = PAYLOAD_FIXED_NAN;
+            if (present) {
+                value = fromCode(reader.getVarint(), delta ? reference.values[first + v] : 0, error);
+                sensor.values.push_back(fromFixed(value, decimalsFor(sensor.type, v)));
+            }
+            if (frame.valid) {
+                frame.values[first + v] = value;
+            }
+        }
+        if (present) {
+            out.sensors.push_back(sensor);
+        }
+    }
+
+    // Bytes sobrantes: el esquema no corresponde al del dispositivo
+    if (reader.error || error || reader.offset != length) {
+        return false;
+    }
+    reference = frame;
+    return true;
+}
+
+uint8_t PayloadCodec::decimalsFor(SensorType type, uint8_t valueIndex) {
+    switch (type) {
+        case N100K:
+        case N10K:
+        case RTD:
+        case DS18B20:
+        case TEMP_A:
+        case PH:
+        case SHT30:
+            return 2;
+        case CO2:
+        case LIGHT:
+            return 0;
+        case ENV4:
+            // [0]=Humedad, [1]=Temperatura, [2]=Presión a 0.1; [3]=Iluminación en lux enteros
+            return (valueIndex == 3) ? 0 : 1;
+        default:
+            // Humedades, conductividad y presión
+            return 1;
+    }
+}
@@ -23,6 +23,9 @@
 #include "sensors/SHT30Sensor.h"
 #include "sensors/DS18B20Sensor.h"
 
+// Ciclos de lectura desde el arranque, para los sensores con periodo
+RTC_DATA_ATTR uint32_t sensorCycle = 0;
+
 // -------------------------------------------------------------------------------------
 // Métodos de la clase SensorManager
 // -------------------------------------------------------------------------------------
@@ -57,10 +60,9 @@ void SensorManager::beginSensors(const std::vector<SensorConfig>& enabledNormalS
 
     // Inicializar DS18B20 solo si está habilitado en la configuración
     if (ds18b20SensorEnabled) {
-        // TIEMPO ejecución ≈ 65 ms
-        // Inicializar DS18B20
-        dallasTemp.begin();
-        dallasTemp.requestTemperatures();
+        // Restaura las ROM desde RTC (búsqueda en bus ≈ 65 ms solo si hace falta)
+        // e inicia la conversión sin bloquear; se lee en getSensorReading()
+        DS18B20Sensor::begin(enabledNormalSensors);
         DEBUG_PRINTLN("DS18B20 inicializado");
     }
 
@@ -152,7 +154,7 @@ float SensorManager::readSensorValue(const SensorConfig &cfg, SensorReading &rea
             break;
 
         case DS18B20:
-            reading.value = DS18B20Sensor::read();
+            reading.value = DS18B20Sensor::read(cfg.sensorId);
             break;
 
         case SHT30:
@@ -187,25 +189,36 @@ float SensorManager::readSensorValue(const SensorConfig &cfg, SensorReading &rea
     return reading.value;
 }
 
-ModbusSensorReading SensorManager::getModbusSensorReading(const ModbusSensorConfig& cfg) {
-    ModbusSensorReading reading;
-    
-    // Copiar el ID del sensor
-    strlcpy(reading.sensorId, cfg.sensorId, sizeof(reading.sensorId));
-    reading.type = cfg.type;
-    
-    // Leer sensor según su tipo
-    switch (cfg.type) {
-        case ENV4:
-            reading = ModbusSensorManager::readEnvSensor(cfg);
-            break;
-        // Añadir casos para otros tipos de sensores Modbus
-        default:
-            DEBUG_PRINTLN("Tipo de sensor Modbus no soportado");
-            break;
+ModbusSensorReading SensorManager::getModbusSensorReading(const ModbusSensorConfig& cfg,
+                                                          const std::vector<ModbusDeviceDescriptor>& descriptors) {
+    // Un solo sensor: el planificador lo lee con las mínimas transacciones de su mapa
+    std::vector<ModbusSensorReading> readings;
+    ModbusSensorManager::readSensors(std::vector<ModbusSensorConfig>(1, cfg), descriptors, readings);
+    return readings.front();
+}
+
+std::vector<ModbusInventoryEntry> SensorManager::discoverModbusDevices(uint8_t firstAddress, uint8_t lastAddress) {
+    std::vector<ModbusDeviceDescriptor> descriptors = ConfigManager::getModbusDeviceDescriptors();
+
+    powerManager.power12VOn();
+    DEBUG_PRINTF("Buscando esclavos Modbus %u..%u tras %u ms de estabilización\n",
+                 firstAddress, lastAddress, MODBUS_SCAN_STABILIZATION_TIME);
+    delay(MODBUS_SCAN_STABILIZATION_TIME);
+
+    ModbusSensorManager::beginModbus();
+    std::vector<ModbusInventoryEntry> devices;
+    for (uint8_t bus = 0; bus < ModbusSensorManager::getBusCount(); bus++) {
+        std::vector<ModbusInventoryEntry> found =
+            ModbusSensorManager::scanBus(bus, firstAddress, lastAddress, descriptors);
+        devices.insert(devices.end(), found.begin(), found.end());
     }
-    
-    return reading;
+    ModbusSensorManager::endModbus();
+
+    powerManager.power12VOff();
+
+    ConfigManager::setModbusInventory(firstAddress, lastAddress, devices);
+    DEBUG_PRINTF("Inventario Modbus: %u esclavos\n", (unsigned)devices.size());
+    return devices;
 }
 
 void SensorManager::getAllSensorReadings(std::vector<SensorReading>& normalReadings,
@@ -215,50 +228,106 @@ void SensorManager::getAllSensorReadings(std::vector<SensorReading>& normalReadi
     // Reservar espacio para los vectores
     normalReadings.reserve(enabledNormalSensors.size());
     modbusReadings.reserve(enabledModbusSensors.size());
+    sensorCycle++;
     
     // Leer sensores normales
     for (const auto &sensor : enabledNormalSensors) {
-        normalReadings.push_back(getSensorReading(sensor));
+        normalReadings.push_back(isDue(sensor.period) ? getSensorReading(sensor) : skippedReading(sensor));
     }
     
+    // Sensores Modbus que toca medir en este ciclo
+    std::vector<ModbusSensorConfig> dueModbusSensors;
+    for (const auto &sensor : enabledModbusSensors) {
+        if (isDue(sensor.period)) {
+            dueModbusSensors.push_back(sensor);
+        }
+    }
+    if (enabledModbusSensors.empty()) {
+        return;
+    }
+
+    // Mapas de registros (guardados + integrados), se cargan una vez por ciclo
+    std::vector<ModbusDeviceDescriptor> descriptors = ConfigManager::getModbusDeviceDescriptors();
+    std::vector<ModbusSensorReading> dueReadings;
+    readModbusSensors(dueModbusSensors, descriptors, dueReadings);
+
+    // Intercalar las lecturas con las de los sensores omitidos, en el orden configurado
+    size_t next = 0;
+    for (const auto &sensor : enabledModbusSensors) {
+        if (isDue(sensor.period) && next < dueReadings.size()) {
+            modbusReadings.push_back(dueReadings[next++]);
+        } else {
+            modbusReadings.push_back(skippedModbusReading(sensor, descriptors));
+        }
+    }
+}
+
+bool SensorManager::isDue(uint8_t period) {
+    return period <= 1 || (sensorCycle % period) == 0;
+}
+
+SensorReading SensorManager::skippedReading(const SensorConfig& cfg) {
+    SensorReading reading;
+    strncpy(reading.sensorId, cfg.sensorId, sizeof(reading.sensorId) - 1);
+    reading.sensorId[sizeof(reading.sensorId) - 1] = '\0';
+    reading.type = cfg.type;
+    reading.value = NAN;
+    if (cfg.type == SHT30) {
+        // Temperatura y humedad
+        reading.subValues.assign(2, SubValue{NAN});
+    }
+    return reading;
+}
+
+ModbusSensorReading SensorManager::skippedModbusReading(const ModbusSensorConfig& cfg,
+                                                        const std::vector<ModbusDeviceDescriptor>& descriptors) {
+    ModbusSensorReading reading;
+    strncpy(reading.sensorId, cfg.sensorId, sizeof(reading.sensorId) - 1);
+    reading.sensorId[sizeof(reading.sensorId) - 1] = '\0';
+    reading.type = cfg.type;
+    const ModbusDeviceDescriptor* descriptor = ModbusSensorManager::findDescriptor(descriptors, cfg.type);
+    if (descriptor != nullptr) {
+        reading.subValues.assign(descriptor->valueCount, SubValue{NAN});
+    }
+    return reading;
+}
+
+void SensorManager::readModbusSensors(const std::vector<ModbusSensorConfig>& sensors,
+                                      const std::vector<ModbusDeviceDescriptor>& descriptors,
+                                      std::vector<ModbusSensorReading>& modbusReadings) {
     // Si hay sensores Modbus, inicializar comunicación, leerlos y finalizar
-    if (!enabledModbusSensors.empty()) {
-        // Determinar el tiempo máximo de estabilización necesario
-        uint32_t maxStabilizationTime = 0;
-        
-        // Revisar cada sensor habilitado para encontrar el tiempo máximo
-        for (const auto &sensor : enabledModbusSensors) {
-            uint32_t sensorStabilizationTime = 0;
-            
-            // Obtener el tiempo de estabilización según el tipo de sensor
-            switch (sensor.type) {
-                case ENV4:
-                    sensorStabilizationTime = MODBUS_ENV4_STABILIZATION_TIME;
-                    break;
-                // Añadir casos para otros tipos de sensores Modbus con sus respectivos tiempos
-                default:
-                    sensorStabilizationTime = 500; // Tiempo predeterminado si no se especifica
-                    break;
-            }
-            
-            // Actualizar el tiempo máximo si este sensor necesita más tiempo
-            if (sensorStabilizationTime > maxStabilizationTime) {
-                maxStabilizationTime = sensorStabilizationTime;
+    if (!sensors.empty()) {
+        ModbusSensorManager::startCycle();
+
+        // Con inventario, las direcciones que no respondieron en la búsqueda empiezan con el circuito abierto
+        uint8_t inventoryFirst, inventoryLast;
+        std::vector<ModbusInventoryEntry> inventory;
+        if (ConfigManager::getModbusInventory(inventoryFirst, inventoryLast, inventory)) {
+            ModbusSensorManager::useInventory(inventoryFirst, inventoryLast, inventory);
+        }
+
+        // Si todos los esclavos tienen el circuito abierto no se enciende el bus:
+        // las lecturas se reportan como NAN sin esperar estabilización ni timeouts
+        bool anySlaveAvailable = false;
+        for (const auto &sensor : sensors) {
+            if (ModbusSensorManager::isSlaveAvailable(sensor.bus, sensor.address)) {
+                anySlaveAvailable = true;
+                break;
             }
         }
-        
-        // Encender alimentación de 12V para sensores Modbus
+        if (!anySlaveAvailable) {
+            DEBUG_PRINTLN("Todos los esclavos Modbus en espera, se omite el encendido de 12V");
+            ModbusSensorManager::readSensors(sensors, descriptors, modbusReadings);
+            return;
+        }
+
+        // Encender alimentación de 12V e inicializar la comunicación de inmediato: cada
+        // esclavo se lee en cuanto responde con un valor plausible (con tope por tipo)
         powerManager.power12VOn();
-        DEBUG_PRINTF("Esperando %u ms para estabilización de sensores Modbus\n", maxStabilizationTime);
-        delay(maxStabilizationTime);
-        
-        // Inicializar comunicación Modbus antes de comenzar las mediciones
         ModbusSensorManager::beginModbus();
         
-        // Leer todos los sensores Modbus
-        for (const auto &sensor : enabledModbusSensors) {
-            modbusReadings.push_back(getModbusSensorReading(sensor));
-        }
+        // Leer todos los sensores Modbus, uniendo las peticiones por esclavo
+        ModbusSensorManager::readSensorsWhenReady(sensors, descriptors, modbusReadings);
         
         // Finalizar comunicación Modbus después de completar todas las lecturas
         ModbusSensorManager::endModbus();
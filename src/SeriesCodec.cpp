@@ -0,0 +1,272 @@
+/*******************************************************************************************
+ * Archivo: src/SeriesCodec.cpp
+ * Descripción: Compresión de series de muestras (timestamps delta-of-delta y floats XOR).
+ *              Sin dependencias de Arduino (se compila también en el servidor).
+ *******************************************************************************************/
+
+#include "SeriesCodec.h"
+#include <math.h>
+#include <string.h>
+#include "PayloadCodec.h"
+
+namespace {
+
+const double kPow10[PAYLOAD_MAX_DECIMALS + 1] = {1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0};
+
+/**
+ * @brief Escritor de bits sobre un buffer fijo; marca desbordamiento en lugar de escribir fuera.
+ */
+struct BitWriter {
+    uint8_t* data;
+    size_t size;
+    size_t bits;
+    bool overflow;
+
+    void put(uint32_t value, uint8_t count) {
+        while (count > 0) {
+            count--;
+            size_t byte = bits >> 3;
+            if (byte >= size) {
+                overflow = true;
+                return;
+            }
+            uint8_t mask = (uint8_t)(0x80 >> (bits & 7));
+            if ((value >> count) & 1) {
+                data[byte] |= mask;
+            } else {
+                data[byte] &= (uint8_t)~mask;
+            }
+            bits++;
+        }
+    }
+
+    size_t length() const {
+        return (bits + 7) >> 3;
+    }
+};
+
+/**
+ * @brief Lector de bits; cualquier lectura fuera del bloque lo marca como inválido.
+ */
+struct BitReader {
+    const uint8_t* data;
+    size_t size;
+    size_t bits;
+    bool error;
+
+    uint32_t get(uint8_t count) {
+        uint32_t value = 0;
+        while (count > 0) {
+            count--;
+            size_t byte = bits >> 3;
+            if (byte >= size) {
+                error = true;
+                return 0;
+            }
+            value = (value << 1) | ((data[byte] >> (7 - (bits & 7))) & 1);
+            bits++;
+        }
+        return value;
+    }
+
+    /**
+     * @brief Entero con signo de count bits en complemento a dos.
+     */
+    int32_t getSigned(uint8_t count) {
+        uint32_t value = get(count);
+        uint32_t sign = (uint32_t)1 << (count - 1);
+        return (int32_t)((value ^ sign) - sign);
+    }
+};
+
+uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void putDeltaOfDelta(BitWriter& writer, int32_t value) {
+    if (value == 0) {
+        writer.put(0x0, 1);
+    } else if (value >= -64 && value <= 63) {
+        writer.put(0x2, 2);
+        writer.put((uint32_t)value & 0x7F, 7);
+    } else if (value >= -256 && value <= 255) {
+        writer.put(0x6, 3);
+        writer.put((uint32_t)value & 0x1FF, 9);
+    } else if (value >= -2048 && value <= 2047) {
+        writer.put(0xE, 4);
+        writer.put((uint32_t)value & 0xFFF, 12);
+    } else {
+        writer.put(0xF, 4);
+        writer.put((uint32_t)value, 32);
+    }
+}
+
+int32_t getDeltaOfDelta(BitReader& reader) {
+    if (reader.get(1) == 0) {
+        return 0;
+    }
+    if (reader.get(1) == 0) {
+        return reader.getSigned(7);
+    }
+    if (reader.get(1) == 0) {
+        return reader.getSigned(9);
+    }
+    if (reader.get(1) == 0) {
+        return reader.getSigned(12);
+    }
+    return (int32_t)reader.get(32);
+}
+
+} // namespace
+
+float SeriesCodec::quantize(float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) {
+        return NAN;
+    }
+    if (decimals > PAYLOAD_MAX_DECIMALS) {
+        decimals = PAYLOAD_MAX_DECIMALS;
+    }
+    return (float)(round((double)value * kPow10[decimals]) / kPow10[decimals]);
+}
+
+size_t SeriesCodec::sampleOf(const std::vector<SensorReading>& normalReadings,
+                             const std::vector<ModbusSensorReading>& modbusReadings,
+                             float battery, float* values, size_t maxValues) {
+    size_t count = 0;
+    auto put = [&](float value, uint8_t decimals) {
+        if (count < maxValues) {
+            values[count] = quantize(value, decimals);
+        }
+        count++;
+    };
+
+    put(battery, PAYLOAD_BATTERY_DECIMALS);
+    for (const auto& reading : normalReadings) {
+        if (reading.subValues.empty()) {
+            put(reading.value, PayloadCodec::decimalsFor(reading.type, 0));
+        }
+        for (size_t v = 0; v < reading.subValues.size(); v++) {
+            put(reading.subValues[v].value, PayloadCodec::decimalsFor(reading.type, (uint8_t)v));
+        }
+    }
+    for (const auto& reading : modbusReadings) {
+        for (size_t v = 0; v < reading.subValues.size(); v++) {
+            put(reading.subValues[v].value, PayloadCodec::decimalsFor(reading.type, (uint8_t)v));
+        }
+    }
+    return count <= maxValues ? count : 0;
+}
+
+size_t SeriesCodec::encode(uint16_t schemaHash, const uint32_t* timestamps, const float* values,
+                           uint8_t sampleCount, uint8_t seriesCount, uint8_t* buffer, size_t bufferSize) {
+    if (sampleCount == 0 || seriesCount == 0 || bufferSize < SERIES_HEADER_LENGTH) {
+        return 0;
+    }
+    buffer[0] = (uint8_t)(SERIES_CODEC_VERSION << 4);
+    buffer[1] = (uint8_t)(schemaHash & 0xFF);
+    buffer[2] = (uint8_t)(schemaHash >> 8);
+    buffer[3] = sampleCount;
+    buffer[4] = seriesCount;
+
+    BitWriter writer = {buffer + SERIES_HEADER_LENGTH, bufferSize - SERIES_HEADER_LENGTH, 0, false};
+
+    // Timestamps: diferencias de diferencias (aritmética módulo 2^32)
+    writer.put(timestamps[0], 32);
+    uint32_t previousDelta = 0;
+    for (uint8_t i = 1; i < sampleCount; i++) {
+        uint32_t delta = timestamps[i] - timestamps[i - 1];
+        putDeltaOfDelta(writer, (int32_t)(delta - previousDelta));
+        previousDelta = delta;
+    }
+
+    // Valores: XOR con el anterior de la misma serie
+    for (uint8_t s = 0; s < seriesCount; s++) {
+        uint32_t previous = floatBits(values[s]);
+        writer.put(previous, 32);
+        uint8_t leading = 0xFF;     // Sin ventana todavía
+        uint8_t trailing = 0;
+        for (uint8_t i = 1; i < sampleCount; i++) {
+            uint32_t current = floatBits(values[i * seriesCount + s]);
+            uint32_t xored = current ^ previous;
+            previous = current;
+            if (xored == 0) {
+                writer.put(0x0, 1);
+                continue;
+            }
+            uint8_t lz = (uint8_t)__builtin_clz(xored);
+            uint8_t tz = (uint8_t)__builtin_ctz(xored);
+            if (leading != 0xFF && lz >= leading && tz >= trailing) {
+                writer.put(0x2, 2);
+                writer.put(xored >> trailing, 32 - leading - trailing);
+            } else {
+                leading = lz;
+                trailing = tz;
+                uint8_t significant = 32 - lz - tz;
+                writer.put(0x3, 2);
+                writer.put(lz, 5);
+                writer.put(significant - 1, 5);
+                writer.put(xored >> tz, significant);
+            }
+        }
+    }
+
+    return writer.overflow ? 0 : SERIES_HEADER_LENGTH + writer.length();
+}
+
+bool SeriesCodec::decode(const uint8_t* payload, size_t length, DecodedSeries& out) {
+    if (length < SERIES_HEADER_LENGTH || (payload[0] >> 4) != SERIES_CODEC_VERSION) {
+        return false;
+    }
+    out.schemaHash = (uint16_t)(payload[1] | (payload[2] << 8));
+    uint8_t sampleCount = payload[3];
+    uint8_t seriesCount = payload[4];
+    if (sampleCount == 0 || seriesCount == 0) {
+        return false;
+    }
+
+    BitReader reader = {payload + SERIES_HEADER_LENGTH, length - SERIES_HEADER_LENGTH, 0, false};
+
+    out.timestamps.assign(sampleCount, 0);
+    out.timestamps[0] = reader.get(32);
+    uint32_t delta = 0;
+    for (uint8_t i = 1; i < sampleCount; i++) {
+        delta += (uint32_t)getDeltaOfDelta(reader);
+        out.timestamps[i] = out.timestamps[i - 1] + delta;
+    }
+
+    out.series.assign(seriesCount, std::vector<float>(sampleCount));
+    for (uint8_t s = 0; s < seriesCount && !reader.error; s++) {
+        uint32_t previous = reader.get(32);
+        out.series[s][0] = bitsFloat(previous);
+        uint8_t leading = 0xFF;
+        uint8_t trailing = 0;
+        for (uint8_t i = 1; i < sampleCount && !reader.error; i++) {
+            if (reader.get(1) == 1) {
+                if (reader.get(1) == 1) {
+                    leading = (uint8_t)reader.get(5);
+                    uint8_t significant = (uint8_t)reader.get(5) + 1;
+                    if (leading + significant > 32) {
+                        return false;
+                    }
+                    trailing = 32 - leading - significant;
+                } else if (leading == 0xFF) {
+                    // Ventana reutilizada sin que exista una anterior
+                    return false;
+                }
+                previous ^= reader.get(32 - leading - trailing) << trailing;
+            }
+            out.series[s][i] = bitsFloat(previous);
+        }
+    }
+
+    // Solo puede sobrar el relleno del último byte
+    return !reader.error && (reader.bits + 7) / 8 == length - SERIES_HEADER_LENGTH;
+}
@@ -0,0 +1,185 @@
+#include "SessionStore.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <string.h>
+#include "config.h"
+#include "debug.h"
+#include "util/crc16.h"
+
+#define SESSION_STORE_MAGIC  0x53455331
+
+/**
+ * @brief Posición de la rotación y último punto de control, conservados entre
+ *        despertares. Tras un arranque en frío se reconstruyen leyendo las claves.
+ */
+struct SessionStoreState {
+    uint32_t magic;         // SESSION_STORE_MAGIC si el resto es válido
+    uint32_t sequence;      // Secuencia del próximo punto de control
+    uint8_t nextSlot;       // Clave del próximo punto de control
+    bool saved;             // Hay un punto de control de la sesión actual
+    uint32_t savedFCntUp;   // Contador de uplinks del último punto de control
+};
+
+RTC_DATA_ATTR SessionStoreState sessionStoreState = {};
+
+namespace {
+
+void slotKey(uint8_t slot, char* key) {
+    key[0] = 's';
+    key[1] = '0' + slot;
+    key[2] = '\0';
+}
+
+uint16_t slotCrc(const SessionSlot& slot) {
+    return crc16_modbus((const uint8_t*)&slot, offsetof(SessionSlot, crc));
+}
+
+} // namespace
+
+bool SessionStore::scan(SessionSlot& latest) {
+    Preferences store;
+    store.begin(SESSION_STORE_NAMESPACE, true);
+
+    bool found = false;
+    sessionStoreState.magic = SESSION_STORE_MAGIC;
+    sessionStoreState.sequence = 0;
+    sessionStoreState.nextSlot = 0;
+    for (uint8_t i = 0; i < SESSION_STORE_SLOTS; i++) {
+        char key[3];
+        slotKey(i, key);
+        SessionSlot slot;
+        if (store.getBytes(key, &slot, sizeof(slot)) != sizeof(slot) || slot.crc != slotCrc(slot)) {
+            continue;
+        }
+        if (!found || (int32_t)(slot.sequence - latest.sequence) > 0) {
+            latest = slot;
+            found = true;
+            sessionStoreState.sequence = slot.sequence + 1;
+            sessionStoreState.nextSlot = (i + 1) % SESSION_STORE_SLOTS;
+        }
+    }
+    store.end();
+    return found;
+}
+
+void SessionStore::save(const uint8_t* session, uint32_t fCntUp) {
+    if (sessionStoreState.magic != SESSION_STORE_MAGIC) {
+        SessionSlot latest;
+        scan(latest);
+        sessionStoreState.saved = false;
+    }
+    if (sessionStoreState.saved && fCntUp - sessionStoreState.savedFCntUp < SESSION_FCNT_CHECKPOINT) {
+        return;
+    }
+
+    SessionSlot slot;
+    slot.sequence = sessionStoreState.sequence;
+    slot.fCntUp = fCntUp;
+    memcpy(slot.session, session, sizeof(slot.session));
+    slot.crc = slotCrc(slot);
+
+    char key[3];
+    slotKey(sessionStoreState.nextSlot, key);
+    Preferences store;
+    store.begin(SESSION_STORE_NAMESPACE, false);
+    size_t written = store.putBytes(key, &slot, sizeof(slot));
+    store.end();
+    if (written != sizeof(slot)) {
+        DEBUG_PRINTLN("Error al guardar la sesión LoRaWAN en flash");
+        return;
+    }
+
+    DEBUG_PRINTF("Sesión LoRaWAN guardada en flash (clave %s, FCntUp %lu)\n", key, (unsigned long)fCntUp);
+    sessionStoreState.sequence++;
+    sessionStoreState.nextSlot = (sessionStoreState.nextSlot + 1) % SESSION_STORE_SLOTS;
+    sessionStoreState.saved = true;
+    sessionStoreState.savedFCntUp = fCntUp;
+}
+
+void SessionStore::markNewSession() {
+    sessionStoreState.saved = false;
+}
+
+bool SessionStore::restore(uint8_t* session, uint32_t& fCntUp) {
+    SessionSlot latest;
+    if (!scan(latest)) {
+        sessionStoreState.saved = false;
+        return false;
+    }
+    if (!advanceFCntUp(latest.session, latest.fCntUp, SESSION_FCNT_SKIP)) {
+        DEBUG_PRINTLN("Sesión en flash con formato desconocido: se descarta");
+        sessionStoreState.saved = false;
+        return false;
+    }
+
+    memcpy(session, latest.session, sizeof(latest.session));
+    fCntUp = latest.fCntUp + SESSION_FCNT_SKIP;
+
+    // El contador adelantado no está en ningún punto de control: grabarlo en el próximo save
+    sessionStoreState.saved = false;
+    return true;
+}
+
+void SessionStore::clear() {
+    Preferences store;
+    store.begin(SESSION_STORE_NAMESPACE, false);
+    store.clear();
+    store.end();
+    sessionStoreState = {};
+    sessionStoreState.magic = SESSION_STORE_MAGIC;
+}
+
+bool SessionStore::advanceFCntUp(uint8_t* session, uint32_t savedFCntUp, uint32_t skip) {
+#if defined(RADIOLIB_LORAWAN_SESSION_FCNT_UP) && defined(RADIOLIB_LORAWAN_SESSION_SIGNATURE)
+    const size_t signatureOffset = RADIOLIB_LORAWAN_SESSION_SIGNATURE;
+    const size_t fCntOffset = RADIOLIB_LORAWAN_SESSION_FCNT_UP;
+    if (signatureOffset + 2 > RADIOLIB_LORAWAN_SESSION_BUF_SIZE || fCntOffset + 4 > signatureOffset) {
+        return false;
+    }
+
+    // Firma de RadioLib: XOR de las palabras de 16 bits previas a la firma. Se acepta en
+    // cualquiera de los dos órdenes de bytes y se vuelve a escribir en el mismo
+    auto signature = [&]() {
+        uint16_t sum = 0;
+        for (size_t i = 0; i + 1 < signatureOffset; i += 2) {
+            sum ^= ((uint16_t)session[i] << 8) | session[i + 1];
+        }
+        if (signatureOffset % 2) {
+            sum ^= (uint16_t)session[signatureOffset - 1] << 8;
+        }
+        return sum;
+    };
+    uint16_t stored = (uint16_t)session[signatureOffset] | ((uint16_t)session[signatureOffset + 1] << 8);
+    uint16_t computed = signature();
+    bool littleEndian;
+    if (stored == computed) {
+        littleEndian = true;
+    } else if (stored == (uint16_t)((computed >> 8) | (computed << 8))) {
+        littleEndian = false;
+    } else {
+        return false;
+    }
+
+    // El contador del buffer debe coincidir con el registrado al grabar
+    uint8_t* field = session + fCntOffset;
+    uint32_t fCnt = (uint32_t)field[0] | ((uint32_t)field[1] << 8) | ((uint32_t)field[2] << 16) |
+                    ((uint32_t)field[3] << 24);
+    if (fCnt != savedFCntUp) {
+        return false;
+    }
+    fCnt += skip;
+    for (uint8_t i = 0; i < 4; i++) {
+        field[i] = (fCnt >> (8 * i)) & 0xFF;
+    }
+
+    computed = signature();
+    if (!littleEndian) {
+        computed = (computed >> 8) | (computed << 8);
+    }
+    session[signatureOffset] = computed & 0xFF;
+    session[signatureOffset + 1] = computed >> 8;
+    return true;
+#else
+    return false;
+#endif
+}
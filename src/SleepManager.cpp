@@ -2,16 +2,20 @@
 #include "debug.h"
 #include "LoRaManager.h"
 #include "esp_sleep.h"
+#include "ClockSync.h"
 
 void SleepManager::goToDeepSleep(uint32_t timeToSleep, 
                                PowerManager& powerManager,
                                SX1262* radio,
-                               LoRaWANNode& node,
+                               LoRaNode& node,
                                uint8_t* LWsession,
                                SPIClass& spi) {
     // Guardar sesión en RTC y otras rutinas de apagado
     uint8_t *persist = node.getBufferSession();
     memcpy(LWsession, persist, RADIOLIB_LORAWAN_SESSION_BUF_SIZE);
+
+    // Punto de control en flash para sobrevivir a un corte de energía
+    LoRaManager::persistSession(node);
     
     // Apagar todos los reguladores
     powerManager.allPowerOff();
@@ -30,7 +34,8 @@ void SleepManager::goToDeepSleep(uint32_t timeToSleep,
     spi.end();
     
     // Configurar el temporizador y GPIO para despertar
-    esp_sleep_enable_timer_wakeup(timeToSleep * 1000000ULL);
+    // Temporizador corregido por la deriva estimada del RTC
+    esp_sleep_enable_timer_wakeup(ClockSync::sleepMicros(timeToSleep));
     gpio_wakeup_enable((gpio_num_t)CONFIG_PIN, GPIO_INTR_LOW_LEVEL);
     esp_sleep_enable_gpio_wakeup();
     esp_sleep_enable_ext0_wakeup((gpio_num_t)CONFIG_PIN, 0); // 0 para nivel bajo
@@ -0,0 +1,300 @@
+#include "UplinkQueue.h"
+#include <Arduino.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "config.h"
+#include "debug.h"
+#include "util/crc16.h"
+
+#define UPLINK_QUEUE_MAGIC  0x55510001
+
+/**
+ * @brief Posiciones de la cola, conservadas entre despertares.
+ */
+struct UplinkQueueState {
+    uint32_t magic;         // UPLINK_QUEUE_MAGIC si el resto es válido
+    uint32_t head;          // Posición donde se escribe el próximo registro
+    uint32_t tail;          // Registro pendiente más antiguo (head si no hay)
+    uint32_t sequence;      // Secuencia del próximo registro
+    uint16_t pending;       // Registros pendientes
+    uint32_t dropped;       // Registros descartados por cola llena
+};
+
+RTC_DATA_ATTR UplinkQueueState queueState = {};
+
+static const esp_partition_t* queuePartition = nullptr;
+
+namespace {
+
+uint32_t recordSize(uint16_t length) {
+    return sizeof(UplinkQueueHeader) + length;
+}
+
+/**
+ * @brief Inicio de la página siguiente, dando la vuelta al final de la partición.
+ */
+uint32_t nextPage(uint32_t offset, uint32_t partitionSize) {
+    uint32_t next = (offset / UPLINK_QUEUE_PAGE_SIZE + 1) * UPLINK_QUEUE_PAGE_SIZE;
+    return (next >= partitionSize) ? 0 : next;
+}
+
+/**
+ * @brief Posición válida para una cabecera: si no cabe en lo que queda de página, la
+ *        siguiente.
+ */
+uint32_t alignHeader(uint32_t offset, uint32_t partitionSize) {
+    if (offset >= partitionSize) {
+        return 0;
+    }
+    if (UPLINK_QUEUE_PAGE_SIZE - offset % UPLINK_QUEUE_PAGE_SIZE < sizeof(UplinkQueueHeader)) {
+        return nextPage(offset, partitionSize);
+    }
+    return offset;
+}
+
+} // namespace
+
+bool UplinkQueue::begin() {
+    if (queuePartition == nullptr) {
+        queuePartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                  (esp_partition_subtype_t)UPLINK_QUEUE_PARTITION_SUBTYPE,
+                                                  UPLINK_QUEUE_PARTITION);
+        if (queuePartition == nullptr) {
+            DEBUG_PRINTLN("Partición de la cola de uplinks no encontrada");
+            return false;
+        }
+    }
+    if (queueState.magic != UPLINK_QUEUE_MAGIC || queueState.head >= queuePartition->size ||
+        queueState.tail >= queuePartition->size) {
+        recover();
+    }
+    return true;
+}
+
+bool UplinkQueue::push(uint8_t fPort, uint32_t timestamp, const uint8_t* payload, size_t length) {
+    if (!begin() || length > UPLINK_QUEUE_MAX_PAYLOAD) {
+        return false;
+    }
+
+    // El registro entero va en una página: una sola programación
+    uint32_t size = recordSize((uint16_t)length);
+    uint32_t offset = alignHeader(queueState.head, queuePartition->size);
+    if (UPLINK_QUEUE_PAGE_SIZE - offset % UPLINK_QUEUE_PAGE_SIZE < size) {
+        offset = nextPage(offset, queuePartition->size);
+    }
+    if (offset % UPLINK_QUEUE_SECTOR_SIZE == 0) {
+        eraseSectorAt(offset);
+    }
+
+    uint8_t record[UPLINK_QUEUE_PAGE_SIZE];
+    UplinkQueueHeader header = {};
+    header.state = UPLINK_QUEUE_STATE_PENDING;
+    header.reserved0 = 0xFF;
+    header.fPort = fPort;
+    header.reserved1 = 0xFF;
+    header.length = (uint16_t)length;
+    header.sequence = queueState.sequence;
+    header.timestamp = timestamp;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), payload, length);
+    header.crc = crc16_modbus(record + offsetof(UplinkQueueHeader, fPort),
+                              size - offsetof(UplinkQueueHeader, fPort));
+    memcpy(record + offsetof(UplinkQueueHeader, crc), &header.crc, sizeof(header.crc));
+
+    if (esp_partition_write(queuePartition, offset, record, size) != ESP_OK) {
+        // La página pudo quedar a medio programar: no volver a escribir en ella
+        DEBUG_PRINTLN("Error al grabar en la cola de uplinks");
+        queueState.head = nextPage(offset, queuePartition->size);
+        return false;
+    }
+
+    if (queueState.pending == 0) {
+        queueState.tail = offset;
+    }
+    queueState.pending++;
+    queueState.sequence++;
+    queueState.head = offset + size;
+    return true;
+}
+
+bool UplinkQueue::peek(QueuedUplink& uplink) {
+    if (!begin() || queueState.pending == 0) {
+        return false;
+    }
+    queueState.tail = seekPending(queueState.tail);
+    UplinkQueueHeader header;
+    if (queueState.tail == queueState.head || !readRecord(queueState.tail, header, uplink.payload)) {
+        queueState.pending = 0;
+        return false;
+    }
+    uplink.fPort = header.fPort;
+    uplink.timestamp = header.timestamp;
+    uplink.length = header.length;
+    return true;
+}
+
+void UplinkQueue::pop() {
+    if (!begin() || queueState.pending == 0) {
+        return;
+    }
+    queueState.tail = seekPending(queueState.tail);
+    UplinkQueueHeader header;
+    if (queueState.tail == queueState.head || !readRecord(queueState.tail, header, nullptr)) {
+        queueState.pending = 0;
+        return;
+    }
+
+    // Solo baja bits del estado: no hace falta borrar
+    uint8_t state = UPLINK_QUEUE_STATE_DELIVERED;
+    esp_partition_write(queuePartition, queueState.tail + offsetof(UplinkQueueHeader, state), &state, 1);
+    queueState.pending--;
+    queueState.tail = (queueState.pending > 0)
+                          ? seekPending(queueState.tail + recordSize(header.length))
+                          : queueState.head;
+}
+
+uint16_t UplinkQueue::size() {
+    return begin() ? queueState.pending : 0;
+}
+
+uint32_t UplinkQueue::dropped() {
+    return queueState.dropped;
+}
+
+bool UplinkQueue::readRecord(uint32_t offset, UplinkQueueHeader& header, uint8_t* payload) {
+    uint32_t room = UPLINK_QUEUE_PAGE_SIZE - offset % UPLINK_QUEUE_PAGE_SIZE;
+    if (room < sizeof(header)) {
+        return false;
+    }
+
+    // Se lee hasta el final de la página: el registro nunca la cruza
+    uint8_t record[UPLINK_QUEUE_PAGE_SIZE];
+    if (esp_partition_read(queuePartition, offset, record, room) != ESP_OK) {
+        return false;
+    }
+    memcpy(&header, record, sizeof(header));
+    if ((header.state != UPLINK_QUEUE_STATE_PENDING && header.state != UPLINK_QUEUE_STATE_DELIVERED) ||
+        recordSize(header.length) > room) {
+        return false;
+    }
+    uint16_t crc = crc16_modbus(record + offsetof(UplinkQueueHeader, fPort),
+                                recordSize(header.length) - offsetof(UplinkQueueHeader, fPort));
+    if (crc != header.crc) {
+        return false;
+    }
+    if (payload != nullptr) {
+        memcpy(payload, record + sizeof(header), header.length);
+    }
+    return true;
+}
+
+uint32_t UplinkQueue::seekPending(uint32_t offset) {
+    uint32_t head = queueState.head;
+    for (uint32_t guard = queuePartition->size / sizeof(UplinkQueueHeader); guard > 0; guard--) {
+        offset = alignHeader(offset, queuePartition->size);
+        if (offset == head) {
+            return head;
+        }
+        UplinkQueueHeader header;
+        if (readRecord(offset, header, nullptr)) {
+            if (header.state == UPLINK_QUEUE_STATE_PENDING) {
+                return offset;
+            }
+            offset += recordSize(header.length);
+        } else {
+            // Relleno de fin de página o registro dañado: seguir en la página siguiente
+            uint32_t next = nextPage(offset, queuePartition->size);
+            offset = (offset < head && head < next) ? head : next;
+        }
+    }
+    return head;
+}
+
+void UplinkQueue::eraseSectorAt(uint32_t offset) {
+    uint32_t sector = offset - offset % UPLINK_QUEUE_SECTOR_SIZE;
+    uint32_t sectorEnd = sector + UPLINK_QUEUE_SECTOR_SIZE;
+
+    // Cola llena: el sector a reutilizar tiene los registros pendientes más antiguos
+    if (queueState.pending > 0 && queueState.tail >= sector && queueState.tail < sectorEnd) {
+        uint16_t lost = 0;
+        uint32_t position = queueState.tail;
+        while (position < sectorEnd) {
+            UplinkQueueHeader header;
+            if (readRecord(position, header, nullptr)) {
+                lost += (header.state == UPLINK_QUEUE_STATE_PENDING) ? 1 : 0;
+                position = alignHeader(position + recordSize(header.length), queuePartition->size);
+            } else {
+                position = (position / UPLINK_QUEUE_PAGE_SIZE + 1) * UPLINK_QUEUE_PAGE_SIZE;
+            }
+            if (position == 0) {
+                break;
+            }
+        }
+        lost = (lost > queueState.pending) ? queueState.pending : lost;
+        queueState.pending -= lost;
+        queueState.dropped += lost;
+        DEBUG_PRINTF("Cola de uplinks llena: se descartan %u registros antiguos\n", lost);
+
+        queueState.head = sector;
+        queueState.tail = (queueState.pending > 0)
+                              ? seekPending(sectorEnd >= queuePartition->size ? 0 : sectorEnd)
+                              : sector;
+    }
+
+    esp_partition_erase_range(queuePartition, sector, UPLINK_QUEUE_SECTOR_SIZE);
+}
+
+void UplinkQueue::recover() {
+    queueState = {};
+    queueState.magic = UPLINK_QUEUE_MAGIC;
+
+    bool found = false;
+    uint32_t lastSequence = 0;
+    uint32_t oldestPending = UINT32_MAX;
+    for (uint32_t page = 0; page < queuePartition->size; page += UPLINK_QUEUE_PAGE_SIZE) {
+        uint32_t offset = page;
+        UplinkQueueHeader header;
+        while (offset - page + sizeof(header) <= UPLINK_QUEUE_PAGE_SIZE && readRecord(offset, header, nullptr)) {
+            if (!found || header.sequence >= lastSequence) {
+                lastSequence = header.sequence;
+                queueState.head = offset + recordSize(header.length);
+            }
+            if (header.state == UPLINK_QUEUE_STATE_PENDING) {
+                queueState.pending++;
+                if (header.sequence < oldestPending) {
+                    oldestPending = header.sequence;
+                    queueState.tail = offset;
+                }
+            }
+            found = true;
+            offset += recordSize(header.length);
+        }
+    }
+
+    if (found) {
+        // Tras el último registro puede haber uno a medio escribir, en su página o en la
+        // siguiente: seguir en la primera página borrada (o en un sector nuevo, que se borra)
+        queueState.sequence = lastSequence + 1;
+        if (queueState.head % UPLINK_QUEUE_PAGE_SIZE != 0) {
+            queueState.head = nextPage(queueState.head, queuePartition->size);
+        } else if (queueState.head >= queuePartition->size) {
+            queueState.head = 0;
+        }
+        uint8_t page[UPLINK_QUEUE_PAGE_SIZE];
+        while (queueState.head % UPLINK_QUEUE_SECTOR_SIZE != 0 &&
+               esp_partition_read(queuePartition, queueState.head, page, sizeof(page)) == ESP_OK) {
+            bool erased = true;
+            for (size_t i = 0; i < sizeof(page) && erased; i++) {
+                erased = (page[i] == 0xFF);
+            }
+            if (erased) {
+                break;
+            }
+            queueState.head = nextPage(queueState.head, queuePartition->size);
+        }
+    }
+    if (queueState.pending == 0) {
+        queueState.tail = queueState.head;
+    }
+    DEBUG_PRINTF("Cola de uplinks recuperada: %u pendientes\n", queueState.pending);
+}
@@ -5,6 +5,7 @@
 #include "sensor_types.h"
 #include <Preferences.h>
 #include <Arduino.h> // Incluido para usar Serial
+#include "debug.h"
 
 /* =========================================================================
    FUNCIONES AUXILIARES
@@ -124,6 +125,15 @@ void ConfigManager::initializeDefaultConfig() {
             sensorObj[KEY_SENSOR_ID] = config.sensorId;
             sensorObj[KEY_SENSOR_TYPE] = static_cast<int>(config.type);
             sensorObj[KEY_SENSOR_ENABLE] = config.enable;
+            if (config.type == DS18B20) {
+                sensorObj[KEY_SENSOR_PRECISION] = config.precision;
+            }
+            if (config.priority != 0) {
+                sensorObj[KEY_SENSOR_PRIORITY] = config.priority;
+            }
+            if (config.period > 1) {
+                sensorObj[KEY_SENSOR_PERIOD] = config.period;
+            }
         }
         
         String jsonString;
@@ -170,6 +180,12 @@ void ConfigManager::initializeDefaultConfig() {
         prefs.putString(NAMESPACE_SENSORS_MODBUS, jsonString.c_str());
         prefs.end();
     }
+
+    // Mapas de registros: sin mapas guardados, se usan los integrados
+    setModbusDeviceDescriptors(std::vector<ModbusDeviceDescriptor>());
+
+    // Sin inventario: se sondean todas las direcciones configuradas
+    clearModbusInventory();
 }
 
 void ConfigManager::getSystemConfig(bool &initialized, uint32_t &sleepTime, String &deviceId, String &stationId) {
@@ -213,6 +229,9 @@ std::vector<SensorConfig> ConfigManager::getAllSensorConfigs() {
         strncpy(config.sensorId, sensorId, sizeof(config.sensorId));
         config.type = static_cast<SensorType>(sensorObj[KEY_SENSOR_TYPE] | 0);
         config.enable = sensorObj[KEY_SENSOR_ENABLE] | false;
+        config.precision = sensorObj[KEY_SENSOR_PRECISION] | 0.0f;
+        config.priority = sensorObj[KEY_SENSOR_PRIORITY] | 0;
+        config.period = sensorObj[KEY_SENSOR_PERIOD] | 0;
         
         configs.push_back(config);
     }
@@ -245,6 +264,15 @@ void ConfigManager::setSensorsConfigs(const std::vector<SensorConfig>& configs)
         sensorObj[KEY_SENSOR_ID] = sensor.sensorId;
         sensorObj[KEY_SENSOR_TYPE] = static_cast<int>(sensor.type);
         sensorObj[KEY_SENSOR_ENABLE] = sensor.enable;
+        if (sensor.type == DS18B20) {
+            sensorObj[KEY_SENSOR_PRECISION] = sensor.precision;
+        }
+        if (sensor.priority != 0) {
+            sensorObj[KEY_SENSOR_PRIORITY] = sensor.priority;
+        }
+        if (sensor.period > 1) {
+            sensorObj[KEY_SENSOR_PERIOD] = sensor.period;
+        }
     }
     
     String jsonString;
@@ -303,6 +331,15 @@ void ConfigManager::setModbusSensorsConfigs(const std::vector<ModbusSensorConfig
         sensorObj[KEY_MODBUS_SENSOR_TYPE] = static_cast<int>(sensor.type);
         sensorObj[KEY_MODBUS_SENSOR_ADDR] = sensor.address;
         sensorObj[KEY_MODBUS_SENSOR_ENABLE] = sensor.enable;
+        if (sensor.bus != 0) {
+            sensorObj[KEY_MODBUS_SENSOR_BUS] = sensor.bus;
+        }
+        if (sensor.priority != 0) {
+            sensorObj[KEY_MODBUS_SENSOR_PRIORITY] = sensor.priority;
+        }
+        if (sensor.period > 1) {
+            sensorObj[KEY_MODBUS_SENSOR_PERIOD] = sensor.period;
+        }
     }
     
     String jsonString;
@@ -326,6 +363,9 @@ std::vector<ModbusSensorConfig> ConfigManager::getAllModbusSensorConfigs() {
             config.type = static_cast<SensorType>(sensorObj[KEY_MODBUS_SENSOR_TYPE] | 0);
             config.address = sensorObj[KEY_MODBUS_SENSOR_ADDR] | 1;
             config.enable = sensorObj[KEY_MODBUS_SENSOR_ENABLE] | false;
+            config.bus = sensorObj[KEY_MODBUS_SENSOR_BUS] | 0;
+            config.priority = sensorObj[KEY_MODBUS_SENSOR_PRIORITY] | 0;
+            config.period = sensorObj[KEY_MODBUS_SENSOR_PERIOD] | 0;
             
             configs.push_back(config);
         }
@@ -345,6 +385,214 @@ std::vector<ModbusSensorConfig> ConfigManager::getEnabledModbusSensorConfigs() {
     return enabled;
 }
 
+/* =========================================================================
+   MAPAS DE REGISTROS MODBUS
+   ========================================================================= */
+const ModbusDeviceDescriptor ConfigManager::defaultModbusDescriptors[] = DEFAULT_MODBUS_DEVICE_DESCRIPTORS;
+
+void ConfigManager::modbusDescriptorToJson(const ModbusDeviceDescriptor& descriptor, JsonObject obj) {
+    obj[KEY_MB_MAP_TYPE] = static_cast<int>(descriptor.type);
+    obj[KEY_MB_MAP_FUNCTION] = descriptor.functionCode;
+    if (descriptor.maxBlock != 0) {
+        obj[KEY_MB_MAP_MAX_BLOCK] = descriptor.maxBlock;
+    }
+    obj[KEY_MB_MAP_MAX_WAIT] = descriptor.maxWait;
+    if (descriptor.readyValue != MODBUS_NO_READY_VALUE) {
+        obj[KEY_MB_MAP_READY_VALUE] = descriptor.readyValue;
+        obj[KEY_MB_MAP_READY_MIN] = descriptor.readyMin;
+        obj[KEY_MB_MAP_READY_MAX] = descriptor.readyMax;
+    }
+
+    // Bloques como pares [inicio, cantidad]
+    JsonArray ranges = obj.createNestedArray(KEY_MB_MAP_RANGES);
+    for (uint8_t i = 0; i < descriptor.rangeCount; i++) {
+        JsonArray range = ranges.createNestedArray();
+        range.add(descriptor.ranges[i].start);
+        range.add(descriptor.ranges[i].count);
+    }
+
+    // Orden y offset solo cuando no son los valores por defecto, para ahorrar NVS
+    JsonArray values = obj.createNestedArray(KEY_MB_MAP_VALUES);
+    for (uint8_t i = 0; i < descriptor.valueCount; i++) {
+        const ModbusValueDescriptor& value = descriptor.values[i];
+        JsonObject valueObj = values.createNestedObject();
+        valueObj[KEY_MB_VALUE_REG] = value.reg;
+        valueObj[KEY_MB_VALUE_TYPE] = static_cast<int>(value.dataType);
+        if (value.order != MB_ORDER_ABCD) {
+            valueObj[KEY_MB_VALUE_ORDER] = static_cast<int>(value.order);
+        }
+        valueObj[KEY_MB_VALUE_SCALE] = value.scale;
+        if (value.offset != 0.0f) {
+            valueObj[KEY_MB_VALUE_OFFSET] = value.offset;
+        }
+    }
+}
+
+bool ConfigManager::modbusDescriptorFromJson(JsonObjectConst obj, ModbusDeviceDescriptor& descriptor) {
+    descriptor = ModbusDeviceDescriptor();
+    descriptor.type = static_cast<SensorType>(obj[KEY_MB_MAP_TYPE] | 0);
+    descriptor.functionCode = obj[KEY_MB_MAP_FUNCTION] | 0x03;
+    descriptor.maxBlock = obj[KEY_MB_MAP_MAX_BLOCK] | 0;
+    descriptor.maxWait = obj[KEY_MB_MAP_MAX_WAIT] | 500;
+    descriptor.readyValue = obj[KEY_MB_MAP_READY_VALUE] | MODBUS_NO_READY_VALUE;
+    descriptor.readyMin = obj[KEY_MB_MAP_READY_MIN] | -INFINITY;
+    descriptor.readyMax = obj[KEY_MB_MAP_READY_MAX] | INFINITY;
+    if (descriptor.functionCode != 0x03 && descriptor.functionCode != 0x04) {
+        return false;
+    }
+    if (descriptor.maxBlock > MODBUS_MAX_BLOCK_REGS || descriptor.maxWait > MODBUS_READY_MAX_WAIT) {
+        return false;
+    }
+
+    uint8_t maxBlock = descriptor.maxBlock ? descriptor.maxBlock : MODBUS_MAX_BLOCK_REGS;
+    for (JsonArrayConst range : obj[KEY_MB_MAP_RANGES].as<JsonArrayConst>()) {
+        if (descriptor.rangeCount >= MODBUS_MAX_RANGES) {
+            return false;
+        }
+        ModbusRegisterRange& r = descriptor.ranges[descriptor.rangeCount++];
+        r.start = range[0] | 0;
+        r.count = range[1] | 0;
+        if (r.count == 0 || r.count > maxBlock) {
+            return false;
+        }
+    }
+
+    for (JsonObjectConst valueObj : obj[KEY_MB_MAP_VALUES].as<JsonArrayConst>()) {
+        if (descriptor.valueCount >= MODBUS_MAX_VALUES) {
+            return false;
+        }
+        ModbusValueDescriptor& value = descriptor.values[descriptor.valueCount++];
+        value.reg = valueObj[KEY_MB_VALUE_REG] | 0;
+        value.dataType = static_cast<ModbusDataType>(valueObj[KEY_MB_VALUE_TYPE] | 0);
+        value.order = static_cast<ModbusWordOrder>(valueObj[KEY_MB_VALUE_ORDER] | 0);
+        value.scale = valueObj[KEY_MB_VALUE_SCALE] | 1.0f;
+        value.offset = valueObj[KEY_MB_VALUE_OFFSET] | 0.0f;
+        if (value.dataType > MB_FLOAT32 || value.order > MB_ORDER_DCBA) {
+            return false;
+        }
+
+        // El valor completo debe caer dentro de un único bloque leído
+        uint8_t words = (value.dataType >= MB_UINT32) ? 2 : 1;
+        bool covered = false;
+        for (uint8_t i = 0; i < descriptor.rangeCount; i++) {
+            const ModbusRegisterRange& r = descriptor.ranges[i];
+            if (value.reg >= r.start && value.reg + words <= r.start + r.count) {
+                covered = true;
+                break;
+            }
+        }
+        if (!covered) {
+            return false;
+        }
+    }
+
+    if (descriptor.readyValue != MODBUS_NO_READY_VALUE && descriptor.readyValue >= descriptor.valueCount) {
+        return false;
+    }
+
+    return descriptor.type != 0 && descriptor.rangeCount > 0 && descriptor.valueCount > 0;
+}
+
+void ConfigManager::setModbusDeviceDescriptors(const std::vector<ModbusDeviceDescriptor>& descriptors) {
+    DynamicJsonDocument doc(JSON_DOC_SIZE_MODBUS_MAPS);
+    JsonArray mapArray = doc.to<JsonArray>();
+    for (const auto& descriptor : descriptors) {
+        modbusDescriptorToJson(descriptor, mapArray.createNestedObject());
+    }
+
+    Preferences prefs;
+    prefs.begin(NAMESPACE_MODBUS_MAPS, false);
+    String jsonString;
+    serializeJson(doc, jsonString);
+    prefs.putString(NAMESPACE_MODBUS_MAPS, jsonString.c_str());
+    prefs.end();
+}
+
+std::vector<ModbusDeviceDescriptor> ConfigManager::getModbusDeviceDescriptors() {
+    std::vector<ModbusDeviceDescriptor> descriptors;
+
+    Preferences prefs;
+    prefs.begin(NAMESPACE_MODBUS_MAPS, true);
+    String jsonString = prefs.getString(NAMESPACE_MODBUS_MAPS, "[]");
+    prefs.end();
+
+    DynamicJsonDocument doc(JSON_DOC_SIZE_MODBUS_MAPS);
+    if (deserializeJson(doc, jsonString) == DeserializationError::Ok && doc.is<JsonArray>()) {
+        for (JsonObjectConst obj : doc.as<JsonArrayConst>()) {
+            ModbusDeviceDescriptor descriptor;
+            if (modbusDescriptorFromJson(obj, descriptor)) {
+                descriptors.push_back(descriptor);
+            } else {
+                DEBUG_PRINTLN("Mapa Modbus inválido en NVS, se ignora");
+            }
+        }
+    }
+
+    // Completar con los mapas integrados de los tipos sin mapa guardado
+    size_t count = sizeof(defaultModbusDescriptors) / sizeof(defaultModbusDescriptors[0]);
+    for (size_t i = 0; i < count; i++) {
+        bool overridden = false;
+        for (const auto& descriptor : descriptors) {
+            if (descriptor.type == defaultModbusDescriptors[i].type) {
+                overridden = true;
+                break;
+            }
+        }
+        if (!overridden) {
+            descriptors.push_back(defaultModbusDescriptors[i]);
+        }
+    }
+
+    return descriptors;
+}
+
+/* =========================================================================
+   INVENTARIO DE ESCLAVOS MODBUS
+   ========================================================================= */
+void ConfigManager::setModbusInventory(uint8_t firstAddress, uint8_t lastAddress,
+                                       const std::vector<ModbusInventoryEntry>& devices) {
+    StaticJsonDocument<JSON_DOC_SIZE_MEDIUM> doc;
+    doc[KEY_MB_INV_FIRST] = firstAddress;
+    doc[KEY_MB_INV_LAST] = lastAddress;
+    JsonArray deviceArray = doc.createNestedArray(KEY_MB_INV_DEVICES);
+    for (const auto& device : devices) {
+        JsonObject deviceObj = deviceArray.createNestedObject();
+        deviceObj[KEY_MB_INV_ADDR] = device.address;
+        deviceObj[KEY_MB_INV_TYPE] = static_cast<int>(device.type);
+        if (device.bus != 0) {
+            deviceObj[KEY_MB_INV_BUS] = device.bus;
+        }
+    }
+    writeNamespace(NAMESPACE_MODBUS_INVENTORY, doc);
+}
+
+bool ConfigManager::getModbusInventory(uint8_t& firstAddress, uint8_t& lastAddress,
+                                       std::vector<ModbusInventoryEntry>& devices) {
+    StaticJsonDocument<JSON_DOC_SIZE_MEDIUM> doc;
+    readNamespace(NAMESPACE_MODBUS_INVENTORY, doc);
+
+    devices.clear();
+    if (!doc.containsKey(KEY_MB_INV_DEVICES)) {
+        return false;
+    }
+    firstAddress = doc[KEY_MB_INV_FIRST] | MODBUS_SCAN_FIRST_ADDRESS;
+    lastAddress = doc[KEY_MB_INV_LAST] | MODBUS_SCAN_LAST_ADDRESS;
+    for (JsonObject deviceObj : doc[KEY_MB_INV_DEVICES].as<JsonArray>()) {
+        ModbusInventoryEntry device;
+        device.bus = deviceObj[KEY_MB_INV_BUS] | 0;
+        device.address = deviceObj[KEY_MB_INV_ADDR] | 0;
+        device.type = static_cast<SensorType>(deviceObj[KEY_MB_INV_TYPE] | 0);
+        devices.push_back(device);
+    }
+    return true;
+}
+
+void ConfigManager::clearModbusInventory() {
+    StaticJsonDocument<JSON_DOC_SIZE_MEDIUM> doc;
+    doc.to<JsonObject>();
+    writeNamespace(NAMESPACE_MODBUS_INVENTORY, doc);
+}
+
 /* =========================================================================
    CONFIGURACIÓN DE SENSORES ANALÓGICOS
    ========================================================================= */
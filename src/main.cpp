@@ -29,6 +29,8 @@
 #include "HardwareManager.h"
 #include "SleepManager.h"
 #include "SHT31.h"
+#include "DownlinkProcessor.h"
+#include "ClockSync.h"
 //--------------------------------------------------------------------------------------------
 // Variables globales
 //--------------------------------------------------------------------------------------------
@@ -57,7 +59,8 @@ MAX31865_RTD rtd(MAX31865_RTD::RTD_PT100, spi, spiRtdSettings, PT100_CS_PIN);
 SHT31 sht30Sensor(0x44, &Wire);
 
 SX1262 radio = new Module(LORA_NSS_PIN, LORA_DIO1_PIN, LORA_RST_PIN, LORA_BUSY_PIN, spi, spiRadioSettings);
-LoRaWANNode node(&radio, &Region, subBand);
+LoRaWANNode lorawanNode(&radio, &Region, subBand);
+RadioLibNode node(lorawanNode, radio);
 
 OneWire oneWire(ONE_WIRE_BUS);
 DallasTemperature dallasTemp(&oneWire);
@@ -75,6 +78,7 @@ void setup() {
     DEBUG_BEGIN(SERIAL_BAUD_RATE);
 
     SleepManager::releaseHeldPins();
+    bootCount++;
 
     // // Inicialización del NVS y de hardware I2C/IO
     // preferences.clear();
@@ -115,9 +119,19 @@ void setup() {
         rtc.setTime(0, 0, 0, 1, 1, 2023);  // 01/01/2023 00:00:00
     }
 
+    // Descontar la deriva del RTC acumulada durante el sleep
+    ClockSync::correct();
+
     // Inicializar sensores
     SensorManager::beginSensors(enabledNormalSensors);
 
+#ifdef MODBUS_SCAN_ON_COLD_BOOT
+    // Arranque en frío (no viene de deep sleep): rehacer el inventario de esclavos Modbus
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED && !enabledModbusSensors.empty()) {
+        SensorManager::discoverModbusDevices(MODBUS_SCAN_FIRST_ADDRESS, MODBUS_SCAN_LAST_ADDRESS);
+    }
+#endif
+
     //TIEMPO TRASCURRIDO HASTA EL MOMENTO ≈ 98 ms
     // Inicializar radio LoRa
     int16_t state = radio.begin();
@@ -131,6 +145,12 @@ void setup() {
     if (state != RADIOLIB_LORAWAN_NEW_SESSION && 
         state != RADIOLIB_LORAWAN_SESSION_RESTORED) {
         DEBUG_PRINTF("Error activando LoRaWAN o sincronizando RTC: %d\n", state);
+
+        // Sin red: las lecturas se guardan en flash y se envían al recuperar la conexión
+        std::vector<SensorReading> normalReadings;
+        std::vector<ModbusSensorReading> modbusReadings;
+        SensorManager::getAllSensorReadings(normalReadings, modbusReadings, enabledNormalSensors, enabledModbusSensors);
+        LoRaManager::queueReadings(normalReadings, modbusReadings, deviceId, stationId, rtc);
         SleepManager::goToDeepSleep(timeToSleep, powerManager, &radio, node, LWsession, spi);
     }
 }
@@ -150,8 +170,25 @@ void loop() {
     std::vector<ModbusSensorReading> modbusReadings;
     SensorManager::getAllSensorReadings(normalReadings, modbusReadings, enabledNormalSensors, enabledModbusSensors);
 
+#ifdef UPLINK_BINARY_FORMAT
+    // Formato binario compacto: IDs implícitos en el esquema, valores en punto fijo
+    std::vector<uint8_t> priorities;
+    for (const auto& sensor : enabledNormalSensors) {
+        priorities.push_back(sensor.priority);
+    }
+    for (const auto& sensor : enabledModbusSensors) {
+        priorities.push_back(sensor.priority);
+    }
+    LoRaManager::sendBinaryPayload(normalReadings, modbusReadings, priorities, node, deviceId, stationId, rtc);
+#else
     // Usar el nuevo formato delimitado en lugar de JSON
     LoRaManager::sendDelimitedPayload(normalReadings, modbusReadings, node, deviceId, stationId, rtc);
+#endif
+
+    // Un downlink pudo cambiar el tiempo de sleep: dormir ya con el nuevo
+    if (DownlinkProcessor::configChanged()) {
+        ConfigManager::getSystemConfig(systemInitialized, timeToSleep, deviceId, stationId);
+    }
 
     // Calcular y mostrar el tiempo transcurrido antes de dormir
     unsigned long elapsedTime = millis() - setupStartTime;
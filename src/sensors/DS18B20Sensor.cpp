@@ -2,19 +2,217 @@
 
 #if defined(DEVICE_TYPE_BASIC) || defined(DEVICE_TYPE_ANALOGIC)
 
+#include <string.h>
+
+#define DS18B20_CMD_CONVERT_T   0x44    // Inicia la conversión de temperatura
+
+// Caché de direcciones ROM, sobrevive al deep sleep
+RTC_DATA_ATTR DS18B20RomCache ds18b20RomCache = {};
+
+bool DS18B20Sensor::conversionStarted = false;
+uint32_t DS18B20Sensor::conversionStartTime = 0;
+uint16_t DS18B20Sensor::conversionTime = 0;
+
 /**
- * @brief Lee la temperatura del sensor DS18B20
- * 
+ * @brief Restaura las direcciones ROM desde memoria RTC (o busca en el bus si la caché
+ *        no cubre los sensores configurados) e inicia una conversión broadcast sin bloquear.
+ * @param enabledNormalSensors Vector con las configuraciones de sensores habilitados
+ */
+void DS18B20Sensor::begin(const std::vector<SensorConfig>& enabledNormalSensors) {
+    // Solo recorrer el bus (≈ 65 ms) cuando la caché RTC no sirve
+    if (!cacheCoversSensors(enabledNormalSensors)) {
+        discoverBus(enabledNormalSensors);
+    }
+
+    // La sonda más precisa marca el tiempo de espera de la conversión broadcast
+    uint8_t busResolution = applyResolutions(enabledNormalSensors);
+
+    // Conversión broadcast (Skip ROM) para todas las sondas a la vez, sin esperar
+    startConversion();
+    conversionStartTime = millis();
+    conversionTime = DallasTemperature::millisToWaitForConversion(busResolution);
+    conversionStarted = true;
+
+    DEBUG_PRINTF("DS18B20: %u sondas en caché%s, conversión de %u bits (%u ms) iniciada\n",
+                 ds18b20RomCache.count, ds18b20RomCache.parasite ? " (parásitas)" : "",
+                 busResolution, conversionTime);
+}
+
+/**
+ * @brief Lee la temperatura de la sonda asociada al ID de sensor indicado.
+ * @param sensorId ID del sensor configurado
  * @return float Temperatura en °C, o NAN si hay error
  */
-float DS18B20Sensor::read() {
-    dallasTemp.requestTemperatures();
-    float temp = dallasTemp.getTempCByIndex(0);
+float DS18B20Sensor::read(const char* sensorId) {
+    int index = findSensor(sensorId);
+    if (index < 0) {
+        return NAN;
+    }
+
+    waitForConversion();
+
+    // Leer scratchpad directamente por dirección (valida CRC)
+    float temp = dallasTemp.getTempC(ds18b20RomCache.rom[index]);
     if (temp == DEVICE_DISCONNECTED_C) {
+        // La sonda no respondió: forzar una nueva búsqueda en el próximo ciclo
+        ds18b20RomCache.valid = false;
         return NAN;
     }
     return temp;
 }
 
+bool DS18B20Sensor::cacheCoversSensors(const std::vector<SensorConfig>& enabledNormalSensors) {
+    if (!ds18b20RomCache.valid) {
+        return false;
+    }
+    for (const auto& sensor : enabledNormalSensors) {
+        if (sensor.type == DS18B20 && sensor.enable && findSensor(sensor.sensorId) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DS18B20Sensor::discoverBus(const std::vector<SensorConfig>& enabledNormalSensors) {
+    DS18B20RomCache previous = ds18b20RomCache;
+    DS18B20RomCache fresh = {};
+
+    // Recorrer el bus una sola vez
+    DeviceAddress addr;
+    oneWire.reset_search();
+    while (fresh.count < DS18B20_MAX_SENSORS && oneWire.search(addr)) {
+        if (!dallasTemp.validAddress(addr) || !dallasTemp.validFamily(addr)) {
+            continue;
+        }
+        memcpy(fresh.rom[fresh.count], addr, sizeof(DeviceAddress));
+        fresh.sensorId[fresh.count][0] = '\0';
+        fresh.resolution[fresh.count] = 0;
+        fresh.count++;
+    }
+
+    // Conservar las asociaciones previas cuyo ID sigue configurado
+    for (uint8_t i = 0; i < fresh.count; i++) {
+        for (uint8_t j = 0; previous.valid && j < previous.count; j++) {
+            if (memcmp(fresh.rom[i], previous.rom[j], sizeof(DeviceAddress)) != 0) {
+                continue;
+            }
+            // La resolución aplicada pertenece a la sonda, no al ID
+            fresh.resolution[i] = previous.resolution[j];
+            for (const auto& sensor : enabledNormalSensors) {
+                if (sensor.type == DS18B20 && sensor.enable &&
+                    strcmp(sensor.sensorId, previous.sensorId[j]) == 0) {
+                    strlcpy(fresh.sensorId[i], previous.sensorId[j], sizeof(fresh.sensorId[i]));
+                    break;
+                }
+            }
+            break;
+        }
+    }
+
+    // Asignar las ROM libres a los IDs configurados pendientes, en orden
+    ds18b20RomCache = fresh;
+    for (const auto& sensor : enabledNormalSensors) {
+        if (sensor.type != DS18B20 || !sensor.enable || findSensor(sensor.sensorId) >= 0) {
+            continue;
+        }
+        for (uint8_t i = 0; i < ds18b20RomCache.count; i++) {
+            if (ds18b20RomCache.sensorId[i][0] == '\0') {
+                strlcpy(ds18b20RomCache.sensorId[i], sensor.sensorId, sizeof(ds18b20RomCache.sensorId[i]));
+                break;
+            }
+        }
+    }
+
+    // Read Power Supply broadcast: basta una sonda parásita para que responda 0. Sin
+    // dallasTemp.begin() la librería no lo detecta, así que se guarda en la caché RTC
+    ds18b20RomCache.parasite = ds18b20RomCache.count > 0 && dallasTemp.readPowerSupply();
+
+    ds18b20RomCache.valid = ds18b20RomCache.count > 0;
+    DEBUG_PRINTF("DS18B20: búsqueda en bus, %u sondas encontradas%s\n", ds18b20RomCache.count,
+                 ds18b20RomCache.parasite ? " (alimentación parásita)" : "");
+}
+
+int DS18B20Sensor::findSensor(const char* sensorId) {
+    if (sensorId == nullptr || sensorId[0] == '\0') {
+        return -1;
+    }
+    for (uint8_t i = 0; i < ds18b20RomCache.count; i++) {
+        if (strcmp(ds18b20RomCache.sensorId[i], sensorId) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint8_t DS18B20Sensor::resolutionForPrecision(float precision) {
+    // Paso de cada resolución: 9 bits = 0.5 °C, 10 = 0.25, 11 = 0.125, 12 = 0.0625
+    if (precision >= 0.5f)   return 9;
+    if (precision >= 0.25f)  return 10;
+    if (precision >= 0.125f) return 11;
+    return 12;
+}
+
+uint8_t DS18B20Sensor::applyResolutions(const std::vector<SensorConfig>& enabledNormalSensors) {
+    uint8_t busResolution = 0;
+
+    for (const auto& sensor : enabledNormalSensors) {
+        if (sensor.type != DS18B20 || !sensor.enable) {
+            continue;
+        }
+        int index = findSensor(sensor.sensorId);
+        if (index < 0) {
+            continue;
+        }
+
+        uint8_t wanted = resolutionForPrecision(sensor.precision);
+        if (ds18b20RomCache.parasite || ds18b20RomCache.rom[index][0] == DS18S20MODEL) {
+            // DS18S20: resolución fija de 9 bits, pero la conversión dura siempre 750 ms.
+            // Parásitas: la copia a EEPROM necesita el pull-up fuerte, que setResolution no
+            // activa; la sonda puede volver a su resolución guardada. En ambos, el peor caso
+            busResolution = 12;
+            continue;
+        }
+        if (ds18b20RomCache.resolution[index] != wanted) {
+            // setResolution solo escribe el scratchpad si el registro de configuración
+            // difiere; autoSaveScratchPad lo copia entonces a la EEPROM de la sonda
+            if (dallasTemp.setResolution(ds18b20RomCache.rom[index], wanted, true)) {
+                ds18b20RomCache.resolution[index] = wanted;
+                DEBUG_PRINTF("DS18B20: %s ajustado a %u bits\n", sensor.sensorId, wanted);
+            }
+        }
+
+        // Si la escritura falló la resolución real es desconocida: asumir el peor caso
+        uint8_t inUse = ds18b20RomCache.resolution[index] ? ds18b20RomCache.resolution[index] : 12;
+        if (inUse > busResolution) {
+            busResolution = inUse;
+        }
+    }
+
+    return busResolution ? busResolution : 12;
+}
+
+void DS18B20Sensor::startConversion() {
+    if (!ds18b20RomCache.parasite) {
+        dallasTemp.setWaitForConversion(false);
+        dallasTemp.requestTemperatures();
+        return;
+    }
+    // Igual que requestTemperatures, pero con el pull-up fuerte activo tras el comando:
+    // las sondas parásitas se alimentan de la línea durante la conversión
+    oneWire.reset();
+    oneWire.skip();
+    oneWire.write(DS18B20_CMD_CONVERT_T, 1);
+}
+
+void DS18B20Sensor::waitForConversion() {
+    if (!conversionStarted) {
+        return;
+    }
+    uint32_t elapsed = millis() - conversionStartTime;
+    if (elapsed < conversionTime) {
+        delay(conversionTime - elapsed);
+    }
+    conversionStarted = false;
+}
 
-#endif // defined(DEVICE_TYPE_BASIC) || defined(DEVICE_TYPE_ANALOGIC) 
\ No newline at end of file
+#endif // defined(DEVICE_TYPE_BASIC) || defined(DEVICE_TYPE_ANALOGIC)
@@ -50,13 +50,96 @@ bool parseEUIString(const char* euiStr, uint64_t* eui) {
     return true;
 } 
 
+/**
+ * @brief Escala un float a milésimas con redondeo exacto (mitad al par, como printf).
+ *        El float es m·2^e con m de 24 bits, así que |valor|·1000 se calcula sin error
+ *        en 64 bits.
+ * @param value Valor a escalar
+ * @param scaled Milésimas de |value|
+ * @param negative true si el valor lleva signo (incluido -0)
+ * @return false si el valor no es finito o |value| >= 2^31
+ */
+static bool scaleTo3Decimals(float value, uint64_t& scaled, bool& negative) {
+    if (!std::isfinite(value)) {
+        return false;
+    }
+    negative = std::signbit(value);
+    if (value == 0.0f) {
+        scaled = 0;
+        return true;
+    }
+
+    int exponent;
+    float mantissa = frexpf(fabsf(value), &exponent);   // |value| = mantissa·2^exponent, mantissa en [0.5, 1)
+    if (exponent > 31) {
+        return false;
+    }
+    uint64_t product = (uint64_t)ldexpf(mantissa, 24) * 1000;   // < 2^34
+    int shift = 24 - exponent;
+
+    if (shift <= 0) {
+        scaled = product << -shift;
+    } else if (shift >= 40) {
+        scaled = 0;   // Menos de media milésima
+    } else {
+        uint64_t remainder = product & ((1ULL << shift) - 1);
+        uint64_t half = 1ULL << (shift - 1);
+        scaled = product >> shift;
+        if (remainder > half || (remainder == half && (scaled & 1))) {
+            scaled++;
+        }
+    }
+    return true;
+}
+
 /**
  * @brief Formatea un valor flotante con hasta 3 decimales, eliminando ceros finales.
+ *        Produce lo mismo que snprintf("%.3f") sin los ceros finales, pero en punto fijo
+ *        entero; los valores no finitos o fuera de rango usan snprintf.
  * @param value Valor flotante a formatear.
  * @param buffer Buffer donde se almacenará la cadena formateada.
  * @param bufferSize Tamaño del buffer.
+ * @return Longitud de la cadena formateada.
  */
-void formatFloatTo3Decimals(float value, char* buffer, size_t bufferSize) {
+size_t formatFloatTo3Decimals(float value, char* buffer, size_t bufferSize) {
+    uint64_t scaled;
+    bool negative;
+    if (bufferSize > FLOAT_3_DECIMALS_MAX_LENGTH && scaleTo3Decimals(value, scaled, negative)) {
+        char* out = buffer;
+        if (negative) {
+            *out++ = '-';
+        }
+
+        // Parte entera, de atrás hacia adelante
+        uint32_t integer = (uint32_t)(scaled / 1000);
+        uint32_t fraction = (uint32_t)(scaled % 1000);
+        char digits[10];
+        int count = 0;
+        do {
+            digits[count++] = '0' + integer % 10;
+            integer /= 10;
+        } while (integer != 0);
+        while (count > 0) {
+            *out++ = digits[--count];
+        }
+
+        // Decimales sin ceros finales
+        if (fraction != 0) {
+            *out++ = '.';
+            *out++ = '0' + fraction / 100;
+            fraction %= 100;
+            if (fraction != 0) {
+                *out++ = '0' + fraction / 10;
+                fraction %= 10;
+                if (fraction != 0) {
+                    *out++ = '0' + fraction;
+                }
+            }
+        }
+        *out = '\0';
+        return out - buffer;
+    }
+
     // Primero formateamos con 3 decimales
     snprintf(buffer, bufferSize, "%.3f", value);
     
@@ -72,8 +155,9 @@ void formatFloatTo3Decimals(float value, char* buffer, size_t bufferSize) {
     // Si el último carácter es un punto, también lo eliminamos
     if (i >= 0 && buffer[i] == '.') {
         buffer[i] = '\0';
-    } else {
-        // Si no, terminamos la cadena después del último dígito no cero
-        buffer[i + 1] = '\0';
+        return i;
     }
+    // Si no, terminamos la cadena después del último dígito no cero
+    buffer[i + 1] = '\0';
+    return i + 1;
 }
@@ -0,0 +1,218 @@
+/*******************************************************************************************
+ * Archivo: test/support/Arduino.h
+ * Descripción: Sustituto mínimo de Arduino.h para compilar módulos del firmware en el
+ *              host (entorno native). Solo cubre lo que usan esos módulos.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_ARDUINO_H
+#define TEST_SUPPORT_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @brief String de Arduino sobre std::string (solo los métodos que usa el firmware).
+ */
+class String {
+public:
+    String() {}
+    String(const char* text) : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return (unsigned int)value.size(); }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = value.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+
+    String substring(unsigned int from) const {
+        return from < value.size() ? String(value.substr(from)) : String();
+    }
+
+    String substring(unsigned int from, unsigned int to) const {
+        return from < to && from < value.size() ? String(value.substr(from, to - from)) : String();
+    }
+
+    bool operator==(const char* text) const { return value == text; }
+    String& operator+=(const char* text) { value += text; return *this; }
+
+private:
+    std::string value;
+};
+
+typedef uint8_t byte;
+
+// Sin memoria RTC en el host: las variables que sobreviven al deep sleep son globales normales
+#define RTC_DATA_ATTR
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+
+inline uint16_t word(uint16_t w) { return w; }
+inline uint16_t word(uint8_t high, uint8_t low) { return (uint16_t)((high << 8) | low); }
+
+/**
+ * @brief Tiempo adelantado por las esperas simuladas (hostAdvance).
+ */
+inline uint64_t& hostAdvancedMicros() {
+    static uint64_t advanced = 0;
+    return advanced;
+}
+
+/**
+ * @brief Reloj monotónico del host con el origen en la primera llamada, como tras un reset.
+ */
+inline uint64_t hostMicros() {
+    static const auto origin = std::chrono::steady_clock::now();
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - origin).count() + hostAdvancedMicros();
+}
+
+/**
+ * @brief Adelanta el reloj del host sin esperar: una espera simulada (p. ej. las ventanas
+ *        RX de FakeLoRaNode) que millis() y el RTC ven pasar.
+ */
+inline void hostAdvance(uint64_t micros) {
+    hostAdvancedMicros() += micros;
+}
+
+inline unsigned long millis() { return (unsigned long)(hostMicros() / 1000); }
+inline unsigned long micros() { return (unsigned long)hostMicros(); }
+inline void delay(unsigned long ms) { usleep(ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { usleep(us); }
+
+/**
+ * @brief Generador del ESP32 con semilla fija: las esperas con jitter se repiten entre ejecuciones.
+ */
+inline uint32_t esp_random() {
+    static std::mt19937 generator(1);
+    return generator();
+}
+
+/**
+ * @brief Interfaz Stream de Arduino (lo que usa ModbusMaster).
+ */
+class Stream {
+public:
+    virtual ~Stream() {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(uint8_t byte) = 0;
+    virtual void flush() {}
+};
+
+/**
+ * @brief Línea de una UART del host: un Stream que además avisa del timeout RX de la
+ *        UART (PtySerial). Las pruebas la conectan a un número de UART con hostUartLine().
+ */
+class HostUartLine : public Stream {
+public:
+    virtual void arm() {}
+    virtual bool rxTimedOut() { return false; }
+};
+
+/**
+ * @brief Línea conectada a cada UART del ESP32 (nullptr = UART sin conectar).
+ */
+inline HostUartLine*& hostUartLine(int uart) {
+    static HostUartLine* lines[3] = {};
+    return lines[(uart >= 0 && uart < 3) ? uart : 0];
+}
+
+#define SERIAL_8N1 0x800001c
+
+/**
+ * @brief UART del ESP32 sobre la línea conectada a su número. onReceive(cb, true) se
+ *        llama una vez por trama al detectar el timeout RX, al revisar la línea.
+ *        Serial (UART 0) es la de las macros DEBUG_*: su salida se descarta para no
+ *        mezclarla con la de Unity.
+ */
+class HardwareSerial : public Stream {
+public:
+    explicit HardwareSerial(int uart = 0) : uart(uart) {}
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {
+        (void)baud; (void)config; (void)rxPin; (void)txPin;
+    }
+    void end() {}
+    bool setRxTimeout(uint8_t symbols) { (void)symbols; return true; }
+    void onReceive(void (*callback)(), bool onlyOnTimeout = false) {
+        (void)onlyOnTimeout;
+        receiveCallback = callback;
+    }
+
+    int available() override {
+        HostUartLine* line = hostUartLine(uart);
+        int count = line ? line->available() : 0;
+        checkRxTimeout(line);
+        return count;
+    }
+    int read() override {
+        HostUartLine* line = hostUartLine(uart);
+        int c = line ? line->read() : -1;
+        checkRxTimeout(line);
+        return c;
+    }
+    int peek() override {
+        HostUartLine* line = hostUartLine(uart);
+        return line ? line->peek() : -1;
+    }
+    size_t write(uint8_t byte) override {
+        HostUartLine* line = hostUartLine(uart);
+        if (!line || uart == 0) {
+            return 1;
+        }
+        // Un envío empieza una nueva trama: el próximo timeout RX vuelve a avisar
+        line->arm();
+        notified = false;
+        return line->write(byte);
+    }
+    void flush() override {
+        HostUartLine* line = hostUartLine(uart);
+        if (line && uart != 0) {
+            line->flush();
+        }
+    }
+
+    int printf(const char* format, ...) { (void)format; return 0; }
+    template <typename T> size_t print(const T& value) { (void)value; return 0; }
+    template <typename T> size_t println(const T& value) { (void)value; return 0; }
+    size_t println() { return 0; }
+
+private:
+    void checkRxTimeout(HostUartLine* line) {
+        if (line && receiveCallback && !notified && line->rxTimedOut()) {
+            notified = true;
+            receiveCallback();
+        }
+    }
+
+    int uart;
+    void (*receiveCallback)() = nullptr;
+    bool notified = false;
+};
+
+inline HardwareSerial Serial;
+
+#endif // TEST_SUPPORT_ARDUINO_H
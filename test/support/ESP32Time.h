@@ -0,0 +1,29 @@
+/*******************************************************************************************
+ * Archivo: test/support/ESP32Time.h
+ * Descripción: Sustituto de ESP32Time para el host: la hora fijada con setTime avanza con
+ *              el reloj monotónico del host. Las pruebas simulan un sleep adelantándola.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_ESP32TIME_H
+#define TEST_SUPPORT_ESP32TIME_H
+
+#include <Arduino.h>
+
+class ESP32Time {
+public:
+    void setTime(unsigned long epoch = 1609459200, int ms = 0) {
+        baseMs = (uint64_t)epoch * 1000 + ms;
+        setAtUs = hostMicros();
+    }
+
+    unsigned long getEpoch() { return (unsigned long)(nowMs() / 1000); }
+    unsigned long getMillis() { return (unsigned long)(nowMs() % 1000); }
+
+private:
+    uint64_t nowMs() { return baseMs + (hostMicros() - setAtUs) / 1000; }
+
+    uint64_t baseMs = 1609459200ULL * 1000;
+    uint64_t setAtUs = 0;
+};
+
+#endif // TEST_SUPPORT_ESP32TIME_H
@@ -0,0 +1,497 @@
+/*******************************************************************************************
+ * Archivo: test/support/FakeLoRaNode.h
+ * Descripción: Nodo LoRaWAN y servidor de red simulados en el host. FakeLoRaNode implementa
+ *              LoRaNode sin radio y entrega cada join-request y uplink a FakeNetworkServer,
+ *              que acepta joins con las claves esperadas, responde DeviceTime y LinkCheck,
+ *              confirma uplinks y entrega downlinks inyectados. Las pérdidas, la latencia del
+ *              servidor y las claves equivocadas se programan con FakeNetworkScript.
+ *              El tiempo de las ventanas RX es simulado: el reloj del host (y el RTC)
+ *              se adelanta sin esperar en tiempo real.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_FAKE_LORA_NODE_H
+#define TEST_SUPPORT_FAKE_LORA_NODE_H
+
+#include <Arduino.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "LoRaNode.h"
+
+// Apertura de las ventanas de recepción de clase A tras el uplink (ms). Una respuesta del
+// servidor más lenta que la segunda ventana no llega al nodo
+#define FAKE_RX1_DELAY_MS           1000
+#define FAKE_RX2_DELAY_MS           2000
+#define FAKE_JOIN_ACCEPT_DELAY1_MS  5000
+#define FAKE_JOIN_ACCEPT_DELAY2_MS  6000
+
+#define FAKE_GPS_UNIX_OFFSET        (315964800UL - 18)    // Época GPS en Unix, menos los segundos intercalares
+
+/**
+ * @brief Comportamiento programado de la red. Las probabilidades se evalúan en cada trama.
+ */
+struct FakeNetworkScript {
+    float uplinkLossRate = 0.0f;     // Probabilidad de que un uplink o join-request no llegue al servidor
+    float downlinkLossRate = 0.0f;   // Probabilidad de que un downlink o join-accept no llegue al nodo
+    uint32_t latencyMs = 0;          // Demora del servidor en responder: RX1, RX2 o ninguna ventana
+    float rssi = -90.0f;             // RSSI (dBm) con que el nodo recibe los downlinks
+    float snr = 7.5f;                // SNR (dB) con que el nodo recibe los downlinks
+    uint8_t linkMargin = 20;         // Margen (dB) que informa LinkCheckAns
+    uint8_t gatewayCount = 1;        // Gateways que informa LinkCheckAns
+    uint32_t seed = 1;               // Semilla de los sucesos aleatorios
+};
+
+/**
+ * @brief Uplink tal como lo recibe el servidor.
+ */
+struct FakeUplink {
+    uint32_t fCnt;
+    uint8_t fPort;
+    bool confirmed;
+    uint8_t datarate;
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> macCommands;    // CID de los comandos MAC (FOpts)
+};
+
+/**
+ * @brief Respuesta del servidor en una ventana de recepción.
+ */
+struct FakeDownlink {
+    uint8_t window;                      // 1 = RX1, 2 = RX2
+    uint32_t fCnt;
+    uint8_t fPort;                       // 0 = solo comandos MAC
+    bool ack;                            // Confirma el uplink
+    std::vector<uint8_t> payload;
+    bool deviceTimeAns;
+    uint32_t epoch;                      // DeviceTimeAns (Unix)
+    uint8_t fraction;                    // DeviceTimeAns, 1/256 s
+    bool linkCheckAns;
+    uint8_t margin;
+    uint8_t gatewayCount;
+};
+
+/**
+ * @brief Contadores del servidor desde su creación.
+ */
+struct FakeNetworkStats {
+    uint32_t joinRequests;       // Join-requests recibidos
+    uint32_t joinAccepts;        // Join-accepts enviados (incluidos los que se pierden)
+    uint32_t badMic;             // Join-requests con claves o EUIs que no corresponden (sin respuesta)
+    uint32_t uplinks;            // Uplinks aceptados
+    uint32_t replayed;           // Uplinks o DevNonces ya vistos (descartados)
+    uint32_t lostUplinks;        // Uplinks y join-requests perdidos en el aire
+    uint32_t downlinks;          // Downlinks enviados (incluidos los que se pierden)
+    uint32_t lostDownlinks;      // Downlinks y join-accepts perdidos o fuera de ventana
+    uint32_t deviceTimeAnswers;  // DeviceTimeAns enviados
+};
+
+class FakeNetworkServer {
+public:
+    /**
+     * @brief Servidor con un único dispositivo registrado.
+     */
+    FakeNetworkServer(uint64_t joinEUI, uint64_t devEUI, const uint8_t* nwkKey, const uint8_t* appKey)
+        : joinEUI(joinEUI), devEUI(devEUI) {
+        memcpy(this->nwkKey, nwkKey, 16);
+        memcpy(this->appKey, appKey, 16);
+    }
+
+    void setScript(const FakeNetworkScript& newScript) {
+        script = newScript;
+        rng.seed(script.seed);
+    }
+
+    const FakeNetworkScript& currentScript() const { return script; }
+
+    /**
+     * @brief Hora del servidor (Unix) con que se responde DeviceTimeReq.
+     */
+    void setClock(uint32_t epoch) { clock = epoch; }
+    uint32_t getClock() const { return clock; }
+
+    /**
+     * @brief Encola un downlink para la próxima ventana de recepción del dispositivo.
+     */
+    void injectDownlink(uint8_t fPort, const std::vector<uint8_t>& payload) {
+        pending.push_back({fPort, payload});
+    }
+
+    size_t pendingDownlinks() const { return pending.size(); }
+
+    const std::vector<FakeUplink>& received() const { return uplinks; }
+    void clearReceived() { uplinks.clear(); }
+
+    FakeNetworkStats stats() const { return counters; }
+
+    /**
+     * @brief Join-request del nodo.
+     * @param devAddr Dirección asignada si llegó el join-accept
+     * @return true si el join-accept llegó al nodo
+     */
+    bool join(uint64_t requestJoinEUI, uint64_t requestDevEUI, const uint8_t* requestNwkKey,
+              const uint8_t* requestAppKey, uint16_t devNonce, uint32_t& devAddr) {
+        if (chance() < script.uplinkLossRate) {
+            counters.lostUplinks++;
+            return false;
+        }
+        counters.joinRequests++;
+
+        // Con otras claves el MIC no verifica: el servidor no responde
+        if (requestJoinEUI != joinEUI || requestDevEUI != devEUI || memcmp(requestNwkKey, nwkKey, 16) != 0 ||
+            memcmp(requestAppKey, appKey, 16) != 0) {
+            counters.badMic++;
+            return false;
+        }
+        if (joined && (int16_t)(devNonce - lastDevNonce) <= 0) {
+            counters.replayed++;
+            return false;
+        }
+
+        // El servidor da por hecha la sesión aunque el join-accept se pierda
+        lastDevNonce = devNonce;
+        joined = true;
+        sessionAddr = nextDevAddr++;
+        nextFCntUp = 0;
+        fCntDown = 0;
+        counters.joinAccepts++;
+        if (script.latencyMs >= FAKE_JOIN_ACCEPT_DELAY2_MS || chance() < script.downlinkLossRate) {
+            counters.lostDownlinks++;
+            return false;
+        }
+        devAddr = sessionAddr;
+        return true;
+    }
+
+    /**
+     * @brief Uplink del nodo.
+     * @param down Respuesta en RX1/RX2, si la hubo
+     * @return true si llegó un downlink al nodo
+     */
+    bool uplink(uint32_t devAddr, const FakeUplink& up, FakeDownlink& down) {
+        if (chance() < script.uplinkLossRate) {
+            counters.lostUplinks++;
+            return false;
+        }
+        // Sesión desconocida o contador repetido: el servidor descarta la trama
+        if (!joined || devAddr != sessionAddr) {
+            counters.badMic++;
+            return false;
+        }
+        if (up.fCnt < nextFCntUp) {
+            counters.replayed++;
+            return false;
+        }
+        nextFCntUp = up.fCnt + 1;
+        counters.uplinks++;
+        uplinks.push_back(up);
+
+        down = {};
+        down.ack = up.confirmed;
+        for (uint8_t cid : up.macCommands) {
+            if (cid == RADIOLIB_LORAWAN_MAC_DEVICE_TIME) {
+                down.deviceTimeAns = true;
+                down.epoch = clock;
+                counters.deviceTimeAnswers++;
+            } else if (cid == RADIOLIB_LORAWAN_MAC_LINK_CHECK) {
+                down.linkCheckAns = true;
+                down.margin = script.linkMargin;
+                down.gatewayCount = script.gatewayCount;
+            }
+        }
+        if (!pending.empty()) {
+            down.fPort = pending.front().fPort;
+            down.payload = pending.front().payload;
+            pending.pop_front();
+        }
+        if (!down.ack && !down.deviceTimeAns && !down.linkCheckAns && down.payload.empty()) {
+            return false;
+        }
+
+        down.fCnt = fCntDown++;
+        down.window = script.latencyMs < FAKE_RX1_DELAY_MS ? 1 : 2;
+        counters.downlinks++;
+        if (script.latencyMs >= FAKE_RX2_DELAY_MS || chance() < script.downlinkLossRate) {
+            counters.lostDownlinks++;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct PendingDownlink {
+        uint8_t fPort;
+        std::vector<uint8_t> payload;
+    };
+
+    float chance() { return std::uniform_real_distribution<float>(0.0f, 1.0f)(rng); }
+
+    uint64_t joinEUI;
+    uint64_t devEUI;
+    uint8_t nwkKey[16];
+    uint8_t appKey[16];
+    FakeNetworkScript script;
+    std::mt19937 rng{1};
+    uint32_t clock = 0;
+    bool joined = false;
+    uint16_t lastDevNonce = 0;
+    uint32_t nextDevAddr = 0x26000001;
+    uint32_t sessionAddr = 0;
+    uint32_t nextFCntUp = 0;
+    uint32_t fCntDown = 0;
+    std::deque<PendingDownlink> pending;
+    std::vector<FakeUplink> uplinks;
+    FakeNetworkStats counters = {};
+};
+
+/**
+ * @brief LoRaNode sin radio conectado a un FakeNetworkServer. Guarda la sesión en los
+ *        buffers con la disposición de test/support/RadioLib.h, así que LWsession y
+ *        SessionStore la conservan igual que en el equipo.
+ */
+class FakeLoRaNode : public LoRaNode {
+public:
+    explicit FakeLoRaNode(FakeNetworkServer& server) : server(server) {}
+
+    void beginOTAA(uint64_t joinEUI, uint64_t devEUI, uint8_t* nwkKey, uint8_t* appKey) override {
+        this->joinEUI = joinEUI;
+        this->devEUI = devEUI;
+        memcpy(this->nwkKey, nwkKey, 16);
+        memcpy(this->appKey, appKey, 16);
+        joined = false;
+        sessionLoaded = false;
+    }
+
+    int16_t activateOTAA(uint8_t datarate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED) override {
+        if (sessionLoaded) {
+            sessionLoaded = false;
+            joined = true;
+            return RADIOLIB_LORAWAN_SESSION_RESTORED;
+        }
+
+        joinAttempts++;
+        joinDatarate = datarate;
+        devNonce++;
+        uint32_t addr;
+        if (!server.join(joinEUI, devEUI, nwkKey, appKey, devNonce, addr)) {
+            return RADIOLIB_ERR_NO_JOIN_ACCEPT;
+        }
+        devAddr = addr;
+        fCntUp = 0;
+        fCntDown = 0;
+        joined = true;
+        return RADIOLIB_LORAWAN_NEW_SESSION;
+    }
+
+    uint8_t* getBufferNonces() override {
+        memset(nonces, 0, sizeof(nonces));
+        putU32(nonces + RADIOLIB_LORAWAN_NONCES_DEV_NONCE, devNonce);
+        sign(nonces, RADIOLIB_LORAWAN_NONCES_SIGNATURE);
+        return nonces;
+    }
+
+    int16_t setBufferNonces(uint8_t* buffer) override {
+        if (!signatureValid(buffer, RADIOLIB_LORAWAN_NONCES_SIGNATURE)) {
+            return RADIOLIB_ERR_CHECKSUM_MISMATCH;
+        }
+        devNonce = (uint16_t)getU32(buffer + RADIOLIB_LORAWAN_NONCES_DEV_NONCE);
+        return RADIOLIB_ERR_NONE;
+    }
+
+    uint8_t* getBufferSession() override {
+        memset(session, 0, sizeof(session));
+        putU32(session + RADIOLIB_LORAWAN_SESSION_DEV_ADDR, devAddr);
+        putU32(session + RADIOLIB_LORAWAN_SESSION_FCNT_UP, fCntUp);
+        putU32(session + RADIOLIB_LORAWAN_SESSION_N_FCNT_DOWN, fCntDown);
+        sign(session, RADIOLIB_LORAWAN_SESSION_SIGNATURE);
+        return session;
+    }
+
+    int16_t setBufferSession(uint8_t* buffer) override {
+        if (!signatureValid(buffer, RADIOLIB_LORAWAN_SESSION_SIGNATURE) ||
+            getU32(buffer + RADIOLIB_LORAWAN_SESSION_DEV_ADDR) == 0) {
+            return RADIOLIB_ERR_CHECKSUM_MISMATCH;
+        }
+        devAddr = getU32(buffer + RADIOLIB_LORAWAN_SESSION_DEV_ADDR);
+        fCntUp = getU32(buffer + RADIOLIB_LORAWAN_SESSION_FCNT_UP);
+        fCntDown = getU32(buffer + RADIOLIB_LORAWAN_SESSION_N_FCNT_DOWN);
+        sessionLoaded = true;
+        return RADIOLIB_ERR_NONE;
+    }
+
+    int16_t sendReceive(uint8_t* dataUp, size_t lenUp, uint8_t fPort, uint8_t* dataDown,
+                        size_t* lenDown, bool confirmed = false,
+                        LoRaWANEvent_t* eventUp = nullptr, LoRaWANEvent_t* eventDown = nullptr) override {
+        *lenDown = 0;
+        if (!joined) {
+            return RADIOLIB_ERR_NETWORK_NOT_JOINED;
+        }
+        if (lenUp > getMaxPayloadLen()) {
+            return RADIOLIB_ERR_PACKET_TOO_LONG;
+        }
+
+        FakeUplink up;
+        up.fCnt = fCntUp++;
+        up.fPort = fPort;
+        up.confirmed = confirmed;
+        up.datarate = currentDatarate;
+        up.payload.assign(dataUp, dataUp + (dataUp ? lenUp : 0));
+        up.macCommands = macQueue;
+        macQueue.clear();
+        lastDownlink = {};
+        uplinksSent++;
+        if (eventUp) {
+            *eventUp = {};
+            eventUp->confirmed = confirmed;
+            eventUp->datarate = currentDatarate;
+            eventUp->fcnt = up.fCnt;
+            eventUp->port = fPort;
+        }
+
+        // sendReceive vuelve tras la ventana que respondió, o tras RX2 si no hubo respuesta
+        FakeDownlink down;
+        bool answered = server.uplink(devAddr, up, down);
+        waitWindow((answered && down.window == 1) ? FAKE_RX1_DELAY_MS : FAKE_RX2_DELAY_MS);
+        if (!answered) {
+            return RADIOLIB_ERR_RX_TIMEOUT;
+        }
+        lastDownlink = down;
+        fCntDown = down.fCnt + 1;
+        memcpy(dataDown, down.payload.data(), down.payload.size());
+        *lenDown = down.payload.size();
+        if (eventDown) {
+            *eventDown = {};
+            eventDown->dir = 1;
+            eventDown->confirming = down.ack;
+            eventDown->datarate = currentDatarate;
+            eventDown->fcnt = down.fCnt;
+            eventDown->port = down.fPort;
+        }
+        return RADIOLIB_ERR_NONE;
+    }
+
+    bool sendMacCommandReq(uint8_t cid) override {
+        if (cid != RADIOLIB_LORAWAN_MAC_DEVICE_TIME && cid != RADIOLIB_LORAWAN_MAC_LINK_CHECK) {
+            return false;
+        }
+        for (uint8_t queued : macQueue) {
+            if (queued == cid) {
+                return true;
+            }
+        }
+        macQueue.push_back(cid);
+        return true;
+    }
+
+    int16_t getMacDeviceTimeAns(uint32_t* epoch, uint8_t* fraction, bool returnUnix) override {
+        if (!lastDownlink.deviceTimeAns) {
+            return RADIOLIB_ERR_COMMAND_QUEUE_ITEM_NOT_FOUND;
+        }
+        *epoch = returnUnix ? lastDownlink.epoch : lastDownlink.epoch - FAKE_GPS_UNIX_OFFSET;
+        *fraction = lastDownlink.fraction;
+        return RADIOLIB_ERR_NONE;
+    }
+
+    int16_t getMacLinkCheckAns(uint8_t* margin, uint8_t* gatewayCount) override {
+        if (!lastDownlink.linkCheckAns) {
+            return RADIOLIB_ERR_COMMAND_QUEUE_ITEM_NOT_FOUND;
+        }
+        *margin = lastDownlink.margin;
+        *gatewayCount = lastDownlink.gatewayCount;
+        return RADIOLIB_ERR_NONE;
+    }
+
+    /**
+     * @brief Payload máximo de US915 (LORA_REGION) menos los comandos MAC pendientes.
+     */
+    uint8_t getMaxPayloadLen() override {
+        static const uint8_t maxPayload[] = {11, 53, 125, 242, 242};
+        uint8_t max = currentDatarate < sizeof(maxPayload) ? maxPayload[currentDatarate] : 0;
+        return max > macQueue.size() ? max - macQueue.size() : 0;
+    }
+
+    uint32_t getFCntUp() override { return fCntUp; }
+
+    int16_t setDatarate(uint8_t datarate) override {
+        currentDatarate = datarate;
+        return RADIOLIB_ERR_NONE;
+    }
+
+    void setADR(bool enable) override { adr = enable; }
+
+    float getRSSI() override { return server.currentScript().rssi; }
+    float getSNR() override { return server.currentScript().snr; }
+
+    // Estado para las pruebas
+    bool isJoined() const { return joined; }
+    uint8_t datarate() const { return currentDatarate; }
+    uint8_t lastJoinDatarate() const { return joinDatarate; }
+    uint32_t joinAttemptCount() const { return joinAttempts; }
+    uint32_t uplinkCount() const { return uplinksSent; }
+    uint32_t address() const { return devAddr; }
+
+private:
+    /**
+     * @brief Espera simulada hasta una ventana RX: el nodo y el servidor ven pasar el
+     *        mismo tiempo (las demoras son de segundos enteros).
+     */
+    void waitWindow(uint32_t delayMs) {
+        hostAdvance((uint64_t)delayMs * 1000);
+        server.setClock(server.getClock() + delayMs / 1000);
+    }
+
+    static void putU32(uint8_t* data, uint32_t value) {
+        for (uint8_t i = 0; i < 4; i++) {
+            data[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    static uint32_t getU32(const uint8_t* data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    /**
+     * @brief Firma de RadioLib: XOR de las palabras de 16 bits previas, en little endian.
+     */
+    static uint16_t checksum(const uint8_t* buffer, size_t signatureOffset) {
+        uint16_t sum = 0;
+        for (size_t i = 0; i + 1 < signatureOffset; i += 2) {
+            sum ^= ((uint16_t)buffer[i] << 8) | buffer[i + 1];
+        }
+        return sum;
+    }
+
+    static void sign(uint8_t* buffer, size_t signatureOffset) {
+        uint16_t sum = checksum(buffer, signatureOffset);
+        buffer[signatureOffset] = sum & 0xFF;
+        buffer[signatureOffset + 1] = sum >> 8;
+    }
+
+    static bool signatureValid(const uint8_t* buffer, size_t signatureOffset) {
+        uint16_t stored = (uint16_t)buffer[signatureOffset] | ((uint16_t)buffer[signatureOffset + 1] << 8);
+        return stored == checksum(buffer, signatureOffset);
+    }
+
+    FakeNetworkServer& server;
+    uint64_t joinEUI = 0;
+    uint64_t devEUI = 0;
+    uint8_t nwkKey[16] = {};
+    uint8_t appKey[16] = {};
+    uint8_t nonces[RADIOLIB_LORAWAN_NONCES_BUF_SIZE];
+    uint8_t session[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];
+    bool joined = false;
+    bool sessionLoaded = false;
+    bool adr = true;
+    uint16_t devNonce = 0;
+    uint32_t devAddr = 0;
+    uint32_t fCntUp = 0;
+    uint32_t fCntDown = 0;
+    uint8_t currentDatarate = 0;
+    uint8_t joinDatarate = RADIOLIB_LORAWAN_DATA_RATE_UNUSED;
+    uint32_t joinAttempts = 0;
+    uint32_t uplinksSent = 0;
+    std::vector<uint8_t> macQueue;
+    FakeDownlink lastDownlink = {};
+};
+
+#endif // TEST_SUPPORT_FAKE_LORA_NODE_H
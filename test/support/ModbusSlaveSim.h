@@ -0,0 +1,257 @@
+/*******************************************************************************************
+ * Archivo: test/support/ModbusSlaveSim.h
+ * Descripción: Esclavo Modbus RTU simulado en el host, conectado al lado esclavo del pty
+ *              de PtySerial. Responde 0x03/0x04 desde un mapa de registros y se programa
+ *              con latencia, pausas aleatorias entre bytes, CRC corrupto y respuestas
+ *              perdidas para probar ModbusMaster sin adaptador RS485.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_MODBUS_SLAVE_SIM_H
+#define TEST_SUPPORT_MODBUS_SLAVE_SIM_H
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "util/crc16.h"
+
+/**
+ * @brief Comportamiento programado del esclavo. Las probabilidades se evalúan en cada petición.
+ */
+struct ModbusSimScript {
+    uint32_t baudRate = 9600;        // Velocidad emulada: la respuesta tarda su tiempo de línea
+    uint32_t latencyUs = 2000;       // Reacción del esclavo antes de empezar a responder
+    uint32_t byteGapJitterUs = 0;    // Pausa extra aleatoria máxima entre bytes de la respuesta (0 = sin pausas)
+    float crcErrorRate = 0.0f;       // Probabilidad de enviar la respuesta con el CRC alterado
+    float dropRate = 0.0f;           // Probabilidad de no contestar
+    uint32_t seed = 1;               // Semilla de los sucesos aleatorios
+};
+
+/**
+ * @brief Contadores del esclavo desde start().
+ */
+struct ModbusSimStats {
+    uint32_t requests;       // Peticiones válidas dirigidas a este esclavo
+    uint32_t replies;        // Respuestas enviadas (incluidas excepciones y CRC corruptos)
+    uint32_t exceptions;     // Respuestas de excepción
+    uint32_t corrupted;      // Respuestas con CRC alterado
+    uint32_t dropped;        // Peticiones sin respuesta
+};
+
+class ModbusSlaveSim {
+public:
+    explicit ModbusSlaveSim(uint8_t address) : address(address) {}
+    ~ModbusSlaveSim() { stop(); }
+
+    /**
+     * @brief Carga registros consecutivos en el mapa de una función.
+     * @param functionCode 0x03 (holding) o 0x04 (input)
+     */
+    void setRegisters(uint8_t functionCode, uint16_t start, const std::vector<uint16_t>& values) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < values.size(); i++) {
+            registers[key(functionCode, (uint16_t)(start + i))] = values[i];
+        }
+    }
+
+    void setScript(const ModbusSimScript& newScript) {
+        std::lock_guard<std::mutex> lock(mutex);
+        script = newScript;
+        rng.seed(script.seed);
+    }
+
+    /**
+     * @brief Abre el lado esclavo del pty y empieza a atender peticiones en un hilo.
+     */
+    bool start(const char* path) {
+        fd = ::open(path, O_RDWR | O_NOCTTY);
+        if (fd < 0) {
+            return false;
+        }
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        requests = replies = exceptions = corrupted = dropped = 0;
+        running = true;
+        worker = std::thread(&ModbusSlaveSim::serve, this);
+        return true;
+    }
+
+    void stop() {
+        running = false;
+        if (worker.joinable()) {
+            worker.join();
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    /**
+     * @brief Espera a que el esclavo termine la respuesta en curso (útil tras cortar una
+     *        trama con pausas: los bytes rezagados ensuciarían la siguiente transacción).
+     */
+    void waitIdle() const {
+        while (busy) {
+            usleep(1000);
+        }
+    }
+
+    ModbusSimStats stats() const {
+        return {requests.load(), replies.load(), exceptions.load(), corrupted.load(), dropped.load()};
+    }
+
+private:
+    static uint32_t key(uint8_t functionCode, uint16_t reg) { return ((uint32_t)functionCode << 16) | reg; }
+
+    /**
+     * @brief Lee una petición de 8 bytes (todas las lecturas y escrituras simples lo son).
+     * @return false si no llegó ninguna petición completa
+     */
+    bool readRequest(uint8_t* request) {
+        size_t got = 0;
+        while (running && got < 8) {
+            struct pollfd p = {fd, POLLIN, 0};
+            // Sin petición en curso se revisa running cada 50 ms; a media petición se descarta tras 20 ms
+            if (poll(&p, 1, got ? 20 : 50) <= 0) {
+                if (got) {
+                    return false;
+                }
+                continue;
+            }
+            ssize_t n = ::read(fd, request + got, 8 - got);
+            if (n <= 0) {
+                return false;
+            }
+            got += n;
+        }
+        return got == 8;
+    }
+
+    void serve() {
+        uint8_t request[8];
+        while (running) {
+            if (!readRequest(request) || crc16_modbus(request, 8) != 0 || request[0] != address) {
+                continue;
+            }
+            requests++;
+            busy = true;
+
+            std::vector<uint8_t> response;
+            ModbusSimScript now;
+            bool drop;
+            bool corrupt;
+            std::vector<uint32_t> gaps;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                now = script;
+                std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+                drop = chance(rng) < script.dropRate;
+                corrupt = chance(rng) < script.crcErrorRate;
+                buildResponse(request, response);
+                if (script.byteGapJitterUs) {
+                    std::uniform_int_distribution<uint32_t> gap(0, script.byteGapJitterUs);
+                    for (size_t i = 1; i < response.size(); i++) {
+                        gaps.push_back(gap(rng));
+                    }
+                }
+            }
+            if (drop) {
+                dropped++;
+                busy = false;
+                continue;
+            }
+            if (response[1] & 0x80) {
+                exceptions++;
+            }
+            if (corrupt) {
+                response[response.size() - 1] ^= 0x5A;
+                corrupted++;
+            }
+            send(response, now, gaps);
+            replies++;
+            busy = false;
+        }
+    }
+
+    /**
+     * @brief Respuesta a 0x03/0x04 desde el mapa, o excepción 0x01/0x02/0x03.
+     */
+    void buildResponse(const uint8_t* request, std::vector<uint8_t>& response) {
+        uint8_t functionCode = request[1];
+        uint16_t start = word(request[2], request[3]);
+        uint16_t qty = word(request[4], request[5]);
+        uint8_t exception = 0;
+
+        response = {address, functionCode};
+        if (functionCode != 0x03 && functionCode != 0x04) {
+            exception = 0x01;    // Función no soportada
+        } else if (qty == 0 || qty > 125) {
+            exception = 0x03;    // Cantidad fuera del protocolo
+        } else {
+            response.push_back((uint8_t)(2 * qty));
+            for (uint16_t i = 0; i < qty; i++) {
+                auto it = registers.find(key(functionCode, (uint16_t)(start + i)));
+                if (it == registers.end()) {
+                    exception = 0x02;    // Registro fuera del mapa
+                    break;
+                }
+                response.push_back(highByte(it->second));
+                response.push_back(lowByte(it->second));
+            }
+        }
+        if (exception) {
+            response = {address, (uint8_t)(functionCode | 0x80), exception};
+        }
+        uint16_t crc = crc16_modbus(response.data(), response.size());
+        response.push_back(lowByte(crc));
+        response.push_back(highByte(crc));
+    }
+
+    /**
+     * @brief Envía la respuesta tras el tiempo de línea de la petición (el pty la entrega al
+     *        instante), la latencia y el tiempo de línea de la respuesta. Sin jitter sale en una
+     *        sola escritura: el planificador del host no garantiza pausas de un carácter, y
+     *        las ráfagas y el silencio final los reproduce la FIFO de PtySerial.
+     */
+    void send(const std::vector<uint8_t>& response, const ModbusSimScript& now, const std::vector<uint32_t>& gaps) {
+        usleep(now.latencyUs + (8 + response.size()) * (11000000UL / now.baudRate));
+        if (gaps.empty()) {
+            (void)::write(fd, response.data(), response.size());
+            return;
+        }
+        for (size_t i = 0; i < response.size(); i++) {
+            if (i > 0 && gaps[i - 1]) {
+                usleep(gaps[i - 1]);
+            }
+            (void)::write(fd, &response[i], 1);
+        }
+    }
+
+    uint8_t address;
+    int fd = -1;
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::atomic<bool> busy{false};
+    std::mutex mutex;
+    ModbusSimScript script;
+    std::mt19937 rng{1};
+    std::map<uint32_t, uint16_t> registers;
+    std::atomic<uint32_t> requests{0};
+    std::atomic<uint32_t> replies{0};
+    std::atomic<uint32_t> exceptions{0};
+    std::atomic<uint32_t> corrupted{0};
+    std::atomic<uint32_t> dropped{0};
+};
+
+#endif // TEST_SUPPORT_MODBUS_SLAVE_SIM_H
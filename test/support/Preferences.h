@@ -0,0 +1,76 @@
+/*******************************************************************************************
+ * Archivo: test/support/Preferences.h
+ * Descripción: Sustituto de Preferences (NVS) en memoria para el host. Los espacios de
+ *              nombres se comparten entre instancias, como la flash: lo grabado sigue ahí
+ *              tras un deep sleep o un corte de energía simulado.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_PREFERENCES_H
+#define TEST_SUPPORT_PREFERENCES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        space = &storage()[name];
+        this->readOnly = readOnly;
+        return true;
+    }
+
+    void end() { space = nullptr; }
+
+    bool isKey(const char* key) { return space && space->count(key) > 0; }
+
+    size_t putBytes(const char* key, const void* value, size_t len) {
+        if (!space || readOnly) {
+            return 0;
+        }
+        const uint8_t* bytes = (const uint8_t*)value;
+        (*space)[key].assign(bytes, bytes + len);
+        return len;
+    }
+
+    /**
+     * @brief Como en el ESP32: 0 si la clave no existe o no cabe en maxLen.
+     */
+    size_t getBytes(const char* key, void* buf, size_t maxLen) {
+        if (!space || !space->count(key)) {
+            return 0;
+        }
+        const std::vector<uint8_t>& blob = (*space)[key];
+        if (blob.size() > maxLen) {
+            return 0;
+        }
+        memcpy(buf, blob.data(), blob.size());
+        return blob.size();
+    }
+
+    bool remove(const char* key) { return space && !readOnly && space->erase(key) > 0; }
+
+    bool clear() {
+        if (!space || readOnly) {
+            return false;
+        }
+        space->clear();
+        return true;
+    }
+
+private:
+    typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+    static std::map<std::string, Namespace>& storage() {
+        static std::map<std::string, Namespace> flash;
+        return flash;
+    }
+
+    Namespace* space = nullptr;
+    bool readOnly = false;
+};
+
+#endif // TEST_SUPPORT_PREFERENCES_H
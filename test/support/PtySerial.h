@@ -0,0 +1,181 @@
+/*******************************************************************************************
+ * Archivo: test/support/PtySerial.h
+ * Descripción: Sustituto en el host de la UART del bus Modbus sobre un pseudoterminal.
+ *              El lado maestro del pty hace de UART del ESP32 para ModbusMaster y el lado
+ *              esclavo (slavePath()) queda libre para un esclavo simulado.
+ *              Reproduce cómo entrega la UART los bytes con onReceive(cb, true): quedan en
+ *              la FIFO hasta juntar fifoThreshold bytes o hasta que la línea calla
+ *              rxTimeoutSymbols caracteres, y solo entonces llega el evento de fin de trama.
+ *              Conectada con hostUartLine(uart) hace de UART del bus para ModbusSensorManager.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_PTY_SERIAL_H
+#define TEST_SUPPORT_PTY_SERIAL_H
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <deque>
+
+class PtySerial : public HostUartLine {
+public:
+    /**
+     * @param baud Velocidad emulada (fija el tiempo de carácter de 11 bits)
+     * @param rxTimeoutSymbols Caracteres de silencio que disparan el timeout RX
+     * @param fifoThreshold Bytes de la FIFO que fuerzan el volcado al buffer (120 en el ESP32)
+     */
+    explicit PtySerial(uint32_t baud, uint8_t rxTimeoutSymbols = 4, size_t fifoThreshold = 120)
+        : charUs(11000000UL / baud), rxTimeoutUs((uint32_t)rxTimeoutSymbols * (11000000UL / baud)),
+          fifoThreshold(fifoThreshold) {}
+
+    ~PtySerial() override { close(); }
+
+    /**
+     * @brief Abre el pty en modo crudo y sin bloqueo.
+     * @return true si el lado esclavo quedó disponible en slavePath()
+     */
+    bool open() {
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+            close();
+            return false;
+        }
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    const char* slavePath() const { return fd >= 0 ? ptsname(fd) : nullptr; }
+
+    /**
+     * @brief Descarta un evento de fin de trama pendiente (equivale a limpiar el flag
+     *        del callback de la UART antes de enviar).
+     */
+    void arm() override { frameEnded = false; }
+
+    /**
+     * @brief Evento de timeout RX desde el último arm(): la FIFO ya está en el buffer.
+     */
+    bool rxTimedOut() override {
+        pump();
+        return frameEnded;
+    }
+
+    /**
+     * @brief Descarta lo pendiente en el pty, la FIFO y el buffer (como uart_flush_input()).
+     *        read() no basta: los bytes que siguen en la FIFO no se ven hasta el timeout RX.
+     */
+    void clearInput() {
+        pump();
+        fifo.clear();
+        buffer.clear();
+        pendingTimeout = false;
+    }
+
+    /**
+     * @brief Mayor pausa entre dos volcados de la FIFO desde resetBurstStats(), en µs.
+     */
+    uint32_t longestBurstGapUs() const { return longestGapUs; }
+    void resetBurstStats() { lastDeliveryUs = 0; longestGapUs = 0; }
+
+    int available() override {
+        pump();
+        return (int)buffer.size();
+    }
+
+    int read() override {
+        pump();
+        if (buffer.empty()) {
+            return -1;
+        }
+        int c = buffer.front();
+        buffer.pop_front();
+        return c;
+    }
+
+    int peek() override {
+        pump();
+        return buffer.empty() ? -1 : buffer.front();
+    }
+
+    size_t write(uint8_t byte) override {
+        if (fd < 0 || ::write(fd, &byte, 1) != 1) {
+            return 0;
+        }
+        pendingTx++;
+        return 1;
+    }
+
+    /**
+     * @brief Como HardwareSerial::flush(): espera a que los bytes salgan a la línea.
+     */
+    void flush() override {
+        if (pendingTx) {
+            usleep(pendingTx * charUs);
+            pendingTx = 0;
+        }
+    }
+
+private:
+    /**
+     * @brief Mueve los bytes del pty a la FIFO y de la FIFO al buffer como la UART.
+     */
+    void pump() {
+        uint64_t now = hostMicros();
+        uint8_t chunk[64];
+        ssize_t n;
+        while (fd >= 0 && (n = ::read(fd, chunk, sizeof(chunk))) > 0) {
+            fifo.insert(fifo.end(), chunk, chunk + n);
+            lastByteUs = now;
+            pendingTimeout = true;
+            while (fifo.size() >= fifoThreshold) {
+                deliver(fifoThreshold, now);
+            }
+        }
+        if (pendingTimeout && now - lastByteUs >= rxTimeoutUs) {
+            deliver(fifo.size(), now);
+            pendingTimeout = false;
+            frameEnded = true;
+        }
+    }
+
+    void deliver(size_t count, uint64_t now) {
+        if (count == 0) {
+            return;
+        }
+        if (lastDeliveryUs && now - lastDeliveryUs > longestGapUs) {
+            longestGapUs = (uint32_t)(now - lastDeliveryUs);
+        }
+        lastDeliveryUs = now;
+        buffer.insert(buffer.end(), fifo.begin(), fifo.begin() + count);
+        fifo.erase(fifo.begin(), fifo.begin() + count);
+    }
+
+    int fd = -1;
+    uint32_t charUs;
+    uint32_t rxTimeoutUs;
+    size_t fifoThreshold;
+    std::deque<uint8_t> fifo;      // FIFO hardware de la UART
+    std::deque<uint8_t> buffer;    // Buffer del driver (lo que ve available())
+    uint64_t lastByteUs = 0;
+    uint64_t lastDeliveryUs = 0;
+    uint32_t longestGapUs = 0;
+    size_t pendingTx = 0;
+    bool pendingTimeout = false;
+    bool frameEnded = false;
+};
+
+#endif // TEST_SUPPORT_PTY_SERIAL_H
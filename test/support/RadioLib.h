@@ -0,0 +1,76 @@
+/*******************************************************************************************
+ * Archivo: test/support/RadioLib.h
+ * Descripción: Sustituto de RadioLib.h para compilar LoRaManager en el host (entorno
+ *              native_lora). Solo los códigos de estado, constantes y tipos que usa el
+ *              firmware, con los nombres de RadioLib 6.x; el nodo LoRaWAN lo reemplaza
+ *              FakeLoRaNode (test/support/FakeLoRaNode.h).
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_RADIOLIB_H
+#define TEST_SUPPORT_RADIOLIB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Códigos de estado
+#define RADIOLIB_ERR_NONE                           (0)
+#define RADIOLIB_ERR_UNKNOWN                        (-1)
+#define RADIOLIB_ERR_PACKET_TOO_LONG                (-4)
+#define RADIOLIB_ERR_RX_TIMEOUT                     (-6)
+#define RADIOLIB_ERR_NETWORK_NOT_JOINED             (-1101)
+#define RADIOLIB_ERR_COMMAND_QUEUE_FULL             (-1109)
+#define RADIOLIB_ERR_COMMAND_QUEUE_ITEM_NOT_FOUND   (-1110)
+#define RADIOLIB_ERR_CHECKSUM_MISMATCH              (-1115)
+#define RADIOLIB_ERR_NO_JOIN_ACCEPT                 (-1116)
+#define RADIOLIB_LORAWAN_SESSION_RESTORED           (-1117)
+#define RADIOLIB_LORAWAN_NEW_SESSION                (-1118)
+
+#define RADIOLIB_LORAWAN_DATA_RATE_UNUSED           (0xFF)
+
+// Comandos MAC que pide el nodo
+#define RADIOLIB_LORAWAN_MAC_LINK_CHECK             (0x02)
+#define RADIOLIB_LORAWAN_MAC_DEVICE_TIME            (0x0D)
+
+// Buffers de nonces y de sesión con la disposición de FakeLoRaNode. Con FCNT_UP y
+// SIGNATURE definidos SessionStore adelanta el contador de una sesión leída de flash
+#define RADIOLIB_LORAWAN_NONCES_DEV_NONCE           (0)
+#define RADIOLIB_LORAWAN_NONCES_SIGNATURE           (14)
+#define RADIOLIB_LORAWAN_NONCES_BUF_SIZE            (16)
+#define RADIOLIB_LORAWAN_SESSION_DEV_ADDR           (0)
+#define RADIOLIB_LORAWAN_SESSION_FCNT_UP            (4)
+#define RADIOLIB_LORAWAN_SESSION_N_FCNT_DOWN        (8)
+#define RADIOLIB_LORAWAN_SESSION_SIGNATURE          (254)
+#define RADIOLIB_LORAWAN_SESSION_BUF_SIZE           (256)
+
+/**
+ * @brief Datos de un uplink o downlink (campos de RadioLib 6.x).
+ */
+struct LoRaWANEvent_t {
+    uint8_t dir;
+    bool confirmed;
+    bool confirming;
+    uint8_t datarate;
+    float freq;
+    int16_t power;
+    uint32_t fcnt;
+    uint8_t port;
+};
+
+// Solo RadioLibNode (equipo) lo usa
+class LoRaWANNode;
+
+/**
+ * @brief Radio sin hardware: lo que llama LoRaManager::prepareForSleep.
+ */
+class SX1262 {
+public:
+    int16_t sleep(bool retainConfig = true) {
+        (void)retainConfig;
+        sleeping = true;
+        return RADIOLIB_ERR_NONE;
+    }
+
+    bool sleeping = false;
+};
+
+#endif // TEST_SUPPORT_RADIOLIB_H
@@ -0,0 +1,87 @@
+/*******************************************************************************************
+ * Archivo: test/support/esp_partition.h
+ * Descripción: Sustituto de la API de particiones del ESP-IDF para el host: una partición
+ *              de datos en memoria con las reglas de la flash NOR (escribir solo baja bits,
+ *              borrar por sectores de 4 KB). Su tamaño es el de uplinkq en partitions.csv.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_ESP_PARTITION_H
+#define TEST_SUPPORT_ESP_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_SIZE    0x104
+
+#define HOST_PARTITION_SIZE         0x20000
+#define HOST_PARTITION_SECTOR_SIZE  4096
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+/**
+ * @brief Contenido de la partición simulada (borrada = 0xFF).
+ */
+inline std::vector<uint8_t>& hostPartitionData() {
+    static std::vector<uint8_t> data(HOST_PARTITION_SIZE, 0xFF);
+    return data;
+}
+
+/**
+ * @brief Devuelve siempre la partición simulada, sea cual sea la etiqueta pedida.
+ */
+inline const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                       esp_partition_subtype_t subtype, const char* label) {
+    static esp_partition_t partition = {};
+    partition.type = type;
+    partition.subtype = subtype;
+    partition.size = HOST_PARTITION_SIZE;
+    strncpy(partition.label, label ? label : "", sizeof(partition.label) - 1);
+    return &partition;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, hostPartitionData().data() + offset, size);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    if (offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) {
+        hostPartitionData()[offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (offset % HOST_PARTITION_SECTOR_SIZE || size % HOST_PARTITION_SECTOR_SIZE || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(hostPartitionData().data() + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+#endif // TEST_SUPPORT_ESP_PARTITION_H
@@ -0,0 +1,110 @@
+/*******************************************************************************************
+ * Archivo: test/support/freertos/FreeRTOS.h
+ * Descripción: Sustituto mínimo de FreeRTOS para el host (lo que incluye Arduino.h en el
+ *              ESP32): semáforos binarios, secciones críticas y tareas sobre std::thread.
+ *              Un tick equivale a 1 ms.
+ *******************************************************************************************/
+
+#ifndef TEST_SUPPORT_FREERTOS_H
+#define TEST_SUPPORT_FREERTOS_H
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdFAIL          0
+#define pdPASS          1
+#define portMAX_DELAY   ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+/**
+ * @brief Semáforo binario: give deja una señal, take la consume o espera hasta el timeout.
+ */
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool given = false;
+};
+typedef HostSemaphore* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return new HostSemaphore();
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    delete semaphore;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        semaphore->given = true;
+    }
+    semaphore->signal.notify_one();
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (ticks == portMAX_DELAY) {
+        semaphore->signal.wait(lock, [semaphore] { return semaphore->given; });
+    } else if (!semaphore->signal.wait_for(lock, std::chrono::milliseconds(ticks),
+                                           [semaphore] { return semaphore->given; })) {
+        return pdFALSE;
+    }
+    semaphore->given = false;
+    return pdTRUE;
+}
+
+/**
+ * @brief Spinlock de las secciones críticas del ESP32 (un mutex en el host).
+ */
+struct portMUX_TYPE {
+    std::mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) ((mux)->mutex.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->mutex.unlock())
+
+/**
+ * @brief Crea la tarea como un hilo independiente; la pila y la prioridad se ignoran.
+ */
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                              UBaseType_t priority, TaskHandle_t* handle) {
+    (void)name;
+    (void)stackDepth;
+    (void)priority;
+    std::thread(function, parameter).detach();
+    if (handle) {
+        *handle = nullptr;
+    }
+    return pdPASS;
+}
+
+/**
+ * @brief En el host la tarea termina al volver de su función: borrarla no hace nada.
+ */
+inline void vTaskDelete(TaskHandle_t task) {
+    (void)task;
+}
+
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    (void)task;
+    return 1;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+#endif // TEST_SUPPORT_FREERTOS_H
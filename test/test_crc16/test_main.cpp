@@ -0,0 +1,125 @@
+/*******************************************************************************************
+ * Archivo: test/test_crc16/test_main.cpp
+ * Descripción: CRC-16/MODBUS por tabla (crc16_modbus) frente a la versión bit a bit
+ *              (crc16_update) en tramas aleatorias, y su rendimiento en bytes/µs.
+ *              Se ejecuta en el host: pio test -e native -f test_crc16
+ *******************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "util/crc16.h"
+
+#define CRC_RANDOM_FRAMES   100000  // Tramas aleatorias comparadas
+#define CRC_MAX_FRAME       256     // Tamaño máximo de una ADU Modbus RTU
+#define CRC_BENCH_BYTES     (4UL * 1024 * 1024)
+
+static uint16_t crcBitwise(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc16_update(crc, data[i]);
+    }
+    return crc;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+/**
+ * @brief Vector de referencia: lectura de 2 registros desde el 0 al esclavo 1 (CRC 0x0BC4,
+ *        se transmite C4 0B).
+ */
+void test_known_frame(void) {
+    const uint8_t frame[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x02};
+    TEST_ASSERT_EQUAL_HEX16(0x0BC4, crc16_modbus(frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL_HEX16(0x0BC4, crcBitwise(frame, sizeof(frame)));
+}
+
+/**
+ * @brief Una trama con su CRC agregado (byte bajo primero) da residuo 0.
+ */
+void test_residue_is_zero(void) {
+    uint8_t frame[] = {0x11, 0x04, 0x00, 0x08, 0x00, 0x01, 0x00, 0x00};
+    uint16_t crc = crc16_modbus(frame, 6);
+    frame[6] = crc & 0xFF;
+    frame[7] = crc >> 8;
+    TEST_ASSERT_EQUAL_HEX16(0x0000, crc16_modbus(frame, sizeof(frame)));
+}
+
+void test_table_matches_bitwise_on_random_frames(void) {
+    std::mt19937 rng(0x5EED);
+    uint8_t frame[CRC_MAX_FRAME];
+    for (uint32_t n = 0; n < CRC_RANDOM_FRAMES; n++) {
+        size_t len = rng() % (CRC_MAX_FRAME + 1);
+        for (size_t i = 0; i < len; i++) {
+            frame[i] = (uint8_t)rng();
+        }
+        uint16_t expected = crcBitwise(frame, len);
+        uint16_t actual = crc16_modbus(frame, len);
+        if (expected != actual) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "trama %lu de %u bytes", (unsigned long)n, (unsigned)len);
+            TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected, actual, msg);
+        }
+    }
+}
+
+/**
+ * @brief Continuar el cálculo por partes da lo mismo que de una vez.
+ */
+void test_buffer_update_is_incremental(void) {
+    std::mt19937 rng(42);
+    std::vector<uint8_t> data(CRC_MAX_FRAME);
+    for (auto& b : data) {
+        b = (uint8_t)rng();
+    }
+    for (size_t split = 0; split <= data.size(); split += 17) {
+        uint16_t crc = crc16_update_buffer(0xFFFF, data.data(), split);
+        crc = crc16_update_buffer(crc, data.data() + split, data.size() - split);
+        TEST_ASSERT_EQUAL_HEX16(crc16_modbus(data.data(), data.size()), crc);
+    }
+}
+
+/**
+ * @brief Bytes/µs de cada implementación sobre tramas de 256 bytes.
+ */
+void test_benchmark(void) {
+    std::vector<uint8_t> frame(CRC_MAX_FRAME);
+    std::mt19937 rng(7);
+    for (auto& b : frame) {
+        b = (uint8_t)rng();
+    }
+    const uint32_t rounds = CRC_BENCH_BYTES / frame.size();
+    volatile uint16_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        sink = sink ^ crcBitwise(frame.data(), frame.size());
+    }
+    double bitwiseUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        sink = sink ^ crc16_modbus(frame.data(), frame.size());
+    }
+    double tableUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "CRC-16/MODBUS: bit a bit %.1f bytes/us, tabla %.1f bytes/us (x%.1f)",
+             CRC_BENCH_BYTES / bitwiseUs, CRC_BENCH_BYTES / tableUs, bitwiseUs / tableUs);
+    TEST_MESSAGE(msg);
+    (void)sink;
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_known_frame);
+    RUN_TEST(test_residue_is_zero);
+    RUN_TEST(test_table_matches_bitwise_on_random_frames);
+    RUN_TEST(test_buffer_update_is_incremental);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,155 @@
+/*******************************************************************************************
+ * Archivo: test/test_float_format/test_main.cpp
+ * Descripción: formatFloatTo3Decimals (punto fijo entero) frente a la versión anterior
+ *              con snprintf("%.3f") y recorte de ceros, sobre millones de floats, y su
+ *              rendimiento en ns por llamada.
+ *              Se ejecuta en el host: pio test -e native -f test_float_format
+ *******************************************************************************************/
+#include <Arduino.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "utilities.h"
+
+#define FORMAT_RANDOM_BITS      3000000     // Patrones de bits aleatorios (todos los exponentes)
+#define FORMAT_RANDOM_VALUES    3000000     // Valores en rangos típicos de sensores
+#define FORMAT_BENCH_CALLS      1000000
+
+/**
+ * @brief Implementación anterior, tal como estaba en utilities.cpp.
+ */
+static size_t referenceFormat(float value, char* buffer, size_t bufferSize) {
+    snprintf(buffer, bufferSize, "%.3f", value);
+    int len = strlen(buffer);
+    int i = len - 1;
+    while (i >= 0 && buffer[i] == '0') {
+        i--;
+    }
+    if (i >= 0 && buffer[i] == '.') {
+        buffer[i] = '\0';
+        return i;
+    }
+    buffer[i + 1] = '\0';
+    return i + 1;
+}
+
+static void assertSameOutput(float value) {
+    char expected[64];
+    char actual[64];
+    size_t expectedLength = referenceFormat(value, expected, sizeof(expected));
+    size_t actualLength = formatFloatTo3Decimals(value, actual, sizeof(actual));
+    if (expectedLength != actualLength || strcmp(expected, actual) != 0) {
+        char msg[200];
+        snprintf(msg, sizeof(msg), "%.9g: esperado \"%s\", obtenido \"%s\"", value, expected, actual);
+        TEST_FAIL_MESSAGE(msg);
+    }
+}
+
+static float fromBits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_special_values(void) {
+    const float values[] = {0.0f, -0.0f, NAN, -NAN, INFINITY, -INFINITY, 1.0f, -1.0f, 0.1f, 0.0005f, 0.0015f,
+                            0.0025f, -0.0004f, 2147483520.0f, 2147483648.0f, -2147483648.0f, 3.4e38f, 1e-45f};
+    for (float value : values) {
+        assertSameOutput(value);
+    }
+
+    char buffer[32];
+    TEST_ASSERT_EQUAL(6, formatFloatTo3Decimals(23.456f, buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_STRING("23.456", buffer);
+    formatFloatTo3Decimals(3.7f, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("3.7", buffer);
+    formatFloatTo3Decimals(-12.0f, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING("-12", buffer);
+}
+
+/**
+ * @brief Valores justo en la mitad de una milésima: el redondeo debe coincidir con printf.
+ */
+void test_half_thousandths(void) {
+    for (int32_t k = -200000; k <= 200000; k++) {
+        float value = (float)((k + 0.5) / 1000.0);
+        assertSameOutput(value);
+        assertSameOutput(nextafterf(value, INFINITY));
+        assertSameOutput(nextafterf(value, -INFINITY));
+    }
+}
+
+void test_random_bit_patterns(void) {
+    std::mt19937 rng(41);
+    for (uint32_t n = 0; n < FORMAT_RANDOM_BITS; n++) {
+        assertSameOutput(fromBits(rng()));
+    }
+}
+
+void test_random_sensor_values(void) {
+    std::mt19937 rng(4141);
+    std::uniform_real_distribution<float> small(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> large(-100000.0f, 100000.0f);
+    for (uint32_t n = 0; n < FORMAT_RANDOM_VALUES; n++) {
+        assertSameOutput((n & 1) ? small(rng) : large(rng));
+    }
+}
+
+/**
+ * @brief Buffer justo: con menos de FLOAT_3_DECIMALS_MAX_LENGTH + 1 bytes se usa snprintf,
+ *        que trunca igual que antes.
+ */
+void test_small_buffer_truncates_like_snprintf(void) {
+    char expected[8];
+    char actual[8];
+    for (float value : {1234567.891f, -98.765f, 0.5f}) {
+        size_t expectedLength = referenceFormat(value, expected, sizeof(expected));
+        size_t actualLength = formatFloatTo3Decimals(value, actual, sizeof(actual));
+        TEST_ASSERT_EQUAL(expectedLength, actualLength);
+        TEST_ASSERT_EQUAL_STRING(expected, actual);
+    }
+}
+
+void test_benchmark(void) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> range(-1000.0f, 1000.0f);
+    std::vector<float> values(4096);
+    for (auto& value : values) {
+        value = range(rng);
+    }
+    char buffer[32];
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < FORMAT_BENCH_CALLS; n++) {
+        sink = sink + referenceFormat(values[n & 4095], buffer, sizeof(buffer));
+    }
+    double referenceNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < FORMAT_BENCH_CALLS; n++) {
+        sink = sink + formatFloatTo3Decimals(values[n & 4095], buffer, sizeof(buffer));
+    }
+    double fixedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "formatFloatTo3Decimals: snprintf %.1f ns/llamada, punto fijo %.1f ns/llamada (x%.1f)",
+             referenceNs / FORMAT_BENCH_CALLS, fixedNs / FORMAT_BENCH_CALLS, referenceNs / fixedNs);
+    TEST_MESSAGE(msg);
+    (void)sink;
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_special_values);
+    RUN_TEST(test_half_thousandths);
+    RUN_TEST(test_random_bit_patterns);
+    RUN_TEST(test_random_sensor_values);
+    RUN_TEST(test_small_buffer_truncates_like_snprintf);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,623 @@
+/*******************************************************************************************
+ * Archivo: test/test_lora_manager/test_main.cpp
+ * Descripción: LoRaManager de punta a punta contra el nodo y el servidor de red simulados
+ *              de test/support/FakeLoRaNode.h: join con DeviceTime, claves equivocadas y
+ *              espera entre joins, sesión restaurada tras deep sleep y tras un corte de
+ *              energía, uplink binario decodificado en el servidor, cola persistente con
+ *              pérdidas y latencia, comandos por downlink y un benchmark de ciclos de envío.
+ *              Se ejecuta en el host: pio test -e native_lora -f test_lora_manager
+ *******************************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "config.h"
+#include "AirtimeBudget.h"
+#include "LoRaManager.h"
+#include "DownlinkProcessor.h"
+#include "LinkAdapter.h"
+#include "SessionStore.h"
+#include "UplinkQueue.h"
+#include "sensors/BatterySensor.h"
+#include "FakeLoRaNode.h"
+
+#define TEST_BATTERY_V          3.912f
+#define TEST_RTC_OFFSET_S       5000    // Error del RTC tras un arranque en frío (lo corrige DeviceTime)
+#define TEST_SLEEP_S            600     // Sleep simulado entre ciclos
+#define TEST_BENCH_CYCLES       200
+#define TEST_WRONG_APP_KEY      "00,11,22,33,44,55,66,77,88,99,aa,bb,cc,dd,ee,ff"
+
+// Globales de main.cpp
+ESP32Time rtc;
+RTC_DATA_ATTR uint16_t bootCount = 0;
+RTC_DATA_ATTR uint16_t bootCountSinceUnsuccessfulJoin = 0;
+RTC_DATA_ATTR uint8_t LWsession[RADIOLIB_LORAWAN_SESSION_BUF_SIZE];
+
+// Estado de LoRaManager en memoria RTC
+extern uint32_t nextJoinAttempt;
+extern UplinkFrame uplinkReference;
+extern uint64_t uplinkDeferred;
+extern bool uplinkSchemaSent;
+
+// Configuración que devuelven los dobles de ConfigManager
+static LoRaConfig loraConfig;
+static uint32_t configSleepTime = 300;
+
+LoRaConfig ConfigManager::getLoRaConfig() { return loraConfig; }
+
+void ConfigManager::getSystemConfig(bool& initialized, uint32_t& sleepTime, String& deviceId, String& stationId) {
+    initialized = true;
+    sleepTime = configSleepTime;
+    deviceId = DEFAULT_DEVICE_ID;
+    stationId = DEFAULT_STATION_ID;
+}
+
+void ConfigManager::setSystemConfig(bool initialized, uint32_t sleepTime, const String& deviceId,
+                                    const String& stationId) {
+    configSleepTime = sleepTime;
+}
+
+std::vector<SensorConfig> ConfigManager::getAllSensorConfigs() { return {}; }
+void ConfigManager::setSensorsConfigs(const std::vector<SensorConfig>& configs) {}
+std::vector<ModbusSensorConfig> ConfigManager::getAllModbusSensorConfigs() { return {}; }
+void ConfigManager::setModbusSensorsConfigs(const std::vector<ModbusSensorConfig>& configs) {}
+
+void ConfigManager::getNTC100KConfig(double& t1, double& r1, double& t2, double& r2, double& t3, double& r3) {
+    t1 = r1 = t2 = r2 = t3 = r3 = 0;
+}
+void ConfigManager::setNTC100KConfig(double t1, double r1, double t2, double r2, double t3, double r3) {}
+void ConfigManager::getNTC10KConfig(double& t1, double& r1, double& t2, double& r2, double& t3, double& r3) {
+    t1 = r1 = t2 = r2 = t3 = r3 = 0;
+}
+void ConfigManager::setNTC10KConfig(double t1, double r1, double t2, double r2, double t3, double r3) {}
+void ConfigManager::getConductivityConfig(float& calTemp, float& coefComp, float& v1, float& t1, float& v2,
+                                          float& t2, float& v3, float& t3) {
+    calTemp = coefComp = v1 = t1 = v2 = t2 = v3 = t3 = 0;
+}
+void ConfigManager::setConductivityConfig(float calTemp, float coefComp, float v1, float t1, float v2, float t2,
+                                          float v3, float t3) {}
+void ConfigManager::getPHConfig(float& v1, float& t1, float& v2, float& t2, float& v3, float& t3,
+                                float& defaultTemp) {
+    v1 = t1 = v2 = t2 = v3 = t3 = defaultTemp = 0;
+}
+void ConfigManager::setPHConfig(float v1, float t1, float v2, float t2, float v3, float t3, float defaultTemp) {}
+
+float BatterySensor::readVoltage() { return TEST_BATTERY_V; }
+
+static FakeNetworkServer* server = nullptr;
+static FakeLoRaNode* node = nullptr;
+
+static FakeNetworkServer* registeredServer() {
+    uint64_t joinEUI, devEUI;
+    uint8_t nwkKey[16], appKey[16];
+    parseEUIString(DEFAULT_JOIN_EUI, &joinEUI);
+    parseEUIString(DEFAULT_DEV_EUI, &devEUI);
+    parseKeyString(DEFAULT_NWK_KEY, nwkKey, 16);
+    parseKeyString(DEFAULT_APP_KEY, appKey, 16);
+    return new FakeNetworkServer(joinEUI, devEUI, nwkKey, appKey);
+}
+
+/**
+ * @brief Dispositivo recién instalado: flash y memoria RTC vacías, RTC con error, y un
+ *        servidor que no lo conoce. La hora siempre avanza (una ventana entera del
+ *        presupuesto de tiempo en aire) para que las pruebas no dependan del orden.
+ */
+static void powerOnReset() {
+    Preferences store;
+    store.begin("radiolib");
+    store.clear();
+    store.end();
+    SessionStore::clear();
+    while (UplinkQueue::size() > 0) {
+        UplinkQueue::pop();
+    }
+    memset(LWsession, 0, sizeof(LWsession));
+    bootCountSinceUnsuccessfulJoin = 0;
+    nextJoinAttempt = 0;
+    uplinkReference.valid = false;
+    uplinkDeferred = 0;
+    uplinkSchemaSent = false;
+
+    // Enlace sin degradar: LinkAdapter vuelve al data rate inicial si una prueba lo bajó
+    if (LinkAdapter::datarate() != UPLINK_DATARATE) {
+        LinkAdapter::linkCheckAnswered(LinkAdapter::datarate(), LINK_MARGIN_DB + 10, 1);
+    }
+
+    loraConfig.joinEUI = DEFAULT_JOIN_EUI;
+    loraConfig.devEUI = DEFAULT_DEV_EUI;
+    loraConfig.nwkKey = DEFAULT_NWK_KEY;
+    loraConfig.appKey = DEFAULT_APP_KEY;
+    configSleepTime = 300;
+
+    uint32_t now = rtc.getEpoch() + AIRTIME_BUDGET_WINDOW_S;
+    rtc.setTime(now);
+    server = registeredServer();
+    server->setClock(now + TEST_RTC_OFFSET_S);
+    node = new FakeLoRaNode(*server);
+}
+
+/**
+ * @brief Deep sleep como SleepManager: la sesión queda en LWsession y el nodo se reconstruye.
+ */
+static void deepSleep(uint32_t seconds) {
+    LoRaManager::persistSession(*node);
+    memcpy(LWsession, node->getBufferSession(), RADIOLIB_LORAWAN_SESSION_BUF_SIZE);
+    delete node;
+    rtc.setTime(rtc.getEpoch() + seconds);
+    server->setClock(server->getClock() + seconds);
+    node = new FakeLoRaNode(*server);
+}
+
+/**
+ * @brief Corte de energía: se pierde la memoria RTC de la sesión; la flash se conserva.
+ */
+static void powerLoss() {
+    delete node;
+    memset(LWsession, 0, sizeof(LWsession));
+    node = new FakeLoRaNode(*server);
+}
+
+static void setScript(float uplinkLoss, float downlinkLoss, uint32_t latencyMs) {
+    FakeNetworkScript script;
+    script.uplinkLossRate = uplinkLoss;
+    script.downlinkLossRate = downlinkLoss;
+    script.latencyMs = latencyMs;
+    script.seed = 49;
+    server->setScript(script);
+}
+
+static SensorReading normalReading(const char* id, SensorType type, float value) {
+    SensorReading reading = {};
+    strncpy(reading.sensorId, id, sizeof(reading.sensorId) - 1);
+    reading.type = type;
+    reading.value = value;
+    return reading;
+}
+
+/**
+ * @brief Lecturas de un ciclo: NTC, pH y SHT30 (dos valores).
+ */
+static std::vector<SensorReading> cycleReadings(float offset) {
+    SensorReading sht = normalReading("SHT30_1", SHT30, NAN);
+    sht.subValues.push_back({21.37f + offset});
+    sht.subValues.push_back({55.2f});
+    return {normalReading("NTC1", N100K, 18.25f + offset), normalReading("PH1", PH, 6.82f), sht};
+}
+
+static void sendCycle(float offset) {
+    LoRaManager::sendBinaryPayload(cycleReadings(offset), {}, {0, 1, 2}, *node, DEFAULT_DEVICE_ID,
+                                   DEFAULT_STATION_ID, rtc);
+}
+
+/**
+ * @brief Enlace débil: un LinkCheck con margen 0 lleva LinkAdapter al data rate más robusto.
+ */
+static void weakLink() {
+    LinkAdapter::linkCheckAnswered(LinkAdapter::datarate(), 0, 1);
+    TEST_ASSERT_EQUAL_UINT8(LINK_MIN_DATARATE, LinkAdapter::datarate());
+}
+
+/**
+ * @brief Lecturas de muchos sensores: más de las que caben en los frames de un ciclo a
+ *        data rates bajos.
+ */
+static std::vector<SensorReading> manyReadings(size_t count, std::vector<uint8_t>& priorities) {
+    std::vector<SensorReading> readings;
+    char id[8];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(id, sizeof(id), "T%02u", (unsigned)i);
+        readings.push_back(normalReading(id, N100K, 10.0f + 0.37f * i));
+        priorities.push_back(0);
+    }
+    return readings;
+}
+
+/**
+ * @brief Esquema armado con las partes que recibió el servidor.
+ */
+static bool receivedSchema(UplinkSchema& schema) {
+    std::vector<uint8_t> serialized;
+    uint16_t schemaHash = 0;
+    for (const FakeUplink& uplink : server->received()) {
+        uint8_t part, partCount;
+        if (uplink.fPort == UPLINK_FPORT_SCHEMA &&
+            PayloadCodec::parseSchemaPart(uplink.payload.data(), uplink.payload.size(), schemaHash, part, partCount)) {
+            serialized.insert(serialized.end(), uplink.payload.begin() + PAYLOAD_SCHEMA_PART_HEADER,
+                              uplink.payload.end());
+        }
+    }
+    return PayloadCodec::parseSchema(serialized.data(), serialized.size(), schema);
+}
+
+static bool hasMacCommand(const FakeUplink& uplink, uint8_t cid) {
+    for (uint8_t queued : uplink.macCommands) {
+        if (queued == cid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const FakeUplink* lastUplinkOn(uint8_t fPort) {
+    const std::vector<FakeUplink>& received = server->received();
+    for (size_t i = received.size(); i > 0; i--) {
+        if (received[i - 1].fPort == fPort) {
+            return &received[i - 1];
+        }
+    }
+    return nullptr;
+}
+
+void setUp(void) {
+    powerOnReset();
+}
+
+void tearDown(void) {
+    delete node;
+    delete server;
+    node = nullptr;
+    server = nullptr;
+}
+
+void test_join_syncs_clock_with_device_time(void) {
+    static const uint8_t joinDatarates[] = JOIN_DATARATES;
+
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_TRUE(node->isJoined());
+    TEST_ASSERT_EQUAL_UINT8(joinDatarates[0], node->lastJoinDatarate());
+    TEST_ASSERT_EQUAL_UINT32(1, server->stats().joinAccepts);
+    TEST_ASSERT_EQUAL_UINT16(0, bootCountSinceUnsuccessfulJoin);
+
+    // Uplink vacío confirmado con DeviceTimeReq, y el RTC con la hora del servidor
+    TEST_ASSERT_EQUAL_UINT32(1, server->received().size());
+    const FakeUplink& request = server->received()[0];
+    TEST_ASSERT_TRUE(request.confirmed);
+    TEST_ASSERT_EQUAL_UINT32(0, request.payload.size());
+    TEST_ASSERT_TRUE(hasMacCommand(request, RADIOLIB_LORAWAN_MAC_DEVICE_TIME));
+    TEST_ASSERT_EQUAL_UINT32(1, server->stats().deviceTimeAnswers);
+
+    // La respuesta llegó en RX1, un segundo después del uplink: el RTC lo descuenta
+    uint64_t localMs = (uint64_t)rtc.getEpoch() * 1000 + rtc.getMillis();
+    TEST_ASSERT_UINT32_WITHIN(100, (uint64_t)server->getClock() * 1000, localMs);
+}
+
+void test_wrong_keys_back_off_until_fixed(void) {
+    static const uint8_t joinDatarates[] = JOIN_DATARATES;
+    const uint32_t maxFirstBackoff = JOIN_BACKOFF_BASE_S * (100 + JOIN_BACKOFF_JITTER_PCT) / 100;
+
+    loraConfig.appKey = TEST_WRONG_APP_KEY;
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_ERR_NO_JOIN_ACCEPT, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_EQUAL_UINT32(1, server->stats().badMic);
+    TEST_ASSERT_EQUAL_UINT32(0, server->stats().joinAccepts);
+    TEST_ASSERT_EQUAL_UINT16(1, bootCountSinceUnsuccessfulJoin);
+    TEST_ASSERT_UINT32_WITHIN(JOIN_BACKOFF_BASE_S * JOIN_BACKOFF_JITTER_PCT / 100 + 1,
+                              rtc.getEpoch() + JOIN_BACKOFF_BASE_S, nextJoinAttempt);
+
+    // Antes de la espera no sale ningún join-request
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_ERR_JOIN_DEFERRED, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_EQUAL_UINT32(1, server->stats().joinRequests);
+
+    // Cumplida la espera, el siguiente intento usa el siguiente data rate
+    rtc.setTime(rtc.getEpoch() + maxFirstBackoff + 1);
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_ERR_NO_JOIN_ACCEPT, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_EQUAL_UINT8(joinDatarates[1], node->lastJoinDatarate());
+    TEST_ASSERT_EQUAL_UINT16(2, bootCountSinceUnsuccessfulJoin);
+
+    loraConfig.appKey = DEFAULT_APP_KEY;
+    rtc.setTime(rtc.getEpoch() + JOIN_BACKOFF_MAX_S);
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_EQUAL_UINT8(joinDatarates[2], node->lastJoinDatarate());
+    TEST_ASSERT_EQUAL_UINT16(0, bootCountSinceUnsuccessfulJoin);
+    TEST_ASSERT_EQUAL_UINT32(2, server->stats().badMic);
+}
+
+/**
+ * @brief Un join-accept perdido o más lento que sus ventanas cuenta como join fallido.
+ */
+void test_join_accept_lost_or_late(void) {
+    setScript(0.0f, 1.0f, 0);
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_ERR_NO_JOIN_ACCEPT, LoRaManager::lwActivate(*node));
+
+    setScript(0.0f, 0.0f, FAKE_JOIN_ACCEPT_DELAY2_MS + 500);
+    rtc.setTime(rtc.getEpoch() + JOIN_BACKOFF_MAX_S);
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_ERR_NO_JOIN_ACCEPT, LoRaManager::lwActivate(*node));
+
+    TEST_ASSERT_EQUAL_UINT32(2, server->stats().joinAccepts);
+    TEST_ASSERT_EQUAL_UINT32(2, server->stats().lostDownlinks);
+    TEST_ASSERT_EQUAL_UINT16(2, bootCountSinceUnsuccessfulJoin);
+    TEST_ASSERT_FALSE(node->isJoined());
+}
+
+void test_session_restored_after_deep_sleep(void) {
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    uint32_t address = node->address();
+    deepSleep(TEST_SLEEP_S);
+
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_SESSION_RESTORED, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_EQUAL_UINT32(1, server->stats().joinRequests);
+    TEST_ASSERT_EQUAL_HEX32(address, node->address());
+
+    // El contador sigue tras el uplink de DeviceTime y el servidor acepta la trama
+    sendCycle(0.0f);
+    TEST_ASSERT_EQUAL_UINT32(0, server->stats().replayed);
+    TEST_ASSERT_EQUAL_UINT32(1, server->received()[1].fCnt);
+}
+
+/**
+ * @brief Tras perder la memoria RTC la sesión sale del último punto de control en flash,
+ *        con el contador adelantado para que el servidor no descarte los uplinks.
+ */
+void test_session_restored_from_flash_after_power_loss(void) {
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    deepSleep(TEST_SLEEP_S);
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_SESSION_RESTORED, LoRaManager::lwActivate(*node));
+    uint32_t checkpoint = node->getFCntUp();
+    for (int i = 0; i < 5; i++) {
+        sendCycle((float)i);
+    }
+    powerLoss();
+
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_SESSION_RESTORED, LoRaManager::lwActivate(*node));
+    TEST_ASSERT_EQUAL_UINT32(1, server->stats().joinRequests);
+    TEST_ASSERT_EQUAL_UINT32(checkpoint + SESSION_FCNT_SKIP, node->getFCntUp());
+
+    // La hora se perdió con la memoria RTC: el siguiente uplink la pide
+    sendCycle(9.0f);
+    TEST_ASSERT_EQUAL_UINT32(0, server->stats().replayed);
+    const FakeUplink& first = server->received()[server->received().size() - 1];
+    TEST_ASSERT_EQUAL_UINT32(checkpoint + SESSION_FCNT_SKIP, first.fCnt);
+    TEST_ASSERT_TRUE(hasMacCommand(first, RADIOLIB_LORAWAN_MAC_DEVICE_TIME));
+}
+
+/**
+ * @brief El servidor arma el esquema con sus partes y decodifica el keyframe.
+ */
+void test_binary_uplink_decodes_on_server(void) {
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    uint32_t timestamp = rtc.getEpoch();
+    sendCycle(0.0f);
+
+    UplinkSchema schema;
+    TEST_ASSERT_TRUE(receivedSchema(schema));
+    TEST_ASSERT_EQUAL_STRING(DEFAULT_DEVICE_ID, schema.deviceId);
+    TEST_ASSERT_EQUAL_UINT32(3, schema.sensors.size());
+
+    const FakeUplink* frame = lastUplinkOn(UPLINK_FPORT_BINARY);
+    TEST_ASSERT_NOT_NULL(frame);
+    UplinkFrame reference = {};
+    DecodedUplink decoded;
+    TEST_ASSERT_TRUE(PayloadCodec::decode(frame->payload.data(), frame->payload.size(), schema, reference, decoded));
+    TEST_ASSERT_UINT32_WITHIN(1, timestamp, decoded.timestamp);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, TEST_BATTERY_V, decoded.battery);
+    TEST_ASSERT_EQUAL_UINT32(3, decoded.sensors.size());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 18.25f, decoded.sensors[0].values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 6.82f, decoded.sensors[1].values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 55.2f, decoded.sensors[2].values[1]);
+}
+
+/**
+ * @brief Lo que no entra en los UPLINK_MAX_FRAGMENTS frames del ciclo se guarda como
+ *        keyframe en la cola: el servidor recibe todas las lecturas de este ciclo.
+ */
+void test_leftover_sensors_queued_as_keyframes(void) {
+    const size_t sensorCount = 60;
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    weakLink();
+
+    std::vector<uint8_t> priorities;
+    std::vector<SensorReading> readings = manyReadings(sensorCount, priorities);
+    size_t before = server->received().size();
+    LoRaManager::sendBinaryPayload(readings, {}, priorities, *node, DEFAULT_DEVICE_ID, DEFAULT_STATION_ID, rtc);
+    size_t sentFrames = 0;
+    for (size_t i = before; i < server->received().size(); i++) {
+        sentFrames += server->received()[i].fPort == UPLINK_FPORT_BINARY;
+    }
+    TEST_ASSERT_EQUAL_UINT32(UPLINK_MAX_FRAGMENTS, sentFrames);
+    TEST_ASSERT_GREATER_THAN(0, UplinkQueue::size());
+    TEST_ASSERT_TRUE(uplinkDeferred == 0);
+
+    while (UplinkQueue::size() > 0) {
+        TEST_ASSERT_GREATER_THAN(0, LoRaManager::drainUplinkQueue(*node));
+    }
+
+    // Cada sensor llega una vez, con el valor de este ciclo
+    UplinkSchema schema;
+    TEST_ASSERT_TRUE(receivedSchema(schema));
+    UplinkFrame reference = {};
+    std::vector<float> values(sensorCount, NAN);
+    for (const FakeUplink& uplink : server->received()) {
+        DecodedUplink decoded;
+        if (uplink.fPort != UPLINK_FPORT_BINARY) {
+            continue;
+        }
+        TEST_ASSERT_TRUE(PayloadCodec::decode(uplink.payload.data(), uplink.payload.size(), schema, reference, decoded));
+        for (const DecodedSensor& sensor : decoded.sensors) {
+            TEST_ASSERT_TRUE(isnan(values[sensor.index]));
+            values[sensor.index] = sensor.values[0];
+        }
+    }
+    for (size_t i = 0; i < sensorCount; i++) {
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, readings[i].value, values[i]);
+    }
+}
+
+/**
+ * @brief El payload de texto se arma con el máximo del data rate que eligió LinkAdapter:
+ *        en el más robusto sale recortado en lugar de ser rechazado y quedar en la cola.
+ */
+void test_text_payload_fits_adapted_datarate(void) {
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    weakLink();
+
+    std::vector<uint8_t> priorities;
+    LoRaManager::sendDelimitedPayload(manyReadings(20, priorities), {}, *node, DEFAULT_DEVICE_ID,
+                                      DEFAULT_STATION_ID, rtc);
+    const FakeUplink* text = lastUplinkOn(UPLINK_FPORT_TEXT);
+    TEST_ASSERT_NOT_NULL(text);
+    TEST_ASSERT_EQUAL_UINT8(LINK_MIN_DATARATE, text->datarate);
+    TEST_ASSERT_LESS_OR_EQUAL(AirtimeBudget::maxPayloadLen(LINK_MIN_DATARATE), text->payload.size());
+    TEST_ASSERT_EQUAL_UINT16(0, UplinkQueue::size());
+}
+
+/**
+ * @brief Los uplinks en cola salen confirmados: se quedan en la cola hasta que el ACK
+ *        llega dentro de una ventana de recepción.
+ */
+void test_queued_uplinks_wait_for_ack(void) {
+    LoRaManager::queueReadings(cycleReadings(0.0f), {}, DEFAULT_DEVICE_ID, DEFAULT_STATION_ID, rtc);
+    TEST_ASSERT_EQUAL_UINT16(1, UplinkQueue::size());
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+
+    setScript(1.0f, 0.0f, 0);
+    TEST_ASSERT_EQUAL_UINT16(0, LoRaManager::drainUplinkQueue(*node));
+    setScript(0.0f, 1.0f, 0);
+    TEST_ASSERT_EQUAL_UINT16(0, LoRaManager::drainUplinkQueue(*node));
+    setScript(0.0f, 0.0f, FAKE_RX2_DELAY_MS + 100);
+    TEST_ASSERT_EQUAL_UINT16(0, LoRaManager::drainUplinkQueue(*node));
+    TEST_ASSERT_EQUAL_UINT16(1, UplinkQueue::size());
+
+    // Respuesta en RX2: llega a tiempo
+    setScript(0.0f, 0.0f, FAKE_RX1_DELAY_MS + 100);
+    TEST_ASSERT_EQUAL_UINT16(1, LoRaManager::drainUplinkQueue(*node));
+    TEST_ASSERT_EQUAL_UINT16(0, UplinkQueue::size());
+    const FakeUplink* delivered = lastUplinkOn(UPLINK_FPORT_BINARY);
+    TEST_ASSERT_NOT_NULL(delivered);
+    TEST_ASSERT_TRUE(delivered->confirmed);
+}
+
+/**
+ * @brief Sin red las lecturas se guardan en keyframes que caben en LINK_MIN_DATARATE: la
+ *        cola se vacía aunque el enlace obligue al data rate más robusto.
+ */
+void test_queued_frames_fit_slowest_datarate(void) {
+    std::vector<uint8_t> priorities;
+    LoRaManager::queueReadings(manyReadings(20, priorities), {}, DEFAULT_DEVICE_ID, DEFAULT_STATION_ID, rtc);
+    TEST_ASSERT_GREATER_THAN(1, UplinkQueue::size());
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    weakLink();
+
+    size_t before = server->received().size();
+    sendCycle(0.0f);
+    while (UplinkQueue::size() > 0) {
+        TEST_ASSERT_GREATER_THAN(0, LoRaManager::drainUplinkQueue(*node));
+    }
+    for (size_t i = before; i < server->received().size(); i++) {
+        TEST_ASSERT_EQUAL_UINT8(LINK_MIN_DATARATE, server->received()[i].datarate);
+        TEST_ASSERT_LESS_OR_EQUAL(AirtimeBudget::maxPayloadLen(LINK_MIN_DATARATE) - UPLINK_QUEUE_FOPTS_RESERVE,
+                                  server->received()[i].payload.size());
+    }
+}
+
+/**
+ * @brief Un uplink en cola más grande que el data rate actual pasa al final: los que sí
+ *        caben se entregan y él sale cuando el enlace mejora.
+ */
+void test_oversized_queued_uplink_does_not_block(void) {
+    uint8_t oversized[100];
+    memset(oversized, 0xA5, sizeof(oversized));
+    TEST_ASSERT_TRUE(UplinkQueue::push(UPLINK_FPORT_HISTORY, rtc.getEpoch(), oversized, sizeof(oversized)));
+    LoRaManager::queueReadings(cycleReadings(0.0f), {}, DEFAULT_DEVICE_ID, DEFAULT_STATION_ID, rtc);
+    TEST_ASSERT_EQUAL_UINT16(2, UplinkQueue::size());
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    weakLink();
+
+    sendCycle(0.0f);
+    TEST_ASSERT_EQUAL_UINT16(1, UplinkQueue::size());
+    QueuedUplink head;
+    TEST_ASSERT_TRUE(UplinkQueue::peek(head));
+    TEST_ASSERT_EQUAL_UINT16(sizeof(oversized), head.length);
+    TEST_ASSERT_EQUAL_UINT16(0, LoRaManager::drainUplinkQueue(*node));
+    TEST_ASSERT_EQUAL_UINT16(1, UplinkQueue::size());
+
+    // Enlace recuperado: sale al data rate inicial
+    LinkAdapter::linkCheckAnswered(LinkAdapter::datarate(), LINK_MARGIN_DB + 10, 1);
+    sendCycle(1.0f);
+    TEST_ASSERT_EQUAL_UINT16(0, UplinkQueue::size());
+    const FakeUplink* delivered = lastUplinkOn(UPLINK_FPORT_HISTORY);
+    TEST_ASSERT_NOT_NULL(delivered);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(oversized), delivered->payload.size());
+}
+
+/**
+ * @brief Un comando en el puerto de comandos se aplica y se confirma en el siguiente
+ *        envío; en otro puerto se ignora.
+ */
+void test_injected_downlink_applies_command(void) {
+    const std::vector<uint8_t> sleep600 = {DOWNLINK_CMD_SLEEP_TIME, 0x58, 0x02, 0x00, 0x00};
+    const std::vector<uint8_t> sleep900 = {DOWNLINK_CMD_SLEEP_TIME, 0x84, 0x03, 0x00, 0x00};
+
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    server->injectDownlink(DOWNLINK_FPORT_COMMAND + 1, sleep900);
+    sendCycle(0.0f);
+    TEST_ASSERT_EQUAL_UINT32(300, configSleepTime);
+    TEST_ASSERT_FALSE(DownlinkProcessor::hasControlFrame());
+
+    server->injectDownlink(DOWNLINK_FPORT_COMMAND, sleep600);
+    sendCycle(1.0f);
+    TEST_ASSERT_EQUAL_UINT32(600, configSleepTime);
+    TEST_ASSERT_TRUE(DownlinkProcessor::hasControlFrame());
+
+    // Confirmación: [ACK][longitud][fCnt del downlink][comando, estado]
+    sendCycle(2.0f);
+    const FakeUplink* control = lastUplinkOn(UPLINK_FPORT_CONTROL);
+    TEST_ASSERT_NOT_NULL(control);
+    TEST_ASSERT_EQUAL_UINT32(6, control->payload.size());
+    TEST_ASSERT_EQUAL_HEX8(CONTROL_RECORD_ACK, control->payload[0]);
+    TEST_ASSERT_EQUAL_HEX8(DOWNLINK_CMD_SLEEP_TIME, control->payload[4]);
+    TEST_ASSERT_EQUAL_HEX8(DOWNLINK_STATUS_OK, control->payload[5]);
+    TEST_ASSERT_FALSE(DownlinkProcessor::hasControlFrame());
+}
+
+/**
+ * @brief Ciclos completos de despertar (sesión desde RTC, envío binario, punto de control
+ *        y deep sleep) con pérdidas: costo en el host y entrega en el servidor.
+ */
+void test_benchmark_wake_cycles(void) {
+    TEST_ASSERT_EQUAL_INT16(RADIOLIB_LORAWAN_NEW_SESSION, LoRaManager::lwActivate(*node));
+    setScript(0.1f, 0.1f, 300);
+    uint32_t restored = 0;
+    uint64_t busyUs = 0;
+    for (int cycle = 0; cycle < TEST_BENCH_CYCLES; cycle++) {
+        deepSleep(TEST_SLEEP_S);
+        uint64_t start = hostMicros();
+        uint64_t waited = hostAdvancedMicros();
+        if (LoRaManager::lwActivate(*node) == RADIOLIB_LORAWAN_SESSION_RESTORED) {
+            restored++;
+        }
+        sendCycle((float)(cycle % 10) * 0.1f);
+        // Sin las esperas simuladas de las ventanas RX
+        busyUs += (hostMicros() - start) - (hostAdvancedMicros() - waited);
+    }
+
+    FakeNetworkStats stats = server->stats();
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%d ciclos: %.1f µs por ciclo, %u uplinks recibidos, %u perdidos, "
+             "%u downlinks (%u perdidos), %u DeviceTime, %u en cola",
+             TEST_BENCH_CYCLES, (double)busyUs / TEST_BENCH_CYCLES, (unsigned)stats.uplinks,
+             (unsigned)stats.lostUplinks, (unsigned)stats.downlinks, (unsigned)stats.lostDownlinks,
+             (unsigned)stats.deviceTimeAnswers, (unsigned)UplinkQueue::size());
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(TEST_BENCH_CYCLES, restored);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.joinRequests);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.replayed);
+    TEST_ASSERT_EQUAL_UINT32(node->getFCntUp(), stats.uplinks + stats.lostUplinks);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_join_syncs_clock_with_device_time);
+    RUN_TEST(test_wrong_keys_back_off_until_fixed);
+    RUN_TEST(test_join_accept_lost_or_late);
+    RUN_TEST(test_session_restored_after_deep_sleep);
+    RUN_TEST(test_session_restored_from_flash_after_power_loss);
+    RUN_TEST(test_binary_uplink_decodes_on_server);
+    RUN_TEST(test_leftover_sensors_queued_as_keyframes);
+    RUN_TEST(test_text_payload_fits_adapted_datarate);
+    RUN_TEST(test_queued_uplinks_wait_for_ack);
+    RUN_TEST(test_queued_frames_fit_slowest_datarate);
+    RUN_TEST(test_oversized_queued_uplink_does_not_block);
+    RUN_TEST(test_injected_downlink_applies_command);
+    RUN_TEST(test_benchmark_wake_cycles);
+    return UNITY_END();
+}
@@ -0,0 +1,156 @@
+/*******************************************************************************************
+ * Archivo: test/test_modbus_framing/test_main.cpp
+ * Descripción: Fin de trama de ModbusMaster con el evento de timeout RX de la UART,
+ *              sobre el pty de test/support/PtySerial.h que entrega los bytes en ráfagas
+ *              de FIFO como el ESP32. Se ejecuta en el host: pio test -e native -f test_modbus_framing
+ *******************************************************************************************/
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include "ModbusMaster.h"
+#include "PtySerial.h"
+
+#define FRAMING_BAUD        19200   // 573 µs por carácter: timeout RX de 4 caracteres ~2.3 ms
+#define FRAMING_SLAVE       7
+#define FRAMING_TIMEOUT_MS  2000    // Timeout holgado: el fin de trama debe llegar mucho antes
+
+static PtySerial* serial = nullptr;
+
+static void armFrameEnd() { serial->arm(); }
+static bool frameEnded() { return serial->rxTimedOut(); }
+
+/**
+ * @brief Esclavo mínimo: lee la petición 0x03 y contesta con registros = índice,
+ *        enviando solo los primeros sendBytes bytes.
+ */
+static void answerOnce(int fd, size_t sendBytes) {
+    uint8_t request[8];
+    size_t got = 0;
+    while (got < sizeof(request)) {
+        struct pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 1000) <= 0) {
+            return;
+        }
+        ssize_t n = ::read(fd, request + got, sizeof(request) - got);
+        if (n <= 0) {
+            return;
+        }
+        got += n;
+    }
+
+    uint16_t qty = word(request[4], request[5]);
+    std::vector<uint8_t> response = {request[0], request[1], (uint8_t)(2 * qty)};
+    for (uint16_t i = 0; i < qty; i++) {
+        response.push_back(highByte(i));
+        response.push_back(lowByte(i));
+    }
+    uint16_t crc = crc16_modbus(response.data(), response.size());
+    response.push_back(lowByte(crc));
+    response.push_back(highByte(crc));
+
+    // De una vez: el pty no tiene velocidad de línea y el planificador del host no garantiza
+    // pausas de un carácter; las ráfagas y silencios los pone la FIFO de PtySerial
+    usleep(3000);
+    (void)::write(fd, response.data(), std::min(sendBytes, response.size()));
+}
+
+static int openSlave() {
+    int fd = ::open(serial->slavePath(), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (fd >= 0 && tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static ModbusMaster master;
+static int slaveFd = -1;
+
+void setUp(void) {
+    serial = new PtySerial(FRAMING_BAUD);
+    TEST_ASSERT_TRUE(serial->open());
+    slaveFd = openSlave();
+    TEST_ASSERT_TRUE(slaveFd >= 0);
+    master.begin(FRAMING_SLAVE, *serial);
+    master.setResponseTimeout(FRAMING_TIMEOUT_MS);
+    master.preTransmission(armFrameEnd);
+    master.frameEnd(frameEnded);
+}
+
+void tearDown(void) {
+    ::close(slaveFd);
+    delete serial;
+    serial = nullptr;
+}
+
+/**
+ * @brief La FIFO deja pausas en el buffer mayores que 3.5 caracteres en mitad de una
+ *        respuesta de 125 registros: medir silencios en el buffer la cortaría.
+ */
+void test_fifo_bursts_exceed_frame_gap(void) {
+    std::thread slave(answerOnce, slaveFd, 255);
+    serial->resetBurstStats();
+    uint8_t result = master.readHoldingRegisters(0, 125);
+    slave.join();
+
+    const uint32_t frameGapUs = 35 * (11000000UL / FRAMING_BAUD) / 10;
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBSuccess, result);
+    TEST_ASSERT_GREATER_THAN_UINT32(frameGapUs, serial->longestBurstGapUs());
+}
+
+/**
+ * @brief Respuestas por encima del umbral de 120 bytes de la FIFO llegan completas.
+ */
+void test_long_responses_complete(void) {
+    const uint16_t sizes[] = {1, 57, 58, 60, 100, 125};
+    for (uint16_t qty : sizes) {
+        std::thread slave(answerOnce, slaveFd, 255);
+        uint8_t result = master.readHoldingRegisters(0, qty);
+        slave.join();
+
+        TEST_ASSERT_EQUAL_HEX8_MESSAGE(ModbusMaster::ku8MBSuccess, result, "respuesta larga cortada");
+        TEST_ASSERT_EQUAL_UINT16(qty - 1, master.getResponseBuffer(qty - 1));
+    }
+}
+
+/**
+ * @brief Una respuesta truncada termina con el evento de timeout RX, sin esperar el timeout.
+ */
+void test_truncated_response_detected_at_frame_end(void) {
+    std::thread slave(answerOnce, slaveFd, 200);
+    uint32_t start = millis();
+    uint8_t result = master.readHoldingRegisters(0, 125);
+    uint32_t elapsed = millis() - start;
+    slave.join();
+
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBIncompleteFrame, result);
+    TEST_ASSERT_LESS_THAN_UINT32(FRAMING_TIMEOUT_MS / 4, elapsed);
+}
+
+/**
+ * @brief El evento de la respuesta truncada no corta la transacción siguiente.
+ */
+void test_stale_frame_end_is_discarded(void) {
+    std::thread first(answerOnce, slaveFd, 100);
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBIncompleteFrame, master.readHoldingRegisters(0, 125));
+    first.join();
+
+    std::thread second(answerOnce, slaveFd, 255);
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBSuccess, master.readHoldingRegisters(0, 125));
+    second.join();
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_bursts_exceed_frame_gap);
+    RUN_TEST(test_long_responses_complete);
+    RUN_TEST(test_truncated_response_detected_at_frame_end);
+    RUN_TEST(test_stale_frame_end_is_discarded);
+    return UNITY_END();
+}
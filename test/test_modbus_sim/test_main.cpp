@@ -0,0 +1,334 @@
+/*******************************************************************************************
+ * Archivo: test/test_modbus_sim/test_main.cpp
+ * Descripción: ModbusMaster y ModbusSensorManager contra el esclavo simulado de
+ *              test/support/ModbusSlaveSim.h a través del pty de PtySerial: decodificación
+ *              del mapa ENV4 integrado, espera de disponibilidad, circuit breaker, excepciones,
+ *              CRC corrupto, respuestas perdidas y pausas entre bytes, más un benchmark de
+ *              transacciones/s y del tiempo hasta detectar cada tipo de fallo.
+ *              Se ejecuta en el host: pio test -e native -f test_modbus_sim
+ *******************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <unity.h>
+#include "config.h"
+#include "ModbusMaster.h"
+#include "ModbusSensorManager.h"
+#include "ModbusSlaveSim.h"
+#include "PtySerial.h"
+
+#define SIM_BAUD            9600    // MODBUS_BAUD_RATE habitual: 1.15 ms por carácter
+#define SIM_ADDRESS         1
+#define SIM_LATENCY_US      3000    // Reacción típica de un sensor RS485
+#define SIM_BENCH_ROUNDS    20      // Transacciones por tamaño de bloque en el benchmark
+
+#define SIM_READY_DELAY_MS  300     // Arranque del ENV4 simulado: humedad en 0 hasta entonces
+
+// Estado de ModbusSensorManager en memoria RTC: se reinicia en cada prueba
+extern ModbusSlaveHealth modbusSlaveHealth[MODBUS_MAX_SLAVES];
+extern uint32_t modbusPollCycle;
+
+static const ModbusBusConfig busConfigs[] = DEFAULT_MODBUS_BUS_CONFIGS;
+static const ModbusDeviceDescriptor builtinDescriptors[] = DEFAULT_MODBUS_DEVICE_DESCRIPTORS;
+
+static PtySerial* serial = nullptr;
+static ModbusSlaveSim* slave = nullptr;
+static ModbusMaster master;
+
+static void armFrameEnd() { serial->arm(); }
+static bool frameEnded() { return serial->rxTimedOut(); }
+
+/**
+ * @brief Timeout de respuesta como el del firmware para un esclavo ya medido:
+ *        reacción mínima más el tiempo de línea de la respuesta esperada.
+ */
+static uint16_t firmwareTimeout(uint16_t numRegs) {
+    return MODBUS_MIN_RESPONSE_TIMEOUT + (MODBUS_RESPONSE_BYTES(numRegs) * 11000UL + SIM_BAUD - 1) / SIM_BAUD;
+}
+
+/**
+ * @brief Duración teórica de una lectura correcta: petición, reacción y respuesta.
+ */
+static double expectedTransactionMs(uint16_t numRegs) {
+    return (MODBUS_REQUEST_BYTES + MODBUS_RESPONSE_BYTES(numRegs)) * 11000.0 / SIM_BAUD + SIM_LATENCY_US / 1000.0;
+}
+
+static void setScript(uint32_t jitterUs, float crcErrorRate, float dropRate) {
+    ModbusSimScript script;
+    script.baudRate = SIM_BAUD;
+    script.latencyUs = SIM_LATENCY_US;
+    script.byteGapJitterUs = jitterUs;
+    script.crcErrorRate = crcErrorRate;
+    script.dropRate = dropRate;
+    script.seed = 35;
+    slave->setScript(script);
+}
+
+/**
+ * @brief Un ciclo de sondeo del firmware con el ENV4 del esclavo simulado y el mapa integrado.
+ * @param whenReady true para leer con readSensorsWhenReady (sondeo de disponibilidad)
+ */
+static ModbusSensorReading managerCycle(bool whenReady = false) {
+    std::vector<ModbusDeviceDescriptor> descriptors(std::begin(builtinDescriptors), std::end(builtinDescriptors));
+    std::vector<ModbusSensorConfig> sensors = {{"ModbusEnv1", ENV4, SIM_ADDRESS, true, 0, 0, 1}};
+    std::vector<ModbusSensorReading> readings;
+
+    ModbusSensorManager::startCycle();
+    ModbusSensorManager::beginModbus();
+    if (whenReady) {
+        ModbusSensorManager::readSensorsWhenReady(sensors, descriptors, readings);
+    } else {
+        ModbusSensorManager::readSensors(sensors, descriptors, readings);
+    }
+    ModbusSensorManager::endModbus();
+
+    TEST_ASSERT_EQUAL_size_t(1, readings.size());
+    TEST_ASSERT_EQUAL_size_t(4, readings[0].subValues.size());
+    return readings[0];
+}
+
+static void assertEnv4Values(const ModbusSensorReading& reading) {
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 45.6f, reading.subValues[0].value);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, -3.2f, reading.subValues[1].value);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 101.3f, reading.subValues[2].value);
+    TEST_ASSERT_EQUAL_FLOAT(70000.0f, reading.subValues[3].value);
+}
+
+void setUp(void) {
+    serial = new PtySerial(SIM_BAUD, MODBUS_RX_TIMEOUT_SYMBOLS);
+    TEST_ASSERT_TRUE(serial->open());
+
+    // ENV4: humedad 45.6 %, temperatura -3.2 °C, presión 101.3 kPa, iluminación 70000 lux
+    slave = new ModbusSlaveSim(SIM_ADDRESS);
+    slave->setRegisters(0x03, 500, {456, (uint16_t)-32, 0, 0, 0, 1013, 0x0001, 0x1170});
+    std::vector<uint16_t> block(125);
+    for (uint16_t i = 0; i < block.size(); i++) {
+        block[i] = (uint16_t)(0xA000 + i);
+    }
+    slave->setRegisters(0x04, 1000, block);
+    setScript(0, 0.0f, 0.0f);
+    TEST_ASSERT_TRUE(slave->start(serial->slavePath()));
+
+    master.begin(SIM_ADDRESS, *serial);
+    master.setResponseTimeout(firmwareTimeout(125));
+    master.preTransmission(armFrameEnd);
+    master.frameEnd(frameEnded);
+
+    // El pty hace de UART del bus 0 para ModbusSensorManager, sin salud previa ni inventario
+    hostUartLine(busConfigs[0].uart) = serial;
+    memset(modbusSlaveHealth, 0, sizeof(modbusSlaveHealth));
+    modbusPollCycle = 0;
+    ModbusSensorManager::useInventory(1, 0, {});
+}
+
+void tearDown(void) {
+    hostUartLine(busConfigs[0].uart) = nullptr;
+    slave->stop();
+    delete slave;
+    delete serial;
+    slave = nullptr;
+    serial = nullptr;
+}
+
+void test_reads_env4_map(void) {
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBSuccess, master.readHoldingRegisters(500, 8));
+    TEST_ASSERT_EQUAL_UINT16(456, master.getResponseBuffer(0));
+    TEST_ASSERT_EQUAL_INT16(-32, (int16_t)master.getResponseBuffer(1));
+    TEST_ASSERT_EQUAL_UINT16(1013, master.getResponseBuffer(5));
+    TEST_ASSERT_EQUAL_UINT32(70000, ((uint32_t)master.getResponseBuffer(6) << 16) | master.getResponseBuffer(7));
+}
+
+void test_long_block_over_fifo_threshold(void) {
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBSuccess, master.readInputRegisters(1000, 125));
+    TEST_ASSERT_EQUAL_HEX16(0xA000, master.getResponseBuffer(0));
+    TEST_ASSERT_EQUAL_HEX16(0xA000 + 124, master.getResponseBuffer(124));
+}
+
+void test_unmapped_registers_raise_exception(void) {
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBIllegalDataAddress, master.readHoldingRegisters(504, 8));
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBIllegalDataAddress, master.readInputRegisters(500, 1));
+    TEST_ASSERT_EQUAL_UINT32(2, slave->stats().exceptions);
+}
+
+void test_corrupted_crc_rejected(void) {
+    setScript(0, 1.0f, 0.0f);
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBInvalidCRC, master.readHoldingRegisters(500, 8));
+    TEST_ASSERT_EQUAL_UINT32(1, slave->stats().corrupted);
+}
+
+void test_missing_reply_times_out(void) {
+    setScript(0, 0.0f, 1.0f);
+    master.setResponseTimeout(firmwareTimeout(8));
+    uint32_t start = millis();
+    TEST_ASSERT_EQUAL_HEX8(ModbusMaster::ku8MBResponseTimedOut, master.readHoldingRegisters(500, 8));
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(firmwareTimeout(8), millis() - start);
+    TEST_ASSERT_EQUAL_UINT32(1, slave->stats().dropped);
+}
+
+/**
+ * @brief Pausas entre bytes mayores que el timeout RX cortan la trama: se detecta como
+ *        trama incompleta (o CRC si el corte cae justo tras un múltiplo del umbral de la FIFO).
+ */
+void test_byte_gap_jitter_ends_frame(void) {
+    setScript(8000, 0.0f, 0.0f);
+    uint8_t result = master.readInputRegisters(1000, 57);
+    TEST_ASSERT_TRUE(result == ModbusMaster::ku8MBIncompleteFrame || result == ModbusMaster::ku8MBInvalidCRC);
+    slave->waitIdle();
+}
+
+/**
+ * @brief El mapa ENV4 integrado se lee en una sola transacción y se decodifica con su
+ *        tipo y escala (UINT16, INT16 negativo, UINT32 de dos palabras).
+ */
+void test_manager_decodes_env4(void) {
+    ModbusSensorReading reading = managerCycle();
+    assertEnv4Values(reading);
+    TEST_ASSERT_EQUAL_UINT16(1, ModbusSensorManager::getBusStats(0).transactions);
+    TEST_ASSERT_EQUAL_UINT32(1, slave->stats().requests);
+}
+
+/**
+ * @brief Con la humedad en 0 (arranque) se sigue sondeando el registro de disponibilidad
+ *        y se lee en cuanto es plausible, sin esperar la estabilización máxima del tipo.
+ */
+void test_manager_reads_when_ready(void) {
+    slave->setRegisters(0x03, 500, {0});
+    std::thread boot([] {
+        delay(SIM_READY_DELAY_MS);
+        slave->setRegisters(0x03, 500, {456});
+    });
+
+    uint32_t start = millis();
+    ModbusSensorReading reading = managerCycle(true);
+    uint32_t elapsed = millis() - start;
+    boot.join();
+
+    assertEnv4Values(reading);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(SIM_READY_DELAY_MS, elapsed);
+    TEST_ASSERT_LESS_THAN_UINT32(MODBUS_ENV4_STABILIZATION_TIME / 2, elapsed);
+}
+
+/**
+ * @brief Un esclavo que no contesta abre su circuito tras MODBUS_BREAKER_THRESHOLD ciclos:
+ *        los siguientes no gastan tiempo de bus hasta la prueba periódica, que lo cierra.
+ */
+void test_manager_breaker_opens_on_silent_slave(void) {
+    setScript(0, 0.0f, 1.0f);
+    for (uint8_t cycle = 0; cycle < MODBUS_BREAKER_THRESHOLD; cycle++) {
+        ModbusSensorReading reading = managerCycle();
+        TEST_ASSERT_FLOAT_IS_NAN(reading.subValues[0].value);
+    }
+    TEST_ASSERT_EQUAL_UINT32(MODBUS_BREAKER_THRESHOLD * MODBUS_MAX_RETRY, slave->stats().dropped);
+    TEST_ASSERT_FALSE(ModbusSensorManager::isSlaveAvailable(0, SIM_ADDRESS));
+
+    // Circuito abierto: lecturas en NAN sin peticiones
+    setScript(0, 0.0f, 0.0f);
+    for (uint8_t cycle = 1; cycle < MODBUS_BREAKER_BASE_SKIP; cycle++) {
+        ModbusSensorReading reading = managerCycle();
+        TEST_ASSERT_FLOAT_IS_NAN(reading.subValues[0].value);
+    }
+    TEST_ASSERT_EQUAL_UINT32(MODBUS_BREAKER_THRESHOLD * MODBUS_MAX_RETRY, slave->stats().requests);
+
+    // Prueba periódica: el esclavo responde y el circuito se cierra
+    assertEnv4Values(managerCycle());
+    TEST_ASSERT_TRUE(ModbusSensorManager::isSlaveAvailable(0, SIM_ADDRESS));
+}
+
+/**
+ * @brief Un esclavo configurado que no respondió a la búsqueda no se excluye: empieza con
+ *        el circuito abierto y se vuelve a probar tras MODBUS_BREAKER_BASE_SKIP ciclos.
+ */
+void test_manager_retries_slave_missing_from_inventory(void) {
+    ModbusSensorManager::useInventory(MODBUS_SCAN_FIRST_ADDRESS, MODBUS_SCAN_LAST_ADDRESS, {});
+    for (uint8_t cycle = 0; cycle < MODBUS_BREAKER_BASE_SKIP; cycle++) {
+        ModbusSensorReading reading = managerCycle();
+        TEST_ASSERT_FLOAT_IS_NAN(reading.subValues[0].value);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, slave->stats().requests);
+
+    assertEnv4Values(managerCycle());
+    TEST_ASSERT_EQUAL_UINT32(1, slave->stats().requests);
+
+    // Ya respondió: se sigue sondeando en cada ciclo aunque no esté en el inventario
+    assertEnv4Values(managerCycle());
+    TEST_ASSERT_EQUAL_UINT32(2, slave->stats().requests);
+}
+
+/**
+ * @brief Transacciones por segundo a 9600 baudios según el tamaño del bloque, frente al
+ *        límite teórico de la línea.
+ */
+void test_benchmark_throughput(void) {
+    const uint16_t sizes[] = {1, 8, 57, 125};
+    char msg[160];
+    for (uint16_t qty : sizes) {
+        uint32_t failures = 0;
+        uint64_t start = hostMicros();
+        for (uint16_t i = 0; i < SIM_BENCH_ROUNDS; i++) {
+            if (master.readInputRegisters(1000, qty) != ModbusMaster::ku8MBSuccess) {
+                failures++;
+            }
+        }
+        double elapsedMs = (hostMicros() - start) / 1000.0;
+        snprintf(msg, sizeof(msg), "%3u registros: %.1f transacciones/s (%.1f ms cada una, teórico %.1f ms), %u fallos",
+                 qty, SIM_BENCH_ROUNDS * 1000.0 / elapsedMs, elapsedMs / SIM_BENCH_ROUNDS,
+                 expectedTransactionMs(qty), (unsigned)failures);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_EQUAL_UINT32(0, failures);
+    }
+}
+
+/**
+ * @brief Tiempo desde la petición hasta que ModbusMaster devuelve cada tipo de fallo.
+ */
+void test_benchmark_failure_detection(void) {
+    struct Case {
+        const char* name;
+        uint32_t jitterUs;
+        float crcErrorRate;
+        float dropRate;
+        uint16_t start;
+    };
+    const Case cases[] = {
+        {"excepción", 0, 0.0f, 0.0f, 1100},
+        {"CRC corrupto", 0, 1.0f, 0.0f, 1000},
+        {"trama cortada", 8000, 0.0f, 0.0f, 1000},
+        {"sin respuesta", 0, 0.0f, 1.0f, 1000},
+    };
+    const uint16_t qty = 57;
+    char msg[160];
+    master.setResponseTimeout(firmwareTimeout(qty));
+    for (const Case& c : cases) {
+        setScript(c.jitterUs, c.crcErrorRate, c.dropRate);
+        uint64_t start = hostMicros();
+        uint8_t result = master.readInputRegisters(c.start, qty);
+        double detectMs = (hostMicros() - start) / 1000.0;
+
+        snprintf(msg, sizeof(msg), "%-14s -> código 0x%02X en %.1f ms (timeout %u ms)",
+                 c.name, result, detectMs, firmwareTimeout(qty));
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_NOT_EQUAL(ModbusMaster::ku8MBSuccess, result);
+
+        // Dejar que el esclavo termine de enviar los bytes rezagados antes del siguiente caso
+        slave->waitIdle();
+        serial->clearInput();
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_reads_env4_map);
+    RUN_TEST(test_long_block_over_fifo_threshold);
+    RUN_TEST(test_unmapped_registers_raise_exception);
+    RUN_TEST(test_corrupted_crc_rejected);
+    RUN_TEST(test_missing_reply_times_out);
+    RUN_TEST(test_byte_gap_jitter_ends_frame);
+    RUN_TEST(test_manager_decodes_env4);
+    RUN_TEST(test_manager_reads_when_ready);
+    RUN_TEST(test_manager_breaker_opens_on_silent_slave);
+    RUN_TEST(test_manager_retries_slave_missing_from_inventory);
+    RUN_TEST(test_benchmark_throughput);
+    RUN_TEST(test_benchmark_failure_detection);
+    return UNITY_END();
+}
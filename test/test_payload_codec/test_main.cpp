@@ -0,0 +1,276 @@
+/*******************************************************************************************
+ * Archivo: test/test_payload_codec/test_main.cpp
+ * Descripción: Ida y vuelta del codec binario (PayloadCodec): esquema, keyframes con
+ *              valores NAN y sensores ausentes, y rechazo de payloads inválidos.
+ *              Se ejecuta en el host: pio test -e native -f test_payload_codec
+ *******************************************************************************************/
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "PayloadCodec.h"
+
+#define ROUND_TRIP_CASES    20000
+
+static SensorReading normalReading(const char* id, SensorType type, float value) {
+    SensorReading reading = {};
+    strncpy(reading.sensorId, id, sizeof(reading.sensorId) - 1);
+    reading.type = type;
+    reading.value = value;
+    return reading;
+}
+
+static SensorReading multiReading(const char* id, SensorType type, std::vector<float> values) {
+    SensorReading reading = normalReading(id, type, NAN);
+    for (float v : values) {
+        reading.subValues.push_back({v});
+    }
+    return reading;
+}
+
+static ModbusSensorReading modbusReading(const char* id, SensorType type, std::vector<float> values) {
+    ModbusSensorReading reading = {};
+    strncpy(reading.sensorId, id, sizeof(reading.sensorId) - 1);
+    reading.type = type;
+    for (float v : values) {
+        reading.subValues.push_back({v});
+    }
+    return reading;
+}
+
+/**
+ * @brief Valor esperado tras el viaje: redondeado a los decimales con que se transmite.
+ */
+static float expected(float value, uint8_t decimals) {
+    if (isnan(value) || isinf(value)) {
+        return NAN;
+    }
+    double scale = pow(10.0, decimals);
+    return (float)(round((double)value * scale) / scale);
+}
+
+static void assertSameValue(float want, float got) {
+    if (isnan(want)) {
+        TEST_ASSERT_TRUE(isnan(got));
+    } else {
+        TEST_ASSERT_EQUAL_FLOAT(want, got);
+    }
+}
+
+// Estación típica: NTC, SHT30, pH y un ENV4 por Modbus
+static std::vector<SensorReading> normals;
+static std::vector<ModbusSensorReading> modbus;
+static UplinkSchema schema;
+static uint16_t hash;
+
+void setUp(void) {
+    normals = {normalReading("NTC1", N100K, 23.456f),
+               multiReading("SHT1", SHT30, {21.37f, 55.1f}),
+               normalReading("PH1", PH, 6.85f)};
+    modbus = {modbusReading("ENV1", ENV4, {61.2f, 20.9f, 101.3f, 12500.0f})};
+    schema = PayloadCodec::buildSchema("ST001", "DEV01", normals, modbus);
+    hash = PayloadCodec::schemaHash(schema);
+}
+
+void tearDown(void) {}
+
+void test_schema_round_trip(void) {
+    std::vector<uint8_t> serialized = PayloadCodec::serializeSchema(schema);
+    UplinkSchema parsed;
+    TEST_ASSERT_TRUE(PayloadCodec::parseSchema(serialized.data(), serialized.size(), parsed));
+    TEST_ASSERT_EQUAL_STRING("ST001", parsed.stationId);
+    TEST_ASSERT_EQUAL_STRING("DEV01", parsed.deviceId);
+    TEST_ASSERT_EQUAL(4, parsed.sensors.size());
+    TEST_ASSERT_EQUAL_STRING("SHT1", parsed.sensors[1].sensorId);
+    TEST_ASSERT_EQUAL(SHT30, parsed.sensors[1].type);
+    TEST_ASSERT_EQUAL(2, parsed.sensors[1].valueCount);
+    TEST_ASSERT_EQUAL(4, parsed.sensors[3].valueCount);
+    TEST_ASSERT_EQUAL_HEX16(hash, PayloadCodec::schemaHash(parsed));
+
+    // Un byte de menos no forma un esquema completo
+    TEST_ASSERT_FALSE(PayloadCodec::parseSchema(serialized.data(), serialized.size() - 1, parsed));
+}
+
+void test_schema_parts_reassemble(void) {
+    std::vector<uint8_t> serialized = PayloadCodec::serializeSchema(schema);
+    const size_t chunk = 11;
+    std::vector<uint8_t> joined;
+    uint8_t buffer[PAYLOAD_SCHEMA_PART_HEADER + chunk];
+    uint8_t expectedParts = (uint8_t)((serialized.size() + chunk - 1) / chunk);
+
+    for (uint8_t part = 0; part < expectedParts; part++) {
+        size_t length = PayloadCodec::encodeSchemaPart(serialized, hash, part, chunk, buffer);
+        TEST_ASSERT_GREATER_THAN(PAYLOAD_SCHEMA_PART_HEADER, length);
+        uint16_t partHash;
+        uint8_t index, count;
+        TEST_ASSERT_TRUE(PayloadCodec::parseSchemaPart(buffer, length, partHash, index, count));
+        TEST_ASSERT_EQUAL_HEX16(hash, partHash);
+        TEST_ASSERT_EQUAL(part, index);
+        TEST_ASSERT_EQUAL(expectedParts, count);
+        joined.insert(joined.end(), buffer + PAYLOAD_SCHEMA_PART_HEADER, buffer + length);
+    }
+    TEST_ASSERT_EQUAL(0, PayloadCodec::encodeSchemaPart(serialized, hash, expectedParts, chunk, buffer));
+    TEST_ASSERT_EQUAL(serialized.size(), joined.size());
+    TEST_ASSERT_EQUAL_MEMORY(serialized.data(), joined.data(), serialized.size());
+}
+
+void test_keyframe_round_trip(void) {
+    UplinkFrame frame;
+    uint8_t buffer[64];
+    size_t length = PayloadCodec::encode(normals, modbus, 3.712f, 1700000000, 7, hash, nullptr, frame,
+                                         buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_EQUAL_HEX8(PAYLOAD_CODEC_VERSION << 4, buffer[0]);
+
+    UplinkFrame reference = {};
+    DecodedUplink out;
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, reference, out));
+    TEST_ASSERT_EQUAL(7, out.sequence);
+    TEST_ASSERT_EQUAL_UINT32(1700000000, out.timestamp);
+    TEST_ASSERT_EQUAL_FLOAT(3.712f, out.battery);
+    TEST_ASSERT_EQUAL(4, out.sensors.size());
+    TEST_ASSERT_EQUAL_FLOAT(23.46f, out.sensors[0].values[0]);
+    TEST_ASSERT_EQUAL_FLOAT(55.1f, out.sensors[1].values[1]);
+    TEST_ASSERT_EQUAL_FLOAT(12500.0f, out.sensors[3].values[3]);
+
+    // El decodificador guarda lo mismo que el codificador como referencia
+    TEST_ASSERT_TRUE(reference.valid);
+    TEST_ASSERT_EQUAL(frame.valueCount, reference.valueCount);
+    TEST_ASSERT_EQUAL_MEMORY(frame.values, reference.values, frame.valueCount * sizeof(int32_t));
+}
+
+/**
+ * @brief NAN marca un valor no leído; un sensor sin ningún valor queda fuera del bitmap.
+ */
+void test_nan_and_absent_sensors(void) {
+    normals[0].value = NAN;                       // NTC sin lectura: ausente
+    normals[1].subValues[1].value = INFINITY;     // SHT30 con la humedad inválida
+    UplinkFrame frame;
+    uint8_t buffer[64];
+    size_t length = PayloadCodec::encode(normals, modbus, NAN, 1700000600, 8, hash, nullptr, frame,
+                                         buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(0, length);
+
+    UplinkFrame reference = {};
+    DecodedUplink out;
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, reference, out));
+    TEST_ASSERT_TRUE(isnan(out.battery));
+    TEST_ASSERT_EQUAL(3, out.sensors.size());
+    TEST_ASSERT_EQUAL(1, out.sensors[0].index);
+    TEST_ASSERT_EQUAL_FLOAT(21.37f, out.sensors[0].values[0]);
+    TEST_ASSERT_TRUE(isnan(out.sensors[0].values[1]));
+}
+
+void test_selection_sends_unselected_as_absent(void) {
+    std::vector<bool> selection = {true, false, true, false};
+    UplinkFrame frame;
+    uint8_t buffer[64];
+    size_t length = PayloadCodec::encode(normals, modbus, 3.7f, 1700000000, 1, hash, nullptr, frame,
+                                         buffer, sizeof(buffer), &selection);
+    UplinkFrame reference = {};
+    DecodedUplink out;
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, reference, out));
+    TEST_ASSERT_EQUAL(2, out.sensors.size());
+    TEST_ASSERT_EQUAL(0, out.sensors[0].index);
+    TEST_ASSERT_EQUAL(2, out.sensors[1].index);
+}
+
+void test_rejects_invalid_payloads(void) {
+    UplinkFrame frame;
+    uint8_t buffer[64];
+    size_t length = PayloadCodec::encode(normals, modbus, 3.7f, 1700000000, 1, hash, nullptr, frame,
+                                         buffer, sizeof(buffer));
+    UplinkFrame reference = {};
+    DecodedUplink out;
+
+    // Truncado, con bytes de más, de otra versión o de otro esquema
+    TEST_ASSERT_FALSE(PayloadCodec::decode(buffer, length - 1, schema, reference, out));
+    buffer[length] = 0x00;
+    TEST_ASSERT_FALSE(PayloadCodec::decode(buffer, length + 1, schema, reference, out));
+    buffer[0] ^= 0x10;
+    TEST_ASSERT_FALSE(PayloadCodec::decode(buffer, length, schema, reference, out));
+    buffer[0] ^= 0x10;
+    UplinkSchema other = schema;
+    strcpy(other.sensors[0].sensorId, "NTC2");
+    TEST_ASSERT_FALSE(PayloadCodec::decode(buffer, length, other, reference, out));
+    TEST_ASSERT_FALSE(reference.valid);
+
+    // Sin espacio en el buffer no se genera un payload parcial
+    TEST_ASSERT_EQUAL(0, PayloadCodec::encode(normals, modbus, 3.7f, 1700000000, 1, hash, nullptr, frame,
+                                              buffer, 10));
+}
+
+/**
+ * @brief Lecturas aleatorias (incluidos NAN, infinitos y valores grandes) en keyframes.
+ */
+void test_random_keyframes_round_trip(void) {
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<float> range(-2000.0f, 2000.0f);
+    uint8_t buffer[128];
+
+    for (int n = 0; n < ROUND_TRIP_CASES; n++) {
+        for (auto* reading : {&normals[0], &normals[2]}) {
+            reading->value = range(rng);
+        }
+        for (auto& sv : normals[1].subValues) sv.value = range(rng);
+        for (auto& sv : modbus[0].subValues) sv.value = range(rng) * 50.0f;
+        switch (rng() % 8) {
+            case 0: normals[0].value = NAN; break;
+            case 1: modbus[0].subValues[rng() % 4].value = -INFINITY; break;
+            case 2: for (auto& sv : normals[1].subValues) sv.value = NAN; break;
+            default: break;
+        }
+        float battery = (rng() % 10) ? 3.0f + (rng() % 1200) / 1000.0f : NAN;
+        uint32_t timestamp = (uint32_t)rng();
+
+        UplinkFrame frame;
+        size_t length = PayloadCodec::encode(normals, modbus, battery, timestamp, (uint8_t)n, hash, nullptr,
+                                             frame, buffer, sizeof(buffer));
+        TEST_ASSERT_GREATER_THAN(0, length);
+
+        UplinkFrame reference = {};
+        DecodedUplink out;
+        TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, reference, out));
+        TEST_ASSERT_EQUAL_UINT32(timestamp, out.timestamp);
+        assertSameValue(expected(battery, PAYLOAD_BATTERY_DECIMALS), out.battery);
+
+        // Sensores presentes en el orden del esquema, con sus valores redondeados
+        size_t next = 0;
+        for (size_t i = 0; i < schema.sensors.size(); i++) {
+            std::vector<float> sent;
+            if (i < normals.size()) {
+                if (normals[i].subValues.empty()) sent.push_back(normals[i].value);
+                for (auto& sv : normals[i].subValues) sent.push_back(sv.value);
+            } else {
+                for (auto& sv : modbus[i - normals.size()].subValues) sent.push_back(sv.value);
+            }
+            bool present = false;
+            for (float v : sent) present |= !isnan(v) && !isinf(v);
+            if (!present) {
+                continue;
+            }
+            TEST_ASSERT_LESS_THAN(out.sensors.size(), next);
+            const DecodedSensor& sensor = out.sensors[next++];
+            TEST_ASSERT_EQUAL(i, sensor.index);
+            for (size_t v = 0; v < sent.size(); v++) {
+                assertSameValue(expected(sent[v], PayloadCodec::decimalsFor(sensor.type, (uint8_t)v)),
+                                sensor.values[v]);
+            }
+        }
+        TEST_ASSERT_EQUAL(next, out.sensors.size());
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_schema_round_trip);
+    RUN_TEST(test_schema_parts_reassemble);
+    RUN_TEST(test_keyframe_round_trip);
+    RUN_TEST(test_nan_and_absent_sensors);
+    RUN_TEST(test_selection_sends_unselected_as_absent);
+    RUN_TEST(test_rejects_invalid_payloads);
+    RUN_TEST(test_random_keyframes_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,244 @@
+/*******************************************************************************************
+ * Archivo: test/test_payload_delta/test_main.cpp
+ * Descripción: Frames delta de PayloadCodec sobre lecturas registradas en campo: el
+ *              codificador sigue la política del dispositivo (keyframe cada
+ *              UPLINK_KEYFRAME_INTERVAL y tras un envío fallido) y el decodificador la
+ *              del servidor (referencia = último frame decodificado).
+ *              Se ejecuta en el host: pio test -e native -f test_payload_delta
+ *******************************************************************************************/
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include <unity.h>
+#include "PayloadCodec.h"
+
+/**
+ * @brief Un ciclo registrado: batería (V), NTC, SHT30 (T, HR), pH y ENV4 (HR, T, kPa, lux).
+ */
+struct RecordedCycle {
+    uint32_t timestamp;
+    float battery;
+    float ntc;
+    float shtTemp;
+    float shtHum;
+    float ph;
+    float env[4];
+};
+
+// Estación de suelo, una lectura cada 10 minutos; en 1700004200 el NTC no respondió
+static const RecordedCycle recorded[] = {
+    {1700000000, 3.712f, 18.42f, 17.91f, 71.4f, 6.82f, {72.1f, 17.8f, 101.2f, 0.0f}},
+    {1700000600, 3.712f, 18.37f, 17.85f, 71.9f, 6.82f, {72.4f, 17.7f, 101.2f, 0.0f}},
+    {1700001200, 3.711f, 18.31f, 17.80f, 72.3f, 6.83f, {72.9f, 17.6f, 101.2f, 0.0f}},
+    {1700001800, 3.711f, 18.26f, 17.74f, 72.6f, 6.83f, {73.2f, 17.6f, 101.3f, 0.0f}},
+    {1700002400, 3.711f, 18.22f, 17.71f, 72.8f, 6.82f, {73.3f, 17.5f, 101.3f, 3.0f}},
+    {1700003000, 3.710f, 18.19f, 17.73f, 72.6f, 6.82f, {73.1f, 17.6f, 101.3f, 41.0f}},
+    {1700003600, 3.710f, 18.21f, 18.02f, 71.2f, 6.81f, {71.8f, 18.0f, 101.3f, 380.0f}},
+    {1700004200, 3.712f, NAN,    18.64f, 68.9f, 6.81f, {69.5f, 18.7f, 101.4f, 1520.0f}},
+    {1700004800, 3.714f, 18.58f, 19.35f, 66.0f, 6.81f, {66.4f, 19.5f, 101.4f, 4210.0f}},
+    {1700005400, 3.716f, 18.87f, 20.21f, 62.7f, 6.80f, {63.0f, 20.3f, 101.4f, 9800.0f}},
+    {1700006000, 3.719f, 19.24f, 21.12f, 59.1f, 6.80f, {59.6f, 21.2f, 101.4f, 15600.0f}},
+    {1700006600, 3.721f, 19.66f, 22.05f, 55.8f, 6.79f, {56.2f, 22.1f, 101.5f, 23900.0f}},
+    {1700007201, 3.724f, 20.11f, 22.93f, 52.4f, 6.79f, {52.9f, 23.0f, 101.5f, 31200.0f}},
+    {1700007800, 3.726f, 20.57f, 23.71f, 49.9f, 6.79f, {50.3f, 23.8f, 101.5f, 38700.0f}},
+    {1700008400, 3.727f, 21.02f, 24.38f, 47.6f, 6.78f, {48.1f, 24.5f, 101.4f, 44100.0f}},
+    {1700009000, 3.728f, 21.44f, 24.96f, 45.8f, 6.78f, {46.2f, 25.0f, 101.4f, 47300.0f}},
+    {1700009600, 3.728f, 21.81f, 25.40f, 44.5f, 6.78f, {44.9f, 25.5f, 101.4f, 48800.0f}},
+    {1700010200, 3.729f, 22.13f, 25.71f, 43.6f, 6.77f, {44.0f, 25.8f, 101.3f, 46100.0f}},
+    {1700010800, 3.729f, 22.39f, 25.88f, 43.1f, 6.77f, {43.5f, 25.9f, 101.3f, 41700.0f}},
+    {1700011400, 3.728f, 22.58f, 25.90f, 43.0f, 6.77f, {43.4f, 26.0f, 101.3f, 35200.0f}},
+    {1700012000, 3.727f, 22.71f, 25.77f, 43.4f, 6.77f, {43.8f, 25.8f, 101.3f, 27400.0f}},
+    {1700012600, 3.726f, 22.77f, 25.49f, 44.2f, 6.76f, {44.6f, 25.6f, 101.2f, 19100.0f}},
+    {1700013200, 3.724f, 22.76f, 25.08f, 45.3f, 6.76f, {45.7f, 25.1f, 101.2f, 11800.0f}},
+    {1700013800, 3.722f, 22.69f, 24.55f, 46.9f, 6.76f, {47.3f, 24.6f, 101.2f, 5900.0f}},
+};
+static const size_t recordedCount = sizeof(recorded) / sizeof(recorded[0]);
+
+static std::vector<SensorReading> normals;
+static std::vector<ModbusSensorReading> modbus;
+static UplinkSchema schema;
+static uint16_t hash;
+
+static void loadCycle(const RecordedCycle& cycle) {
+    normals.assign(3, SensorReading{});
+    strcpy(normals[0].sensorId, "NTC1");
+    normals[0].type = N100K;
+    normals[0].value = cycle.ntc;
+    strcpy(normals[1].sensorId, "SHT1");
+    normals[1].type = SHT30;
+    normals[1].subValues = {{cycle.shtTemp}, {cycle.shtHum}};
+    strcpy(normals[2].sensorId, "PH1");
+    normals[2].type = PH;
+    normals[2].value = cycle.ph;
+
+    modbus.assign(1, ModbusSensorReading{});
+    strcpy(modbus[0].sensorId, "ENV1");
+    modbus[0].type = ENV4;
+    modbus[0].subValues = {{cycle.env[0]}, {cycle.env[1]}, {cycle.env[2]}, {cycle.env[3]}};
+}
+
+/**
+ * @brief Estado del dispositivo entre ciclos (en el firmware, memoria RTC).
+ */
+struct DeviceState {
+    UplinkFrame reference;
+    uint8_t sequence;
+    uint8_t sinceKeyframe;
+};
+
+/**
+ * @brief Codifica un ciclo como lo hace sendBinaryPayload.
+ */
+static size_t encodeCycle(DeviceState& device, const RecordedCycle& cycle, UplinkFrame& frame,
+                          uint8_t* buffer, size_t size) {
+    loadCycle(cycle);
+    bool keyframe = !device.reference.valid || device.sinceKeyframe + 1 >= UPLINK_KEYFRAME_INTERVAL;
+    return PayloadCodec::encode(normals, modbus, cycle.battery, cycle.timestamp, device.sequence, hash,
+                                keyframe ? nullptr : &device.reference, frame, buffer, size);
+}
+
+static void delivered(DeviceState& device, const UplinkFrame& frame, bool delta) {
+    device.reference = frame;
+    device.sinceKeyframe = delta ? device.sinceKeyframe + 1 : 0;
+    device.sequence++;
+}
+
+static void assertMatchesCycle(const RecordedCycle& cycle, const DecodedUplink& out) {
+    TEST_ASSERT_EQUAL_UINT32(cycle.timestamp, out.timestamp);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, cycle.battery, out.battery);
+    size_t next = 0;
+    if (!isnan(cycle.ntc)) {
+        TEST_ASSERT_EQUAL(0, out.sensors[next].index);
+        TEST_ASSERT_FLOAT_WITHIN(0.005f, cycle.ntc, out.sensors[next++].values[0]);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, cycle.shtTemp, out.sensors[next].values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, cycle.shtHum, out.sensors[next++].values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, cycle.ph, out.sensors[next++].values[0]);
+    for (uint8_t v = 0; v < 4; v++) {
+        TEST_ASSERT_FLOAT_WITHIN(0.05f, cycle.env[v], out.sensors[next].values[v]);
+    }
+    TEST_ASSERT_EQUAL(next + 1, out.sensors.size());
+}
+
+void setUp(void) {
+    loadCycle(recorded[0]);
+    schema = PayloadCodec::buildSchema("ST001", "DEV01", normals, modbus);
+    hash = PayloadCodec::schemaHash(schema);
+}
+
+void tearDown(void) {}
+
+/**
+ * @brief Todos los ciclos entregados: el servidor reconstruye cada lectura y los deltas
+ *        ocupan bastante menos que los keyframes.
+ */
+void test_recorded_series_round_trip(void) {
+    DeviceState device = {};
+    UplinkFrame server = {};
+    size_t keyframeBytes = 0, deltaBytes = 0, keyframes = 0, deltas = 0;
+
+    for (size_t i = 0; i < recordedCount; i++) {
+        uint8_t buffer[64];
+        UplinkFrame frame;
+        size_t length = encodeCycle(device, recorded[i], frame, buffer, sizeof(buffer));
+        TEST_ASSERT_GREATER_THAN(0, length);
+        bool delta = (buffer[0] & PAYLOAD_FLAG_DELTA) != 0;
+        TEST_ASSERT_EQUAL(i % UPLINK_KEYFRAME_INTERVAL != 0, delta);
+
+        DecodedUplink out;
+        TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, server, out));
+        assertMatchesCycle(recorded[i], out);
+        delivered(device, frame, delta);
+
+        (delta ? deltaBytes : keyframeBytes) += length;
+        (delta ? deltas : keyframes)++;
+    }
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "keyframe %.1f bytes, delta %.1f bytes de media",
+             (float)keyframeBytes / keyframes, (float)deltaBytes / deltas);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(keyframeBytes * deltas / keyframes, deltaBytes);
+}
+
+/**
+ * @brief Un uplink perdido: el servidor rechaza los deltas que no parten de su referencia
+ *        y el dispositivo, al no recibir confirmación, manda keyframe en el siguiente.
+ */
+void test_lost_uplink_resynchronizes(void) {
+    DeviceState device = {};
+    UplinkFrame server = {};
+    uint8_t buffer[64];
+    UplinkFrame frame;
+    DecodedUplink out;
+
+    for (size_t i = 0; i < 3; i++) {
+        size_t length = encodeCycle(device, recorded[i], frame, buffer, sizeof(buffer));
+        TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, server, out));
+        delivered(device, frame, i > 0);
+    }
+
+    // El ciclo 3 se pierde pero el dispositivo lo cree entregado (uplink sin confirmar)
+    size_t length = encodeCycle(device, recorded[3], frame, buffer, sizeof(buffer));
+    delivered(device, frame, true);
+
+    // El delta del ciclo 4 parte del 3: el servidor no lo puede decodificar
+    length = encodeCycle(device, recorded[4], frame, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE((buffer[0] & PAYLOAD_FLAG_DELTA) != 0);
+    UplinkFrame before = server;
+    TEST_ASSERT_FALSE(PayloadCodec::decode(buffer, length, schema, server, out));
+    TEST_ASSERT_EQUAL(before.sequence, server.sequence);
+
+    // Fallo de transmisión: la referencia se invalida y el siguiente es keyframe
+    device.reference.valid = false;
+    device.sequence++;
+    length = encodeCycle(device, recorded[5], frame, buffer, sizeof(buffer));
+    TEST_ASSERT_FALSE((buffer[0] & PAYLOAD_FLAG_DELTA) != 0);
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, server, out));
+    assertMatchesCycle(recorded[5], out);
+    delivered(device, frame, false);
+
+    length = encodeCycle(device, recorded[6], frame, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE((buffer[0] & PAYLOAD_FLAG_DELTA) != 0);
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, server, out));
+    assertMatchesCycle(recorded[6], out);
+}
+
+/**
+ * @brief Un cambio de esquema invalida la referencia: el codificador manda keyframe.
+ */
+void test_schema_change_forces_keyframe(void) {
+    DeviceState device = {};
+    UplinkFrame server = {};
+    uint8_t buffer[64];
+    UplinkFrame frame;
+    DecodedUplink out;
+
+    size_t length = encodeCycle(device, recorded[0], frame, buffer, sizeof(buffer));
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, schema, server, out));
+    delivered(device, frame, false);
+
+    // Se deshabilita el pH: otro esquema y otro hash
+    loadCycle(recorded[1]);
+    normals.pop_back();
+    UplinkSchema reduced = PayloadCodec::buildSchema("ST001", "DEV01", normals, modbus);
+    uint16_t reducedHash = PayloadCodec::schemaHash(reduced);
+    TEST_ASSERT_NOT_EQUAL(hash, reducedHash);
+    length = PayloadCodec::encode(normals, modbus, recorded[1].battery, recorded[1].timestamp, device.sequence,
+                                  reducedHash, &device.reference, frame, buffer, sizeof(buffer));
+    TEST_ASSERT_FALSE((buffer[0] & PAYLOAD_FLAG_DELTA) != 0);
+
+    // Con el esquema anterior el servidor lo rechaza; con el nuevo, lo decodifica
+    TEST_ASSERT_FALSE(PayloadCodec::decode(buffer, length, schema, server, out));
+    TEST_ASSERT_TRUE(PayloadCodec::decode(buffer, length, reduced, server, out));
+    TEST_ASSERT_EQUAL(3, out.sensors.size());
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_recorded_series_round_trip);
+    RUN_TEST(test_lost_uplink_resynchronizes);
+    RUN_TEST(test_schema_change_forces_keyframe);
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+/*******************************************************************************************
+ * Archivo: test/test_series_codec/test_main.cpp
+ * Descripción: Ida y vuelta de los bloques de historial (SeriesCodec): floats XOR y
+ *              timestamps por diferencia de diferencias, en series aleatorias y en un
+ *              día de lecturas lentas.
+ *              Se ejecuta en el host: pio test -e native -f test_series_codec
+ *******************************************************************************************/
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include <unity.h>
+#include "SeriesCodec.h"
+#include "PayloadCodec.h"
+
+#define SERIES_RANDOM_CASES     200000
+#define SERIES_MAX_SAMPLES      48
+#define SERIES_MAX_SERIES       16
+
+static bool sameFloat(float a, float b) {
+    if (isnan(a) || isnan(b)) {
+        return isnan(a) && isnan(b);
+    }
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+/**
+ * @brief Compara el bloque decodificado con lo codificado, muestra por muestra.
+ */
+static void assertDecodes(const uint8_t* block, size_t length, uint16_t hash, const uint32_t* timestamps,
+                          const float* values, uint8_t samples, uint8_t series) {
+    DecodedSeries out;
+    TEST_ASSERT_TRUE(SeriesCodec::decode(block, length, out));
+    TEST_ASSERT_EQUAL_HEX16(hash, out.schemaHash);
+    TEST_ASSERT_EQUAL(samples, out.timestamps.size());
+    TEST_ASSERT_EQUAL(series, out.series.size());
+    for (uint8_t i = 0; i < samples; i++) {
+        TEST_ASSERT_EQUAL_UINT32(timestamps[i], out.timestamps[i]);
+        for (uint8_t s = 0; s < series; s++) {
+            if (!sameFloat(values[i * series + s], out.series[s][i])) {
+                char msg[64];
+                snprintf(msg, sizeof(msg), "muestra %u, serie %u", i, s);
+                TEST_FAIL_MESSAGE(msg);
+            }
+        }
+    }
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_single_sample(void) {
+    const uint32_t timestamp = 1700000000;
+    const float values[] = {3.712f, 21.5f, NAN};
+    uint8_t block[32];
+    size_t length = SeriesCodec::encode(0xBEEF, &timestamp, values, 1, 3, block, sizeof(block));
+    TEST_ASSERT_GREATER_THAN(SERIES_HEADER_LENGTH, length);
+    TEST_ASSERT_EQUAL_HEX8(SERIES_CODEC_VERSION << 4, block[0]);
+    assertDecodes(block, length, 0xBEEF, &timestamp, values, 1, 3);
+}
+
+/**
+ * @brief Ciclo fijo y valores iguales: un bit por timestamp y por valor.
+ */
+void test_constant_series_packs_to_bits(void) {
+    uint32_t timestamps[SERIES_MAX_SAMPLES];
+    float values[SERIES_MAX_SAMPLES * 2];
+    for (uint8_t i = 0; i < SERIES_MAX_SAMPLES; i++) {
+        timestamps[i] = 1700000000 + i * 600;
+        values[i * 2] = 3.7f;
+        values[i * 2 + 1] = 20.0f;
+    }
+    uint8_t block[64];
+    size_t length = SeriesCodec::encode(1, timestamps, values, SERIES_MAX_SAMPLES, 2, block, sizeof(block));
+    // Cabecera + 32 + 32 bits de arranque + la primera diferencia; el resto, 3 bits por muestra
+    TEST_ASSERT_LESS_OR_EQUAL(SERIES_HEADER_LENGTH + 14 + (3 * SERIES_MAX_SAMPLES + 7) / 8, length);
+    assertDecodes(block, length, 1, timestamps, values, SERIES_MAX_SAMPLES, 2);
+}
+
+void test_rejects_invalid_blocks(void) {
+    uint32_t timestamps[4] = {100, 700, 1300, 1900};
+    float values[4] = {1.5f, 1.6f, 1.6f, 1.7f};
+    uint8_t block[32];
+    size_t length = SeriesCodec::encode(7, timestamps, values, 4, 1, block, sizeof(block));
+    TEST_ASSERT_GREATER_THAN(0, length);
+
+    DecodedSeries out;
+    TEST_ASSERT_FALSE(SeriesCodec::decode(block, SERIES_HEADER_LENGTH, out));
+    TEST_ASSERT_FALSE(SeriesCodec::decode(block, length - 1, out));
+    block[0] ^= 0x10;
+    TEST_ASSERT_FALSE(SeriesCodec::decode(block, length, out));
+    block[0] ^= 0x10;
+
+    // Sin espacio no se genera un bloque parcial
+    TEST_ASSERT_EQUAL(0, SeriesCodec::encode(7, timestamps, values, 4, 1, block, length - 1));
+    TEST_ASSERT_EQUAL(0, SeriesCodec::encode(7, timestamps, values, 0, 1, block, sizeof(block)));
+}
+
+void test_sample_of_orders_battery_then_schema(void) {
+    std::vector<SensorReading> normals(2);
+    strcpy(normals[0].sensorId, "NTC1");
+    normals[0].type = N100K;
+    normals[0].value = 23.456f;
+    strcpy(normals[1].sensorId, "SHT1");
+    normals[1].type = SHT30;
+    normals[1].subValues = {{21.234f}, {55.06f}};
+    std::vector<ModbusSensorReading> modbus(1);
+    strcpy(modbus[0].sensorId, "ENV1");
+    modbus[0].type = ENV4;
+    modbus[0].subValues = {{61.24f}, {20.96f}, {101.33f}, {12500.4f}};
+
+    float values[SERIES_MAX_SERIES];
+    TEST_ASSERT_EQUAL(8, SeriesCodec::sampleOf(normals, modbus, 3.7126f, values, SERIES_MAX_SERIES));
+    TEST_ASSERT_TRUE(sameFloat(SeriesCodec::quantize(3.7126f, PAYLOAD_BATTERY_DECIMALS), values[0]));
+    TEST_ASSERT_TRUE(sameFloat(SeriesCodec::quantize(23.456f, 2), values[1]));
+    TEST_ASSERT_TRUE(sameFloat(SeriesCodec::quantize(55.06f, PayloadCodec::decimalsFor(SHT30, 1)), values[3]));
+    TEST_ASSERT_TRUE(sameFloat(12500.0f, values[7]));
+    TEST_ASSERT_EQUAL(0, SeriesCodec::sampleOf(normals, modbus, 3.7f, values, 7));
+}
+
+/**
+ * @brief Un día de suelo y aire cada 30 minutos: ocupa menos que en floats de 32 bits.
+ */
+void test_day_of_slow_readings_round_trip(void) {
+    const uint8_t samples = 48, series = 6;
+    const uint8_t decimals[series] = {3, 2, 2, 1, 1, 2};
+    uint32_t timestamps[samples];
+    float values[samples * series];
+    for (uint8_t i = 0; i < samples; i++) {
+        timestamps[i] = 1700000000 + i * 1800 + (i == 20 ? 2 : 0);
+        double hour = i / 2.0;
+        double day = sin((hour - 9.0) * M_PI / 12.0);
+        float raw[series] = {(float)(3.72 - i * 0.0004), (float)(18.0 + 1.5 * day), (float)(19.0 + 6.0 * day),
+                             (float)(60.0 - 15.0 * day), (float)(31.0 - i * 0.05), (float)(6.80 - i * 0.001)};
+        for (uint8_t s = 0; s < series; s++) {
+            values[i * series + s] = SeriesCodec::quantize(raw[s], decimals[s]);
+        }
+    }
+    const size_t rawLength = samples * (4 + series * 4);
+    uint8_t block[rawLength];
+    size_t length = SeriesCodec::encode(0x1234, timestamps, values, samples, series, block, sizeof(block));
+    TEST_ASSERT_GREATER_THAN(0, length);
+    TEST_ASSERT_LESS_THAN(rawLength, length);
+    assertDecodes(block, length, 0x1234, timestamps, values, samples, series);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%u muestras x %u series: %u bytes (%u en floats de 32 bits)",
+             samples, series, (unsigned)length, (unsigned)rawLength);
+    TEST_MESSAGE(msg);
+}
+
+/**
+ * @brief Series aleatorias: caminatas con los decimales de cada serie, saltos, NAN y
+ *        timestamps con desvíos de todos los tamaños de la diferencia de diferencias.
+ */
+void test_random_blocks_round_trip(void) {
+    std::mt19937 rng(50);
+    static uint32_t timestamps[SERIES_MAX_SAMPLES];
+    static float values[SERIES_MAX_SAMPLES * SERIES_MAX_SERIES];
+    static uint8_t block[SERIES_HEADER_LENGTH + SERIES_MAX_SAMPLES * (4 + SERIES_MAX_SERIES * 5)];
+    static const int32_t jitter[] = {0, 0, 0, 1, -3, 60, -64, 255, -256, 2047, -2048, 100000, -7000000};
+
+    for (uint32_t n = 0; n < SERIES_RANDOM_CASES; n++) {
+        uint8_t samples = 1 + rng() % SERIES_MAX_SAMPLES;
+        uint8_t series = 1 + rng() % SERIES_MAX_SERIES;
+        uint32_t period = 60 * (1 + rng() % 60);
+
+        timestamps[0] = rng();
+        for (uint8_t i = 1; i < samples; i++) {
+            int32_t offset = jitter[rng() % (sizeof(jitter) / sizeof(jitter[0]))];
+            timestamps[i] = timestamps[i - 1] + period + (uint32_t)offset;
+        }
+
+        for (uint8_t s = 0; s < series; s++) {
+            uint8_t decimals = rng() % 4;
+            double value = (double)(int32_t)(rng() % 200000) - 100000.0;
+            double step = pow(10.0, -(double)decimals) * (1 + rng() % 5);
+            for (uint8_t i = 0; i < samples; i++) {
+                switch (rng() % 16) {
+                    case 0: value += step * 1000.0; break;          // salto
+                    case 1: value = -value; break;                  // cambio de signo
+                    case 2: case 3: case 4: break;                  // sin cambio
+                    default: value += step * ((int)(rng() % 5) - 2); break;
+                }
+                values[i * series + s] = (rng() % 32 == 0) ? NAN : SeriesCodec::quantize((float)value, decimals);
+            }
+        }
+
+        uint16_t hash = (uint16_t)rng();
+        size_t length = SeriesCodec::encode(hash, timestamps, values, samples, series, block, sizeof(block));
+        TEST_ASSERT_GREATER_THAN(0, length);
+        assertDecodes(block, length, hash, timestamps, values, samples, series);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_sample);
+    RUN_TEST(test_constant_series_packs_to_bits);
+    RUN_TEST(test_rejects_invalid_blocks);
+    RUN_TEST(test_sample_of_orders_battery_then_schema);
+    RUN_TEST(test_day_of_slow_readings_round_trip);
+    RUN_TEST(test_random_blocks_round_trip);
+    return UNITY_END();
+}